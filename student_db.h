@@ -0,0 +1,91 @@
+/*
+ * Student Management System - embedding API
+ * The storage engine behind student_mgmt, for programs that link it in
+ * instead of driving the interactive binary.
+ *
+ * Build: make lib, then link with libstudentdb.a -pthread -lm
+ *
+ * A handle loads the table into memory once; lookups, scans and statistics
+ * are then answered from memory without touching the files. Writes go
+ * through the write-ahead log under the writer lock like every other
+ * student_mgmt process, and first pick up whatever other processes have
+ * committed. Reads see the table as of the last write or
+ * studentDbRefresh().
+ *
+ * The engine keeps process-wide state: one handle may be open at a time,
+ * though once it is closed the next may name another directory. A handle
+ * is not safe to use from several threads at once. The library prints
+ * nothing; failures come back as a status for studentDbError().
+ */
+
+#ifndef STUDENT_DB_H
+#define STUDENT_DB_H
+
+// The calls below are all a library build exports
+#if defined(__GNUC__)
+#define STUDENT_DB_API __attribute__((visibility("default")))
+#else
+#define STUDENT_DB_API
+#endif
+
+typedef struct {
+    int roll_no;
+    char name[50];
+    char department[50];
+    char course[30];
+    int year_joined;
+    float gpa;
+} Student;
+
+typedef struct StudentDb StudentDb;
+
+// Results of the calls below; studentDbError() describes them
+enum {
+    STUDENT_DB_OK = 0,
+    STUDENT_DB_NOT_FOUND = -1,
+    STUDENT_DB_EXISTS = -2,         // the roll number is taken
+    STUDENT_DB_INVALID = -3,        // a field breaks the validation rules
+    STUDENT_DB_NO_MEMORY = -4,
+    STUDENT_DB_IO_ERROR = -5,
+    STUDENT_DB_UNSUPPORTED = -6,    // split into shards, or in the old format
+    STUDENT_DB_BUSY = -7            // another handle is open
+};
+
+// GPA figures of the live students, as the statistics screen shows them
+typedef struct {
+    long count;
+    double average;
+    float highest, lowest;
+    int highestRoll, lowestRoll;    // first student with each
+    long excellent;                 // 3.5 and up
+    long good;                      // 3.0 to 3.49
+    long fair;                      // 2.0 to 2.99
+    long poor;                      // below 2.0
+} StudentStats;
+
+// Called for each student by studentDbScan(); return nonzero to stop
+typedef int (*StudentVisitor)(const Student *s, void *ctx);
+
+// Open the database in `dir` (NULL for the working directory), creating
+// it on the first write. Returns NULL with *status set on failure.
+STUDENT_DB_API StudentDb *studentDbOpen(const char *dir, int *status);
+
+// Release the handle, checkpoint the log and let go of the directory
+STUDENT_DB_API void studentDbClose(StudentDb *db);
+
+STUDENT_DB_API int studentDbGet(StudentDb *db, int roll_no, Student *out);
+STUDENT_DB_API int studentDbPut(StudentDb *db, const Student *s);         // a new student
+STUDENT_DB_API int studentDbUpdate(StudentDb *db, const Student *s);      // replaces every field
+STUDENT_DB_API int studentDbDelete(StudentDb *db, int roll_no);
+
+// Visit every student in file order. Returns the number visited.
+STUDENT_DB_API long studentDbScan(StudentDb *db, StudentVisitor visit, void *ctx);
+
+STUDENT_DB_API int studentDbStats(StudentDb *db, StudentStats *out);
+
+// Reload the table if another process has changed the database
+STUDENT_DB_API int studentDbRefresh(StudentDb *db);
+
+STUDENT_DB_API const char *studentDbError(int status);
+
+#endif
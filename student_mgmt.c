@@ -6,24 +6,60 @@
  * Version: 1.0
  * Date: 2025
  * 
- * Compile: gcc -o student_mgmt student_mgmt.c
- * Run: ./student_mgmt (Linux/Mac) or student_mgmt.exe (Windows)
+ * Compile: gcc -O2 -pthread -o student_mgmt student_mgmt.c -lm
+ * Run: ./student_mgmt (Linux only: the engine uses epoll, FICLONE and fdatasync)
+ * Batch import: ./student_mgmt import students_export.csv
+ * Batch updates: ./student_mgmt update changes.csv, lines of roll_no,field,value
+ * Columnar export for analytics: ./student_mgmt export students.cols format=columns
+ * Nightly sync: ./student_mgmt export delta.csv since=last, only what changed since the last run
+ * Query: ./student_mgmt query department=CS year=2023 gpa=3.0-4.0
+ * Reports: ./student_mgmt report sort=gpa:desc top=100
+ * Breakdowns: ./student_mgmt group by=department,year, with median and p90 GPA
+ * Name search: ./student_mgmt search smi limit=20
+ * Server: ./student_mgmt serve, then ./student_mgmt client get 1500
+ * Upgrade a database from an older release: ./student_mgmt migrate
+ * Newer slot layouts without downtime: ./student_mgmt schema upgrade, or schema migrate rate=512
+ * Backups while in use: ./student_mgmt backup <dir>, then ./student_mgmt restore <dir> [check]
+ * Split a large database: ./student_mgmt shard 4 (by roll number range) or shard 4 hash
+ * Benchmarks: make bench, or ./student_mgmt generate 100000 then ./student_mgmt bench
+ * Metrics: run with SMS_METRICS=1, then ./student_mgmt stats [prometheus]
+ * Library: make lib builds libstudentdb.a for use through student_db.h
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <strings.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
-// Structure definition for Student
-typedef struct {
-    int roll_no;
-    char name[50];
-    char department[50];
-    char course[30];
-    int year_joined;
-    float gpa;
-} Student;
+// The Student record and the embedding API
+#include "student_db.h"
+
+// A library build exports the calls of student_db.h and nothing else; the
+// Makefile then makes every other symbol local to the object
+#ifdef SMS_LIBRARY
+#pragma GCC visibility push(hidden)
+#endif
 
 // Function prototypes
 void displayMenu();
@@ -40,16 +76,648 @@ void pressEnterToContinue();
 void displayWelcome();
 void exportToCSV();
 void displayStatistics();
+long findStudent(int roll_no, Student *out);
+int rebuildIndex();
+int compactDatabase(int force);
+void compactMenu();
+int isValidYear(int year);
+int isValidGPA(float gpa);
+int importCSV(const char *path);
+int runCommand(int argc, char *argv[]);
+int rebuildColumns();
+void walBegin();
+int walCommit();
+int walCheckpoint();
+int walRecover();
+long walReplay(long from);
+int lockWriter();
+void unlockWriter();
+long exportCsvFile(const char *path);
+long exportColumnsFile(const char *path);
+int serveDatabase(const char *path);
+int runClient(const char *path, int argc, char *argv[]);
+int queryCommand(int argc, char *argv[]);
+int verifyStats();
+int legacyDatabase();
+int migrateDatabase();
+void searchByFilters();
+void searchByName(const char *pattern);
+long addStudentRecord(const Student *s);
+long updateStudentRecord(const Student *s);
+long deleteStudentRecord(int roll_no);
+int generateCommand(int argc, char *argv[]);
+int benchCommand(int argc, char *argv[]);
+void metricsInit();
+int metricsCommand(int argc, char *argv[]);
+int reportCommand(int argc, char *argv[]);
+int groupCommand(int argc, char *argv[]);
+int searchCommand(int argc, char *argv[]);
+int loadShardMap();
+int recoverShards();
+void checkpointShards();
+int shardCommand(int argc, char *argv[]);
+int exportCommand(int argc, char *argv[]);
+long exportChangesFile(const char *path, long since, long *high);
+int updateCSV(const char *path);
+int backupCommand(int argc, char *argv[]);
+int restoreCommand(int argc, char *argv[]);
+int schemaCommand(int argc, char *argv[]);
 
 // Global constants
 const char *DB_FILE = "students.dat";
 const char *TEMP_FILE = "temp.dat";
 const char *CSV_FILE = "students_export.csv";
+const char *IDX_FILE = "students.idx";
+const char *COL_FILE = "students.col";
+const char *STR_FILE = "students.str";
+const char *SEC_FILE = "students.sec";
+const char *TRI_FILE = "students.tri";
+const char *STATS_FILE = "students.sts";
+const char *WAL_FILE = "students.wal";
+const char *CHG_FILE = "students.chg";
+const char *SOCKET_FILE = "students.sock";
+const char *LOCK_FILE = "students.lock";
+const char *METRICS_FILE = "students.met";
+const char *PROM_FILE = "students.prom";
+const char *SHARD_FILE = "students.shards";
+const char *TXN_FILE = "students.txn";
+
+// Validation rules shared by interactive entry and batch import
+#define MIN_YEAR 2000
+#define MAX_YEAR 2025
+#define MIN_GPA 0.0f
+#define MAX_GPA 4.0f
+
+// Deleted records keep their slot with the roll number negated (a tombstone)
+#define IS_LIVE(s) ((s).roll_no > 0)
+
+// Compact once this fraction of slots is dead; SMS_COMPACT_THRESHOLD overrides
+#define DEFAULT_COMPACT_THRESHOLD 0.25
+
+// Roll-number index: an open-addressing hash table kept next to DB_FILE.
+// The slot table is followed by a stack of tombstoned record offsets that
+// addStudent() reuses before growing the file.
+#define INDEX_MAGIC "SMSIDX2"
+#define INDEX_MIN_CAPACITY 1024
+#define INDEX_PROBE_BATCH 16
+#define INDEX_EMPTY 0
+#define INDEX_DELETED (-1)
+
+// Identity of DB_FILE at the moment an index was last brought up to date
+typedef struct {
+    long size;
+    long inode;
+    long mtimeSec;
+    long mtimeNsec;
+} DbStamp;
+
+typedef struct {
+    char magic[8];
+    long capacity;      // number of slots, always a power of two
+    long count;         // live keys
+    long used;          // live keys plus deleted markers
+    long freeCount;     // tombstoned records on the free-slot stack
+    DbStamp stamp;      // DB_FILE state this index describes
+} IndexHeader;
+
+// Columnar sidecar: gpa, year_joined and roll_no of every DB_FILE slot as
+// contiguous arrays, in blocks of COLUMN_BLOCK slots
+#define COLUMN_MAGIC "SMSCOL1"
+#define COLUMN_BLOCK 4096
+#define COLUMN_HEADER_SIZE 64
+
+typedef struct {
+    char magic[8];
+    long count;         // slots covered
+    DbStamp stamp;      // DB_FILE state these columns describe
+} ColumnHeader;
+
+typedef struct {
+    float gpa[COLUMN_BLOCK];
+    int year[COLUMN_BLOCK];
+    int roll[COLUMN_BLOCK];     // negative for tombstones, as in DB_FILE
+} ColumnBlock;
+
+typedef struct {
+    void *map;
+    size_t length;
+    const ColumnHeader *hdr;
+    const ColumnBlock *blocks;
+} ColumnMap;
+
+// Output of the single-pass statistics kernel
+typedef struct {
+    long count;
+    double sum;
+    float min, max;
+    long argmin, argmax;        // slot numbers of the first min/max
+    long atLeast35, atLeast30, atLeast20;
+} GpaAggregate;
+
+// Statistics block kept next to DB_FILE and updated by every transaction.
+// The best and worst records are kept in short ordered lists; only when
+// deletes empty one is the table scanned again.
+#define STATS_MAGIC "SMSSTA1"
+#define STATS_EXTREMES 32
+
+typedef struct {
+    float gpa;
+    int roll_no;
+    long slot;
+    char name[50];
+} StatsEntry;
+
+typedef struct {
+    char magic[8];
+    DbStamp stamp;      // DB_FILE state these figures describe
+    long count;
+    long gpaSum;        // in millionths of a point
+    long atLeast35, atLeast30, atLeast20;
+    long highCount, lowCount;
+    StatsEntry high[STATS_EXTREMES];    // best first
+    StatsEntry low[STATS_EXTREMES];     // worst first
+} StatsBlock;
+
+// Secondary indexes: for department, course and year_joined, the slots of
+// the live records under each key value, sorted. Writes after a rebuild go
+// to a delta area at the end of the file until it fills up. Entries may go
+// stale; queries check every record they read against the whole predicate.
+#define SECONDARY_MAGIC "SMSSEC1"
+#define SECONDARY_DELTA_MAX 4096
+#define SECONDARY_INTERSECT_RATIO 16        // longer lists are filtered, not intersected
+
+enum { ATTR_DEPARTMENT, ATTR_COURSE, ATTR_YEAR, ATTR_COUNT };
+
+typedef struct {
+    char magic[8];
+    long count;         // slots covered
+    long keys;          // directory entries, sorted by attribute and key
+    long postings;      // slot numbers following the directory
+    long deltaCount;    // entries in use in the delta area
+    DbStamp stamp;      // DB_FILE state these lists describe
+} SecondaryHeader;
+
+typedef struct {
+    int attr;
+    int reserved;
+    unsigned long key;  // case-folded hash of the text, or the year
+    long start;         // first posting
+    long length;
+} SecondaryKey;
+
+typedef struct {
+    int attr;
+    int reserved;
+    unsigned long key;
+    long slot;
+} SecondaryDelta;
+
+// Name search index: for each trigram of the case-folded names, the slots
+// of the live records holding it, sorted. A name is indexed as "\1name\3"
+// and every later word adds a "\2" trigram for its first two bytes, so
+// exact, prefix and word-prefix matches have keys of their own. TRI_FILE
+// has the SEC_FILE header and is kept up to date the same way.
+#define TRIGRAM_MAGIC "SMSTRI1"
+#define TRIGRAM_DELTA_MAX 16384
+#define TRIGRAM_MAX_KEYS 128                // distinct keys of one name, at most
+#define TRIGRAM_SPACE (1L << 24)            // three bytes per key
+#define NAME_START '\1'
+#define WORD_START '\2'
+#define NAME_END '\3'
+
+// How a name matches a search, best first
+enum { MATCH_NONE, MATCH_EXACT, MATCH_PREFIX, MATCH_WORD, MATCH_SUBSTRING, MATCH_COUNT };
+
+typedef struct {
+    unsigned int key;
+    unsigned int length;
+    long start;         // first posting; postings are 32-bit slot numbers
+} TrigramKey;
+
+typedef struct {
+    unsigned int key;
+    unsigned int slot;
+} TrigramDelta;
+
+// A predicate over students; empty text and full ranges match anything
+typedef struct {
+    char department[50];
+    char course[30];
+    int yearMin, yearMax;
+    float gpaMin, gpaMax;
+} StudentQuery;
+
+// Sorted reports
+#define SORT_KEY_SIZE 58                    // longest text field plus the slot
+#define REPORT_DEFAULT_MEMORY (64L << 20)   // SMS_SORT_MEMORY overrides
+#define REPORT_MERGE_ROWS 256               // fewest rows read from a run at a time
+#define REPORT_BUFFER (256 * 1024)
+#define REPORT_PAGE_ROWS 20
+
+enum { SORT_ROLL, SORT_NAME, SORT_DEPARTMENT, SORT_COURSE, SORT_YEAR, SORT_GPA, SORT_FIELD_COUNT };
+
+typedef struct {
+    int field;          // SORT_* field, or -1 for file order
+    int descending;
+    long limit;         // rows wanted, 0 for all
+} ReportSpec;
+
+typedef struct {
+    unsigned char key[SORT_KEY_SIZE];   // compared with memcmp alone
+    long slot;
+    Student s;
+} SortRow;
+
+// Group-by aggregation: each scan consumer folds its batches into a hash
+// table of groups of its own, and the tables are merged at the end. GPA
+// quantiles come from a KLL-style sketch per group: levels of at most
+// GROUP_SKETCH_K values, a value on level i standing for 2^i students;
+// a full level is sorted and every other value moves up one. A group
+// keeps O(K log n) values, quantiles are exact until a level first fills
+// and within about 1/K in rank after, and two sketches merge by pushing
+// one's levels into the other's.
+#define GROUP_SKETCH_K 256
+#define GROUP_SKETCH_LEVELS 32
+#define GROUP_MIN_CAPACITY 64
+
+enum { GROUP_DEPARTMENT = 1, GROUP_COURSE = 2, GROUP_YEAR = 4 };
+
+typedef struct {
+    float *level[GROUP_SKETCH_LEVELS];
+    int size[GROUP_SKETCH_LEVELS];
+    int cap[GROUP_SKETCH_LEVELS];
+    int levels;
+    unsigned int coin;      // alternates the half a full level keeps
+} QuantileSketch;
+
+typedef struct {
+    char department[50];    // the grouping fields; the others stay empty
+    char course[30];
+    int year;
+    unsigned long hash;
+    long count;
+    double sum;
+    float min, max;
+    QuantileSketch sketch;
+} GroupRow;
+
+typedef struct {
+    int keys;               // GROUP_* fields to group by
+    GroupRow *rows;
+    long count;
+    long *slots;            // open addressing over rows; -1 empty
+    long capacity;          // power of two
+    int failed;             // out of memory
+} GroupTable;
+
+// CSV export engine: scan batches are formatted on the pipeline's consumers
+#define EXPORT_ROW_MAX 512                  // longest possible formatted row
+
+// Columnar export: a COLS_HEADER_SIZE file header (magic, version, column
+// count, batch size, then a name and type per column), record batches of
+// at most COLS_BATCH_ROWS rows, and a footer. A batch starts with a header
+// of row count, byte length and an (offset, length) pair per buffer,
+// offsets relative to the batch; its buffers follow, each 64-byte aligned:
+// roll_no int32, then name, department and course each as uint32 offsets
+// (rows + 1, from 0) and UTF-8 bytes, then year_joined int32 and gpa
+// float32. These are the buffers of Arrow's columnar layout for columns
+// with no nulls. The footer is the file offset of each batch followed by
+// a COLS_TRAILER_SIZE trailer: batch count, row count, CRC-32C of the
+// footer before it, and the magic again. Every field is little-endian.
+#define COLS_MAGIC "SMSCOLS"
+#define COLS_VERSION 1
+#define COLS_COLUMNS 6
+#define COLS_BUFFERS 9
+#define COLS_BATCH_ROWS 65536
+#define COLS_ALIGN 64
+#define COLS_HEADER_SIZE 192
+#define COLS_TRAILER_SIZE 32
+
+// On-disk format, version 3. DB_FILE is a header page followed by data
+// pages of fixed-size slots, each page sealed with a CRC-32C. Department
+// and course are stored as ids into a dictionary, and names too long for
+// their slot go to an append-only string heap, STR_FILE.<generation>, that
+// compaction rewrites. Every field is little-endian whatever the host.
+// Offsets elsewhere (index, log) stay slot * sizeof(Student).
+//
+// Each page records the slot layout it was written in, and the header the
+// layout new writes use and how many slots a page holds. A layout has a
+// slot size and set of fields of its own. Pages in an older layout are
+// read as they are, fields it lacks taking their defaults, and upgraded
+// when next written, so a layout change never rewrites the file as long
+// as the new slots still fit the page. New files leave DB_SLOT_ROOM bytes
+// for each slot to grow into; files from before that are full at 32 bytes
+// and take a wider layout by one rewrite. Version 2 files are version 3
+// files with every page in layout 1, and stay version 2 until `schema
+// upgrade` so older releases can open them.
+#define DB_MAGIC "SMSDATA"
+#define DB_VERSION 3
+#define DB_VERSION_BASE 2                   // headers without a layout
+#define DB_LAYOUT 3                         // newest slot layout
+#define DB_PAGE_SIZE 4096
+#define DB_PAGE_HEADER 16                   // crc, page number, slots used, layout
+#define DB_SLOT_ROOM 40                     // bytes a slot may grow to in new files
+#define DB_SLOTS_PER_PAGE ((DB_PAGE_SIZE - DB_PAGE_HEADER) / DB_SLOT_ROOM)
+#define DB_SLOTS_PER_PAGE_BASE 127          // 32-byte slots, as in version 2
+#define DB_WRITE_PAGES 64                   // pages per write when streaming
+#define DB_MIGRATE_RATE 1024                // pages a second `schema migrate` upgrades
+#define HEAP_MAGIC "SMSHEAP"
+#define HEAP_VERSION 2
+#define HEAP_HEADER_SIZE 32
+#define HEAP_RECORD_HEADER 20
+#define HEAP_TEXT_MAX 255
+#define HEAP_BUFFER (1 << 20)
+#define DICT_MAX 65536                      // ids are 16 bits; id 0 is ""
+
+enum { HEAP_DICT = 1, HEAP_NAME = 2 };
+
+// A string heap file opened for reading or appending
+typedef struct {
+    int fd;
+    unsigned int generation;
+    long end;           // offset the next record goes to
+    long lastDict;      // newest dictionary record, 0 for none
+    unsigned char *buf; // appends pending while a new heap is built, or
+    size_t len;         // NULL for the live heap, written at once
+} Heap;
+
+// An open DB_FILE and the heap its header names
+typedef struct {
+    int fd;
+    Heap heap;
+    long pages;         // data pages
+    long count;         // slots in use
+    int layout;         // slot layout of pages written from now on
+    int perPage;        // slots a data page holds
+} DbFile;
+
+// Shared scan layer: full-table scans walk a read-only mapping of DB_FILE
+#define SCAN_BATCH (32 * DB_SLOTS_PER_PAGE) // records decoded per step
+#define SCAN_SEQUENTIAL_MIN (1L << 20)      // advise sequential access above this
+#define SCAN_READ_AHEAD 4                   // batches the reader decodes ahead
+#define SCAN_MAX_CONSUMERS 64
+
+enum { SCAN_LIVE, SCAN_ALL };
+
+// Visitor for scanDatabase(); return nonzero to stop the scan early
+typedef int (*RecordVisitor)(const Student *s, long offset, void *ctx);
+
+// Visitor for scanPipeline(): a batch of records starting at slot `first`
+typedef int (*BatchVisitor)(const Student *batch, long first, long n, void *ctx);
+
+// Read-only mapping of DB_FILE, header page included
+typedef struct {
+    const unsigned char *pages;
+    long count;         // slots
+    void *map;          // NULL for an empty file
+    size_t length;
+} DbMap;
+
+// Multi-process access: writers serialize on one byte of LOCK_FILE and
+// snapshot readers pin the write-ahead log against truncation on another
+#define LOCK_WRITER 0       // held for a transaction, compaction or checkpoint
+#define LOCK_PIN 1          // shared by snapshot readers; a checkpoint needs it alone
+#define LOCK_ALIVE 2        // shared by every running process
+#define UNDO_MIN_CAPACITY 64
+#define SNAPSHOT_LOG_BATCH 32               // log records read per step
+
+// Consistent view of DB_FILE as of snapshotOpen(). Writers are not blocked:
+// records they change afterwards are put back from the before-images in the
+// write-ahead log.
+typedef struct {
+    DbMap map;          // empty when the file could not be mapped
+    DbFile db;          // DB_FILE as opened for the snapshot
+    long count;         // records in the snapshot
+    DbStamp stamp;      // DB_FILE state the snapshot shows
+    long seq;           // last transaction the snapshot shows
+    int exclusive;      // taken under our own writer lock; nothing can change
+    int pinned;
+    int walFd;
+    long walSeen;       // log bytes already examined
+    long *undoSlots;    // slots changed since the snapshot ...
+    Student *undoImages;    // ... and their images at snapshot time
+    long undoCount;
+    long *undoHash;     // slot -> undo entry, -1 empty
+    long undoHashCap;
+    pthread_mutex_t lock;   // export workers share one snapshot
+} Snapshot;
+
+// Defined with the write-ahead log
+int snapshotOpen(Snapshot *snap);
+int snapshotOpenShards(Snapshot *snaps);
+void snapshotFix(Snapshot *snap, Student *records, long first, long n);
+void snapshotFixSlots(Snapshot *snap, Student *records, const long *slots, long n);
+int snapshotRead(Snapshot *snap, long first, long n, Student *out);
+int snapshotReadSlots(Snapshot *snap, const long *slots, long n, Student *out);
+void snapshotClose(Snapshot *snap);
+int scanPipeline(Snapshot *snap, const Student *records, long count, BatchVisitor visit, void **ctxs, int consumers);
+int scanThreads();
+long scanSnapshot(Snapshot *snap, int mode, RecordVisitor visit, void *ctx);
+long scanDatabase(int mode, RecordVisitor visit, void *ctx);
+long scanShards(int mode, RecordVisitor visit, void *ctx);
+int rebuildSecondary(Snapshot *snap);
+int rebuildTrigrams(Snapshot *snap);
+int rebuildStats(StatsBlock *b);
+int loadStats(StatsBlock *b);
+int databaseStats(StatsBlock *b);
+long queryDatabase(const StudentQuery *q, RecordVisitor visit, void *ctx, long *examined);
+long searchNames(const char *pattern, RecordVisitor visit, void *ctx, long *examined);
+long exportRecords(int fd, const Student *records, long count, Snapshot *snap);
+long exportArrayToCsv(const char *path, const Student *records, long count, Snapshot *snap);
+int parseSortSpec(const char *s, ReportSpec *spec);
+long reportStudents(const ReportSpec *spec, RecordVisitor emit, void *ctx);
+long pageReport(const ReportSpec *spec);
+int groupStudents(int keys, GroupTable *out);
+
+// How a write changed DB_FILE, for indexAfterWrite()
+enum { INDEX_PUT, INDEX_REUSE, INDEX_REMOVE };
+
+// Write-ahead log: every change to DB_FILE is first appended to WAL_FILE and
+// made durable by one fdatasync per transaction, then copied into DB_FILE
+#define WAL_MAGIC 0x324C5753u               // "SWL2"
+#define WAL_BUFFER (256 * 1024)
+#define WAL_APPLY_BATCH 4096                // records per read while applying
+#define WAL_INCREMENTAL_MAX 64              // bigger transactions re-index lazily
+#define WAL_CHECKPOINT_BYTES (4L << 20)     // checkpoint once the log is this big
+
+// A WAL_PREPARE record ends the writes of a transaction that commits
+// only together with others in other shards' logs; see commitShards()
+enum { WAL_WRITE = 1, WAL_COMMIT = 2, WAL_PREPARE = 3 };
+
+typedef struct {
+    unsigned int magic;
+    unsigned short type;    // WAL_WRITE, WAL_COMMIT or WAL_PREPARE
+    unsigned short op;      // INDEX_PUT, INDEX_REUSE or INDEX_REMOVE
+    long txn;               // transaction the record belongs to
+    long offset;            // record offset in DB_FILE; for WAL_COMMIT and
+                            // WAL_PREPARE, the number of writes in the transaction
+    Student image;          // the record as written
+    Student before;         // the record it replaced, for snapshot readers
+    unsigned int crc;       // CRC-32 of all fields above
+    unsigned int reserved;
+} WalRecord;
+
+// A transaction prepared in one shard's log, waiting for the others
+typedef struct {
+    int shard;
+    long txn;
+    long start;             // log offset of its first write
+    long end;               // log offset just past its WAL_PREPARE
+    long writes;
+} PreparedTxn;
+
+// TXN_FILE is the commit point of a transaction spanning shards: after an
+// 8-byte magic, u32 count of shards and u32 CRC-32C of the entries, one
+// entry per shard of u32 shard, u32 reserved, u64 transaction, u64 start,
+// u64 end and u64 writes as in PreparedTxn. It lives until every shard
+// has the writes copied in.
+#define TXN_MAGIC "SMSTXN1"
+#define TXN_HEADER_SIZE 16
+#define TXN_ENTRY_SIZE 40
+
+// Change feed: CHG_FILE lists, in commit order, the roll numbers each
+// transaction wrote under the transaction's number, which is the change
+// sequence number of those students. Numbers go on rising across
+// processes and shards. After a FEED_HEADER_SIZE header holding the magic,
+// each entry is a u64 sequence number, the i32 roll number (negated for a
+// delete) and a u32 CRC-32C of the two. Compaction keeps only the newest
+// entry of each roll number.
+#define FEED_MAGIC "SMSCHG1"
+#define FEED_HEADER_SIZE 16
+#define FEED_ENTRY_SIZE 16
+
+typedef struct {
+    long seq;
+    int roll_no;        // negative for a delete
+} FeedEntry;
+
+// Sharding: SHARD_FILE splits the table by roll number into shards, each
+// a directory shard<k>/ with a DB_FILE, log and sidecars of its own. Point
+// operations go to one shard; scans visit the shards in turn, and the
+// statistics and export run on all of them at once in worker processes.
+// LOCK_FILE is shared, so there is still one writer at a time.
+#define SHARD_MAGIC "SMSSHD1"
+#define SHARD_MAX 64
+#define SHARD_FILES 9                       // file globals each shard has its own of
+#define SHARD_PATH_MAX 64
+
+enum { SHARD_RANGE, SHARD_HASH };
 
-// Main function
-int main() {
+typedef struct {
+    char magic[8];
+    int count;          // shards; 0 when the table is not split
+    int mode;           // SHARD_RANGE or SHARD_HASH
+    long width;         // roll numbers per shard for SHARD_RANGE; the last takes the rest
+} ShardMap;
+
+// Backups: a directory with a consistent copy of the data files, heaps,
+// change feed and shard map, shard directories and all, and a MANIFEST
+// of "SMSBACKUP 1", "sequence N" (the last transaction in the copy),
+// "shards N", then one "name size crc" line per file with its CRC-32C.
+// The log is already applied in the copy, and sidecars are rebuilt on
+// first use, so neither is kept.
+#define BACKUP_MANIFEST "MANIFEST"
+#define BACKUP_MAGIC "SMSBACKUP"
+#define BACKUP_VERSION 1
+#define BACKUP_MAX_FILES (2 * SHARD_MAX + 2)    // data file and heap per shard, feed, map
+#define BACKUP_BUFFER (1 << 20)
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)          // from <linux/fs.h>: share another file's blocks
+#endif
+
+typedef struct {
+    char name[SHARD_PATH_MAX];  // relative to the database directory
+    long size;
+    unsigned int crc;
+} BackupFile;
+
+typedef struct {
+    const char *dir;
+    BackupFile files[BACKUP_MAX_FILES];
+    int count;
+    long seq;
+    int shards;         // 0 when the table is not split
+} Backup;
+
+// Server mode: one request per line, "VERB<tab>arg<tab>arg...", answered
+// by one "OK ..." or "ERR <reason>" line
+#define SERVER_LINE_MAX 1024
+#define SERVER_MAX_FIELDS 6
+#define SERVER_MAX_EVENTS 64
+#define SERVER_OUTPUT_MAX (1 << 20)         // unread answers before input pauses
+#define TABLE_EMPTY (-1)
+#define TABLE_DELETED (-2)
+#define TABLE_MIN_CAPACITY 4096
+#define TABLE_MAX_RECORDS (1L << 27)        // address space reserved per table
+#define DB_PATH_MAX 256                     // a file name with a library user's directory
+
+typedef struct {
+    int roll_no;        // INDEX_EMPTY, INDEX_DELETED or a real roll number
+    int reserved;
+    long offset;        // byte offset of the record in DB_FILE
+} IndexSlot;
+
+// Operation metrics, kept only when SMS_METRICS is set. Each process adds
+// what it measured to METRICS_FILE when it exits (a server also does so
+// every METRICS_FLUSH_SECONDS) and rewrites PROM_FILE from the totals.
+#define METRICS_MAGIC "SMSMET2"
+#define METRIC_BUCKETS 28                   // latency under 1us, 2us, 4us ... 2^26us, then above
+#define METRICS_FLUSH_SECONDS 10
+
+enum {
+    OP_LOOKUP, OP_ADD, OP_UPDATE, OP_DELETE, OP_STATISTICS, OP_EXPORT, OP_IMPORT,
+    OP_QUERY, OP_SCAN, OP_COMPACT, OP_COMMIT, OP_CHECKPOINT, OP_LOCK_WAIT, OP_REQUEST,
+    OP_SEARCH, OP_COUNT
+};
+
+enum {
+    METRIC_BYTES_READ, METRIC_BYTES_WRITTEN, METRIC_FSYNCS, METRIC_LOOKUP_RECORDS,
+    METRIC_RECORDS_SCANNED, METRIC_COUNT
+};
+
+typedef struct {
+    char magic[8];
+    long calls[OP_COUNT];
+    long totalNs[OP_COUNT];
+    long buckets[OP_COUNT][METRIC_BUCKETS];
+    long counters[METRIC_COUNT];
+} Metrics;
+
+#ifndef SMS_LIBRARY
+// Main function; a library build (-DSMS_LIBRARY) leaves it to the embedding program
+int main(int argc, char *argv[]) {
     int choice;
     
+    metricsInit();
+    
+    // A split table keeps its files in a directory per shard
+    if(loadShardMap() != 0) {
+        fprintf(stderr, "⚠ %s is damaged!\n", SHARD_FILE);
+        return 1;
+    }
+    
+    // Files from releases before the paged format are converted first
+    if(argc == 2 && strcmp(argv[1], "migrate") == 0) {
+        return migrateDatabase();
+    }
+    if(legacyDatabase()) {
+        fprintf(stderr, "⚠ %s is in the old record format; run ./student_mgmt migrate first.\n", DB_FILE);
+        return 1;
+    }
+    
+    // Finish any transaction a crash interrupted before touching the data
+    if(recoverShards() != 0) {
+        fprintf(stderr, "⚠ Error: Could not replay the write-ahead log %s!\n", WAL_FILE);
+        return 1;
+    }
+    
+    // Non-interactive commands, e.g. "student_mgmt import file.csv"
+    if(argc > 1) {
+        int status = runCommand(argc - 1, argv + 1);
+        checkpointShards();
+        return status;
+    }
+    
     displayWelcome();
     
     while(1) {
@@ -86,20 +754,25 @@ int main() {
             case 7:
                 exportToCSV();
                 break;
-            case 8: 
+            case 8:
+                compactMenu();
+                break;
+            case 9: 
+                checkpointShards();
                 printf("\n╔════════════════════════════════════════╗\n");
                 printf("║  Thank you for using our system!      ║\n");
                 printf("║  Have a great day! 👋                 ║\n");
                 printf("╚════════════════════════════════════════╝\n\n");
                 exit(0);
             default:
-                printf("\n⚠ Invalid choice! Please select 1-8.\n");
+                printf("\n⚠ Invalid choice! Please select 1-9.\n");
                 pressEnterToContinue();
         }
     }
     
     return 0;
 }
+#endif
 
 // Display welcome screen
 void displayWelcome() {
@@ -127,7 +800,8 @@ void displayMenu() {
     printf("│  5. 🗑️  Delete Student                         │\n");
     printf("│  6. 📊 View Statistics                         │\n");
     printf("│  7. 💾 Export to CSV                           │\n");
-    printf("│  8. 🚪 Exit                                    │\n");
+    printf("│  8. 🧹 Compact Database                        │\n");
+    printf("│  9. 🚪 Exit                                    │\n");
     printf("└────────────────────────────────────────────────┘\n");
 }
 
@@ -137,551 +811,10542 @@ void clearInputBuffer() {
     while ((c = getchar()) != '\n' && c != EOF);
 }
 
+// Validate year of joining
+int isValidYear(int year) {
+    return year >= MIN_YEAR && year <= MAX_YEAR;
+}
+
+// Validate GPA
+int isValidGPA(float gpa) {
+    return gpa >= MIN_GPA && gpa <= MAX_GPA;
+}
+
 // Press enter to continue
 void pressEnterToContinue() {
     printf("\nPress Enter to continue...");
     getchar();
 }
 
-// Check for duplicate roll number
-int isDuplicate(int roll_no) {
-    FILE *fp = fopen(DB_FILE, "rb");
-    if(fp == NULL) return 0;
+// ─── Metrics ────────────────────────────────────────────────
+
+static Metrics metrics;
+static int metricsOn = 0;       // SMS_METRICS is set; checked before any clock read
+
+static const char *const opNames[OP_COUNT] = {
+    "lookup", "add", "update", "delete", "statistics", "export", "import",
+    "query", "scan", "compact", "commit", "checkpoint", "lock_wait", "request", "search"
+};
+
+static const char *const metricNames[METRIC_COUNT] = {
+    "bytes_read", "bytes_written", "fsyncs", "lookup_records_read", "records_scanned"
+};
+
+// Nanoseconds on the monotonic clock
+static long monotonicNs() {
+    struct timespec ts;
     
-    Student temp;
-    while(fread(&temp, sizeof(Student), 1, fp) == 1) {
-        if(temp.roll_no == roll_no) {
-            fclose(fp);
-            return 1;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long)ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Start timing an operation; pass the result to metricsEnd()
+static long metricsStart() {
+    return metricsOn ? monotonicNs() : 0;
+}
+
+static void metricsEnd(int op, long start) {
+    long ns, us;
+    int b;
+    
+    if(!metricsOn) return;
+    ns = monotonicNs() - start;
+    us = ns / 1000;
+    b = us == 0 ? 0 : 64 - __builtin_clzl((unsigned long)us);
+    if(b >= METRIC_BUCKETS) b = METRIC_BUCKETS - 1;
+    __atomic_fetch_add(&metrics.calls[op], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metrics.totalNs[op], ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metrics.buckets[op][b], 1, __ATOMIC_RELAXED);
+}
+
+static void metricsAdd(int counter, long n) {
+    if(metricsOn) __atomic_fetch_add(&metrics.counters[counter], n, __ATOMIC_RELAXED);
+}
+
+// fread() and fwrite() on database files, counting the bytes moved
+static size_t countedRead(void *buf, size_t size, size_t n, FILE *fp) {
+    size_t got = fread(buf, size, n, fp);
+    
+    metricsAdd(METRIC_BYTES_READ, (long)(got * size));
+    return got;
+}
+
+static size_t countedWrite(const void *buf, size_t size, size_t n, FILE *fp) {
+    size_t put = fwrite(buf, size, n, fp);
+    
+    metricsAdd(METRIC_BYTES_WRITTEN, (long)(put * size));
+    return put;
+}
+
+// fsync() and fdatasync(), counted
+static int syncFile(int fd) {
+    metricsAdd(METRIC_FSYNCS, 1);
+    return fsync(fd);
+}
+
+static int syncData(int fd) {
+    metricsAdd(METRIC_FSYNCS, 1);
+    return fdatasync(fd);
+}
+
+// Flush the directory entry of a just-renamed file
+static void syncDirectory(const char *path) {
+    const char *slash = strrchr(path, '/');
+    char dir[4096];
+    int fd;
+    
+    if(slash == NULL) {
+        strcpy(dir, ".");
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path) + (slash == path), path);
+    }
+    fd = open(dir, O_RDONLY);
+    if(fd < 0) return;
+    syncFile(fd);
+    close(fd);
+}
+
+// Read METRICS_FILE; an absent or foreign file reads as all zeros
+static void metricsLoad(int fd, Metrics *m) {
+    memset(m, 0, sizeof(*m));
+    if(pread(fd, m, sizeof(*m), 0) != (ssize_t)sizeof(*m) || memcmp(m->magic, METRICS_MAGIC, 8) != 0) {
+        memset(m, 0, sizeof(*m));
+    }
+    memcpy(m->magic, METRICS_MAGIC, 8);
+}
+
+// Upper bound of a latency bucket, in seconds
+static double bucketBound(int b) {
+    return (double)(1L << b) / 1e6;
+}
+
+// Write metrics in the Prometheus text exposition format
+static void writePrometheus(FILE *out, const Metrics *m) {
+    fprintf(out, "# HELP sms_operation_seconds Latency of student_mgmt operations.\n");
+    fprintf(out, "# TYPE sms_operation_seconds histogram\n");
+    for(int op = 0; op < OP_COUNT; op++) {
+        long cumulative = 0;
+        
+        for(int b = 0; b < METRIC_BUCKETS - 1; b++) {
+            cumulative += m->buckets[op][b];
+            fprintf(out, "sms_operation_seconds_bucket{op=\"%s\",le=\"%g\"} %ld\n",
+                    opNames[op], bucketBound(b), cumulative);
         }
+        fprintf(out, "sms_operation_seconds_bucket{op=\"%s\",le=\"+Inf\"} %ld\n", opNames[op], m->calls[op]);
+        fprintf(out, "sms_operation_seconds_sum{op=\"%s\"} %.9f\n", opNames[op], m->totalNs[op] / 1e9);
+        fprintf(out, "sms_operation_seconds_count{op=\"%s\"} %ld\n", opNames[op], m->calls[op]);
+    }
+    for(int c = 0; c < METRIC_COUNT; c++) {
+        fprintf(out, "# TYPE sms_%s_total counter\n", metricNames[c]);
+        fprintf(out, "sms_%s_total %ld\n", metricNames[c], m->counters[c]);
     }
-    fclose(fp);
-    return 0;
 }
 
-// Add new student
-void addStudent() {
-    FILE *fp;
-    Student newStudent;
+// Add what this process measured to METRICS_FILE and rewrite PROM_FILE.
+// Processes take turns through a lock on METRICS_FILE.
+static void metricsFlush() {
+    char tmpName[256];
+    struct flock fl;
+    Metrics total;
+    long *mine = (long *)&metrics.calls, *sum = (long *)&total.calls;
+    size_t n = (sizeof(Metrics) - offsetof(Metrics, calls)) / sizeof(long);
+    int fd, any = 0;
+    FILE *out;
     
-    fp = fopen(DB_FILE, "ab");
-    if(fp == NULL) {
-        printf("\n⚠ Error: Could not open database file!\n");
-        printf("Check if you have write permissions.\n");
-        pressEnterToContinue();
-        return;
+    if(!metricsOn) return;
+    fd = open(METRICS_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0) return;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    while(fcntl(fd, F_SETLKW, &fl) != 0) {
+        if(errno != EINTR) {
+            close(fd);
+            return;
+        }
     }
     
-    printf("\n╔════════════════════════════════════════════════╗\n");
-    printf("║              ADD NEW STUDENT                   ║\n");
-    printf("╚════════════════════════════════════════════════╝\n");
-    
-    // Get roll number
-    printf("\nEnter Roll Number: ");
-    while(scanf("%d", &newStudent.roll_no) != 1 || newStudent.roll_no <= 0) {
-        printf("⚠ Please enter a valid positive number: ");
-        clearInputBuffer();
+    metricsLoad(fd, &total);
+    for(size_t i = 0; i < n; i++) {
+        long v = __atomic_exchange_n(&mine[i], 0, __ATOMIC_RELAXED);
+        sum[i] += v;
+        any |= v != 0;
     }
-    clearInputBuffer();
-    
-    // Check for duplicate
-    if(isDuplicate(newStudent.roll_no)) {
-        printf("\n⚠ Error: Roll number %d already exists!\n", newStudent.roll_no);
-        fclose(fp);
-        pressEnterToContinue();
-        return;
+    if(any && pwrite(fd, &total, sizeof(total), 0) == (ssize_t)sizeof(total)) {
+        snprintf(tmpName, sizeof(tmpName), "%s.tmp", PROM_FILE);
+        out = fopen(tmpName, "w");
+        if(out != NULL) {
+            writePrometheus(out, &total);
+            if(fclose(out) != 0 || rename(tmpName, PROM_FILE) != 0) remove(tmpName);
+        }
     }
+    close(fd);
+}
+
+// Turn metrics on if SMS_METRICS asks for them
+void metricsInit() {
+    const char *env = getenv("SMS_METRICS");
     
-    // Get name
-    printf("Enter Name: ");
-    fgets(newStudent.name, sizeof(newStudent.name), stdin);
-    newStudent.name[strcspn(newStudent.name, "\n")] = '\0';
+    if(env == NULL || *env == '\0' || strcmp(env, "0") == 0) return;
+    memcpy(metrics.magic, METRICS_MAGIC, 8);
+    metricsOn = 1;
+    atexit(metricsFlush);
+}
+
+// Estimate a percentile of an operation's latency, in microseconds, as the
+// upper bound of the bucket it falls in
+static double bucketPercentile(const Metrics *m, int op, int p) {
+    long rank = (m->calls[op] * p + 99) / 100, seen = 0;
     
-    // Validate name is not empty
-    if(strlen(newStudent.name) == 0) {
-        printf("\n⚠ Error: Name cannot be empty!\n");
-        fclose(fp);
-        pressEnterToContinue();
-        return;
+    for(int b = 0; b < METRIC_BUCKETS - 1; b++) {
+        seen += m->buckets[op][b];
+        if(seen >= rank) return bucketBound(b) * 1e6;
     }
+    return INFINITY;
+}
+
+// Print the metrics every process has recorded so far, as a table or with
+// "prometheus" in the text format PROM_FILE holds. Returns the exit status.
+int metricsCommand(int argc, char *argv[]) {
+    Metrics m;
+    long lookups;
+    int fd;
     
-    // Get department
-    printf("Enter Department (CS/EE/ME/CE/Other): ");
-    fgets(newStudent.department, sizeof(newStudent.department), stdin);
-    newStudent.department[strcspn(newStudent.department, "\n")] = '\0';
-    
-    // Get course
-    printf("Enter Course: ");
-    fgets(newStudent.course, sizeof(newStudent.course), stdin);
-    newStudent.course[strcspn(newStudent.course, "\n")] = '\0';
+    if(argc > 1 || (argc == 1 && strcmp(argv[0], "prometheus") != 0)) {
+        fprintf(stderr, "Usage: student_mgmt stats [prometheus]\n");
+        return 2;
+    }
     
-    // Get year
-    printf("Enter Year of Joining (2000-2025): ");
-    while(scanf("%d", &newStudent.year_joined) != 1 || 
-          newStudent.year_joined < 2000 || 
-          newStudent.year_joined > 2025) {
-        printf("⚠ Please enter a valid year (2000-2025): ");
-        clearInputBuffer();
+    metricsFlush();
+    fd = open(METRICS_FILE, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        fprintf(stderr, "⚠ No metrics recorded yet; run with SMS_METRICS=1 to collect them.\n");
+        return 1;
     }
-    clearInputBuffer();
+    metricsLoad(fd, &m);
+    close(fd);
     
-    // Get GPA
-    printf("Enter GPA (0.0-4.0): ");
-    while(scanf("%f", &newStudent.gpa) != 1 || 
-          newStudent.gpa < 0.0 || 
-          newStudent.gpa > 4.0) {
-        printf("⚠ Please enter a valid GPA (0.0-4.0): ");
-        clearInputBuffer();
+    if(argc == 1) {
+        writePrometheus(stdout, &m);
+        return fflush(stdout) != 0;
     }
-    clearInputBuffer();
     
-    // Write to file
-    if(fwrite(&newStudent, sizeof(Student), 1, fp) != 1) {
-        printf("\n⚠ Error: Failed to save student data!\n");
-    } else {
-        printf("\n╔════════════════════════════════════════════════╗\n");
-        printf("║     ✓ Student added successfully!              ║\n");
-        printf("║     Roll Number %d has been registered.        ║\n", newStudent.roll_no);
-        printf("╚════════════════════════════════════════════════╝\n");
+    printf("%-12s %10s %12s %12s %12s\n", "Operation", "Calls", "Mean (us)", "p50 (us)", "p99 (us)");
+    for(int op = 0; op < OP_COUNT; op++) {
+        if(m.calls[op] == 0) continue;
+        printf("%-12s %10ld %12.1f %12.0f %12.0f\n", opNames[op], m.calls[op],
+               m.totalNs[op] / 1e3 / (double)m.calls[op],
+               bucketPercentile(&m, op, 50), bucketPercentile(&m, op, 99));
+    }
+    printf("\n");
+    for(int c = 0; c < METRIC_COUNT; c++) printf("%-20s %ld\n", metricNames[c], m.counters[c]);
+    lookups = m.calls[OP_LOOKUP];
+    if(lookups > 0) {
+        printf("%-20s %.2f\n", "records_per_lookup", (double)m.counters[METRIC_LOOKUP_RECORDS] / (double)lookups);
     }
+    return 0;
+}
+
+// Read the current identity of DB_FILE; returns 0 if the file exists
+static int getDbStamp(DbStamp *st) {
+    struct stat sb;
     
-    fclose(fp);
-    pressEnterToContinue();
+    memset(st, 0, sizeof(*st));
+    if(stat(DB_FILE, &sb) != 0) return -1;
+    
+    st->size = (long)sb.st_size;
+    st->inode = (long)sb.st_ino;
+    st->mtimeSec = (long)sb.st_mtim.tv_sec;
+    st->mtimeNsec = (long)sb.st_mtim.tv_nsec;
+    return 0;
 }
 
-// Print table header
-void printHeader() {
-    printf("\n╔════════╦══════════════════════════════╦═══════════════╦════════════════════╦══════╦═════╗\n");
-    printf("║ Roll # ║ Name                         ║ Department    ║ Course             ║ Year ║ GPA ║\n");
-    printf("╠════════╬══════════════════════════════╬═══════════════╬════════════════════╬══════╬═════╣\n");
+static int sameStamp(const DbStamp *a, const DbStamp *b) {
+    return a->size == b->size && a->inode == b->inode &&
+           a->mtimeSec == b->mtimeSec && a->mtimeNsec == b->mtimeNsec;
 }
 
-// Print single student in table format
-void printStudent(Student s) {
-    printf("║ %-6d ║ %-28s ║ %-13s ║ %-18s ║ %4d ║ %.1f ║\n",
-           s.roll_no, s.name, s.department, s.course, s.year_joined, s.gpa);
+// Spread roll numbers over the table (Fibonacci hashing)
+static long hashSlot(int roll_no, long capacity) {
+    unsigned long h = (unsigned long)(unsigned int)roll_no * 2654435761UL;
+    return (long)(h & (unsigned long)(capacity - 1));
 }
 
-// Display all students
-void displayAll() {
-    FILE *fp;
-    Student student;
-    int count = 0;
+// Insert into an in-memory slot array; the first occurrence of a key wins
+static void placeInSlots(IndexSlot *slots, long capacity, int roll_no, long offset) {
+    long i = hashSlot(roll_no, capacity);
     
-    fp = fopen(DB_FILE, "rb");
-    if(fp == NULL) {
-        printf("\n╔════════════════════════════════════════════════╗\n");
-        printf("║     ⚠ No records found!                        ║\n");
-        printf("║     Database is empty.                         ║\n");
-        printf("║     Add some students first.                   ║\n");
-        printf("╚════════════════════════════════════════════════╝\n");
-        pressEnterToContinue();
-        return;
+    while(slots[i].roll_no != INDEX_EMPTY) {
+        if(slots[i].roll_no == roll_no) return;
+        i = (i + 1) & (capacity - 1);
     }
+    slots[i].roll_no = roll_no;
+    slots[i].offset = offset;
+}
+
+typedef struct {
+    IndexSlot *slots;
+    long capacity;
+    long *freeSlots;
+    long freeCount;
+} IndexBuild;
+
+static int indexRecord(const Student *s, long offset, void *ctx) {
+    IndexBuild *b = ctx;
     
-    printHeader();
+    if(IS_LIVE(*s)) {
+        placeInSlots(b->slots, b->capacity, s->roll_no, offset);
+    } else {
+        b->freeSlots[b->freeCount++] = offset;
+    }
+    return 0;
+}
+
+// Rebuild the index from a full scan of DB_FILE
+int rebuildIndex() {
+    FILE *idx;
+    IndexHeader hdr;
+    IndexBuild build;
+    IndexSlot *slots;
+    long *freeSlots;
+    long capacity = INDEX_MIN_CAPACITY;
+    long records;
+    char tmpName[256];
+    Snapshot snap;
     
-    while(fread(&student, sizeof(Student), 1, fp) == 1) {
-        printStudent(student);
-        count++;
+    // Scan a snapshot so the stamp describes exactly what was indexed
+    memset(&hdr, 0, sizeof(hdr));
+    if(snapshotOpen(&snap) != 0) {
+        remove(IDX_FILE);
+        return -1;
     }
+    hdr.stamp = snap.stamp;
     
-    printf("╚════════╩══════════════════════════════╩═══════════════╩════════════════════╩══════╩═════╝\n");
-    printf("\nTotal Students: %d\n", count);
+    records = snap.count;
+    while(capacity < records * 2) capacity *= 2;
     
-    fclose(fp);
-    pressEnterToContinue();
-}
-
-// Search for a student
-void searchStudent() {
-    FILE *fp;
-    Student student;
-    int searchRoll, found = 0;
+    slots = calloc((size_t)capacity, sizeof(IndexSlot));
+    freeSlots = malloc((size_t)(records + 1) * sizeof(long));
+    if(slots == NULL || freeSlots == NULL) {
+        snapshotClose(&snap);
+        free(slots);
+        free(freeSlots);
+        return -1;
+    }
     
-    printf("\n╔════════════════════════════════════════════════╗\n");
-    printf("║              SEARCH STUDENT                    ║\n");
-    printf("╚════════════════════════════════════════════════╝\n");
+    build.slots = slots;
+    build.capacity = capacity;
+    build.freeSlots = freeSlots;
+    build.freeCount = 0;
+    if(scanSnapshot(&snap, SCAN_ALL, indexRecord, &build) < 0) {
+        snapshotClose(&snap);
+        free(slots);
+        free(freeSlots);
+        return -1;
+    }
+    snapshotClose(&snap);
+    hdr.freeCount = build.freeCount;
     
-    printf("\nEnter Roll Number to search: ");
-    if(scanf("%d", &searchRoll) != 1) {
-        printf("\n⚠ Invalid input!\n");
-        clearInputBuffer();
-        pressEnterToContinue();
-        return;
+    memcpy(hdr.magic, INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.capacity = capacity;
+    for(long i = 0; i < capacity; i++) {
+        if(slots[i].roll_no != INDEX_EMPTY) hdr.count++;
     }
-    clearInputBuffer();
+    hdr.used = hdr.count;
     
-    fp = fopen(DB_FILE, "rb");
-    if(fp == NULL) {
-        printf("\n⚠ Database is empty!\n");
-        pressEnterToContinue();
-        return;
+    // Write under a temporary name so a crash never leaves a half index;
+    // the name is per process as readers anywhere may rebuild
+    snprintf(tmpName, sizeof(tmpName), "%s.%ld.tmp", IDX_FILE, (long)getpid());
+    idx = fopen(tmpName, "wb");
+    if(idx == NULL) {
+        free(slots);
+        free(freeSlots);
+        return -1;
+    }
+    if(countedWrite(&hdr, sizeof(hdr), 1, idx) != 1 ||
+       countedWrite(slots, sizeof(IndexSlot), (size_t)capacity, idx) != (size_t)capacity ||
+       countedWrite(freeSlots, sizeof(long), (size_t)hdr.freeCount, idx) != (size_t)hdr.freeCount) {
+        fclose(idx);
+        free(slots);
+        free(freeSlots);
+        remove(tmpName);
+        return -1;
     }
+    fclose(idx);
+    free(slots);
+    free(freeSlots);
     
-    while(fread(&student, sizeof(Student), 1, fp) == 1) {
-        if(student.roll_no == searchRoll) {
-            printf("\n╔════════════════════════════════════════════════╗\n");
-            printf("║           ✓ STUDENT FOUND!                     ║\n");
-            printf("╠════════════════════════════════════════════════╣\n");
-            printf("║  Roll Number : %-32d ║\n", student.roll_no);
-            printf("║  Name        : %-32s ║\n", student.name);
-            printf("║  Department  : %-32s ║\n", student.department);
-            printf("║  Course      : %-32s ║\n", student.course);
-            printf("║  Year Joined : %-32d ║\n", student.year_joined);
-            printf("║  GPA         : %-32.2f ║\n", student.gpa);
-            printf("╚════════════════════════════════════════════════╝\n");
-            found = 1;
-            break;
+    return rename(tmpName, IDX_FILE) == 0 ? 0 : -1;
+}
+
+// Open the index for reading, rebuilding it if it is missing or stale
+static FILE *openIndex(IndexHeader *hdr) {
+    DbStamp now;
+    FILE *idx;
+    
+    if(getDbStamp(&now) != 0) return NULL;
+    
+    for(int attempt = 0; attempt < 2; attempt++) {
+        idx = fopen(IDX_FILE, "rb");
+        if(idx != NULL) {
+            if(countedRead(hdr, sizeof(*hdr), 1, idx) == 1 &&
+               memcmp(hdr->magic, INDEX_MAGIC, sizeof(hdr->magic)) == 0 &&
+               sameStamp(&hdr->stamp, &now)) {
+                return idx;
+            }
+            fclose(idx);
         }
+        if(rebuildIndex() != 0) return NULL;
     }
+    return NULL;
+}
+
+// File positions of index slot `slot` and of free-stack entry `n`
+static long slotPos(long slot) {
+    return (long)sizeof(IndexHeader) + slot * (long)sizeof(IndexSlot);
+}
+
+static long freeStackPos(const IndexHeader *hdr, long n) {
+    return slotPos(hdr->capacity) + n * (long)sizeof(long);
+}
+
+// Probe for roll_no. Returns the slot number holding it, or -1 with
+// *freeSlot set to the first reusable slot on its probe path.
+static long probeIndex(FILE *idx, const IndexHeader *hdr, int roll_no, long *freeSlot) {
+    IndexSlot batch[INDEX_PROBE_BATCH];
+    long start = hashSlot(roll_no, hdr->capacity);
+    long scanned = 0;
     
-    if(!found) {
-        printf("\n╔════════════════════════════════════════════════╗\n");
-        printf("║     ⚠ Student with Roll Number %d not found!   ║\n", searchRoll);
-        printf("╚════════════════════════════════════════════════╝\n");
-    }
+    if(freeSlot) *freeSlot = -1;
     
-    fclose(fp);
-    pressEnterToContinue();
+    while(scanned < hdr->capacity) {
+        long pos = (start + scanned) & (hdr->capacity - 1);
+        long n = hdr->capacity - pos;
+        if(n > INDEX_PROBE_BATCH) n = INDEX_PROBE_BATCH;
+        
+        fseek(idx, slotPos(pos), SEEK_SET);
+        if(countedRead(batch, sizeof(IndexSlot), (size_t)n, idx) != (size_t)n) return -1;
+        
+        for(long i = 0; i < n; i++) {
+            if(batch[i].roll_no == roll_no) return pos + i;
+            if(batch[i].roll_no == INDEX_DELETED) {
+                if(freeSlot && *freeSlot < 0) *freeSlot = pos + i;
+            } else if(batch[i].roll_no == INDEX_EMPTY) {
+                if(freeSlot && *freeSlot < 0) *freeSlot = pos + i;
+                return -1;
+            }
+        }
+        scanned += n;
+    }
+    return -1;
 }
 
-// Update student details
-void updateStudent() {
-    FILE *fp;
-    Student student;
-    int searchRoll, found = 0;
+// Look up the byte offset of roll_no in DB_FILE, or -1 if absent
+static long indexLookup(int roll_no) {
+    IndexHeader hdr;
+    IndexSlot slot;
+    FILE *idx = openIndex(&hdr);
     long pos;
-    char buffer[100];
     
-    printf("\n╔════════════════════════════════════════════════╗\n");
-    printf("║            UPDATE STUDENT DETAILS              ║\n");
-    printf("╚════════════════════════════════════════════════╝\n");
+    if(idx == NULL) return -1;
     
-    printf("\nEnter Roll Number to update: ");
-    if(scanf("%d", &searchRoll) != 1) {
-        printf("\n⚠ Invalid input!\n");
-        clearInputBuffer();
-        pressEnterToContinue();
-        return;
+    pos = probeIndex(idx, &hdr, roll_no, NULL);
+    if(pos >= 0) {
+        fseek(idx, slotPos(pos), SEEK_SET);
+        if(countedRead(&slot, sizeof(slot), 1, idx) != 1) pos = -1;
     }
-    clearInputBuffer();
+    fclose(idx);
+    return pos >= 0 ? slot.offset : -1;
+}
+
+// Offset of the most recently freed record slot, or -1 if there is none
+static long peekFreeSlot() {
+    IndexHeader hdr;
+    FILE *idx = openIndex(&hdr);
+    long offset = -1;
     
-    fp = fopen(DB_FILE, "rb+");
-    if(fp == NULL) {
-        printf("\n⚠ Database error! Cannot open file.\n");
-        pressEnterToContinue();
+    if(idx == NULL) return -1;
+    if(hdr.freeCount > 0) {
+        fseek(idx, freeStackPos(&hdr, hdr.freeCount - 1), SEEK_SET);
+        if(countedRead(&offset, sizeof(offset), 1, idx) != 1) offset = -1;
+    }
+    fclose(idx);
+    return offset;
+}
+
+// Bring the index up to date after a write to DB_FILE. `before` is the
+// DB_FILE stamp taken just before the write; an index that did not match
+// it was already stale and is left for openIndex() to rebuild.
+static void indexAfterWrite(const DbStamp *before, const DbStamp *after,
+                            int roll_no, long offset, int op) {
+    IndexHeader hdr;
+    IndexSlot slot;
+    FILE *idx;
+    long pos, freeSlot, top;
+    
+    idx = fopen(IDX_FILE, "rb+");
+    if(idx == NULL) return;
+    
+    if(countedRead(&hdr, sizeof(hdr), 1, idx) != 1 ||
+       memcmp(hdr.magic, INDEX_MAGIC, sizeof(hdr.magic)) != 0 ||
+       !sameStamp(&hdr.stamp, before)) {
+        fclose(idx);
         return;
     }
     
-    while(fread(&student, sizeof(Student), 1, fp) == 1) {
-        if(student.roll_no == searchRoll) {
-            found = 1;
-            pos = ftell(fp) - sizeof(Student);
-            
-            printf("\n┌─── Current Details ───┐\n");
-            printf("│ Name       : %s\n", student.name);
-            printf("│ Department : %s\n", student.department);
-            printf("│ Course     : %s\n", student.course);
-            printf("│ Year       : %d\n", student.year_joined);
-            printf("│ GPA        : %.2f\n", student.gpa);
-            printf("└───────────────────────┘\n");
-            
-            printf("\n📝 Enter new details (press Enter to keep current):\n\n");
-            
-            // Update name
-            printf("New Name [%s]: ", student.name);
-            fgets(buffer, sizeof(buffer), stdin);
-            if(buffer[0] != '\n') {
-                buffer[strcspn(buffer, "\n")] = '\0';
-                strcpy(student.name, buffer);
-            }
-            
-            // Update department
-            printf("New Department [%s]: ", student.department);
-            fgets(buffer, sizeof(buffer), stdin);
-            if(buffer[0] != '\n') {
-                buffer[strcspn(buffer, "\n")] = '\0';
-                strcpy(student.department, buffer);
-            }
-            
-            // Update course
-            printf("New Course [%s]: ", student.course);
-            fgets(buffer, sizeof(buffer), stdin);
-            if(buffer[0] != '\n') {
-                buffer[strcspn(buffer, "\n")] = '\0';
-                strcpy(student.course, buffer);
-            }
-            
-            // Update year
-            printf("New Year [%d]: ", student.year_joined);
-            fgets(buffer, sizeof(buffer), stdin);
-            if(buffer[0] != '\n') {
-                int newYear;
-                if(sscanf(buffer, "%d", &newYear) == 1 && 
-                   newYear >= 2000 && newYear <= 2025) {
-                    student.year_joined = newYear;
-                }
-            }
-            
-            // Update GPA
-            printf("New GPA [%.2f]: ", student.gpa);
-            fgets(buffer, sizeof(buffer), stdin);
-            if(buffer[0] != '\n') {
-                float newGpa;
-                if(sscanf(buffer, "%f", &newGpa) == 1 && 
-                   newGpa >= 0.0 && newGpa <= 4.0) {
-                    student.gpa = newGpa;
-                }
-            }
-            
-            // Seek back and write updated record
-            fseek(fp, pos, SEEK_SET);
-            
-            if(fwrite(&student, sizeof(Student), 1, fp) != 1) {
-                printf("\n⚠ Error: Update failed!\n");
-            } else {
-                printf("\n╔════════════════════════════════════════════════╗\n");
-                printf("║     ✓ Student record updated successfully!     ║\n");
-                printf("╚════════════════════════════════════════════════╝\n");
-            }
-            break;
+    if(op == INDEX_REUSE) {
+        // The slot must be the one peekFreeSlot() handed out
+        fseek(idx, freeStackPos(&hdr, hdr.freeCount - 1), SEEK_SET);
+        if(hdr.freeCount == 0 || countedRead(&top, sizeof(top), 1, idx) != 1 || top != offset) {
+            fclose(idx);
+            rebuildIndex();
+            return;
         }
+        hdr.freeCount--;
     }
     
-    if(!found) {
-        printf("\n⚠ Student with Roll Number %d not found!\n", searchRoll);
+    pos = probeIndex(idx, &hdr, roll_no, &freeSlot);
+    if(op == INDEX_REMOVE) {
+        if(pos >= 0) {
+            slot.roll_no = INDEX_DELETED;
+            slot.reserved = 0;
+            slot.offset = -1;
+            fseek(idx, slotPos(pos), SEEK_SET);
+            countedWrite(&slot, sizeof(slot), 1, idx);
+            hdr.count--;
+        }
+        fseek(idx, freeStackPos(&hdr, hdr.freeCount), SEEK_SET);
+        countedWrite(&offset, sizeof(offset), 1, idx);
+        hdr.freeCount++;
+    } else if(pos >= 0 || freeSlot >= 0) {
+        int fresh = pos < 0;
+        if(fresh) pos = freeSlot;
+        
+        // Keep probe chains short; a rebuild doubles the table
+        if(fresh && (hdr.used + 1) * 10 > hdr.capacity * 7) {
+            fclose(idx);
+            rebuildIndex();
+            return;
+        }
+        
+        fseek(idx, slotPos(pos), SEEK_SET);
+        if(fresh && countedRead(&slot, sizeof(slot), 1, idx) == 1 && slot.roll_no == INDEX_EMPTY) {
+            hdr.used++;
+        }
+        slot.roll_no = roll_no;
+        slot.reserved = 0;
+        slot.offset = offset;
+        fseek(idx, slotPos(pos), SEEK_SET);
+        countedWrite(&slot, sizeof(slot), 1, idx);
+        if(fresh) hdr.count++;
+    } else {
+        fclose(idx);
+        rebuildIndex();
+        return;
     }
     
-    fclose(fp);
-    pressEnterToContinue();
+    hdr.stamp = *after;
+    fseek(idx, 0, SEEK_SET);
+    countedWrite(&hdr, sizeof(hdr), 1, idx);
+    fclose(idx);
 }
 
-// Delete a student
-void deleteStudent() {
-    FILE *fp, *temp;
-    Student student;
-    int searchRoll, found = 0;
-    char confirm;
+// ─── Columnar sidecar and statistics kernel ─────────────────
+
+// Slot position of a record offset in DB_FILE
+static long slotOf(long offset) {
+    return offset / (long)sizeof(Student);
+}
+
+static long columnBlockPos(long block) {
+    return COLUMN_HEADER_SIZE + block * (long)sizeof(ColumnBlock);
+}
+
+// Rebuild COL_FILE from a full scan of DB_FILE
+typedef struct {
+    FILE *out;
+    ColumnBlock *block;
+    long slot;
+    int failed;
+} ColumnBuild;
+
+static int columnRecord(const Student *s, long offset, void *ctx) {
+    ColumnBuild *b = ctx;
+    long j = b->slot % COLUMN_BLOCK;
+    (void)offset;
     
-    printf("\n╔════════════════════════════════════════════════╗\n");
-    printf("║              DELETE STUDENT                    ║\n");
-    printf("╚════════════════════════════════════════════════╝\n");
+    b->block->gpa[j] = s->gpa;
+    b->block->year[j] = s->year_joined;
+    b->block->roll[j] = s->roll_no;
+    b->slot++;
     
-    printf("\nEnter Roll Number to delete: ");
-    if(scanf("%d", &searchRoll) != 1) {
-        printf("\n⚠ Invalid input!\n");
-        clearInputBuffer();
-        pressEnterToContinue();
-        return;
+    if(j == COLUMN_BLOCK - 1 &&
+       countedWrite(b->block, sizeof(ColumnBlock), 1, b->out) != 1) {
+        b->failed = 1;
+        return 1;
     }
-    clearInputBuffer();
+    return 0;
+}
+
+int rebuildColumns() {
+    ColumnHeader hdr;
+    ColumnBuild build;
+    char pad[COLUMN_HEADER_SIZE];
+    char tmpName[256];
+    Snapshot snap;
     
-    fp = fopen(DB_FILE, "rb");
-    if(fp == NULL) {
-        printf("\n⚠ Database is empty!\n");
-        pressEnterToContinue();
-        return;
+    memset(&hdr, 0, sizeof(hdr));
+    if(snapshotOpen(&snap) != 0) {
+        remove(COL_FILE);
+        return -1;
     }
+    hdr.stamp = snap.stamp;
     
-    // First, find and display the student
-    Student toDelete;
-    while(fread(&student, sizeof(Student), 1, fp) == 1) {
-        if(student.roll_no == searchRoll) {
-            toDelete = student;
-            found = 1;
-            break;
-        }
+    memset(&build, 0, sizeof(build));
+    build.block = calloc(1, sizeof(ColumnBlock));
+    if(build.block == NULL) {
+        snapshotClose(&snap);
+        return -1;
     }
     
-    if(!found) {
-        printf("\n⚠ Student with Roll Number %d not found!\n", searchRoll);
-        fclose(fp);
-        pressEnterToContinue();
-        return;
+    snprintf(tmpName, sizeof(tmpName), "%s.%ld.tmp", COL_FILE, (long)getpid());
+    build.out = fopen(tmpName, "wb");
+    if(build.out == NULL) {
+        snapshotClose(&snap);
+        free(build.block);
+        return -1;
     }
     
-    // Show student details and confirm deletion
-    printf("\n┌─── Student to Delete ───┐\n");
-    printf("│ Roll Number : %d\n", toDelete.roll_no);
-    printf("│ Name        : %s\n", toDelete.name);
-    printf("│ Department  : %s\n", toDelete.department);
-    printf("│ GPA         : %.2f\n", toDelete.gpa);
-    printf("└─────────────────────────┘\n");
+    // Header goes in last, once the slot count is known
+    memset(pad, 0, sizeof(pad));
+    countedWrite(pad, sizeof(pad), 1, build.out);
     
-    printf("\n⚠ Are you sure you want to delete this student? (y/n): ");
-    scanf(" %c", &confirm);
-    clearInputBuffer();
+    if(scanSnapshot(&snap, SCAN_ALL, columnRecord, &build) < 0) build.failed = 1;
+    snapshotClose(&snap);
     
-    if(confirm != 'y' && confirm != 'Y') {
-        printf("\n✓ Deletion cancelled.\n");
-        fclose(fp);
-        pressEnterToContinue();
-        return;
+    // Flush the partly filled last block
+    if(!build.failed && build.slot % COLUMN_BLOCK != 0 &&
+       countedWrite(build.block, sizeof(ColumnBlock), 1, build.out) != 1) {
+        build.failed = 1;
     }
     
-    // Reset file pointer and create temp file
-    rewind(fp);
-    temp = fopen(TEMP_FILE, "wb");
-    if(temp == NULL) {
-        printf("\n⚠ System error! Cannot create temporary file.\n");
-        fclose(fp);
-        pressEnterToContinue();
-        return;
+    memcpy(hdr.magic, COLUMN_MAGIC, sizeof(hdr.magic));
+    hdr.count = build.slot;
+    fseek(build.out, 0, SEEK_SET);
+    if(countedWrite(&hdr, sizeof(hdr), 1, build.out) != 1) build.failed = 1;
+    if(fclose(build.out) != 0) build.failed = 1;
+    free(build.block);
+    
+    if(build.failed || rename(tmpName, COL_FILE) != 0) {
+        remove(tmpName);
+        return -1;
     }
+    return 0;
+}
+
+// Map COL_FILE read-only, rebuilding it first if it is missing or stale.
+// Returns 0 on success and -1 if there is no database.
+static int mapColumns(ColumnMap *m) {
+    DbStamp now;
+    struct stat sb;
+    
+    memset(m, 0, sizeof(*m));
+    if(getDbStamp(&now) != 0) return -1;
     
-    // Copy all records except the one to delete
-    while(fread(&student, sizeof(Student), 1, fp) == 1) {
-        if(student.roll_no != searchRoll) {
-            fwrite(&student, sizeof(Student), 1, temp);
+    for(int attempt = 0; attempt < 2; attempt++) {
+        int fd = open(COL_FILE, O_RDONLY);
+        
+        if(fd >= 0 && fstat(fd, &sb) == 0 && sb.st_size >= COLUMN_HEADER_SIZE) {
+            m->length = (size_t)sb.st_size;
+            m->map = mmap(NULL, m->length, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            fd = -1;
+            
+            if(m->map != MAP_FAILED) {
+                m->hdr = m->map;
+                m->blocks = (const ColumnBlock *)((const char *)m->map + COLUMN_HEADER_SIZE);
+                long blocks = (m->hdr->count + COLUMN_BLOCK - 1) / COLUMN_BLOCK;
+                
+                if(memcmp(m->hdr->magic, COLUMN_MAGIC, sizeof(m->hdr->magic)) == 0 &&
+                   sameStamp(&m->hdr->stamp, &now) &&
+                   columnBlockPos(blocks) <= (long)m->length) {
+                    return 0;
+                }
+                munmap(m->map, m->length);
+            }
+            m->map = NULL;
         }
+        if(fd >= 0) close(fd);
+        if(rebuildColumns() != 0) return -1;
     }
+    return -1;
+}
+
+static void unmapColumns(ColumnMap *m) {
+    if(m->map != NULL) munmap(m->map, m->length);
+    memset(m, 0, sizeof(*m));
+}
+
+// Patch one slot of COL_FILE after a write to DB_FILE, following the same
+// stamp protocol as indexAfterWrite()
+static void columnsAfterWrite(const DbStamp *before, const DbStamp *after,
+                              long slot, const Student *s) {
+    ColumnHeader hdr;
+    FILE *col;
+    long base = columnBlockPos(slot / COLUMN_BLOCK);
+    long j = slot % COLUMN_BLOCK;
+    int roll_no = s->roll_no;
     
-    fclose(fp);
-    fclose(temp);
+    col = fopen(COL_FILE, "rb+");
+    if(col == NULL) return;
     
-    // Replace original file with temp file
-    if(remove(DB_FILE) != 0) {
-        printf("\n⚠ Error: Cannot delete original file!\n");
-        pressEnterToContinue();
+    if(countedRead(&hdr, sizeof(hdr), 1, col) != 1 ||
+       memcmp(hdr.magic, COLUMN_MAGIC, sizeof(hdr.magic)) != 0 ||
+       !sameStamp(&hdr.stamp, before) || slot > hdr.count) {
+        fclose(col);
         return;
     }
     
-    if(rename(TEMP_FILE, DB_FILE) != 0) {
-        printf("\n⚠ Error: Cannot rename temporary file!\n");
-        pressEnterToContinue();
-        return;
+    if(slot == hdr.count && j == 0) {
+        // Starting a new block: write it in full so mappings cover it
+        ColumnBlock *blank = calloc(1, sizeof(ColumnBlock));
+        if(blank == NULL) {
+            fclose(col);
+            return;
+        }
+        blank->gpa[0] = s->gpa;
+        blank->year[0] = s->year_joined;
+        blank->roll[0] = roll_no;
+        fseek(col, base, SEEK_SET);
+        countedWrite(blank, sizeof(ColumnBlock), 1, col);
+        free(blank);
+    } else {
+        fseek(col, base + (long)offsetof(ColumnBlock, gpa) + j * (long)sizeof(float), SEEK_SET);
+        countedWrite(&s->gpa, sizeof(float), 1, col);
+        fseek(col, base + (long)offsetof(ColumnBlock, year) + j * (long)sizeof(int), SEEK_SET);
+        countedWrite(&s->year_joined, sizeof(int), 1, col);
+        fseek(col, base + (long)offsetof(ColumnBlock, roll) + j * (long)sizeof(int), SEEK_SET);
+        countedWrite(&roll_no, sizeof(int), 1, col);
     }
     
-    printf("\n╔════════════════════════════════════════════════╗\n");
-    printf("║     ✓ Student deleted successfully!            ║\n");
-    printf("╚════════════════════════════════════════════════╝\n");
-    
-    pressEnterToContinue();
+    if(slot == hdr.count) hdr.count++;
+    hdr.stamp = *after;
+    fseek(col, 0, SEEK_SET);
+    countedWrite(&hdr, sizeof(hdr), 1, col);
+    fclose(col);
 }
 
-// Display statistics
-void displayStatistics() {
-    FILE *fp;
-    Student student;
-    int count = 0;
-    float totalGPA = 0.0;
-    float highestGPA = 0.0;
-    float lowestGPA = 4.0;
-    char topStudent[50] = "";
-    char weakStudent[50] = "";
+// Fold `b` into `a`; ties on min/max keep the lower slot
+static void mergeAggregate(GpaAggregate *a, const GpaAggregate *b) {
+    if(b->count == 0) return;
     
-    fp = fopen(DB_FILE, "rb");
-    if(fp == NULL) {
-        printf("\n⚠ No data available for statistics!\n");
-        pressEnterToContinue();
-        return;
+    if(a->count == 0 || b->max > a->max || (b->max == a->max && b->argmax < a->argmax)) {
+        a->max = b->max;
+        a->argmax = b->argmax;
+    }
+    if(a->count == 0 || b->min < a->min || (b->min == a->min && b->argmin < a->argmin)) {
+        a->min = b->min;
+        a->argmin = b->argmin;
     }
+    a->count += b->count;
+    a->sum += b->sum;
+    a->atLeast35 += b->atLeast35;
+    a->atLeast30 += b->atLeast30;
+    a->atLeast20 += b->atLeast20;
+}
+
+// Scalar kernel; also finishes the tails of the vector kernels
+static void aggregateScalar(const float *gpa, const int *roll, long n, long base,
+                            GpaAggregate *out) {
+    GpaAggregate a;
     
-    while(fread(&student, sizeof(Student), 1, fp) == 1) {
-        count++;
-        totalGPA += student.gpa;
+    memset(&a, 0, sizeof(a));
+    for(long i = 0; i < n; i++) {
+        float g = gpa[i];
+        if(roll[i] <= 0) continue;
         
-        if(student.gpa > highestGPA) {
-            highestGPA = student.gpa;
-            strcpy(topStudent, student.name);
+        if(a.count == 0 || g > a.max) {
+            a.max = g;
+            a.argmax = base + i;
         }
-        
-        if(student.gpa < lowestGPA) {
-            lowestGPA = student.gpa;
-            strcpy(weakStudent, student.name);
+        if(a.count == 0 || g < a.min) {
+            a.min = g;
+            a.argmin = base + i;
         }
+        a.count++;
+        a.sum += g;
+        a.atLeast35 += g >= 3.5f;
+        a.atLeast30 += g >= 3.0f;
+        a.atLeast20 += g >= 2.0f;
     }
+    mergeAggregate(out, &a);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// Reduce per-lane extremes to one, preferring the lowest slot on ties
+static void reduceLanes(const float *maxv, const int *maxi, const float *minv,
+                        const int *mini, int lanes, long base, GpaAggregate *a) {
+    int best = -1, worst = -1;
     
-    fclose(fp);
-    
-    if(count == 0) {
-        printf("\n⚠ No students in database!\n");
-        pressEnterToContinue();
-        return;
+    for(int k = 0; k < lanes; k++) {
+        if(maxi[k] < 0) continue;
+        if(best < 0 || maxv[k] > maxv[best] || (maxv[k] == maxv[best] && maxi[k] < maxi[best])) best = k;
+        if(worst < 0 || minv[k] < minv[worst] || (minv[k] == minv[worst] && mini[k] < mini[worst])) worst = k;
     }
+    if(best >= 0) {
+        a->max = maxv[best];
+        a->argmax = base + maxi[best];
+        a->min = minv[worst];
+        a->argmin = base + mini[worst];
+    }
+}
+
+// SSE2 kernel: 4 slots per step, baseline on every x86-64 CPU
+__attribute__((target("sse2")))
+static void aggregateSSE2(const float *gpa, const int *roll, long n, long base,
+                          GpaAggregate *out) {
+    GpaAggregate a;
+    __m128 vmax = _mm_set1_ps(-1.0f), vmin = _mm_set1_ps(5.0f);
+    __m128i imax = _mm_set1_epi32(-1), imin = _mm_set1_epi32(-1);
+    __m128i idx = _mm_setr_epi32(0, 1, 2, 3), step = _mm_set1_epi32(4);
+    __m128d sumLo = _mm_setzero_pd(), sumHi = _mm_setzero_pd();
+    const __m128 t35 = _mm_set1_ps(3.5f), t30 = _mm_set1_ps(3.0f), t20 = _mm_set1_ps(2.0f);
+    float maxv[4], minv[4];
+    int maxi[4], mini[4];
+    long i = 0;
     
-    float averageGPA = totalGPA / count;
-    
-    printf("\n╔════════════════════════════════════════════════╗\n");
-    printf("║            📊 DATABASE STATISTICS              ║\n");
-    printf("╠════════════════════════════════════════════════╣\n");
-    printf("║  Total Students    : %-25d ║\n", count);
-    printf("║  Average GPA       : %-25.2f ║\n", averageGPA);
-    printf("║  Highest GPA       : %-25.2f ║\n", highestGPA);
-    printf("║  Top Performer     : %-25s ║\n", topStudent);
-    printf("║  Lowest GPA        : %-25.2f ║\n", lowestGPA);
-    printf("║  Needs Improvement : %-25s ║\n", weakStudent);
-    printf("╚════════════════════════════════════════════════╝\n");
+    memset(&a, 0, sizeof(a));
+    for(; i + 4 <= n; i += 4) {
+        __m128 g = _mm_loadu_ps(gpa + i);
+        __m128 live = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *)(roll + i)),
+                                                       _mm_setzero_si128()));
+        __m128 gm = _mm_and_ps(live, g);
+        __m128 hi = _mm_or_ps(gm, _mm_andnot_ps(live, _mm_set1_ps(-1.0f)));
+        __m128 lo = _mm_or_ps(gm, _mm_andnot_ps(live, _mm_set1_ps(5.0f)));
+        __m128 gt = _mm_cmpgt_ps(hi, vmax), lt = _mm_cmplt_ps(lo, vmin);
+        
+        vmax = _mm_or_ps(_mm_and_ps(gt, hi), _mm_andnot_ps(gt, vmax));
+        imax = _mm_or_si128(_mm_and_si128(_mm_castps_si128(gt), idx),
+                            _mm_andnot_si128(_mm_castps_si128(gt), imax));
+        vmin = _mm_or_ps(_mm_and_ps(lt, lo), _mm_andnot_ps(lt, vmin));
+        imin = _mm_or_si128(_mm_and_si128(_mm_castps_si128(lt), idx),
+                            _mm_andnot_si128(_mm_castps_si128(lt), imin));
+        
+        sumLo = _mm_add_pd(sumLo, _mm_cvtps_pd(gm));
+        sumHi = _mm_add_pd(sumHi, _mm_cvtps_pd(_mm_movehl_ps(gm, gm)));
+        
+        a.count += __builtin_popcount(_mm_movemask_ps(live));
+        a.atLeast35 += __builtin_popcount(_mm_movemask_ps(_mm_and_ps(live, _mm_cmpge_ps(g, t35))));
+        a.atLeast30 += __builtin_popcount(_mm_movemask_ps(_mm_and_ps(live, _mm_cmpge_ps(g, t30))));
+        a.atLeast20 += __builtin_popcount(_mm_movemask_ps(_mm_and_ps(live, _mm_cmpge_ps(g, t20))));
+        idx = _mm_add_epi32(idx, step);
+    }
     
-    // GPA Distribution
-    printf("\n📈 GPA Distribution:\n");
-    printf("   Excellent (3.5-4.0): ");
+    double sums[2];
+    _mm_storeu_pd(sums, _mm_add_pd(sumLo, sumHi));
+    a.sum = sums[0] + sums[1];
+    _mm_storeu_ps(maxv, vmax);
+    _mm_storeu_ps(minv, vmin);
+    _mm_storeu_si128((__m128i *)maxi, imax);
+    _mm_storeu_si128((__m128i *)mini, imin);
+    reduceLanes(maxv, maxi, minv, mini, 4, base, &a);
     
-    fp = fopen(DB_FILE, "rb");
-    int excellent = 0, good = 0, average = 0, poor = 0;
+    mergeAggregate(out, &a);
+    aggregateScalar(gpa + i, roll + i, n - i, base + i, out);
+}
+
+// AVX2 kernel: 8 slots per step
+__attribute__((target("avx2")))
+static void aggregateAVX2(const float *gpa, const int *roll, long n, long base,
+                          GpaAggregate *out) {
+    GpaAggregate a;
+    __m256 vmax = _mm256_set1_ps(-1.0f), vmin = _mm256_set1_ps(5.0f);
+    __m256i imax = _mm256_set1_epi32(-1), imin = _mm256_set1_epi32(-1);
+    __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), step = _mm256_set1_epi32(8);
+    __m256d sumLo = _mm256_setzero_pd(), sumHi = _mm256_setzero_pd();
+    const __m256 t35 = _mm256_set1_ps(3.5f), t30 = _mm256_set1_ps(3.0f), t20 = _mm256_set1_ps(2.0f);
+    float maxv[8], minv[8];
+    int maxi[8], mini[8];
+    long i = 0;
     
-    while(fread(&student, sizeof(Student), 1, fp) == 1) {
-        if(student.gpa >= 3.5) excellent++;
-        else if(student.gpa >= 3.0) good++;
-        else if(student.gpa >= 2.0) average++;
-        else poor++;
+    memset(&a, 0, sizeof(a));
+    for(; i + 8 <= n; i += 8) {
+        __m256 g = _mm256_loadu_ps(gpa + i);
+        __m256 live = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i *)(roll + i)),
+                                                             _mm256_setzero_si256()));
+        __m256 gm = _mm256_and_ps(live, g);
+        __m256 hi = _mm256_blendv_ps(_mm256_set1_ps(-1.0f), g, live);
+        __m256 lo = _mm256_blendv_ps(_mm256_set1_ps(5.0f), g, live);
+        __m256 gt = _mm256_cmp_ps(hi, vmax, _CMP_GT_OQ), lt = _mm256_cmp_ps(lo, vmin, _CMP_LT_OQ);
+        
+        vmax = _mm256_blendv_ps(vmax, hi, gt);
+        imax = _mm256_blendv_epi8(imax, idx, _mm256_castps_si256(gt));
+        vmin = _mm256_blendv_ps(vmin, lo, lt);
+        imin = _mm256_blendv_epi8(imin, idx, _mm256_castps_si256(lt));
+        
+        sumLo = _mm256_add_pd(sumLo, _mm256_cvtps_pd(_mm256_castps256_ps128(gm)));
+        sumHi = _mm256_add_pd(sumHi, _mm256_cvtps_pd(_mm256_extractf128_ps(gm, 1)));
+        
+        a.count += __builtin_popcount(_mm256_movemask_ps(live));
+        a.atLeast35 += __builtin_popcount(_mm256_movemask_ps(_mm256_and_ps(live, _mm256_cmp_ps(g, t35, _CMP_GE_OQ))));
+        a.atLeast30 += __builtin_popcount(_mm256_movemask_ps(_mm256_and_ps(live, _mm256_cmp_ps(g, t30, _CMP_GE_OQ))));
+        a.atLeast20 += __builtin_popcount(_mm256_movemask_ps(_mm256_and_ps(live, _mm256_cmp_ps(g, t20, _CMP_GE_OQ))));
+        idx = _mm256_add_epi32(idx, step);
     }
     
-    fclose(fp);
-    
-    printf("%d students\n", excellent);
-    printf("   Good (3.0-3.49)    : %d students\n", good);
-    printf("   Average (2.0-2.99) : %d students\n", average);
-    printf("   Poor (Below 2.0)   : %d students\n", poor);
+    double sums[4];
+    _mm256_storeu_pd(sums, _mm256_add_pd(sumLo, sumHi));
+    a.sum = sums[0] + sums[1] + sums[2] + sums[3];
+    _mm256_storeu_ps(maxv, vmax);
+    _mm256_storeu_ps(minv, vmin);
+    _mm256_storeu_si256((__m256i *)maxi, imax);
+    _mm256_storeu_si256((__m256i *)mini, imin);
+    reduceLanes(maxv, maxi, minv, mini, 8, base, &a);
     
-    pressEnterToContinue();
+    mergeAggregate(out, &a);
+    aggregateScalar(gpa + i, roll + i, n - i, base + i, out);
 }
 
-// Export data to CSV
-void exportToCSV() {
-    FILE *fp, *csv;
-    Student student;
-    int count = 0;
+#endif
+
+// Aggregate count, sum, min/argmin, max/argmax and the GPA buckets of n
+// slots in one pass, using the widest vector unit the CPU offers. `base`
+// is the slot number of gpa[0]; dead slots (roll <= 0) are skipped.
+void aggregateGpa(const float *gpa, const int *roll, long n, long base, GpaAggregate *out) {
+#if defined(__x86_64__) || defined(__i386__)
+    static int level = -1;
     
-    fp = fopen(DB_FILE, "rb");
-    if(fp == NULL) {
-        printf("\n⚠ No data to export!\n");
-        pressEnterToContinue();
+    if(level < 0) {
+        __builtin_cpu_init();
+        level = __builtin_cpu_supports("avx2") ? 2 : __builtin_cpu_supports("sse2") ? 1 : 0;
+    }
+    if(level == 2) {
+        aggregateAVX2(gpa, roll, n, base, out);
+        return;
+    }
+    if(level == 1) {
+        aggregateSSE2(gpa, roll, n, base, out);
         return;
     }
+#endif
+    aggregateScalar(gpa, roll, n, base, out);
+}
+
+// Aggregate every slot of the columnar sidecar. Returns -1 if there is no database.
+int aggregateColumns(GpaAggregate *out) {
+    ColumnMap m;
+    
+    memset(out, 0, sizeof(*out));
+    out->argmin = out->argmax = -1;
+    if(mapColumns(&m) != 0) return -1;
+    
+    for(long b = 0; b * COLUMN_BLOCK < m.hdr->count; b++) {
+        long n = m.hdr->count - b * COLUMN_BLOCK;
+        if(n > COLUMN_BLOCK) n = COLUMN_BLOCK;
+        aggregateGpa(m.blocks[b].gpa, m.blocks[b].roll, n, b * COLUMN_BLOCK, out);
+    }
     
-    csv = fopen(CSV_FILE, "w");
-    if(csv == NULL) {
-        printf("\n⚠ Cannot create CSV file!\n");
-        fclose(fp);
-        pressEnterToContinue();
+    unmapColumns(&m);
+    return 0;
+}
+
+// ─── Secondary indexes ──────────────────────────────────────
+
+// Hash a text field the way queries compare it: case-insensitively
+static unsigned long textKey(const char *s, size_t max) {
+    unsigned long h = 14695981039346656037UL;
+    
+    for(size_t i = 0; i < max && s[i] != '\0'; i++) {
+        h ^= (unsigned char)tolower((unsigned char)s[i]);
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+// Key a record is listed under for one attribute
+static unsigned long attributeKey(const Student *s, int attr) {
+    if(attr == ATTR_DEPARTMENT) return textKey(s->department, sizeof(s->department));
+    if(attr == ATTR_COURSE) return textKey(s->course, sizeof(s->course));
+    return (unsigned long)(unsigned int)s->year_joined;
+}
+
+// SEC_FILE layout: header, posting lists, key directory, delta area
+static long secondaryPostingPos(long p) {
+    return (long)sizeof(SecondaryHeader) + p * (long)sizeof(long);
+}
+
+static long secondaryKeyPos(const SecondaryHeader *hdr, long k) {
+    return secondaryPostingPos(hdr->postings) + k * (long)sizeof(SecondaryKey);
+}
+
+static long secondaryDeltaPos(const SecondaryHeader *hdr, long d) {
+    return secondaryKeyPos(hdr, hdr->keys) + d * (long)sizeof(SecondaryDelta);
+}
+
+// Rebuild SEC_FILE from a full scan of a snapshot
+typedef struct {
+    unsigned long key;
+    long slot;
+} SecondaryPair;
+
+typedef struct {
+    SecondaryPair *pairs[ATTR_COUNT];
+    long count;
+} SecondaryBuild;
+
+static int secondaryRecord(const Student *s, long offset, void *ctx) {
+    SecondaryBuild *b = ctx;
+    
+    for(int attr = 0; attr < ATTR_COUNT; attr++) {
+        b->pairs[attr][b->count].key = attributeKey(s, attr);
+        b->pairs[attr][b->count].slot = slotOf(offset);
+    }
+    b->count++;
+    return 0;
+}
+
+static int comparePairs(const void *a, const void *b) {
+    const SecondaryPair *x = a, *y = b;
+    
+    if(x->key != y->key) return x->key < y->key ? -1 : 1;
+    return (x->slot > y->slot) - (x->slot < y->slot);
+}
+
+int rebuildSecondary(Snapshot *snap) {
+    SecondaryHeader hdr;
+    SecondaryBuild build;
+    SecondaryKey *dir = NULL;
+    SecondaryDelta *blank;
+    char tmpName[256];
+    FILE *out = NULL;
+    long dirCap = 0;
+    int failed = 0;
+    
+    memset(&hdr, 0, sizeof(hdr));
+    memset(&build, 0, sizeof(build));
+    for(int attr = 0; attr < ATTR_COUNT; attr++) {
+        build.pairs[attr] = malloc((size_t)(snap->count + 1) * sizeof(SecondaryPair));
+        if(build.pairs[attr] == NULL) failed = 1;
+    }
+    blank = calloc(SECONDARY_DELTA_MAX, sizeof(SecondaryDelta));
+    if(blank == NULL) failed = 1;
+    
+    snprintf(tmpName, sizeof(tmpName), "%s.%ld.tmp", SEC_FILE, (long)getpid());
+    if(!failed) out = fopen(tmpName, "wb");
+    if(out == NULL || scanSnapshot(snap, SCAN_LIVE, secondaryRecord, &build) < 0) failed = 1;
+    
+    // Lists in attribute then key order; the header goes in last
+    hdr.postings = (long)ATTR_COUNT * build.count;
+    if(!failed) fseek(out, secondaryPostingPos(0), SEEK_SET);
+    for(int attr = 0; attr < ATTR_COUNT && !failed; attr++) {
+        SecondaryPair *pairs = build.pairs[attr];
+        
+        qsort(pairs, (size_t)build.count, sizeof(SecondaryPair), comparePairs);
+        for(long i = 0; i < build.count && !failed; i++) {
+            if(i == 0 || pairs[i].key != pairs[i - 1].key) {
+                if(hdr.keys == dirCap) {
+                    long cap = dirCap ? dirCap * 2 : 256;
+                    SecondaryKey *grown = realloc(dir, (size_t)cap * sizeof(SecondaryKey));
+                    if(grown == NULL) {
+                        failed = 1;
+                        break;
+                    }
+                    dir = grown;
+                    dirCap = cap;
+                }
+                memset(&dir[hdr.keys], 0, sizeof(SecondaryKey));
+                dir[hdr.keys].attr = attr;
+                dir[hdr.keys].key = pairs[i].key;
+                dir[hdr.keys].start = (long)attr * build.count + i;
+                hdr.keys++;
+            }
+            dir[hdr.keys - 1].length++;
+            if(countedWrite(&pairs[i].slot, sizeof(long), 1, out) != 1) failed = 1;
+        }
+    }
+    
+    if(!failed &&
+       (countedWrite(dir, sizeof(SecondaryKey), (size_t)hdr.keys, out) != (size_t)hdr.keys ||
+        countedWrite(blank, sizeof(SecondaryDelta), SECONDARY_DELTA_MAX, out) != SECONDARY_DELTA_MAX)) {
+        failed = 1;
+    }
+    
+    memcpy(hdr.magic, SECONDARY_MAGIC, sizeof(hdr.magic));
+    hdr.count = snap->count;
+    hdr.stamp = snap->stamp;
+    if(out != NULL) {
+        fseek(out, 0, SEEK_SET);
+        if(countedWrite(&hdr, sizeof(hdr), 1, out) != 1) failed = 1;
+        if(fclose(out) != 0) failed = 1;
+    }
+    for(int attr = 0; attr < ATTR_COUNT; attr++) free(build.pairs[attr]);
+    free(blank);
+    free(dir);
+    
+    if(failed || rename(tmpName, SEC_FILE) != 0) {
+        remove(tmpName);
+        return -1;
+    }
+    return 0;
+}
+
+// Record the keys of a record written to a slot in the delta area of
+// SEC_FILE, following the same stamp protocol as indexAfterWrite(). Keys
+// the slot already had need no entry; a full delta area leaves the file
+// stale for the next query to rebuild.
+static void secondaryAfterWrite(const DbStamp *before, const DbStamp *after, long slot,
+                                const Student *s, const Student *old) {
+    SecondaryHeader hdr;
+    SecondaryDelta entries[ATTR_COUNT];
+    FILE *sec;
+    int n = 0;
+    
+    sec = fopen(SEC_FILE, "rb+");
+    if(sec == NULL) return;
+    
+    if(countedRead(&hdr, sizeof(hdr), 1, sec) != 1 ||
+       memcmp(hdr.magic, SECONDARY_MAGIC, sizeof(hdr.magic)) != 0 ||
+       !sameStamp(&hdr.stamp, before)) {
+        fclose(sec);
+        return;
+    }
+    
+    for(int attr = 0; attr < ATTR_COUNT && IS_LIVE(*s); attr++) {
+        unsigned long key = attributeKey(s, attr);
+        
+        if(IS_LIVE(*old) && attributeKey(old, attr) == key) continue;
+        memset(&entries[n], 0, sizeof(entries[n]));
+        entries[n].attr = attr;
+        entries[n].key = key;
+        entries[n].slot = slot;
+        n++;
+    }
+    if(hdr.deltaCount + n > SECONDARY_DELTA_MAX) {
+        fclose(sec);
         return;
     }
     
-    // Write CSV header
-    fprintf(csv, "Roll Number,Name,Department,Course,Year Joined,GPA\n");
+    if(n > 0) {
+        fseek(sec, secondaryDeltaPos(&hdr, hdr.deltaCount), SEEK_SET);
+        countedWrite(entries, sizeof(SecondaryDelta), (size_t)n, sec);
+        hdr.deltaCount += n;
+    }
+    if(slot >= hdr.count) hdr.count = slot + 1;
+    hdr.stamp = *after;
+    fseek(sec, 0, SEEK_SET);
+    countedWrite(&hdr, sizeof(hdr), 1, sec);
+    fclose(sec);
+}
+
+// ─── Name search index ──────────────────────────────────────
+
+// Fold a name the way searches compare it; `out` holds max + 1 bytes
+static size_t foldName(char *out, const char *name, size_t max) {
+    size_t n = 0;
+    
+    for(; n < max && name[n] != '\0'; n++) out[n] = (char)tolower((unsigned char)name[n]);
+    out[n] = '\0';
+    return n;
+}
+
+// Bytes a word is made of; anything else separates words
+static int isWordByte(char c) {
+    return isalnum((unsigned char)c) || (unsigned char)c >= 0x80;
+}
+
+static unsigned int trigramAt(const char *p) {
+    return (unsigned int)(unsigned char)p[0] << 16 | (unsigned int)(unsigned char)p[1] << 8 |
+           (unsigned int)(unsigned char)p[2];
+}
+
+static int compareTrigrams(const void *a, const void *b) {
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    
+    return (x > y) - (x < y);
+}
+
+// Sort keys and drop repeats; returns how many are left
+static int uniqueTrigrams(unsigned int *keys, int n) {
+    int kept = 0;
     
-    // Write student data
-    while(fread(&student, sizeof(Student), 1, fp) == 1) {
-        fprintf(csv, "%d,%s,%s,%s,%d,%.2f\n",
-                student.roll_no,
-                student.name,
-                student.department,
-                student.course,
-                student.year_joined,
-                student.gpa);
-        count++;
+    qsort(keys, (size_t)n, sizeof(unsigned int), compareTrigrams);
+    for(int i = 0; i < n; i++) {
+        if(kept == 0 || keys[i] != keys[kept - 1]) keys[kept++] = keys[i];
     }
+    return kept;
+}
+
+// The distinct keys a name is listed under, sorted; returns how many
+static int nameTrigrams(const char *name, size_t max, unsigned int *keys) {
+    char framed[sizeof(((Student *)0)->name) + 2];
+    size_t len;
+    int n = 0;
     
-    fclose(fp);
-    fclose(csv);
+    if(max > sizeof(((Student *)0)->name)) max = sizeof(((Student *)0)->name);
+    framed[0] = NAME_START;
+    len = foldName(framed + 1, name, max);
+    framed[len + 1] = NAME_END;
     
-    printf("\n╔════════════════════════════════════════════════╗\n");
-    printf("║     ✓ Export Successful!                       ║\n");
-    printf("║     %d records exported to %s     ║\n", count, CSV_FILE);
-    printf("║     You can open this file in Excel.           ║\n");
-    printf("╚════════════════════════════════════════════════╝\n");
+    for(size_t i = 0; i + 3 <= len + 2; i++) keys[n++] = trigramAt(framed + i);
     
-    pressEnterToContinue();
+    // framed[i + 1] is name[i]: a word starts there after a separator
+    for(size_t i = 1; i + 1 < len; i++) {
+        if(!isWordByte(framed[i])) {
+            char word[3] = { WORD_START, framed[i + 1], framed[i + 2] };
+            keys[n++] = trigramAt(word);
+        }
+    }
+    return uniqueTrigrams(keys, n);
+}
+
+// How a name matches a folded pattern
+static int nameMatch(const char *name, size_t max, const char *pattern, size_t length) {
+    char folded[sizeof(((Student *)0)->name) + 1];
+    size_t len;
+    int best = MATCH_NONE;
+    
+    if(max > sizeof(((Student *)0)->name)) max = sizeof(((Student *)0)->name);
+    len = foldName(folded, name, max);
+    if(length == 0 || length > len) return MATCH_NONE;
+    if(memcmp(folded, pattern, length) == 0) return length == len ? MATCH_EXACT : MATCH_PREFIX;
+    
+    for(const char *p = strstr(folded + 1, pattern); p != NULL; p = strstr(p + 1, pattern)) {
+        if(!isWordByte(p[-1])) return MATCH_WORD;
+        best = MATCH_SUBSTRING;
+    }
+    return best;
+}
+
+// TRI_FILE layout: header, posting lists, key directory, delta area
+static long trigramPostingPos(long p) {
+    return (long)sizeof(SecondaryHeader) + p * (long)sizeof(unsigned int);
+}
+
+static long trigramKeyPos(const SecondaryHeader *hdr, long k) {
+    return trigramPostingPos(hdr->postings) + k * (long)sizeof(TrigramKey);
+}
+
+static long trigramDeltaPos(const SecondaryHeader *hdr, long d) {
+    return trigramKeyPos(hdr, hdr->keys) + d * (long)sizeof(TrigramDelta);
+}
+
+// Rebuild TRI_FILE from a full scan of a snapshot. The keys of every name
+// are kept in scan order and counted, then placed by a counting sort, so
+// each list comes out in slot order.
+typedef struct {
+    unsigned int *counts;   // postings under each key, then the next free one
+    unsigned int *keys;     // the keys of every record, one after another
+    long nkeys;
+    long capacity;
+    unsigned int *slots;    // slot of each record
+    unsigned char *lengths; // and its number of keys
+    long count;
+    int failed;
+} TrigramBuild;
+
+static int trigramRecord(const Student *s, long offset, void *ctx) {
+    TrigramBuild *b = ctx;
+    unsigned int keys[TRIGRAM_MAX_KEYS];
+    int n = nameTrigrams(s->name, sizeof(s->name), keys);
+    
+    if(b->nkeys + n > b->capacity) {
+        long cap = b->capacity ? b->capacity * 2 : 1L << 16;
+        unsigned int *grown = realloc(b->keys, (size_t)cap * sizeof(unsigned int));
+        
+        if(grown == NULL) {
+            b->failed = 1;
+            return 1;
+        }
+        b->keys = grown;
+        b->capacity = cap;
+    }
+    for(int i = 0; i < n; i++) {
+        b->keys[b->nkeys++] = keys[i];
+        b->counts[keys[i]]++;
+    }
+    b->slots[b->count] = (unsigned int)slotOf(offset);
+    b->lengths[b->count] = (unsigned char)n;
+    b->count++;
+    return 0;
+}
+
+int rebuildTrigrams(Snapshot *snap) {
+    SecondaryHeader hdr;
+    TrigramBuild build;
+    TrigramKey *dir = NULL;
+    TrigramDelta *blank;
+    unsigned int *postings = NULL;
+    char tmpName[256];
+    FILE *out = NULL;
+    long dirCap = 0, next = 0;
+    int failed = 0;
+    
+    memset(&hdr, 0, sizeof(hdr));
+    memset(&build, 0, sizeof(build));
+    build.counts = calloc(TRIGRAM_SPACE, sizeof(unsigned int));
+    build.slots = malloc((size_t)(snap->count + 1) * sizeof(unsigned int));
+    build.lengths = malloc((size_t)(snap->count + 1));
+    blank = calloc(TRIGRAM_DELTA_MAX, sizeof(TrigramDelta));
+    if(build.counts == NULL || build.slots == NULL || build.lengths == NULL || blank == NULL) failed = 1;
+    
+    snprintf(tmpName, sizeof(tmpName), "%s.%ld.tmp", TRI_FILE, (long)getpid());
+    if(!failed) out = fopen(tmpName, "wb");
+    if(out == NULL || scanSnapshot(snap, SCAN_LIVE, trigramRecord, &build) < 0 || build.failed) {
+        failed = 1;
+    }
+    
+    // Directory in key order; each count becomes where its list starts
+    for(long key = 0; key < TRIGRAM_SPACE && !failed; key++) {
+        unsigned int length = build.counts[key];
+        
+        if(length == 0) continue;
+        if(hdr.keys == dirCap) {
+            long cap = dirCap ? dirCap * 2 : 4096;
+            TrigramKey *grown = realloc(dir, (size_t)cap * sizeof(TrigramKey));
+            if(grown == NULL) {
+                failed = 1;
+                break;
+            }
+            dir = grown;
+            dirCap = cap;
+        }
+        dir[hdr.keys].key = (unsigned int)key;
+        dir[hdr.keys].length = length;
+        dir[hdr.keys].start = next;
+        hdr.keys++;
+        build.counts[key] = (unsigned int)next;
+        next += length;
+    }
+    hdr.postings = next;
+    
+    // Records were scanned in slot order, so every list is sorted
+    if(!failed) postings = malloc((size_t)(next + 1) * sizeof(unsigned int));
+    if(postings == NULL) failed = 1;
+    for(long r = 0, k = 0; r < build.count && !failed; r++) {
+        for(int i = 0; i < build.lengths[r]; i++, k++) {
+            postings[build.counts[build.keys[k]]++] = build.slots[r];
+        }
+    }
+    
+    // The header goes in last
+    if(!failed &&
+       (fseek(out, trigramPostingPos(0), SEEK_SET) != 0 ||
+        countedWrite(postings, sizeof(unsigned int), (size_t)next, out) != (size_t)next ||
+        countedWrite(dir, sizeof(TrigramKey), (size_t)hdr.keys, out) != (size_t)hdr.keys ||
+        countedWrite(blank, sizeof(TrigramDelta), TRIGRAM_DELTA_MAX, out) != TRIGRAM_DELTA_MAX)) {
+        failed = 1;
+    }
+    
+    memcpy(hdr.magic, TRIGRAM_MAGIC, sizeof(hdr.magic));
+    hdr.count = snap->count;
+    hdr.stamp = snap->stamp;
+    if(out != NULL) {
+        fseek(out, 0, SEEK_SET);
+        if(countedWrite(&hdr, sizeof(hdr), 1, out) != 1) failed = 1;
+        if(fclose(out) != 0) failed = 1;
+    }
+    free(build.counts);
+    free(build.keys);
+    free(build.slots);
+    free(build.lengths);
+    free(postings);
+    free(blank);
+    free(dir);
+    
+    if(failed || rename(tmpName, TRI_FILE) != 0) {
+        remove(tmpName);
+        return -1;
+    }
+    return 0;
+}
+
+// Record the keys of a name written to a slot in the delta area of
+// TRI_FILE, as secondaryAfterWrite() does for SEC_FILE. Keys the old name
+// already had need no entry; lists keep the slots of deleted records.
+static void trigramAfterWrite(const DbStamp *before, const DbStamp *after, long slot,
+                              const Student *s, const Student *old) {
+    SecondaryHeader hdr;
+    TrigramDelta entries[TRIGRAM_MAX_KEYS];
+    unsigned int keys[TRIGRAM_MAX_KEYS], had[TRIGRAM_MAX_KEYS];
+    FILE *tri;
+    int n = 0, nkeys = 0, nhad = 0;
+    
+    tri = fopen(TRI_FILE, "rb+");
+    if(tri == NULL) return;
+    
+    if(countedRead(&hdr, sizeof(hdr), 1, tri) != 1 ||
+       memcmp(hdr.magic, TRIGRAM_MAGIC, sizeof(hdr.magic)) != 0 ||
+       !sameStamp(&hdr.stamp, before)) {
+        fclose(tri);
+        return;
+    }
+    
+    if(IS_LIVE(*s)) nkeys = nameTrigrams(s->name, sizeof(s->name), keys);
+    if(IS_LIVE(*old)) nhad = nameTrigrams(old->name, sizeof(old->name), had);
+    for(int i = 0, j = 0; i < nkeys; i++) {
+        while(j < nhad && had[j] < keys[i]) j++;
+        if(j < nhad && had[j] == keys[i]) continue;
+        entries[n].key = keys[i];
+        entries[n].slot = (unsigned int)slot;
+        n++;
+    }
+    if(hdr.deltaCount + n > TRIGRAM_DELTA_MAX) {
+        fclose(tri);
+        return;
+    }
+    
+    if(n > 0) {
+        fseek(tri, trigramDeltaPos(&hdr, hdr.deltaCount), SEEK_SET);
+        countedWrite(entries, sizeof(TrigramDelta), (size_t)n, tri);
+        hdr.deltaCount += n;
+    }
+    if(slot >= hdr.count) hdr.count = slot + 1;
+    hdr.stamp = *after;
+    fseek(tri, 0, SEEK_SET);
+    countedWrite(&hdr, sizeof(hdr), 1, tri);
+    fclose(tri);
+}
+
+// ─── Multi-process locking ──────────────────────────────────
+
+static int lockFd = -1;         // LOCK_FILE, kept open: closing it drops our locks
+static int writerDepth = 0;     // nesting of lockWriter() calls
+static int pinDepth = 0;        // open snapshots sharing our LOCK_PIN
+static int currentShard = 0;    // shard the file globals name; see useShard()
+
+static int openLockFile() {
+    if(lockFd < 0) lockFd = open(LOCK_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    return lockFd < 0 ? -1 : 0;
+}
+
+// Lock one byte of LOCK_FILE (F_RDLCK or F_WRLCK), or unlock it (F_UNLCK)
+static int lockByte(int type, long byte, int wait) {
+    struct flock fl;
+    
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = (short)type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = byte;
+    fl.l_len = 1;
+    
+    // Only waits for a lock someone else holds are timed
+    if(wait && metricsOn && type != F_UNLCK) {
+        long start;
+        
+        if(fcntl(lockFd, F_SETLK, &fl) == 0) return 0;
+        if(errno != EAGAIN && errno != EACCES && errno != EINTR) return -1;
+        start = monotonicNs();
+        while(fcntl(lockFd, F_SETLKW, &fl) != 0) {
+            if(errno != EINTR) return -1;
+        }
+        metricsEnd(OP_LOCK_WAIT, start);
+        return 0;
+    }
+    while(fcntl(lockFd, wait ? F_SETLKW : F_SETLK, &fl) != 0) {
+        if(errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+// LOCK_FILE starts with the log offset of a transaction that is being
+// copied into DB_FILE, plus one, or 0 when there is none; one such word
+// per shard. A writer that dies half way leaves it set for the next one to
+// finish.
+static long applyingFrom() {
+    long v = 0;
+    
+    if(pread(lockFd, &v, sizeof(v), (off_t)currentShard * (off_t)sizeof(v)) != (ssize_t)sizeof(v)) return -1;
+    return v - 1;
+}
+
+static void setApplying(long from) {
+    long v = from + 1;
+    
+    if(pwrite(lockFd, &v, sizeof(v), (off_t)currentShard * (off_t)sizeof(v)) != (ssize_t)sizeof(v)) return;
+}
+
+// Finish the copy of a transaction a dead writer left behind in the
+// current shard. Call with the writer lock held.
+static void finishApplying() {
+    long from = applyingFrom();
+    
+    if(from >= 0 && walReplay(from) >= 0) setApplying(-1);
+}
+
+static int finishCommitting();
+
+// Take the writer lock, waiting for other processes; nests within one.
+// Finishes the copy of a transaction a dead writer left behind, and fails
+// while one spanning shards cannot be finished.
+int lockWriter() {
+    if(writerDepth > 0) {
+        writerDepth++;
+        return 0;
+    }
+    if(openLockFile() != 0 || lockByte(F_WRLCK, LOCK_WRITER, 1) != 0) return -1;
+    writerDepth = 1;
+    
+    finishApplying();
+    if(finishCommitting() != 0) {
+        writerDepth = 0;
+        lockByte(F_UNLCK, LOCK_WRITER, 0);
+        return -1;
+    }
+    return 0;
+}
+
+void unlockWriter() {
+    if(writerDepth > 0 && --writerDepth == 0) lockByte(F_UNLCK, LOCK_WRITER, 0);
+}
+
+// ─── Incremental statistics ─────────────────────────────────
+
+// GPA in millionths; integer sums do not drift as records come and go
+static long gpaUnits(float gpa) {
+    return lrint((double)gpa * 1e6);
+}
+
+// Whether a record ranks before an entry of the best (high) or worst
+// list. Ties go to the lower slot, as in aggregateGpa().
+static int ranksBefore(float gpa, long slot, const StatsEntry *e, int high) {
+    if(gpa != e->gpa) return high ? gpa > e->gpa : gpa < e->gpa;
+    return slot < e->slot;
+}
+
+// Offer a record to an extremes list. The list always holds the leading
+// records of the whole table in its order, so a record ranking after its
+// last entry may only join while the list is `complete` (holds them all).
+static void extremesInsert(StatsEntry *list, long *n, int complete,
+                           const Student *s, long slot, int high) {
+    long i = *n;
+    
+    if(!complete && (i == 0 || !ranksBefore(s->gpa, slot, &list[i - 1], high))) return;
+    if(i == STATS_EXTREMES) {
+        if(!ranksBefore(s->gpa, slot, &list[i - 1], high)) return;
+        i--;    // the last entry drops out
+    } else {
+        (*n)++;
+    }
+    
+    while(i > 0 && ranksBefore(s->gpa, slot, &list[i - 1], high)) {
+        list[i] = list[i - 1];
+        i--;
+    }
+    memset(&list[i], 0, sizeof(list[i]));
+    list[i].gpa = s->gpa;
+    list[i].roll_no = s->roll_no;
+    list[i].slot = slot;
+    memcpy(list[i].name, s->name, sizeof(list[i].name));
+}
+
+static void extremesRemove(StatsEntry *list, long *n, long slot) {
+    for(long i = 0; i < *n; i++) {
+        if(list[i].slot != slot) continue;
+        memmove(&list[i], &list[i + 1], (size_t)(*n - i - 1) * sizeof(StatsEntry));
+        (*n)--;
+        return;
+    }
+}
+
+// Account for one slot changing from `old` to `s`
+static void statsApply(StatsBlock *b, long slot, const Student *old, const Student *s) {
+    if(IS_LIVE(*old)) {
+        b->count--;
+        b->gpaSum -= gpaUnits(old->gpa);
+        b->atLeast35 -= old->gpa >= 3.5f;
+        b->atLeast30 -= old->gpa >= 3.0f;
+        b->atLeast20 -= old->gpa >= 2.0f;
+        extremesRemove(b->high, &b->highCount, slot);
+        extremesRemove(b->low, &b->lowCount, slot);
+    }
+    if(IS_LIVE(*s)) {
+        extremesInsert(b->high, &b->highCount, b->highCount == b->count, s, slot, 1);
+        extremesInsert(b->low, &b->lowCount, b->lowCount == b->count, s, slot, 0);
+        b->count++;
+        b->gpaSum += gpaUnits(s->gpa);
+        b->atLeast35 += s->gpa >= 3.5f;
+        b->atLeast30 += s->gpa >= 3.0f;
+        b->atLeast20 += s->gpa >= 2.0f;
+    }
+}
+
+static int statsBatch(const Student *batch, long first, long n, void *ctx) {
+    Student none;
+    
+    memset(&none, 0, sizeof(none));
+    for(long i = 0; i < n; i++) {
+        if(IS_LIVE(batch[i])) statsApply(ctx, first + i, &none, &batch[i]);
+    }
+    return 0;
+}
+
+// Offer the extremes of another block to a merged list. Slots from shards
+// carry the shard in their top bits, so ties still go to the earlier
+// record.
+static void extremesMerge(StatsEntry *list, long *n, const StatsEntry *from, long count, long base, int high) {
+    for(long i = 0; i < count; i++) {
+        Student s;
+        
+        memset(&s, 0, sizeof(s));
+        s.gpa = from[i].gpa;
+        s.roll_no = from[i].roll_no;
+        memcpy(s.name, from[i].name, sizeof(s.name));
+        extremesInsert(list, n, 1, &s, from[i].slot + base, high);
+    }
+}
+
+// Add the figures of block `s`, whose slots are offset by `base`, to `b`
+static void statsMerge(StatsBlock *b, const StatsBlock *s, long base) {
+    b->count += s->count;
+    b->gpaSum += s->gpaSum;
+    b->atLeast35 += s->atLeast35;
+    b->atLeast30 += s->atLeast30;
+    b->atLeast20 += s->atLeast20;
+    extremesMerge(b->high, &b->highCount, s->high, s->highCount, base, 1);
+    extremesMerge(b->low, &b->lowCount, s->low, s->lowCount, base, 0);
+}
+
+// Recompute STATS_FILE from a full scan. Each consumer of the scan
+// pipeline adds up the batches it takes in a block of its own, and the
+// blocks are merged. Returns -1 if there is no database or -2 if a record
+// could not be read, when nothing is stored.
+int rebuildStats(StatsBlock *b) {
+    int consumers = scanThreads();
+    StatsBlock *parts = calloc((size_t)consumers, sizeof(StatsBlock));
+    void *ctxs[SCAN_MAX_CONSUMERS];
+    char tmpName[256];
+    Snapshot snap;
+    FILE *out;
+    int rc;
+    
+    memset(b, 0, sizeof(*b));
+    if(parts == NULL || snapshotOpen(&snap) != 0) {
+        free(parts);
+        return -1;
+    }
+    memcpy(b->magic, STATS_MAGIC, sizeof(b->magic));
+    b->stamp = snap.stamp;
+    for(int t = 0; t < consumers; t++) ctxs[t] = &parts[t];
+    rc = scanPipeline(&snap, NULL, snap.count, statsBatch, ctxs, consumers);
+    snapshotClose(&snap);
+    for(int t = 0; t < consumers; t++) statsMerge(b, &parts[t], 0);
+    free(parts);
+    if(rc < 0) return -2;
+    
+    snprintf(tmpName, sizeof(tmpName), "%s.%ld.tmp", STATS_FILE, (long)getpid());
+    out = fopen(tmpName, "wb");
+    if(out == NULL) return 0;
+    if(countedWrite(b, sizeof(*b), 1, out) != 1 || fclose(out) != 0 || rename(tmpName, STATS_FILE) != 0) {
+        remove(tmpName);
+    }
+    return 0;
+}
+
+// Read STATS_FILE if it describes DB_FILE as it is now and deletes have
+// not used up a list of extremes. Returns 0 if it does.
+static int readStats(StatsBlock *b) {
+    DbStamp now;
+    FILE *in;
+    int locked = 0, ok = 0;
+    
+    // Writers update the block in place
+    if(writerDepth == 0 && openLockFile() == 0) locked = lockByte(F_RDLCK, LOCK_WRITER, 1) == 0;
+    if(getDbStamp(&now) == 0 && (in = fopen(STATS_FILE, "rb")) != NULL) {
+        ok = countedRead(b, sizeof(*b), 1, in) == 1 &&
+             memcmp(b->magic, STATS_MAGIC, sizeof(b->magic)) == 0 &&
+             sameStamp(&b->stamp, &now) &&
+             (b->count == 0 || (b->highCount > 0 && b->lowCount > 0));
+        fclose(in);
+    }
+    if(locked) lockByte(F_UNLCK, LOCK_WRITER, 0);
+    return ok ? 0 : -1;
+}
+
+// Read the statistics of the database as it is now, rebuilding the block
+// if it cannot be used. Returns -1 if there is no database or -2 if it
+// could not be read.
+int loadStats(StatsBlock *b) {
+    long start = metricsStart();
+    int rc = readStats(b) == 0 ? 0 : rebuildStats(b);
+    
+    metricsEnd(OP_STATISTICS, start);
+    return rc;
+}
+
+// Open STATS_FILE for a transaction about to be applied; NULL if the
+// block does not describe DB_FILE as it is, and will be rebuilt instead
+static FILE *statsBegin(StatsBlock *b) {
+    DbStamp now;
+    FILE *f = fopen(STATS_FILE, "rb+");
+    
+    if(f == NULL) return NULL;
+    if(getDbStamp(&now) != 0 || countedRead(b, sizeof(*b), 1, f) != 1 ||
+       memcmp(b->magic, STATS_MAGIC, sizeof(b->magic)) != 0 || !sameStamp(&b->stamp, &now)) {
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+// Store the block once the transaction is in DB_FILE
+static void statsEnd(FILE *f, StatsBlock *b, int failed) {
+    if(!failed && getDbStamp(&b->stamp) == 0) {
+        fseek(f, 0, SEEK_SET);
+        countedWrite(b, sizeof(*b), 1, f);
+    }
+    fclose(f);
+}
+
+// Check the stored statistics against a full aggregate of the columnar
+// sidecar, then rebuild them from the records. Returns the number of
+// fields that had drifted, -1 if there is no database or -2 if it could
+// not be read.
+static int verifyShardStats() {
+    StatsBlock stored, fresh;
+    GpaAggregate agg;
+    int drift = 0, rc;
+    
+    lockWriter();
+    rc = loadStats(&stored);
+    if(rc == 0 && aggregateColumns(&agg) != 0) rc = -2;
+    if(rc != 0) {
+        unlockWriter();
+        return rc;
+    }
+    
+    if(stored.count != agg.count) drift++;
+    if(agg.count > 0 && fabs((double)stored.gpaSum / 1e6 - agg.sum) / (double)agg.count > 1e-6) drift++;
+    if(stored.atLeast35 != agg.atLeast35 || stored.atLeast30 != agg.atLeast30 ||
+       stored.atLeast20 != agg.atLeast20) {
+        drift++;
+    }
+    if(agg.count > 0 && (stored.highCount == 0 || stored.high[0].slot != agg.argmax ||
+                         stored.lowCount == 0 || stored.low[0].slot != agg.argmin)) {
+        drift++;
+    }
+    
+    rc = rebuildStats(&fresh);
+    unlockWriter();
+    return rc == 0 ? drift : -2;
+}
+
+// ─── Record storage ─────────────────────────────────────────
+
+// Read exactly len bytes at a file offset
+static int preadAll(int fd, void *buf, size_t len, off_t offset) {
+    char *p = buf;
+    
+    while(len > 0) {
+        ssize_t n = pread(fd, p, len, offset);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return -1;
+        metricsAdd(METRIC_BYTES_READ, n);
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+// Write all of buf at a file offset, retrying short writes
+static int pwriteAll(int fd, const void *buf, size_t len, off_t offset) {
+    const char *p = buf;
+    
+    while(len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        metricsAdd(METRIC_BYTES_WRITTEN, n);
+        p += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+
+
+static unsigned int getU16(const unsigned char *p) {
+    return (unsigned int)p[0] | (unsigned int)p[1] << 8;
+}
+
+static unsigned int getU32(const unsigned char *p) {
+    return getU16(p) | getU16(p + 2) << 16;
+}
+
+static unsigned long getU64(const unsigned char *p) {
+    return (unsigned long)getU32(p) | (unsigned long)getU32(p + 4) << 32;
+}
+
+static void putU16(unsigned char *p, unsigned int v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void putU32(unsigned char *p, unsigned int v) {
+    putU16(p, v & 0xFFFF);
+    putU16(p + 2, v >> 16);
+}
+
+static void putU64(unsigned char *p, unsigned long v) {
+    putU32(p, (unsigned int)v);
+    putU32(p + 4, (unsigned int)(v >> 32));
+}
+
+static unsigned int crc32cTable[256];
+
+static void crc32cInit() {
+    for(unsigned int i = 0; i < 256; i++) {
+        unsigned int c = i;
+        for(int k = 0; k < 8; k++) c = (c & 1) ? 0x82F63B78u ^ (c >> 1) : c >> 1;
+        crc32cTable[i] = c;
+    }
+}
+
+static unsigned int crc32cScalar(unsigned int crc, const unsigned char *p, size_t len) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    
+    pthread_once(&once, crc32cInit);
+    while(len-- > 0) crc = crc32cTable[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2")))
+static unsigned int crc32cSSE42(unsigned int crc, const unsigned char *p, size_t len) {
+    unsigned long long c = crc;
+    
+    for(; len >= 8; p += 8, len -= 8) {
+        unsigned long long v;
+        memcpy(&v, p, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (unsigned int)c;
+    for(; len > 0; p++, len--) crc = _mm_crc32_u8(crc, *p);
+    return crc;
+}
+
+#endif
+
+// CRC-32C (Castagnoli) of a block, continuing `crc` of the bytes before
+// it (0 to start). Every page read is checked, so the SSE4.2 instruction
+// is used where the CPU has it.
+static unsigned int crc32cUpdate(unsigned int crc, const void *data, size_t len) {
+#if defined(__x86_64__)
+    static int level = -1;
+    
+    if(level < 0) {
+        __builtin_cpu_init();
+        level = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    }
+    if(level == 1) return ~crc32cSSE42(~crc, data, len);
+#endif
+    return ~crc32cScalar(~crc, data, len);
+}
+
+static unsigned int crc32c(const void *data, size_t len) {
+    return crc32cUpdate(0, data, len);
+}
+
+// This process's copy of the heap dictionary. An id never changes once
+// given out (compaction copies the dictionary in id order), so one copy
+// serves every heap generation. Entries are only ever added, which lets
+// decoders look up known ids without taking the lock.
+typedef struct {
+    char **text;            // id -> string, room for DICT_MAX
+    long count;             // ids known; read with __atomic_load_n
+    long *hash;             // string -> id, open addressing, -1 empty
+    long hashCap;
+    pthread_mutex_t lock;
+} Dictionary;
+
+// Each shard has a heap and so a dictionary of its own; `dict` is the
+// current shard's (see useShard())
+static Dictionary dicts[SHARD_MAX] = { [0 ... SHARD_MAX - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER } };
+static Dictionary *dict = &dicts[0];
+
+// FNV-1a of a dictionary string
+static unsigned long dictHash(const char *s, size_t len) {
+    unsigned long h = 1469598103934665603UL;
+    
+    for(size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+// Make ids [dict->count, upto), whose text is in place, visible to lookups.
+// Call with dict->lock held, as for every function below up to dictText().
+static int dictPublish(long upto) {
+    long from = dict->count;
+    
+    if(upto * 2 > dict->hashCap) {
+        long cap = dict->hashCap ? dict->hashCap : 256;
+        long *hash;
+        
+        while(upto * 2 > cap) cap *= 2;
+        hash = malloc((size_t)cap * sizeof(long));
+        if(hash == NULL) return -1;
+        for(long i = 0; i < cap; i++) hash[i] = -1;
+        free(dict->hash);
+        dict->hash = hash;
+        dict->hashCap = cap;
+        from = 0;
+    }
+    
+    for(long id = from; id < upto; id++) {
+        long mask = dict->hashCap - 1;
+        long i = (long)(dictHash(dict->text[id], strlen(dict->text[id])) & (unsigned long)mask);
+        
+        while(dict->hash[i] >= 0) i = (i + 1) & mask;
+        dict->hash[i] = id;
+    }
+    __atomic_store_n(&dict->count, upto, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int dictInit() {
+    if(dict->text != NULL) return 0;
+    
+    dict->text = calloc(DICT_MAX, sizeof(char *));
+    if(dict->text == NULL) return -1;
+    dict->text[0] = strdup("");
+    if(dict->text[0] == NULL) {
+        free(dict->text);
+        dict->text = NULL;
+        return -1;
+    }
+    return dictPublish(1);
+}
+
+// The id of a string, or -1
+static long dictFind(const char *s, size_t len) {
+    long mask = dict->hashCap - 1;
+    
+    if(dict->hashCap == 0) return -1;
+    for(long i = (long)(dictHash(s, len) & (unsigned long)mask); dict->hash[i] >= 0; i = (i + 1) & mask) {
+        const char *t = dict->text[dict->hash[i]];
+        if(strncmp(t, s, len) == 0 && t[len] == '\0') return dict->hash[i];
+    }
+    return -1;
+}
+
+static void heapPath(char *buf, size_t size, unsigned int generation) {
+    snprintf(buf, size, "%s.%u", STR_FILE, generation);
+}
+
+// Heap header: magic, u32 version, u32 generation, u64 offset of the
+// newest dictionary record, u32 dictionary size, u32 crc of the fields
+static int heapWriteHeader(int fd, unsigned int generation, long lastDict, long dictCount) {
+    unsigned char h[HEAP_HEADER_SIZE];
+    
+    memset(h, 0, sizeof(h));
+    memcpy(h, HEAP_MAGIC, sizeof(HEAP_MAGIC));
+    putU32(h + 8, HEAP_VERSION);
+    putU32(h + 12, generation);
+    putU64(h + 16, (unsigned long)lastDict);
+    putU32(h + 24, (unsigned int)dictCount);
+    putU32(h + 28, crc32c(h, 28));
+    return pwriteAll(fd, h, sizeof(h), 0);
+}
+
+static int heapReadHeader(int fd, long *lastDict, long *dictCount) {
+    unsigned char h[HEAP_HEADER_SIZE];
+    
+    if(preadAll(fd, h, sizeof(h), 0) != 0 || memcmp(h, HEAP_MAGIC, sizeof(HEAP_MAGIC)) != 0 ||
+       getU32(h + 28) != crc32c(h, 28)) {
+        return -1;
+    }
+    *lastDict = (long)getU64(h + 16);
+    *dictCount = (long)getU32(h + 24);
+    return 0;
+}
+
+static int heapFlush(Heap *h) {
+    if(h->len > 0 && pwriteAll(h->fd, h->buf, h->len, h->end - (long)h->len) != 0) return -1;
+    h->len = 0;
+    return 0;
+}
+
+// Append a record: u32 crc of the rest, u16 length, u8 type, u8 reserved,
+// u32 dictionary id, u64 offset of the previous dictionary record, then
+// the text. Returns the record's offset, or -1.
+static long heapAppend(Heap *h, int type, long id, long prev, const char *s, size_t len) {
+    unsigned char rec[HEAP_RECORD_HEADER + HEAP_TEXT_MAX];
+    size_t size = HEAP_RECORD_HEADER + len;
+    long offset = h->end;
+    
+    if(len > HEAP_TEXT_MAX) return -1;
+    memset(rec, 0, HEAP_RECORD_HEADER);
+    putU16(rec + 4, (unsigned int)len);
+    rec[6] = (unsigned char)type;
+    putU32(rec + 8, (unsigned int)id);
+    putU64(rec + 12, (unsigned long)prev);
+    memcpy(rec + HEAP_RECORD_HEADER, s, len);
+    putU32(rec, crc32c(rec + 4, size - 4));
+    
+    if(h->buf == NULL) {
+        if(pwriteAll(h->fd, rec, size, offset) != 0) return -1;
+    } else {
+        if(h->len + size > HEAP_BUFFER && heapFlush(h) != 0) return -1;
+        memcpy(h->buf + h->len, rec, size);
+        h->len += size;
+    }
+    h->end += (long)size;
+    return offset;
+}
+
+// Read the record at `offset`; text gets its bytes and a terminator
+static int heapRead(int fd, long offset, int *type, long *id, long *prev, char *text, size_t *len) {
+    unsigned char rec[HEAP_RECORD_HEADER + HEAP_TEXT_MAX];
+    ssize_t n;
+    size_t l;
+    
+    do {
+        n = pread(fd, rec, sizeof(rec), offset);
+    } while(n < 0 && errno == EINTR);
+    if(n < HEAP_RECORD_HEADER) return -1;
+    metricsAdd(METRIC_BYTES_READ, n);
+    
+    l = getU16(rec + 4);
+    if(l > HEAP_TEXT_MAX || (size_t)n < HEAP_RECORD_HEADER + l ||
+       getU32(rec) != crc32c(rec + 4, HEAP_RECORD_HEADER - 4 + l)) {
+        return -1;
+    }
+    *type = rec[6];
+    *id = (long)getU32(rec + 8);
+    *prev = (long)getU64(rec + 12);
+    memcpy(text, rec + HEAP_RECORD_HEADER, l);
+    text[l] = '\0';
+    *len = l;
+    return 0;
+}
+
+// Take in the dictionary entries of a heap this process has not seen yet,
+// following the chain back from the newest one
+static int dictLoad(int fd) {
+    char text[HEAP_TEXT_MAX + 1];
+    long last, total, offset, id, prev;
+    size_t len;
+    int type;
+    
+    if(dictInit() != 0 || fd < 0 || heapReadHeader(fd, &last, &total) != 0 || total > DICT_MAX) return -1;
+    
+    for(offset = last; offset > 0 && total > dict->count; offset = prev) {
+        if(heapRead(fd, offset, &type, &id, &prev, text, &len) != 0 || type != HEAP_DICT || id >= total) {
+            return -1;
+        }
+        if(id < dict->count) break;
+        if(dict->text[id] == NULL && (dict->text[id] = strdup(text)) == NULL) return -1;
+    }
+    for(id = dict->count; id < total; id++) {
+        if(dict->text[id] == NULL) return -1;
+    }
+    return total > dict->count ? dictPublish(total) : 0;
+}
+
+// Bring the dictionary up to date with a heap
+static int dictSync(int fd) {
+    int rc;
+    
+    pthread_mutex_lock(&dict->lock);
+    rc = dictLoad(fd);
+    pthread_mutex_unlock(&dict->lock);
+    return rc;
+}
+
+// Text of a dictionary id, or NULL if the heap does not have it
+static const char *dictText(int fd, unsigned int id) {
+    if((long)id >= __atomic_load_n(&dict->count, __ATOMIC_ACQUIRE)) {
+        dictSync(fd);
+        if((long)id >= __atomic_load_n(&dict->count, __ATOMIC_ACQUIRE)) return NULL;
+    }
+    return dict->text[id];
+}
+
+// The id of a string, adding it to the dictionary when new. On the live
+// heap a new entry is on disk before the heap header names it, and before
+// any page refers to it.
+static long dictIntern(Heap *h, const char *s, size_t len) {
+    long id, offset = -1;
+    
+    pthread_mutex_lock(&dict->lock);
+    id = dictInit() == 0 ? dictFind(s, len) : -2;
+    if(id == -1 && h->buf == NULL) {
+        // Another process may have added it
+        id = dictLoad(h->fd) == 0 ? dictFind(s, len) : -2;
+    }
+    if(id == -1) {
+        id = dict->count;
+        if(id >= DICT_MAX || (dict->text[id] = strndup(s, len)) == NULL) {
+            id = -2;
+        } else {
+            offset = heapAppend(h, HEAP_DICT, id, h->lastDict, s, len);
+            if(offset < 0 ||
+               (h->buf == NULL && (syncData(h->fd) != 0 ||
+                                   heapWriteHeader(h->fd, h->generation, offset, id + 1) != 0)) ||
+               dictPublish(id + 1) != 0) {
+                free(dict->text[id]);
+                dict->text[id] = NULL;
+                id = -2;
+            } else {
+                h->lastDict = offset;
+            }
+        }
+    }
+    pthread_mutex_unlock(&dict->lock);
+    return id < 0 ? -1 : id;
+}
+
+// Open the heap of a generation for reading (O_RDONLY) or appending (O_RDWR)
+static int heapOpen(Heap *h, unsigned int generation, int flags) {
+    char path[256];
+    struct stat st;
+    long count;
+    
+    memset(h, 0, sizeof(*h));
+    h->generation = generation;
+    heapPath(path, sizeof(path), generation);
+    h->fd = open(path, flags);
+    if(h->fd < 0) return -1;
+    if(flags == O_RDWR && (fstat(h->fd, &st) != 0 || heapReadHeader(h->fd, &h->lastDict, &count) != 0)) {
+        close(h->fd);
+        h->fd = -1;
+        return -1;
+    }
+    h->end = flags == O_RDWR ? (long)st.st_size : 0;
+    return 0;
+}
+
+// Start an empty heap for a generation, replacing any leftover file
+static int heapCreate(Heap *h, unsigned int generation) {
+    char path[256];
+    
+    memset(h, 0, sizeof(*h));
+    h->generation = generation;
+    heapPath(path, sizeof(path), generation);
+    h->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(h->fd < 0) return -1;
+    h->end = HEAP_HEADER_SIZE;
+    return heapWriteHeader(h->fd, generation, 0, 1);
+}
+
+static int heapClose(Heap *h) {
+    int rc = h->fd >= 0 ? close(h->fd) : 0;
+    
+    free(h->buf);
+    memset(h, 0, sizeof(*h));
+    h->fd = -1;
+    return rc;
+}
+
+// The fields of a slot other than the name; department and course are
+// dictionary ids
+enum { FIELD_ROLL, FIELD_GPA, FIELD_YEAR, FIELD_DEPARTMENT, FIELD_COURSE, SLOT_FIELDS };
+
+typedef struct {
+    int at;                 // offset in the slot
+    int width;              // bytes; 0 if the layout lacks the field
+    unsigned int fallback;  // what it reads as then
+} SlotField;
+
+// Slot layouts: the fields where their descriptors put them, then a u8
+// name length and the name, or for a spilled name the u64 heap offset of
+// its record, to the end of the slot. Layout 1 keeps a flags byte before
+// the name; layout 2 keeps the spilled flag in the top bit of the length
+// and has a byte more of name; layout 3 widens year_joined to 32 bits and
+// has 19 bytes of name. A layout that adds a field gives the older ones
+// a descriptor of width 0 with its default. Later layouts only ever grow
+// the inline room.
+typedef struct {
+    int slotSize;
+    SlotField fields[SLOT_FIELDS];
+    int lengthAt;           // the name length byte, where the name area starts
+    int nameAt;             // offset of the name or its heap offset
+    size_t inlineMax;       // longest name kept in the slot
+    int flagsAt;            // byte holding the spilled flag
+    unsigned char spilled;
+    unsigned char lengthMask;
+} SlotLayout;
+
+static const SlotLayout slotLayouts[DB_LAYOUT + 1] = {
+    { 0 },
+    { 32, { { 0, 4, 0 }, { 4, 4, 0 }, { 8, 2, 0 }, { 10, 2, 0 }, { 12, 2, 0 } }, 14, 16, 16, 15, 0x01, 0xFF },
+    { 32, { { 0, 4, 0 }, { 4, 4, 0 }, { 8, 2, 0 }, { 10, 2, 0 }, { 12, 2, 0 } }, 14, 15, 17, 14, 0x80, 0x7F },
+    { 36, { { 0, 4, 0 }, { 4, 4, 0 }, { 8, 4, 0 }, { 12, 2, 0 }, { 14, 2, 0 } }, 16, 17, 19, 16, 0x80, 0x7F },
+};
+
+// Whether pages of `perPage` slots have room for slots of a layout
+static int layoutFits(int layout, long perPage) {
+    return perPage >= 1 && DB_PAGE_HEADER + perPage * slotLayouts[layout].slotSize <= DB_PAGE_SIZE;
+}
+
+// Slots a data page of a new file in a layout holds. Layout 1 files stay
+// as older releases expect them; later ones leave room to grow.
+static int newPageSlots(int layout) {
+    return layout > 1 ? DB_SLOTS_PER_PAGE : DB_SLOTS_PER_PAGE_BASE;
+}
+
+// A field of a slot, or its default if the layout lacks it
+static unsigned int getField(const unsigned char *p, const SlotLayout *l, int field) {
+    const SlotField *f = &l->fields[field];
+    
+    if(f->width == 0) return f->fallback;
+    return f->width == 2 ? getU16(p + f->at) : getU32(p + f->at);
+}
+
+// Store a field, saturating at what its width holds; a layout without the
+// field drops it
+static void putField(unsigned char *p, const SlotLayout *l, int field, unsigned int v) {
+    const SlotField *f = &l->fields[field];
+    
+    if(f->width == 2) putU16(p + f->at, v > 0xFFFF ? 0xFFFF : v);
+    if(f->width == 4) putU32(p + f->at, v);
+}
+
+// Layout of a data page; pages written before layouts existed hold 0
+static int pageLayout(const unsigned char *page) {
+    return page[10] != 0 ? page[10] : 1;
+}
+
+static int slotSpilled(const unsigned char *p, const SlotLayout *l) {
+    return (p[l->flagsAt] & l->spilled) != 0;
+}
+
+// Set the length and flag bytes of a slot whose name area is cleared
+static void putNameLength(unsigned char *p, const SlotLayout *l, size_t len, int spilled) {
+    p[l->lengthAt] = (unsigned char)len;
+    if(spilled) p[l->flagsAt] |= l->spilled;
+}
+
+// Encode a record into a slot of the given layout. `old`, when given, is
+// what the slot held in that layout; a spilled name it shares keeps its
+// heap record.
+static int encodeSlot(unsigned char *p, int layout, const Student *s, const Student *old, Heap *heap) {
+    const SlotLayout *l = &slotLayouts[layout];
+    size_t nameLen = strnlen(s->name, sizeof(s->name));
+    long department = dictIntern(heap, s->department, strnlen(s->department, sizeof(s->department)));
+    long course = dictIntern(heap, s->course, strnlen(s->course, sizeof(s->course)));
+    int year = s->year_joined;
+    unsigned int gpa;
+    
+    if(department < 0 || course < 0) return -1;
+    if(l->fields[FIELD_YEAR].width == 2) year = year < 0 ? 0 : year;
+    
+    if(nameLen <= l->inlineMax) {
+        memset(p + l->lengthAt, 0, (size_t)(l->slotSize - l->lengthAt));
+        memcpy(p + l->nameAt, s->name, nameLen);
+        putNameLength(p, l, nameLen, 0);
+    } else if(old == NULL || !slotSpilled(p, l) || strncmp(old->name, s->name, sizeof(s->name)) != 0) {
+        long offset = heapAppend(heap, HEAP_NAME, 0, 0, s->name, nameLen);
+        
+        if(offset < 0) return -1;
+        memset(p + l->lengthAt, 0, (size_t)(l->slotSize - l->lengthAt));
+        putU64(p + l->nameAt, (unsigned long)offset);
+        putNameLength(p, l, nameLen, 1);
+    }
+    
+    memcpy(&gpa, &s->gpa, sizeof(gpa));
+    putField(p, l, FIELD_ROLL, (unsigned int)s->roll_no);
+    putField(p, l, FIELD_GPA, gpa);
+    putField(p, l, FIELD_YEAR, (unsigned int)year);
+    putField(p, l, FIELD_DEPARTMENT, (unsigned int)department);
+    putField(p, l, FIELD_COURSE, (unsigned int)course);
+    return 0;
+}
+
+static void copyText(char *dst, size_t size, const char *src) {
+    size_t len = strlen(src);
+    memcpy(dst, src, len < size ? len : size);
+}
+
+// Read a spilled name back from the heap
+static int readSpilledName(int heapFd, const unsigned char *p, const SlotLayout *l, char *text, size_t nameLen) {
+    long id, prev;
+    size_t len;
+    int type;
+    
+    if(heapRead(heapFd, (long)getU64(p + l->nameAt), &type, &id, &prev, text, &len) != 0 ||
+       type != HEAP_NAME || len != nameLen) {
+        return -1;
+    }
+    return 0;
+}
+
+// Decode a slot written in the given layout; fields it lacks take their
+// defaults
+static int decodeSlot(const unsigned char *p, int layout, Student *s, int heapFd) {
+    const SlotLayout *l = &slotLayouts[layout];
+    const char *department = dictText(heapFd, getField(p, l, FIELD_DEPARTMENT));
+    const char *course = dictText(heapFd, getField(p, l, FIELD_COURSE));
+    unsigned int gpa = getField(p, l, FIELD_GPA);
+    size_t nameLen = p[l->lengthAt] & l->lengthMask;
+    
+    memset(s, 0, sizeof(*s));
+    if(department == NULL || course == NULL || nameLen > sizeof(s->name)) return -1;
+    s->roll_no = (int)getField(p, l, FIELD_ROLL);
+    memcpy(&s->gpa, &gpa, sizeof(gpa));
+    s->year_joined = (int)getField(p, l, FIELD_YEAR);
+    copyText(s->department, sizeof(s->department), department);
+    copyText(s->course, sizeof(s->course), course);
+    
+    if(slotSpilled(p, l)) {
+        char text[HEAP_TEXT_MAX + 1];
+        
+        if(readSpilledName(heapFd, p, l, text, nameLen) != 0) return -1;
+        memcpy(s->name, text, nameLen);
+    } else {
+        memcpy(s->name, p + l->nameAt, nameLen < l->inlineMax ? nameLen : l->inlineMax);
+    }
+    return 0;
+}
+
+// Bring slot `p` from one layout into a newer one at `q`, which starts out
+// zeroed. Each field moves over, or takes its default if the old layout
+// lacks it. The name moves over as it is, or comes back from the heap if
+// it fits in the slot now; the heap record it leaves goes at the next
+// compaction.
+static int upgradeSlot(unsigned char *q, const unsigned char *p, int from, int to, int heapFd) {
+    const SlotLayout *a = &slotLayouts[from], *b = &slotLayouts[to];
+    size_t nameLen = p[a->lengthAt] & a->lengthMask;
+    int spilled = slotSpilled(p, a);
+    char name[HEAP_TEXT_MAX + 1];
+    
+    if(!spilled && nameLen > a->inlineMax) return -1;
+    if(spilled && nameLen <= b->inlineMax) {
+        if(readSpilledName(heapFd, p, a, name, nameLen) != 0) return -1;
+        spilled = 0;
+    } else {
+        memcpy(name, p + a->nameAt, spilled ? 8 : nameLen);
+    }
+    
+    for(int f = 0; f < SLOT_FIELDS; f++) putField(q, b, f, getField(p, a, f));
+    memcpy(q + b->nameAt, name, spilled ? 8 : nameLen);
+    putNameLength(q, b, nameLen, spilled);
+    return 0;
+}
+
+// Bring the slots in use of a page into a newer layout, re-spacing them
+// for its slot size. The page still needs sealing.
+static int upgradePage(unsigned char *page, int layout, int heapFd) {
+    unsigned char slots[DB_PAGE_SIZE - DB_PAGE_HEADER];
+    int from = pageLayout(page);
+    int a = slotLayouts[from].slotSize, b = slotLayouts[layout].slotSize;
+    long used = getU16(page + 8);
+    
+    if(!layoutFits(layout, used)) return -1;
+    memset(slots, 0, sizeof(slots));
+    for(long i = 0; i < used; i++) {
+        if(upgradeSlot(slots + i * b, page + DB_PAGE_HEADER + i * a, from, layout, heapFd) != 0) return -1;
+    }
+    memcpy(page + DB_PAGE_HEADER, slots, sizeof(slots));
+    page[10] = (unsigned char)layout;
+    return 0;
+}
+
+// Data page header: u32 crc of the rest of the page, u32 page number,
+// u16 slots used, u8 slot layout, reserved bytes up to DB_PAGE_HEADER
+static void sealPage(unsigned char *page, long p, long used) {
+    putU32(page + 4, (unsigned int)p);
+    putU16(page + 8, (unsigned int)used);
+    putU32(page, crc32c(page + 4, DB_PAGE_SIZE - 4));
+}
+
+static int pageValid(const unsigned char *page, long p) {
+    return getU32(page + 4) == (unsigned int)p && page[10] <= DB_LAYOUT &&
+           layoutFits(pageLayout(page), getU16(page + 8)) && getU32(page) == crc32c(page + 4, DB_PAGE_SIZE - 4);
+}
+
+// Slot `i` of a page in its own layout
+static unsigned char *pageSlot(unsigned char *page, long i) {
+    return page + DB_PAGE_HEADER + i * slotLayouts[pageLayout(page)].slotSize;
+}
+
+// Decode slots [from, from + n) of a checked page
+static int decodePage(const unsigned char *page, int from, int n, Student *out, int heapFd) {
+    int layout = pageLayout(page), size = slotLayouts[layout].slotSize;
+    
+    for(int i = 0; i < n; i++) {
+        if(decodeSlot(page + DB_PAGE_HEADER + (from + i) * size, layout, &out[i], heapFd) != 0) return -1;
+    }
+    return 0;
+}
+
+// Say once per process that a page failed its checksum. The library keeps
+// quiet: its caller has the terminal, and hears of failures by status.
+static void reportDamage(long p) {
+#ifndef SMS_LIBRARY
+    static int reported = 0;
+    
+    if(!reported) fprintf(stderr, "⚠ Page %ld of %s fails its checksum!\n", p, DB_FILE);
+    reported = 1;
+#else
+    (void)p;
+#endif
+}
+
+// Header page: magic, u32 version, u32 page size, u32 slot size of the
+// layout, u32 slots per page, u32 heap generation, u32 crc of the fields;
+// from version 3, a u32 slot layout and a crc of everything before it. A
+// layout-1 header is written as version 2, which older releases still
+// open. Slots per page never change for the life of a file.
+static int writeHeaderPage(int fd, unsigned int generation, int layout, int perPage) {
+    unsigned char page[DB_PAGE_SIZE];
+    
+    memset(page, 0, sizeof(page));
+    memcpy(page, DB_MAGIC, sizeof(DB_MAGIC));
+    putU32(page + 8, layout > 1 ? DB_VERSION : DB_VERSION_BASE);
+    putU32(page + 12, DB_PAGE_SIZE);
+    putU32(page + 16, (unsigned int)slotLayouts[layout].slotSize);
+    putU32(page + 20, (unsigned int)perPage);
+    putU32(page + 24, generation);
+    putU32(page + 28, crc32c(page, 28));
+    if(layout > 1) {
+        putU32(page + 32, (unsigned int)layout);
+        putU32(page + 36, crc32c(page, 36));
+    }
+    return pwriteAll(fd, page, sizeof(page), 0);
+}
+
+// The pages of a valid header have room for the layout it names
+static int headerValid(const unsigned char *page) {
+    unsigned int version = getU32(page + 8), layout = 1, perPage = getU32(page + 20);
+    
+    if(version == DB_VERSION) {
+        layout = getU32(page + 32);
+        if(getU32(page + 36) != crc32c(page, 36) || layout < 1 || layout > DB_LAYOUT) return 0;
+    } else if(version != DB_VERSION_BASE || perPage != DB_SLOTS_PER_PAGE_BASE) {
+        return 0;
+    }
+    return memcmp(page, DB_MAGIC, sizeof(DB_MAGIC)) == 0 && getU32(page + 28) == crc32c(page, 28) &&
+           getU32(page + 12) == DB_PAGE_SIZE && getU32(page + 16) == (unsigned int)slotLayouts[layout].slotSize &&
+           perPage <= DB_PAGE_SIZE && layoutFits((int)layout, perPage);
+}
+
+// Slot layout of new writes named by a checked header
+static int headerLayout(const unsigned char *page) {
+    return getU32(page + 8) == DB_VERSION ? (int)getU32(page + 32) : 1;
+}
+
+// Whether DB_FILE holds raw records, as releases before the paged format
+// wrote it
+int legacyDatabase() {
+    char magic[sizeof(DB_MAGIC)];
+    FILE *fp = fopen(DB_FILE, "rb");
+    size_t n;
+    
+    if(fp == NULL) return 0;
+    n = countedRead(magic, 1, sizeof(magic), fp);
+    fclose(fp);
+    return n > 0 && (n < sizeof(magic) || memcmp(magic, DB_MAGIC, sizeof(magic)) != 0);
+}
+
+static int dbClose(DbFile *db) {
+    int rc = heapClose(&db->heap);
+    
+    if(db->fd >= 0 && close(db->fd) != 0) rc = -1;
+    db->fd = -1;
+    return rc;
+}
+
+// Read data page `p` and check it
+static int dbReadPage(DbFile *db, long p, unsigned char *page) {
+    if(preadAll(db->fd, page, DB_PAGE_SIZE, (off_t)(p + 1) * DB_PAGE_SIZE) != 0) return -1;
+    if(!pageValid(page, p)) {
+        reportDamage(p);
+        return -1;
+    }
+    return 0;
+}
+
+// Open DB_FILE and its heap for reading (O_RDONLY) or writing (O_RDWR,
+// creating the database if there is none). An empty file is an empty
+// database. Returns 0, -1 if there is no database, or -2 if the file is
+// damaged or not in this format.
+static int dbOpen(DbFile *db, int flags) {
+    unsigned char page[DB_PAGE_SIZE];
+    struct stat st;
+    
+    memset(db, 0, sizeof(*db));
+    db->heap.fd = -1;
+    db->fd = open(DB_FILE, flags == O_RDWR ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if(db->fd < 0) return -1;
+    if(fstat(db->fd, &st) != 0) {
+        dbClose(db);
+        return -2;
+    }
+    
+    if(st.st_size == 0) {
+        // The heap is on disk before the header page that names it
+        db->layout = DB_LAYOUT;
+        db->perPage = newPageSlots(DB_LAYOUT);
+        if(flags != O_RDWR || (heapCreate(&db->heap, 1) == 0 && syncData(db->heap.fd) == 0 &&
+                               writeHeaderPage(db->fd, 1, db->layout, db->perPage) == 0)) {
+            return 0;
+        }
+        dbClose(db);
+        return -2;
+    }
+    
+    if(preadAll(db->fd, page, DB_PAGE_SIZE, 0) != 0 || !headerValid(page) ||
+       heapOpen(&db->heap, getU32(page + 24), flags) != 0) {
+        dbClose(db);
+        return -2;
+    }
+    db->layout = headerLayout(page);
+    db->perPage = (int)getU32(page + 20);
+    db->pages = (long)(st.st_size / DB_PAGE_SIZE) - 1;
+    if(db->pages > 0) {
+        if(dbReadPage(db, db->pages - 1, page) != 0) {
+            dbClose(db);
+            return -2;
+        }
+        db->count = (db->pages - 1) * db->perPage + (long)getU16(page + 8);
+    }
+    return 0;
+}
+
+// Decode slots [first, first + n) of an open DB_FILE
+static int dbRead(DbFile *db, long first, long n, Student *out) {
+    unsigned char page[DB_PAGE_SIZE];
+    
+    while(n > 0) {
+        int from = (int)(first % db->perPage);
+        int k = db->perPage - from < n ? db->perPage - from : (int)n;
+        
+        if(dbReadPage(db, first / db->perPage, page) != 0 ||
+           decodePage(page, from, k, out, db->heap.fd) != 0) {
+            return -1;
+        }
+        first += k;
+        out += k;
+        n -= k;
+    }
+    return 0;
+}
+
+// Map the pages of an open DB_FILE. Returns 0, or -2 if the file cannot
+// be mapped.
+static int mapDatabase(const DbFile *db, DbMap *m) {
+    memset(m, 0, sizeof(*m));
+    m->count = db->count;
+    if(db->count == 0) return 0;
+    
+    m->length = (size_t)(db->pages + 1) * DB_PAGE_SIZE;
+    m->map = mmap(NULL, m->length, PROT_READ, MAP_SHARED, db->fd, 0);
+    if(m->map == MAP_FAILED) {
+        memset(m, 0, sizeof(*m));
+        return -2;
+    }
+    if(m->length >= (size_t)SCAN_SEQUENTIAL_MIN) {
+        madvise(m->map, m->length, MADV_SEQUENTIAL);
+    }
+    m->pages = m->map;
+    return 0;
+}
+
+static void unmapDatabase(DbMap *m) {
+    if(m->map != NULL) munmap(m->map, m->length);
+    memset(m, 0, sizeof(*m));
+}
+
+// Consecutive data pages being changed in memory, written back together
+typedef struct {
+    DbFile *db;
+    unsigned char *pages;   // room for DB_WRITE_PAGES
+    long first;             // page number of pages[0]
+    long n;
+} PageRun;
+
+// Seal the pages of a run and write them with one call
+static int runFlush(PageRun *r) {
+    for(long i = 0; i < r->n; i++) {
+        long p = r->first + i;
+        long used = r->db->count - p * r->db->perPage;
+        
+        sealPage(r->pages + i * DB_PAGE_SIZE, p, used < r->db->perPage ? used : r->db->perPage);
+    }
+    if(r->n > 0 && pwriteAll(r->db->fd, r->pages, (size_t)r->n * DB_PAGE_SIZE,
+                             (off_t)(r->first + 1) * DB_PAGE_SIZE) != 0) {
+        return -1;
+    }
+    if(r->first + r->n > r->db->pages) r->db->pages = r->first + r->n;
+    r->n = 0;
+    return 0;
+}
+
+// The bytes of a slot, brought into the run. The slot may be the one just
+// past the end; its page starts out empty if it is new. A page in an older
+// layout than the database's is upgraded on the way in.
+static unsigned char *runSlot(PageRun *r, long slot) {
+    long p = slot / r->db->perPage;
+    unsigned char *page;
+    
+    if(r->n > 0 && (p < r->first || p > r->first + r->n ||
+                    (p == r->first + r->n && r->n == DB_WRITE_PAGES))) {
+        if(runFlush(r) != 0) return NULL;
+    }
+    if(r->n == 0) r->first = p;
+    
+    page = r->pages + (p - r->first) * DB_PAGE_SIZE;
+    if(p == r->first + r->n) {
+        if(p < r->db->pages) {
+            if(dbReadPage(r->db, p, page) != 0) return NULL;
+            if(pageLayout(page) < r->db->layout && upgradePage(page, r->db->layout, r->db->heap.fd) != 0) {
+                return NULL;
+            }
+        } else {
+            memset(page, 0, DB_PAGE_SIZE);
+            page[10] = (unsigned char)r->db->layout;
+        }
+        r->n++;
+    }
+    return pageSlot(page, slot % r->db->perPage);
+}
+
+// A new data file and heap written front to back, for compaction and
+// migration
+typedef struct {
+    int fd;
+    Heap heap;
+    unsigned char *pages;   // room for DB_WRITE_PAGES
+    long written;           // data pages already written
+    long count;             // slots added
+    int layout;
+    int perPage;
+    int failed;
+} PageStream;
+
+// Start a data file at `path` in a slot layout, with an empty heap of a
+// new generation. The heap takes over the dictionary as this process
+// knows it, ids unchanged.
+static int streamOpen(PageStream *w, const char *path, unsigned int generation, int layout) {
+    memset(w, 0, sizeof(*w));
+    w->heap.fd = -1;
+    w->layout = layout;
+    w->perPage = newPageSlots(layout);
+    w->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    w->pages = malloc((size_t)DB_WRITE_PAGES * DB_PAGE_SIZE);
+    if(w->fd < 0 || w->pages == NULL || heapCreate(&w->heap, generation) != 0 ||
+       writeHeaderPage(w->fd, generation, layout, w->perPage) != 0 || (w->heap.buf = malloc(HEAP_BUFFER)) == NULL) {
+        w->failed = 1;
+        return -1;
+    }
+    
+    pthread_mutex_lock(&dict->lock);
+    if(dictInit() != 0) w->failed = 1;
+    for(long id = 1; id < dict->count && !w->failed; id++) {
+        long offset = heapAppend(&w->heap, HEAP_DICT, id, w->heap.lastDict, dict->text[id], strlen(dict->text[id]));
+        if(offset < 0) w->failed = 1;
+        w->heap.lastDict = offset;
+    }
+    pthread_mutex_unlock(&dict->lock);
+    return w->failed ? -1 : 0;
+}
+
+// Write out the buffered pages; only the last page of a file is partial
+static int streamFlush(PageStream *w) {
+    long n = (w->count - w->written * w->perPage + w->perPage - 1) / w->perPage;
+    
+    for(long k = 0; k < n; k++) {
+        long p = w->written + k;
+        long used = w->count - p * w->perPage;
+        
+        sealPage(w->pages + k * DB_PAGE_SIZE, p, used < w->perPage ? used : w->perPage);
+    }
+    if(n > 0 && pwriteAll(w->fd, w->pages, (size_t)n * DB_PAGE_SIZE, (off_t)(w->written + 1) * DB_PAGE_SIZE) != 0) {
+        w->failed = 1;
+        return -1;
+    }
+    w->written += n;
+    return 0;
+}
+
+static void streamAdd(PageStream *w, const Student *s) {
+    long i = w->count - w->written * w->perPage;
+    unsigned char *page;
+    
+    if(w->failed) return;
+    if(i == (long)DB_WRITE_PAGES * w->perPage) {
+        if(streamFlush(w) != 0) return;
+        i = 0;
+    }
+    
+    page = w->pages + (i / w->perPage) * DB_PAGE_SIZE;
+    if(i % w->perPage == 0) {
+        memset(page, 0, DB_PAGE_SIZE);
+        page[10] = (unsigned char)w->layout;
+    }
+    if(encodeSlot(pageSlot(page, i % w->perPage), w->layout, s, NULL, &w->heap) != 0) {
+        w->failed = 1;
+        return;
+    }
+    w->count++;
+}
+
+// Finish both files and have them on disk. Returns 0, or -1 if anything
+// along the way failed.
+static int streamClose(PageStream *w) {
+    if(!w->failed &&
+       (streamFlush(w) != 0 || heapFlush(&w->heap) != 0 ||
+        heapWriteHeader(w->heap.fd, w->heap.generation, w->heap.lastDict,
+                        __atomic_load_n(&dict->count, __ATOMIC_ACQUIRE)) != 0 ||
+        syncFile(w->heap.fd) != 0 || syncFile(w->fd) != 0)) {
+        w->failed = 1;
+    }
+    if(heapClose(&w->heap) != 0) w->failed = 1;
+    if(w->fd >= 0 && close(w->fd) != 0) w->failed = 1;
+    free(w->pages);
+    w->fd = -1;
+    w->pages = NULL;
+    return w->failed ? -1 : 0;
+}
+
+// ─── Change feed ────────────────────────────────────────────
+
+static off_t feedOffset(long entry) {
+    return FEED_HEADER_SIZE + (off_t)entry * FEED_ENTRY_SIZE;
+}
+
+static void feedEncode(unsigned char *e, long seq, int roll_no) {
+    putU64(e, (unsigned long)seq);
+    putU32(e + 8, (unsigned int)roll_no);
+    putU32(e + 12, crc32c(e, 12));
+}
+
+static int feedDecode(const unsigned char *e, FeedEntry *out) {
+    out->seq = (long)getU64(e);
+    out->roll_no = (int)getU32(e + 8);
+    return getU32(e + 12) == crc32c(e, 12) ? 0 : -1;
+}
+
+// Number of whole entries in an open CHG_FILE, not counting a torn tail a
+// crash left, and the sequence number of the last one (0 for none)
+static long feedEntries(int fd, long *last) {
+    unsigned char h[FEED_HEADER_SIZE], e[FEED_ENTRY_SIZE];
+    FeedEntry entry;
+    struct stat st;
+    long n;
+    
+    *last = 0;
+    if(fstat(fd, &st) != 0 || st.st_size < FEED_HEADER_SIZE || preadAll(fd, h, sizeof(h), 0) != 0 ||
+       memcmp(h, FEED_MAGIC, sizeof(FEED_MAGIC)) != 0) {
+        return 0;
+    }
+    for(n = (long)((st.st_size - FEED_HEADER_SIZE) / FEED_ENTRY_SIZE); n > 0; n--) {
+        if(preadAll(fd, e, sizeof(e), feedOffset(n - 1)) == 0 && feedDecode(e, &entry) == 0) break;
+    }
+    if(n > 0) *last = entry.seq;
+    return n;
+}
+
+// Sequence number of the last transaction committed, 0 before the first
+static long feedLast() {
+    int fd = open(CHG_FILE, O_RDONLY);
+    long last = 0;
+    
+    if(fd >= 0) {
+        feedEntries(fd, &last);
+        close(fd);
+    }
+    return last;
+}
+
+// Record the roll numbers a transaction wrote, negated for deletes, under
+// its sequence number. A transaction the feed already has, replayed from
+// the log, is left out. Call with the writer lock held.
+static int feedAppend(long seq, const int *rolls, long n) {
+    unsigned char *buf;
+    long count, last;
+    int fd, rc = 0;
+    
+    if(n == 0) return 0;
+    fd = open(CHG_FILE, O_RDWR | O_CREAT, 0644);
+    if(fd < 0) return -1;
+    count = feedEntries(fd, &last);
+    
+    if(seq > last) {
+        buf = malloc((size_t)n * FEED_ENTRY_SIZE);
+        if(buf == NULL) {
+            rc = -1;
+        } else {
+            unsigned char h[FEED_HEADER_SIZE];
+            
+            memset(h, 0, sizeof(h));
+            memcpy(h, FEED_MAGIC, sizeof(FEED_MAGIC));
+            for(long i = 0; i < n; i++) feedEncode(buf + i * FEED_ENTRY_SIZE, seq, rolls[i]);
+            if((count == 0 && pwriteAll(fd, h, sizeof(h), 0) != 0) ||
+               pwriteAll(fd, buf, (size_t)n * FEED_ENTRY_SIZE, feedOffset(count)) != 0 ||
+               ftruncate(fd, feedOffset(count + n)) != 0) {
+                rc = -1;
+            }
+            free(buf);
+        }
+    }
+    if(close(fd) != 0) rc = -1;
+    return rc;
+}
+
+// Flush the feed to disk, as a checkpoint does DB_FILE before it empties
+// the log the feed could be rebuilt from
+static int feedSync() {
+    int fd = open(CHG_FILE, O_RDONLY), rc;
+    
+    if(fd < 0) return errno == ENOENT ? 0 : -1;
+    rc = syncData(fd);
+    close(fd);
+    return rc;
+}
+
+// Read the entries after sequence number `since`, found by binary search
+// since the feed is in sequence order. *last gets the newest sequence
+// number. Returns the number of entries put in *out (free it), or -1.
+static long feedRead(long since, FeedEntry **out, long *last) {
+    unsigned char e[FEED_ENTRY_SIZE], *buf = NULL;
+    long lo = 0, hi, n;
+    FeedEntry entry;
+    int fd, failed = 0;
+    
+    *out = NULL;
+    *last = 0;
+    fd = open(CHG_FILE, O_RDONLY);
+    if(fd < 0) return errno == ENOENT ? 0 : -1;
+    hi = feedEntries(fd, last);
+    n = hi;
+    
+    while(lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        
+        if(preadAll(fd, e, sizeof(e), feedOffset(mid)) != 0 || feedDecode(e, &entry) != 0) {
+            failed = 1;
+            break;
+        }
+        if(entry.seq <= since) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    n -= lo;
+    
+    if(!failed && n > 0) {
+        buf = malloc((size_t)n * FEED_ENTRY_SIZE);
+        *out = malloc((size_t)n * sizeof(FeedEntry));
+        if(buf == NULL || *out == NULL || preadAll(fd, buf, (size_t)n * FEED_ENTRY_SIZE, feedOffset(lo)) != 0) {
+            failed = 1;
+        }
+        for(long i = 0; i < n && !failed; i++) {
+            if(feedDecode(buf + i * FEED_ENTRY_SIZE, &(*out)[i]) != 0) failed = 1;
+        }
+    }
+    free(buf);
+    close(fd);
+    if(failed) {
+        free(*out);
+        *out = NULL;
+        return -1;
+    }
+    return n;
+}
+
+// ─── Write-ahead log ────────────────────────────────────────
+
+// Log state of this process
+static struct {
+    int fd;             // WAL_FILE, opened on first write
+    int depth;          // nesting of walBegin() calls
+    int failed;         // a write in the open transaction could not be logged
+    int locked;         // the open transaction holds the writer lock
+    long txn;           // id of the open (or last) transaction
+    long writes;        // writes logged in the open transaction
+    long base;          // end offset of DB_FILE when the transaction began
+    long end;           // end offset once its writes are applied
+    off_t start;        // log offset where the open transaction begins
+    DbFile db;          // DB_FILE, for the before-images of overwritten records
+    DbStamp stamp;      // DB_FILE as the last transaction left it
+    char *buf;          // log records not yet handed to write()
+    size_t len;
+} wal = { .fd = -1, .db = { .fd = -1, .heap = { .fd = -1 } } };
+
+static unsigned int crc32Table[256];
+
+static void crc32Init() {
+    for(unsigned int i = 0; i < 256; i++) {
+        unsigned int c = i;
+        for(int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc32Table[i] = c;
+    }
+}
+
+// CRC-32 (IEEE 802.3 polynomial, as in zlib). The table is built once,
+// however many threads check log records.
+static unsigned int crc32Update(unsigned int crc, const void *data, size_t len) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    const unsigned char *p = data;
+    
+    pthread_once(&once, crc32Init);
+    crc = ~crc;
+    while(len-- > 0) crc = crc32Table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static unsigned int walChecksum(const WalRecord *r) {
+    return crc32Update(0, r, offsetof(WalRecord, crc));
+}
+
+// Write all of buf, retrying short writes
+static int writeAll(int fd, const char *buf, size_t len) {
+    while(len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        metricsAdd(METRIC_BYTES_WRITTEN, n);
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int walOpen() {
+    if(wal.fd >= 0) return 0;
+    
+    if(wal.buf == NULL) {
+        wal.buf = malloc(WAL_BUFFER);
+        if(wal.buf == NULL) return -1;
+    }
+    wal.fd = open(WAL_FILE, O_RDWR | O_CREAT | O_APPEND, 0644);
+    return wal.fd < 0 ? -1 : 0;
+}
+
+static int walFlush() {
+    if(wal.len > 0 && writeAll(wal.fd, wal.buf, wal.len) != 0) return -1;
+    wal.len = 0;
+    return 0;
+}
+
+// Seal a record with its checksum and queue it for the log
+static int walAppend(WalRecord *r) {
+    r->magic = WAL_MAGIC;
+    r->crc = walChecksum(r);
+    
+    if(wal.len + sizeof(*r) > WAL_BUFFER && walFlush() != 0) return -1;
+    memcpy(wal.buf + wal.len, r, sizeof(*r));
+    wal.len += sizeof(*r);
+    return 0;
+}
+
+// Copy the writes of one committed transaction, found between two log
+// offsets, into DB_FILE. Small transactions keep the index and columns
+// patched write by write; large ones leave them to be rebuilt on next use
+// and have runs of adjacent pages written in one call. The statistics
+// block follows every transaction, from the images the writes replace,
+// and the change feed gets the roll numbers written.
+static int walApply(int logFd, off_t start, off_t end, long txn, long writes) {
+    int incremental = writes <= WAL_INCREMENTAL_MAX;
+    WalRecord *recs = malloc(WAL_APPLY_BATCH * sizeof(WalRecord));
+    int *rolls = malloc((size_t)writes * sizeof(int));
+    long changed = 0;
+    StatsBlock stats;
+    FILE *statsFile;
+    PageRun run;
+    DbFile db;
+    int failed = 0;
+    
+    memset(&run, 0, sizeof(run));
+    run.db = &db;
+    run.pages = malloc((size_t)DB_WRITE_PAGES * DB_PAGE_SIZE);
+    if(dbOpen(&db, O_RDWR) != 0 || recs == NULL || rolls == NULL || run.pages == NULL) failed = 1;
+    statsFile = failed ? NULL : statsBegin(&stats);
+    
+    while(!failed && start < end) {
+        size_t want = WAL_APPLY_BATCH * sizeof(WalRecord);
+        ssize_t n;
+        
+        if((off_t)want > end - start) want = (size_t)(end - start);
+        n = pread(logFd, recs, want, start);
+        if(n < (ssize_t)sizeof(WalRecord)) {
+            failed = 1;
+            break;
+        }
+        metricsAdd(METRIC_BYTES_READ, n);
+        n -= n % (ssize_t)sizeof(WalRecord);
+        start += n;
+        
+        for(long i = 0; i < n / (ssize_t)sizeof(WalRecord); i++) {
+            const WalRecord *r = &recs[i];
+            long slot = slotOf(r->offset);
+            DbStamp before, after;
+            unsigned char *p;
+            Student old;
+            
+            if(r->type != WAL_WRITE || r->txn != txn) continue;
+            
+            // Records are rewritten in place or appended, never past the end;
+            // what the slot holds now comes from the page being changed
+            if(incremental) getDbStamp(&before);
+            if(slot > db.count || (p = runSlot(&run, slot)) == NULL ||
+               decodeSlot(p, db.layout, &old, db.heap.fd) != 0 ||
+               encodeSlot(p, db.layout, &r->image, &old, &db.heap) != 0) {
+                failed = 1;
+                break;
+            }
+            if(slot == db.count) db.count++;
+            if(statsFile != NULL) statsApply(&stats, slot, &old, &r->image);
+            if(changed < writes) rolls[changed++] = r->image.roll_no;
+            
+            if(incremental) {
+                int roll_no = r->image.roll_no > 0 ? r->image.roll_no : -r->image.roll_no;
+                
+                if(runFlush(&run) != 0) {
+                    failed = 1;
+                    break;
+                }
+                getDbStamp(&after);
+                indexAfterWrite(&before, &after, roll_no, r->offset, r->op);
+                columnsAfterWrite(&before, &after, slot, &r->image);
+                secondaryAfterWrite(&before, &after, slot, &r->image, &r->before);
+                trigramAfterWrite(&before, &after, slot, &r->image, &r->before);
+            }
+        }
+    }
+    
+    if(!failed && runFlush(&run) != 0) failed = 1;
+    if(!failed && feedAppend(txn, rolls, changed) != 0) failed = 1;
+    if(dbClose(&db) != 0) failed = 1;
+    if(statsFile != NULL) statsEnd(statsFile, &stats, failed);
+    free(recs);
+    free(rolls);
+    free(run.pages);
+    return failed ? -1 : 0;
+}
+
+// Start a transaction, or join the one already open. The writer lock is
+// held until the outermost walCommit(), whose writes reach the disk
+// together with one fdatasync. Its number follows the last one any
+// process committed, as the change feed records.
+void walBegin() {
+    long last;
+    
+    if(wal.depth > 0) {
+        wal.depth++;
+        return;
+    }
+    
+    // Taking the lock may finish another shard's transaction first
+    wal.locked = lockWriter() == 0;
+    wal.depth = 1;
+    wal.failed = !wal.locked || walOpen() != 0;
+    if(wal.locked && (last = feedLast()) > wal.txn) wal.txn = last;
+    wal.txn++;
+    wal.writes = 0;
+    wal.len = 0;
+    wal.start = wal.failed ? 0 : lseek(wal.fd, 0, SEEK_END);
+    if(dbOpen(&wal.db, O_RDONLY) == -2) wal.failed = 1;
+    wal.base = wal.end = wal.db.count * (long)sizeof(Student);
+}
+
+// Leave a transaction. The outermost call appends the commit record, syncs
+// the log, applies the writes to DB_FILE and releases the writer lock; or
+// with `prepared`, appends a WAL_PREPARE record instead and leaves the
+// writes for commitShards(). Returns 0 on success; a transaction with a
+// failed write is discarded as a whole.
+static int walFinish(PreparedTxn *prepared) {
+    WalRecord r;
+    off_t end;
+    long start;
+    int rc = 0;
+    
+    if(wal.depth == 0 || (prepared != NULL && wal.depth > 1)) return -1;
+    if(--wal.depth > 0) return wal.failed ? -1 : 0;
+    start = metricsStart();
+    
+    if(!wal.failed && wal.writes > 0) {
+        memset(&r, 0, sizeof(r));
+        r.type = prepared != NULL ? WAL_PREPARE : WAL_COMMIT;
+        r.txn = wal.txn;
+        r.offset = wal.writes;
+        if(walAppend(&r) != 0 || walFlush() != 0 || syncData(wal.fd) != 0) wal.failed = 1;
+    }
+    
+    if(wal.failed) {
+        // Cut the partial transaction off the log so it is never replayed
+        wal.len = 0;
+        if(wal.fd >= 0 && ftruncate(wal.fd, wal.start) != 0) {
+            close(wal.fd);
+            wal.fd = -1;
+        }
+        rc = -1;
+    } else if(prepared != NULL) {
+        prepared->shard = currentShard;
+        prepared->txn = wal.txn;
+        prepared->start = wal.start;
+        prepared->end = wal.writes > 0 ? lseek(wal.fd, 0, SEEK_END) : wal.start;
+        prepared->writes = wal.writes;
+    } else if(wal.writes > 0) {
+        // Durable from here on; if the copy does not finish, the next
+        // writer or walRecover() replays it from the log
+        end = lseek(wal.fd, 0, SEEK_END);
+        setApplying(wal.start);
+        if(walApply(wal.fd, wal.start, end, wal.txn, wal.writes) == 0) {
+            setApplying(-1);
+            if(end >= WAL_CHECKPOINT_BYTES) walCheckpoint();
+        } else {
+            rc = -1;
+        }
+    }
+    
+    dbClose(&wal.db);
+    getDbStamp(&wal.stamp);
+    if(wal.locked) unlockWriter();
+    wal.locked = 0;
+    metricsEnd(OP_COMMIT, start);
+    return rc;
+}
+
+int walCommit() {
+    return walFinish(NULL);
+}
+
+// Flush DB_FILE and its heap to disk and empty the log. Returns 0, 1 if snapshot
+// readers in other processes still need the log, or -1 on error.
+int walCheckpoint() {
+    DbFile db;
+    int rc = 0;
+    
+    if(wal.depth > 0) return -1;
+    if(wal.fd < 0) {
+        struct stat st;
+        if(stat(WAL_FILE, &st) != 0 || st.st_size == 0) return 0;
+        if(walOpen() != 0) return -1;
+    }
+    if(lockWriter() != 0) return -1;
+    
+    if(lseek(wal.fd, 0, SEEK_END) > 0) {
+        // Our own snapshots would not keep us from the lock
+        if(pinDepth > 0 || lockByte(F_WRLCK, LOCK_PIN, 0) != 0) {
+            rc = 1;
+        } else {
+            long start = metricsStart();
+            
+            if(dbOpen(&db, O_RDONLY) != 0 || (db.heap.fd >= 0 && syncData(db.heap.fd) != 0) ||
+               syncData(db.fd) != 0 || feedSync() != 0 || ftruncate(wal.fd, 0) != 0 ||
+               syncData(wal.fd) != 0) {
+                rc = -1;
+            }
+            dbClose(&db);
+            lockByte(F_UNLCK, LOCK_PIN, 0);
+            metricsEnd(OP_CHECKPOINT, start);
+        }
+    }
+    
+    unlockWriter();
+    return rc;
+}
+
+// Apply every committed transaction found in the log from byte `from` on;
+// a torn or uncommitted tail is ignored. Call with the writer lock held.
+// Returns the number of transactions applied, or -1.
+long walReplay(long from) {
+    WalRecord r;
+    FILE *fp;
+    off_t pos = from, txnStart = from;
+    long txn = 0, writes = 0, replayed = 0;
+    int failed = 0;
+    
+    fp = fopen(WAL_FILE, "rb");
+    if(fp == NULL) return 0;
+    if(fseeko(fp, from, SEEK_SET) != 0) {
+        fclose(fp);
+        return -1;
+    }
+    
+    while(countedRead(&r, sizeof(r), 1, fp) == 1) {
+        if(r.magic != WAL_MAGIC || r.crc != walChecksum(&r)) break;
+        
+        if(r.type == WAL_WRITE) {
+            if(writes == 0 || r.txn != txn) {
+                txn = r.txn;
+                txnStart = pos;
+                writes = 0;
+            }
+            writes++;
+        } else if(r.type == WAL_COMMIT && r.txn == txn && r.offset == writes) {
+            if(walApply(fileno(fp), txnStart, pos, txn, writes) != 0) {
+                failed = 1;
+                break;
+            }
+            replayed++;
+            writes = 0;
+        }
+        
+        if(r.txn > wal.txn) wal.txn = r.txn;
+        pos += (off_t)sizeof(r);
+    }
+    fclose(fp);
+    return failed ? -1 : replayed;
+}
+
+// At startup, replay the committed transactions a crash left in the log
+// and checkpoint. Only a process that finds no other one running replays
+// the whole log; running writers have applied it already, and rewriting
+// their records would confuse snapshot readers.
+int walRecover() {
+    struct stat st;
+    long replayed = 0;
+    int alone;
+    
+    if(lockWriter() != 0) {
+        // No lock file (a read-only directory, say): fine if nothing to do
+        return stat(WAL_FILE, &st) == 0 && st.st_size > 0 ? -1 : 0;
+    }
+    
+    alone = lockByte(F_WRLCK, LOCK_ALIVE, 0) == 0;
+    if(alone) replayed = walReplay(0);
+    lockByte(F_RDLCK, LOCK_ALIVE, 1);
+    
+#ifndef SMS_LIBRARY
+    if(replayed > 0) {
+        printf("✓ Recovered %ld committed transaction(s) from the write-ahead log.\n", replayed);
+    }
+#endif
+    if(alone && replayed >= 0) walCheckpoint();
+    
+    unlockWriter();
+    return replayed < 0 ? -1 : 0;
+}
+
+// Log one record write to DB_FILE at `offset`, or an append when offset < 0,
+// and apply it when no enclosing transaction is open. The index and columns
+// follow the write. Returns the offset written, or -1.
+static long writeStudent(const Student *s, long offset, int op) {
+    WalRecord r;
+    
+    walBegin();
+    if(offset < 0) offset = wal.end;
+    
+    memset(&r, 0, sizeof(r));
+    r.type = WAL_WRITE;
+    r.op = (unsigned short)op;
+    r.txn = wal.txn;
+    r.offset = offset;
+    r.image = *s;
+    
+    // Snapshot readers put this image back to undo the write
+    if(offset < wal.base && dbRead(&wal.db, slotOf(offset), 1, &r.before) != 0) wal.failed = 1;
+    if(!wal.failed && walAppend(&r) != 0) wal.failed = 1;
+    
+    wal.writes++;
+    if(offset + (long)sizeof(Student) > wal.end) wal.end = offset + (long)sizeof(Student);
+    
+    return walCommit() == 0 ? offset : -1;
+}
+
+// ─── Shards ─────────────────────────────────────────────────
+
+static ShardMap shardMap;
+static int scanProcesses = 1;   // shard workers running at once share the CPUs
+
+// The globals naming files a shard has its own of, and what they name in
+// each shard; the other files are shared
+static const char **const shardFiles[SHARD_FILES] = {
+    &DB_FILE, &TEMP_FILE, &IDX_FILE, &COL_FILE, &STR_FILE, &SEC_FILE, &TRI_FILE, &STATS_FILE, &WAL_FILE
+};
+static const char *shardNames[SHARD_MAX][SHARD_FILES];
+static const char *shardBase[SHARD_FILES];     // what they name before any split; NULL until known
+
+// Work done in each shard by fanOutShards(); returns 0 or a negative code
+typedef int (*ShardTask)(void *result, void *ctx);
+
+static int shardTotal() {
+    return shardMap.count > 0 ? shardMap.count : 1;
+}
+
+// Fill in shardNames for a map; the one shard of a table that is not
+// split is the files in the working directory
+static void setShardNames(const ShardMap *map) {
+    static char paths[SHARD_MAX][SHARD_FILES][SHARD_PATH_MAX];
+    
+    if(shardBase[0] == NULL) {
+        for(int i = 0; i < SHARD_FILES; i++) shardBase[i] = *shardFiles[i];
+    }
+    for(int k = 0; k < (map->count > 0 ? map->count : 1); k++) {
+        for(int i = 0; i < SHARD_FILES; i++) {
+            if(map->count == 0) {
+                shardNames[k][i] = shardBase[i];
+                continue;
+            }
+            snprintf(paths[k][i], SHARD_PATH_MAX, "shard%d/%s", k, shardBase[i]);
+            shardNames[k][i] = paths[k][i];
+        }
+    }
+}
+
+// The shard a roll number belongs to
+static int shardOf(int roll_no) {
+    long k;
+    
+    if(shardMap.count == 0) return 0;
+    if(shardMap.mode == SHARD_HASH) {
+        return (int)((((unsigned long)(unsigned int)roll_no * 0x9E3779B97F4A7C15UL) >> 32) % (unsigned long)shardMap.count);
+    }
+    k = roll_no > 0 ? (roll_no - 1L) / shardMap.width : 0;
+    return k < shardMap.count ? (int)k : shardMap.count - 1;
+}
+
+// Make shard k current: point the file globals at its files and switch to
+// its dictionary and log. Returns -1 inside a transaction, which belongs
+// to the shard it began on.
+static int useShard(int k) {
+    if(DB_FILE == shardNames[k][0]) return 0;
+    if(wal.depth > 0) return -1;
+    
+    if(wal.fd >= 0) {
+        close(wal.fd);
+        wal.fd = -1;
+    }
+    memset(&wal.stamp, 0, sizeof(wal.stamp));
+    for(int i = 0; i < SHARD_FILES; i++) *shardFiles[i] = shardNames[k][i];
+    dict = &dicts[k];
+    currentShard = k;
+    return 0;
+}
+
+// Read SHARD_FILE, if there is one, and make shard 0 current. Returns -1
+// if the file is damaged.
+int loadShardMap() {
+    ShardMap map;
+    FILE *in = fopen(SHARD_FILE, "rb");
+    
+    memset(&map, 0, sizeof(map));
+    if(in != NULL) {
+        int ok = countedRead(&map, sizeof(map), 1, in) == 1 &&
+                 memcmp(map.magic, SHARD_MAGIC, sizeof(map.magic)) == 0 &&
+                 map.count >= 1 && map.count <= SHARD_MAX &&
+                 (map.mode == SHARD_HASH || (map.mode == SHARD_RANGE && map.width > 0));
+        
+        fclose(in);
+        if(!ok) return -1;
+    }
+    shardMap = map;
+    setShardNames(&shardMap);
+    useShard(0);
+    return 0;
+}
+
+// walRecover() on every shard. Returns 0, or -1 with the shard whose log
+// could not be replayed left current.
+int recoverShards() {
+    for(int k = 0; k < shardTotal(); k++) {
+        useShard(k);
+        if(walRecover() != 0) return -1;
+    }
+    useShard(0);
+    return 0;
+}
+
+void checkpointShards() {
+    for(int k = 0; k < shardTotal(); k++) {
+        useShard(k);
+        walCheckpoint();
+    }
+    useShard(0);
+}
+
+// Make TXN_FILE name the prepared transactions, durably; once it is
+// renamed into place they are committed
+static int writeIntent(const PreparedTxn *t, int n) {
+    unsigned char buf[TXN_HEADER_SIZE + SHARD_MAX * TXN_ENTRY_SIZE];
+    unsigned char *e = buf + TXN_HEADER_SIZE;
+    char tmpName[256];
+    int fd, failed;
+    
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, TXN_MAGIC, sizeof(TXN_MAGIC));
+    putU32(buf + 8, (unsigned int)n);
+    for(int i = 0; i < n; i++, e += TXN_ENTRY_SIZE) {
+        putU32(e, (unsigned int)t[i].shard);
+        putU64(e + 8, (unsigned long)t[i].txn);
+        putU64(e + 16, (unsigned long)t[i].start);
+        putU64(e + 24, (unsigned long)t[i].end);
+        putU64(e + 32, (unsigned long)t[i].writes);
+    }
+    putU32(buf + 12, crc32c(buf + TXN_HEADER_SIZE, (size_t)n * TXN_ENTRY_SIZE));
+    
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", TXN_FILE);
+    fd = open(tmpName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    failed = fd < 0 || writeAll(fd, (const char *)buf, TXN_HEADER_SIZE + (size_t)n * TXN_ENTRY_SIZE) != 0 ||
+             syncData(fd) != 0;
+    if(fd >= 0 && close(fd) != 0) failed = 1;
+    if(failed || rename(tmpName, TXN_FILE) != 0) {
+        remove(tmpName);
+        return -1;
+    }
+    syncDirectory(TXN_FILE);
+    return 0;
+}
+
+// Read TXN_FILE. Returns the number of transactions it names, 0 if there
+// is none, or -1 if it is damaged.
+static int readIntent(PreparedTxn *t) {
+    unsigned char buf[TXN_HEADER_SIZE + SHARD_MAX * TXN_ENTRY_SIZE];
+    unsigned char *e = buf + TXN_HEADER_SIZE;
+    int fd = open(TXN_FILE, O_RDONLY);
+    ssize_t got;
+    long n;
+    
+    if(fd < 0) return errno == ENOENT ? 0 : -1;
+    got = pread(fd, buf, sizeof(buf), 0);
+    close(fd);
+    if(got < TXN_HEADER_SIZE || memcmp(buf, TXN_MAGIC, sizeof(TXN_MAGIC)) != 0) return -1;
+    n = getU32(buf + 8);
+    if(n < 1 || n > SHARD_MAX || got != TXN_HEADER_SIZE + n * TXN_ENTRY_SIZE ||
+       getU32(buf + 12) != crc32c(e, (size_t)n * TXN_ENTRY_SIZE)) {
+        return -1;
+    }
+    for(long i = 0; i < n; i++, e += TXN_ENTRY_SIZE) {
+        t[i].shard = (int)getU32(e);
+        t[i].txn = (long)getU64(e + 8);
+        t[i].start = (long)getU64(e + 16);
+        t[i].end = (long)getU64(e + 24);
+        t[i].writes = (long)getU64(e + 32);
+        if(t[i].shard >= shardTotal()) return -1;
+    }
+    return (int)n;
+}
+
+// Commit a transaction prepared in the current shard's log: append its
+// commit record unless it has one, and copy its writes into DB_FILE
+// unless the change feed shows that done. Call with the writer lock held.
+static int commitPrepared(const PreparedTxn *t) {
+    WalRecord r;
+    struct stat st;
+    int fd, rc = 0;
+    
+    finishApplying();
+    if(feedLast() >= t->txn) return 0;
+    
+    fd = open(WAL_FILE, O_RDWR | O_APPEND);
+    if(fd < 0 || fstat(fd, &st) != 0) {
+        if(fd >= 0) close(fd);
+        return -1;
+    }
+    if(preadAll(fd, &r, sizeof(r), t->end) != 0 || r.magic != WAL_MAGIC || r.crc != walChecksum(&r) ||
+       r.type != WAL_COMMIT || r.txn != t->txn) {
+        // Nothing may follow the prepared writes but their commit record
+        memset(&r, 0, sizeof(r));
+        r.magic = WAL_MAGIC;
+        r.type = WAL_COMMIT;
+        r.txn = t->txn;
+        r.offset = t->writes;
+        r.crc = walChecksum(&r);
+        if(st.st_size != t->end || writeAll(fd, (const char *)&r, sizeof(r)) != 0 || syncData(fd) != 0) rc = -1;
+    }
+    if(rc == 0) {
+        setApplying(t->start);
+        rc = walApply(fd, t->start, t->end + (off_t)sizeof(r), t->txn, t->writes);
+        if(rc == 0) setApplying(-1);
+    }
+    if(close(fd) != 0) rc = -1;
+    if(rc == 0 && t->end >= WAL_CHECKPOINT_BYTES) walCheckpoint();
+    return rc;
+}
+
+// Finish the transaction spanning shards that TXN_FILE names, if a writer
+// died before it was copied into every shard. Call with the writer lock
+// held; returns 0, or -1 if it could not be finished.
+static int finishCommitting() {
+    PreparedTxn t[SHARD_MAX];
+    int home = currentShard, n, failed = 0;
+    
+    if(shardMap.count == 0) return 0;
+    n = readIntent(t);
+    if(n <= 0) return n;
+    for(int i = 0; i < n && !failed; i++) {
+        useShard(t[i].shard);
+        if(commitPrepared(&t[i]) != 0) failed = 1;
+    }
+    useShard(home);
+    if(failed) return -1;
+    remove(TXN_FILE);
+    syncDirectory(TXN_FILE);
+    return 0;
+}
+
+// Cut prepared transactions off their logs. One left behind is never
+// committed either, as replay skips writes without a commit record.
+static int abortPrepared(const PreparedTxn *t, int n) {
+    int home = currentShard, failed = 0;
+    
+    for(int i = 0; i < n; i++) {
+        useShard(t[i].shard);
+        if(truncate(WAL_FILE, t[i].start) != 0) failed = 1;
+    }
+    useShard(home);
+    return failed ? -1 : 0;
+}
+
+// Commit transactions prepared in several shards' logs, in the order they
+// were prepared, as one: either every shard gets its writes or none does.
+// Writing TXN_FILE is the commit point; if this process dies after it,
+// the next one to take the writer lock finishes the copy. A single shard
+// needs only its commit record. Call with the writer lock held. Returns
+// 0, -1 with nothing committed, or -2 when committed but not yet copied
+// into every shard.
+static int commitShards(const PreparedTxn *t, int n) {
+    int home = currentShard, failed = 0;
+    
+    if(n == 0) return 0;
+    if(n > 1 && writeIntent(t, n) != 0) {
+        abortPrepared(t, n);
+        return -1;
+    }
+    for(int i = 0; i < n && !failed; i++) {
+        useShard(t[i].shard);
+        if(commitPrepared(&t[i]) != 0) failed = 1;
+    }
+    useShard(home);
+    if(failed) return n > 1 ? -2 : -1;
+    if(n > 1) {
+        remove(TXN_FILE);
+        syncDirectory(TXN_FILE);
+    }
+    return 0;
+}
+
+// Read all of len bytes from a pipe; -1 on error or a short read
+static int readFull(int fd, void *buf, size_t len) {
+    char *p = buf;
+    
+    while(len > 0) {
+        ssize_t n = read(fd, p, len);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Fork a worker that runs `task` on shard k and sends back the code it
+// returned, as a long, then its result, through the pipe left in *fd
+static pid_t startShardWorker(int k, ShardTask task, void *ctx, size_t size, int *fd) {
+    long *out;
+    int p[2];
+    pid_t pid;
+    
+    if(pipe(p) != 0) return -1;
+    pid = fork();
+    if(pid != 0) {
+        close(p[1]);
+        if(pid < 0) close(p[0]);
+        *fd = p[0];
+        return pid;
+    }
+    
+    // What the parent measured and pinned stays the parent's
+    close(p[0]);
+    memset(&metrics, 0, sizeof(metrics));
+    pinDepth = 0;
+    useShard(k);
+    out = calloc(1, sizeof(long) + size);
+    if(out != NULL) {
+        out[0] = task(out + 1, ctx);
+        writeAll(p[1], (const char *)out, sizeof(long) + size);
+    }
+    metricsFlush();
+    _exit(0);
+}
+
+// Run `task` on every shard, leaving shard k's `size`-byte result at
+// results + k * size. The dictionary, log and locks belong to a process,
+// so each shard gets a worker process of its own, at most one per CPU at
+// a time. One shard, or a caller holding the writer lock (which the
+// workers would wait for), runs the shards here in turn. Returns 0, or
+// the lowest code the task returned on any shard; -1 if a worker failed.
+static int fanOutShards(ShardTask task, void *ctx, void *results, size_t size) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int total = shardTotal(), started = 0, failed = 0;
+    pid_t pids[SHARD_MAX];
+    int fds[SHARD_MAX];
+    
+    if(total == 1 || writerDepth > 0) {
+        for(int k = 0; k < total; k++) {
+            int rc;
+            
+            useShard(k);
+            rc = task((char *)results + (size_t)k * size, ctx);
+            if(rc < failed) failed = rc;
+        }
+        useShard(0);
+        return failed;
+    }
+    
+    // Output still buffered would be written again by every worker
+    fflush(stdout);
+    fflush(stderr);
+    if(cpus < 1) cpus = 1;
+    scanProcesses = total < cpus ? total : (int)cpus;
+    for(int k = 0; k < total; k++) {
+        long rc = -1;
+        
+        while(started < total && started < k + cpus) {
+            pids[started] = startShardWorker(started, task, ctx, size, &fds[started]);
+            started++;
+        }
+        if(pids[k] < 0) {
+            if(failed == 0) failed = -1;
+            continue;
+        }
+        if(readFull(fds[k], &rc, sizeof(rc)) != 0 || readFull(fds[k], (char *)results + (size_t)k * size, size) != 0) {
+            rc = -1;
+        }
+        if(rc < failed) failed = (int)rc;
+        close(fds[k]);
+        while(waitpid(pids[k], NULL, 0) < 0 && errno == EINTR);
+    }
+    scanProcesses = 1;
+    return failed;
+}
+
+// scanDatabase() on each shard in turn; offsets are within the shard.
+// Returns the number visited, -1 if there is no database or -2 if a shard
+// could not be read, which ends the scan.
+long scanShards(int mode, RecordVisitor visit, void *ctx) {
+    long visited = -1;
+    
+    for(int k = 0; k < shardTotal() && visited != -2; k++) {
+        long n;
+        
+        useShard(k);
+        n = scanDatabase(mode, visit, ctx);
+        if(n >= 0) visited = (visited < 0 ? 0 : visited) + n;
+        if(n == -2) visited = -2;
+    }
+    useShard(0);
+    return visited;
+}
+
+static int shardStats(void *result, void *ctx) {
+    (void)ctx;
+    return readStats(result) == 0 ? 0 : rebuildStats(result);
+}
+
+// A shard list that deletes have cut short only vouches for the records
+// down to its last entry, so merged entries ranking after that go
+static void extremesTrim(StatsEntry *list, long *n, const StatsEntry *last, long base, int high) {
+    while(*n > 0 && ranksBefore(last->gpa, last->slot + base, &list[*n - 1], high)) (*n)--;
+}
+
+// Statistics of the whole table: every shard's block, merged. Only
+// rebuilding a block takes long enough to be worth a process, so the
+// shards are fanned out only when one is stale. Returns -1 if there is no
+// database or -2 if a shard could not be read.
+int databaseStats(StatsBlock *b) {
+    int total = shardTotal(), stale = 0, rc = 0;
+    long start;
+    StatsBlock *blocks;
+    
+    if(total == 1) return loadStats(b);
+    start = metricsStart();
+    blocks = malloc((size_t)total * sizeof(StatsBlock));
+    for(int k = 0; k < total && blocks != NULL && !stale; k++) {
+        useShard(k);
+        stale = readStats(&blocks[k]) != 0;
+    }
+    useShard(0);
+    if(blocks == NULL) return -1;
+    if(stale) rc = fanOutShards(shardStats, NULL, blocks, sizeof(StatsBlock));
+    if(rc != 0) {
+        free(blocks);
+        return rc;
+    }
+    
+    memset(b, 0, sizeof(*b));
+    memcpy(b->magic, STATS_MAGIC, sizeof(b->magic));
+    for(int k = 0; k < total; k++) statsMerge(b, &blocks[k], (long)k << 40);
+    for(int k = 0; k < total; k++) {
+        const StatsBlock *s = &blocks[k];
+        long base = (long)k << 40;
+        
+        if(s->highCount > 0 && s->highCount < s->count && s->highCount < STATS_EXTREMES) {
+            extremesTrim(b->high, &b->highCount, &s->high[s->highCount - 1], base, 1);
+        }
+        if(s->lowCount > 0 && s->lowCount < s->count && s->lowCount < STATS_EXTREMES) {
+            extremesTrim(b->low, &b->lowCount, &s->low[s->lowCount - 1], base, 0);
+        }
+    }
+    free(blocks);
+    metricsEnd(OP_STATISTICS, start);
+    return 0;
+}
+
+// verifyShardStats() on every shard; the drift found is added up. A
+// shard that could not be read makes the result -2.
+int verifyStats() {
+    int drift = -1, failed = 0;
+    
+    for(int k = 0; k < shardTotal(); k++) {
+        int n;
+        
+        useShard(k);
+        n = verifyShardStats();
+        if(n >= 0) drift = (drift < 0 ? 0 : drift) + n;
+        if(n == -2) failed = 1;
+    }
+    useShard(0);
+    return failed ? -2 : drift;
+}
+
+// ─── Snapshot reads ─────────────────────────────────────────
+
+// Remember the image a slot had when the snapshot was taken; only the
+// first later change to each slot counts
+static int undoAdd(Snapshot *snap, long slot, const Student *before) {
+    long mask, i;
+    
+    if((snap->undoCount + 1) * 2 > snap->undoHashCap) {
+        long cap = snap->undoHashCap ? snap->undoHashCap * 2 : UNDO_MIN_CAPACITY;
+        long *hash = malloc((size_t)cap * sizeof(long));
+        long *slots;
+        Student *images;
+        
+        if(hash == NULL) return -1;
+        slots = realloc(snap->undoSlots, (size_t)(cap / 2) * sizeof(long));
+        if(slots != NULL) snap->undoSlots = slots;
+        images = slots ? realloc(snap->undoImages, (size_t)(cap / 2) * sizeof(Student)) : NULL;
+        if(images == NULL) {
+            free(hash);
+            return -1;
+        }
+        snap->undoImages = images;
+        
+        for(i = 0; i < cap; i++) hash[i] = -1;
+        for(long e = 0; e < snap->undoCount; e++) {
+            i = hashSlot((int)snap->undoSlots[e], cap);
+            while(hash[i] >= 0) i = (i + 1) & (cap - 1);
+            hash[i] = e;
+        }
+        free(snap->undoHash);
+        snap->undoHash = hash;
+        snap->undoHashCap = cap;
+    }
+    
+    mask = snap->undoHashCap - 1;
+    for(i = hashSlot((int)slot, snap->undoHashCap); snap->undoHash[i] >= 0; i = (i + 1) & mask) {
+        if(snap->undoSlots[snap->undoHash[i]] == slot) return 0;
+    }
+    snap->undoHash[i] = snap->undoCount;
+    snap->undoSlots[snap->undoCount] = slot;
+    snap->undoImages[snap->undoCount++] = *before;
+    return 0;
+}
+
+// Collect the before-images of log records appended since the last call.
+// A record still being written ends the pass; the next call picks it up.
+static void snapshotCatchUp(Snapshot *snap) {
+    WalRecord recs[SNAPSHOT_LOG_BATCH];
+    
+    if(snap->walFd < 0) {
+        // There was no log when the snapshot was taken
+        snap->walFd = open(WAL_FILE, O_RDONLY);
+        snap->walSeen = 0;
+        if(snap->walFd < 0) return;
+    }
+    
+    for(;;) {
+        ssize_t n = pread(snap->walFd, recs, sizeof(recs), snap->walSeen);
+        if(n < (ssize_t)sizeof(WalRecord)) return;
+        metricsAdd(METRIC_BYTES_READ, n);
+        
+        for(long k = 0; k < n / (ssize_t)sizeof(WalRecord); k++) {
+            const WalRecord *r = &recs[k];
+            
+            if(r->magic != WAL_MAGIC || r->crc != walChecksum(r)) return;
+            if(r->type == WAL_WRITE && r->offset < snap->count * (long)sizeof(Student) &&
+               undoAdd(snap, r->offset / (long)sizeof(Student), &r->before) != 0) {
+                return;
+            }
+            snap->walSeen += (long)sizeof(WalRecord);
+        }
+    }
+}
+
+// Hold writers off with the shared writer lock at a moment when no
+// transaction is half copied into the current shard, or into any shard if
+// `all` is set; one whose writer died is finished first. Returns 1 with
+// the lock held, or 0 if it could not be had.
+static int holdWriters(int all) {
+    int home = currentShard;
+    int first = all ? 0 : home, last = all ? shardTotal() - 1 : home;
+    
+    while(lockByte(F_RDLCK, LOCK_WRITER, 1) == 0) {
+        int busy = -1;
+        
+        for(int k = first; k <= last && busy < 0; k++) {
+            useShard(k);
+            if(applyingFrom() >= 0) busy = k;
+        }
+        if(busy < 0 && shardMap.count > 0 && access(TXN_FILE, F_OK) == 0) busy = home;
+        if(busy < 0) {
+            useShard(home);
+            return 1;
+        }
+        lockByte(F_UNLCK, LOCK_WRITER, 0);
+        if(lockWriter() != 0) break;
+        unlockWriter();
+    }
+    useShard(home);
+    return 0;
+}
+
+static void snapshotInit(Snapshot *snap) {
+    memset(snap, 0, sizeof(*snap));
+    snap->db.fd = snap->db.heap.fd = snap->walFd = -1;
+    snap->exclusive = writerDepth > 0;
+    pthread_mutex_init(&snap->lock, NULL);
+}
+
+// Open the current shard's files for a snapshot while writers are held off
+static int snapshotAttach(Snapshot *snap, int shared) {
+    struct stat st;
+    
+    // The lock is the process's, so it is only dropped with the last pin
+    if(shared) snap->pinned = pinDepth > 0 || lockByte(F_RDLCK, LOCK_PIN, 1) == 0;
+    if(snap->pinned) pinDepth++;
+    
+    // Every change from here on is in the log past walSeen
+    snap->walFd = open(WAL_FILE, O_RDONLY);
+    if(snap->walFd >= 0 && fstat(snap->walFd, &st) == 0) snap->walSeen = (long)st.st_size;
+    getDbStamp(&snap->stamp);
+    snap->seq = feedLast();
+    return dbOpen(&snap->db, O_RDONLY);
+}
+
+static void snapshotMap(Snapshot *snap) {
+    snap->count = snap->db.count;
+    
+    // Without a mapping, pages are read instead
+    mapDatabase(&snap->db, &snap->map);
+}
+
+// Take a consistent view of DB_FILE as it is now. Writers are held off only
+// while the files are opened; a transaction being applied is waited for,
+// and one whose writer died is finished first. Returns 0, or -1 if there is
+// no database.
+int snapshotOpen(Snapshot *snap) {
+    int shared = 0, rc;
+    
+    snapshotInit(snap);
+    if(!snap->exclusive && openLockFile() == 0) shared = holdWriters(0);
+    rc = snapshotAttach(snap, shared);
+    if(shared) lockByte(F_UNLCK, LOCK_WRITER, 0);
+    
+    if(rc != 0) {
+        snapshotClose(snap);
+        return -1;
+    }
+    snapshotMap(snap);
+    return 0;
+}
+
+// snapshotOpen() on every shard at the same moment, into snaps[k] for
+// shard k; scan each with its shard current. Returns 0, or -1 with none
+// open if a shard has no database.
+int snapshotOpenShards(Snapshot *snaps) {
+    int shared = 0, failed = 0;
+    
+    if(writerDepth == 0 && openLockFile() == 0) shared = holdWriters(1);
+    for(int k = 0; k < shardTotal(); k++) {
+        useShard(k);
+        snapshotInit(&snaps[k]);
+        if(snapshotAttach(&snaps[k], shared) != 0) failed = 1;
+    }
+    useShard(0);
+    if(shared) lockByte(F_UNLCK, LOCK_WRITER, 0);
+    
+    for(int k = 0; k < shardTotal(); k++) {
+        if(failed) {
+            snapshotClose(&snaps[k]);
+        } else {
+            snapshotMap(&snaps[k]);
+        }
+    }
+    return failed ? -1 : 0;
+}
+
+// Undo, in a copy of snapshot records [first, first + n), every change
+// made to them after the snapshot was taken
+void snapshotFix(Snapshot *snap, Student *records, long first, long n) {
+    if(snap->exclusive) return;
+    
+    pthread_mutex_lock(&snap->lock);
+    snapshotCatchUp(snap);
+    for(long e = 0; e < snap->undoCount; e++) {
+        long slot = snap->undoSlots[e];
+        if(slot >= first && slot < first + n) records[slot - first] = snap->undoImages[e];
+    }
+    pthread_mutex_unlock(&snap->lock);
+}
+
+// Like snapshotFix(), for copies of the snapshot records at the given slots
+void snapshotFixSlots(Snapshot *snap, Student *records, const long *slots, long n) {
+    if(snap->exclusive) return;
+    
+    pthread_mutex_lock(&snap->lock);
+    snapshotCatchUp(snap);
+    for(long k = 0; k < n && snap->undoCount > 0; k++) {
+        long mask = snap->undoHashCap - 1;
+        
+        for(long i = hashSlot((int)slots[k], snap->undoHashCap); snap->undoHash[i] >= 0; i = (i + 1) & mask) {
+            if(snap->undoSlots[snap->undoHash[i]] == slots[k]) {
+                records[k] = snap->undoImages[snap->undoHash[i]];
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&snap->lock);
+}
+
+void snapshotClose(Snapshot *snap) {
+    unmapDatabase(&snap->map);
+    dbClose(&snap->db);
+    if(snap->walFd >= 0) close(snap->walFd);
+    if(snap->pinned && --pinDepth == 0) lockByte(F_UNLCK, LOCK_PIN, 0);
+    free(snap->undoSlots);
+    free(snap->undoImages);
+    free(snap->undoHash);
+    pthread_mutex_destroy(&snap->lock);
+    memset(snap, 0, sizeof(*snap));
+    snap->db.fd = snap->db.heap.fd = snap->walFd = -1;
+}
+
+// A checked data page of the snapshot, copied into `buf` unless nothing
+// can change it. A page only fails its check while another process is
+// rewriting it, so it is read again under the shared writer lock before
+// it counts as damaged; the slots that were changing are corrected from
+// the log afterwards.
+static const unsigned char *snapshotPage(Snapshot *snap, long p, unsigned char *buf) {
+    static pthread_mutex_t retry = PTHREAD_MUTEX_INITIALIZER;
+    off_t pos = (off_t)(p + 1) * DB_PAGE_SIZE;
+    int locked = 0, ok;
+    
+    // Pages read through the mapping count as read too
+    if(snap->map.map != NULL && snap->exclusive) {
+        const unsigned char *page = snap->map.pages + pos;
+        metricsAdd(METRIC_BYTES_READ, DB_PAGE_SIZE);
+        if(pageValid(page, p)) return page;
+        reportDamage(p);
+        return NULL;
+    }
+    if(snap->map.map != NULL) {
+        memcpy(buf, snap->map.pages + pos, DB_PAGE_SIZE);
+        metricsAdd(METRIC_BYTES_READ, DB_PAGE_SIZE);
+    } else if(preadAll(snap->db.fd, buf, DB_PAGE_SIZE, pos) != 0) {
+        return NULL;
+    }
+    if(pageValid(buf, p)) return buf;
+    
+    pthread_mutex_lock(&retry);
+    if(!snap->exclusive && openLockFile() == 0) locked = lockByte(F_RDLCK, LOCK_WRITER, 1) == 0;
+    ok = preadAll(snap->db.fd, buf, DB_PAGE_SIZE, pos) == 0 && pageValid(buf, p);
+    if(locked) lockByte(F_UNLCK, LOCK_WRITER, 0);
+    pthread_mutex_unlock(&retry);
+    
+    if(!ok) {
+        reportDamage(p);
+        return NULL;
+    }
+    return buf;
+}
+
+// Decode snapshot slots [first, first + n) into `out` as they were when
+// the snapshot was taken. Returns 0, or -1 if a page cannot be read.
+int snapshotRead(Snapshot *snap, long first, long n, Student *out) {
+    unsigned char buf[DB_PAGE_SIZE];
+    
+    for(long done = 0; done < n; ) {
+        long slot = first + done;
+        int perPage = snap->db.perPage;
+        int from = (int)(slot % perPage);
+        int k = perPage - from < n - done ? perPage - from : (int)(n - done);
+        const unsigned char *page = snapshotPage(snap, slot / perPage, buf);
+        
+        if(page == NULL || decodePage(page, from, k, out + done, snap->db.heap.fd) != 0) return -1;
+        done += k;
+    }
+    snapshotFix(snap, out, first, n);
+    metricsAdd(METRIC_RECORDS_SCANNED, n);
+    return 0;
+}
+
+// Like snapshotRead(), for the slots listed; slots past the end read as empty
+int snapshotReadSlots(Snapshot *snap, const long *slots, long n, Student *out) {
+    unsigned char buf[DB_PAGE_SIZE];
+    const unsigned char *page = NULL;
+    long current = -1;
+    
+    for(long i = 0; i < n; i++) {
+        long p;
+        
+        if(slots[i] >= snap->count) {
+            memset(&out[i], 0, sizeof(Student));
+            continue;
+        }
+        p = slots[i] / snap->db.perPage;
+        if(p != current) {
+            page = snapshotPage(snap, p, buf);
+            current = p;
+        }
+        if(page == NULL ||
+           decodePage(page, (int)(slots[i] % snap->db.perPage), 1, &out[i], snap->db.heap.fd) != 0) {
+            return -1;
+        }
+    }
+    snapshotFixSlots(snap, out, slots, n);
+    metricsAdd(METRIC_RECORDS_SCANNED, n);
+    return 0;
+}
+
+// ─── Scan pipeline ──────────────────────────────────────────
+
+// A full-table scan in two stages. A reader thread decodes batches of
+// SCAN_BATCH records into a ring of buffers, up to SCAN_READ_AHEAD
+// batches ahead of the consumers, which take them in order as they come
+// free. Batches of an array already in memory skip the reader.
+typedef struct {
+    Snapshot *snap;
+    const Student *records;
+    long count;
+    long nbatches;
+    BatchVisitor visit;
+    Student *ring[SCAN_MAX_CONSUMERS + SCAN_READ_AHEAD];
+    int full[SCAN_MAX_CONSUMERS + SCAN_READ_AHEAD];    // decoded, not yet consumed
+    int depth;                  // buffers in the ring
+    long decoded;               // batches the reader has finished
+    long claimed;               // batches handed to consumers
+    int stopped;                // a visitor asked to stop, or a read failed
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;       // a batch was decoded, or the scan ended
+    pthread_cond_t freed;       // a buffer came free, or the scan ended
+} ScanPipeline;
+
+typedef struct {
+    ScanPipeline *p;
+    void *ctx;
+} ScanConsumer;
+
+// Number of consumer threads for a CPU-bound scan; SMS_SCAN_THREADS overrides
+int scanThreads() {
+    const char *env = getenv("SMS_SCAN_THREADS");
+    long n = env != NULL ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN) / scanProcesses;
+    
+    if(n < 1) n = 1;
+    if(n > SCAN_MAX_CONSUMERS) n = SCAN_MAX_CONSUMERS;
+    return (int)n;
+}
+
+static long batchLength(const ScanPipeline *p, long b) {
+    return p->count - b * SCAN_BATCH < SCAN_BATCH ? p->count - b * SCAN_BATCH : SCAN_BATCH;
+}
+
+static void *pipelineReader(void *arg) {
+    ScanPipeline *p = arg;
+    
+    for(long b = 0; b < p->nbatches; b++) {
+        int slot = (int)(b % p->depth), failed;
+        
+        pthread_mutex_lock(&p->lock);
+        while(p->full[slot] && !p->stopped) pthread_cond_wait(&p->freed, &p->lock);
+        failed = p->stopped;
+        pthread_mutex_unlock(&p->lock);
+        if(failed) break;
+        
+        failed = snapshotRead(p->snap, b * SCAN_BATCH, batchLength(p, b), p->ring[slot]) != 0;
+        
+        pthread_mutex_lock(&p->lock);
+        if(failed) {
+            p->failed = p->stopped = 1;
+        } else {
+            p->full[slot] = 1;
+            p->decoded++;
+        }
+        pthread_cond_broadcast(&p->ready);
+        pthread_mutex_unlock(&p->lock);
+        if(failed) break;
+    }
+    return NULL;
+}
+
+// Take batches and visit them until there are none left or the scan stops
+static void *pipelineConsumer(void *arg) {
+    ScanConsumer *c = arg;
+    ScanPipeline *p = c->p;
+    
+    for(;;) {
+        const Student *batch;
+        long b;
+        int stop;
+        
+        pthread_mutex_lock(&p->lock);
+        while(!p->stopped && p->claimed < p->nbatches && p->records == NULL && p->claimed >= p->decoded) {
+            pthread_cond_wait(&p->ready, &p->lock);
+        }
+        if(p->stopped || p->claimed >= p->nbatches) {
+            pthread_mutex_unlock(&p->lock);
+            return NULL;
+        }
+        b = p->claimed++;
+        pthread_mutex_unlock(&p->lock);
+        
+        batch = p->records != NULL ? p->records + b * SCAN_BATCH : p->ring[b % p->depth];
+        stop = p->visit(batch, b * SCAN_BATCH, batchLength(p, b), c->ctx);
+        
+        pthread_mutex_lock(&p->lock);
+        if(p->records == NULL) p->full[b % p->depth] = 0;
+        if(stop) {
+            p->stopped = 1;
+            pthread_cond_broadcast(&p->ready);
+        }
+        pthread_cond_broadcast(&p->freed);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+// Run `visit` over the records of a snapshot, or of an array when `snap`
+// is NULL, a batch at a time on `consumers` threads, the calling thread
+// among them; each consumer has its own context from `ctxs`. While they
+// work, the snapshot's next batches are read and decoded, so I/O and
+// processing overlap. With one consumer the batches come in file order.
+// Returns 0, 1 if a visitor stopped the scan, or -1 if a page could not
+// be read.
+int scanPipeline(Snapshot *snap, const Student *records, long count, BatchVisitor visit, void **ctxs, int consumers) {
+    ScanConsumer args[SCAN_MAX_CONSUMERS];
+    pthread_t reader, threads[SCAN_MAX_CONSUMERS];
+    ScanPipeline p;
+    int started = 0, rc = 0;
+    
+    memset(&p, 0, sizeof(p));
+    p.snap = snap;
+    p.records = snap != NULL ? NULL : records;
+    p.count = count;
+    p.nbatches = (count + SCAN_BATCH - 1) / SCAN_BATCH;
+    p.visit = visit;
+    if(p.nbatches == 0) return 0;
+    if(consumers > p.nbatches) consumers = (int)p.nbatches;
+    if(consumers > SCAN_MAX_CONSUMERS) consumers = SCAN_MAX_CONSUMERS;
+    
+    // A single batch is read in line
+    if(snap != NULL && p.nbatches == 1) {
+        Student *batch = malloc((size_t)count * sizeof(Student));
+        
+        if(batch == NULL || snapshotRead(snap, 0, count, batch) != 0) {
+            rc = -1;
+        } else {
+            rc = visit(batch, 0, count, ctxs[0]) ? 1 : 0;
+        }
+        free(batch);
+        return rc;
+    }
+    
+    if(snap != NULL) {
+        p.depth = consumers + SCAN_READ_AHEAD;
+        for(int i = 0; i < p.depth; i++) {
+            p.ring[i] = malloc(SCAN_BATCH * sizeof(Student));
+            if(p.ring[i] == NULL) rc = -1;
+        }
+    }
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.ready, NULL);
+    pthread_cond_init(&p.freed, NULL);
+    if(rc == 0 && snap != NULL && pthread_create(&reader, NULL, pipelineReader, &p) != 0) rc = -1;
+    
+    if(rc == 0) {
+        for(int t = 0; t < consumers; t++) {
+            args[t].p = &p;
+            args[t].ctx = ctxs[t];
+        }
+        for(int t = 1; t < consumers; t++) {
+            if(pthread_create(&threads[started], NULL, pipelineConsumer, &args[t]) == 0) started++;
+        }
+        pipelineConsumer(&args[0]);
+        for(int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+        if(snap != NULL) pthread_join(reader, NULL);
+        rc = p.failed ? -1 : p.stopped ? 1 : 0;
+    }
+    
+    for(int i = 0; i < p.depth; i++) free(p.ring[i]);
+    pthread_mutex_destroy(&p.lock);
+    pthread_cond_destroy(&p.ready);
+    pthread_cond_destroy(&p.freed);
+    return rc;
+}
+
+typedef struct {
+    int mode;
+    RecordVisitor visit;
+    void *ctx;
+    long visited;
+} RecordScan;
+
+static int visitBatch(const Student *batch, long first, long n, void *ctx) {
+    RecordScan *rs = ctx;
+    
+    for(long i = 0; i < n; i++) {
+        if(rs->mode == SCAN_LIVE && !IS_LIVE(batch[i])) continue;
+        rs->visited++;
+        if(rs->visit(&batch[i], (first + i) * (long)sizeof(Student), rs->ctx)) return 1;
+    }
+    return 0;
+}
+
+// Call `visit` for every record of a snapshot in file order (SCAN_ALL) or
+// for live records only (SCAN_LIVE). Records are decoded a batch at a
+// time, ahead of the visitor on the pipeline's reader, and corrected
+// before they are visited. Returns the number visited, or -1.
+long scanSnapshot(Snapshot *snap, int mode, RecordVisitor visit, void *ctx) {
+    RecordScan rs = { mode, visit, ctx, 0 };
+    void *ctxs[1] = { &rs };
+    long start = metricsStart();
+    int rc = scanPipeline(snap, NULL, snap->count, visitBatch, ctxs, 1);
+    
+    metricsEnd(OP_SCAN, start);
+    return rc < 0 ? -1 : rs.visited;
+}
+
+// Call `visit` for every record of DB_FILE (see scanSnapshot()) as of the
+// start of the scan. Returns the number visited, -1 if there is no
+// database or -2 if a record could not be read.
+long scanDatabase(int mode, RecordVisitor visit, void *ctx) {
+    Snapshot snap;
+    long visited;
+    
+    if(snapshotOpen(&snap) != 0) return -1;
+    visited = scanSnapshot(&snap, mode, visit, ctx);
+    snapshotClose(&snap);
+    return visited < 0 ? -2 : visited;
+}
+
+// Read the record stored at a byte offset of DB_FILE
+static int readStudentAt(long offset, Student *out) {
+    DbFile db;
+    int locked = 0, ok;
+    
+    // Never read a record while another process is writing it
+    if(writerDepth == 0 && openLockFile() == 0) locked = lockByte(F_RDLCK, LOCK_WRITER, 1) == 0;
+    
+    ok = dbOpen(&db, O_RDONLY) == 0 && slotOf(offset) < db.count && dbRead(&db, slotOf(offset), 1, out) == 0;
+    dbClose(&db);
+    
+    if(locked) lockByte(F_UNLCK, LOCK_WRITER, 0);
+    return ok;
+}
+
+// Find a student through the index of its shard, which is made current.
+// Returns the record offset, or -1. A record that does not match its index
+// entry forces one rebuild.
+long findStudent(int roll_no, Student *out) {
+    long start = metricsStart(), offset = -1;
+    Student s;
+    
+    if(useShard(shardOf(roll_no)) != 0) return -1;
+    for(int attempt = 0; attempt < 2; attempt++) {
+        offset = indexLookup(roll_no);
+        if(offset < 0) break;
+        
+        metricsAdd(METRIC_LOOKUP_RECORDS, 1);
+        if(readStudentAt(offset, &s) && s.roll_no == roll_no) {
+            if(out) *out = s;
+            break;
+        }
+        offset = -1;
+        rebuildIndex();
+    }
+    metricsEnd(OP_LOOKUP, start);
+    return offset;
+}
+
+// Check for duplicate roll number
+int isDuplicate(int roll_no) {
+    return findStudent(roll_no, NULL) >= 0;
+}
+
+// Store a new student, reusing a deleted record's slot when one is free.
+// Another user may have taken the roll number since it was checked, so it
+// is checked again under the writer lock. Returns the record offset, -1 on
+// error or -2 if the roll number is taken.
+long addStudentRecord(const Student *s) {
+    long start = metricsStart(), offset = -1;
+    int taken;
+    
+    if(useShard(shardOf(s->roll_no)) != 0) return -1;
+    walBegin();
+    taken = isDuplicate(s->roll_no);
+    if(!taken) {
+        offset = peekFreeSlot();
+        if(offset >= 0) {
+            offset = writeStudent(s, offset, INDEX_REUSE);
+        } else {
+            offset = writeStudent(s, -1, INDEX_PUT);
+        }
+    }
+    if(walCommit() != 0) offset = -1;
+    metricsEnd(OP_ADD, start);
+    return taken ? -2 : offset;
+}
+
+// Write a student's new details over its record, found again under the
+// writer lock: a compaction may have moved it. Returns the offset, or -1.
+long updateStudentRecord(const Student *s) {
+    long start = metricsStart(), pos;
+    
+    if(useShard(shardOf(s->roll_no)) != 0) return -1;
+    walBegin();
+    pos = findStudent(s->roll_no, NULL);
+    if(pos >= 0) pos = writeStudent(s, pos, INDEX_PUT);
+    if(walCommit() != 0) pos = -1;
+    metricsEnd(OP_UPDATE, start);
+    return pos;
+}
+
+// Tombstone a student's record in place; its slot goes on the free list.
+// Only its shard is compacted. Returns the offset it had, or -1.
+long deleteStudentRecord(int roll_no) {
+    long start = metricsStart(), pos;
+    Student s;
+    
+    if(useShard(shardOf(roll_no)) != 0) return -1;
+    walBegin();
+    pos = findStudent(roll_no, &s);
+    s.roll_no = -roll_no;
+    if(pos >= 0) pos = writeStudent(&s, pos, INDEX_REMOVE);
+    if(walCommit() != 0) pos = -1;
+    
+    // Reclaim space once enough of the file is dead
+    if(pos >= 0) compactDatabase(0);
+    metricsEnd(OP_DELETE, start);
+    return pos;
+}
+
+// Add new student
+void addStudent() {
+    FILE *fp;
+    Student newStudent;
+    
+    fp = fopen(DB_FILE, "ab");
+    if(fp == NULL) {
+        printf("\n⚠ Error: Could not open database file!\n");
+        printf("Check if you have write permissions.\n");
+        pressEnterToContinue();
+        return;
+    }
+    fclose(fp);
+    
+    printf("\n╔════════════════════════════════════════════════╗\n");
+    printf("║              ADD NEW STUDENT                   ║\n");
+    printf("╚════════════════════════════════════════════════╝\n");
+    
+    // Get roll number
+    printf("\nEnter Roll Number: ");
+    while(scanf("%d", &newStudent.roll_no) != 1 || newStudent.roll_no <= 0) {
+        printf("⚠ Please enter a valid positive number: ");
+        clearInputBuffer();
+    }
+    clearInputBuffer();
+    
+    // Check for duplicate
+    if(isDuplicate(newStudent.roll_no)) {
+        printf("\n⚠ Error: Roll number %d already exists!\n", newStudent.roll_no);
+        pressEnterToContinue();
+        return;
+    }
+    
+    // Get name
+    printf("Enter Name: ");
+    fgets(newStudent.name, sizeof(newStudent.name), stdin);
+    newStudent.name[strcspn(newStudent.name, "\n")] = '\0';
+    
+    // Validate name is not empty
+    if(strlen(newStudent.name) == 0) {
+        printf("\n⚠ Error: Name cannot be empty!\n");
+        pressEnterToContinue();
+        return;
+    }
+    
+    // Get department
+    printf("Enter Department (CS/EE/ME/CE/Other): ");
+    fgets(newStudent.department, sizeof(newStudent.department), stdin);
+    newStudent.department[strcspn(newStudent.department, "\n")] = '\0';
+    
+    // Get course
+    printf("Enter Course: ");
+    fgets(newStudent.course, sizeof(newStudent.course), stdin);
+    newStudent.course[strcspn(newStudent.course, "\n")] = '\0';
+    
+    // Get year
+    printf("Enter Year of Joining (2000-2025): ");
+    while(scanf("%d", &newStudent.year_joined) != 1 || 
+          !isValidYear(newStudent.year_joined)) {
+        printf("⚠ Please enter a valid year (2000-2025): ");
+        clearInputBuffer();
+    }
+    clearInputBuffer();
+    
+    // Get GPA
+    printf("Enter GPA (0.0-4.0): ");
+    while(scanf("%f", &newStudent.gpa) != 1 || 
+          !isValidGPA(newStudent.gpa)) {
+        printf("⚠ Please enter a valid GPA (0.0-4.0): ");
+        clearInputBuffer();
+    }
+    clearInputBuffer();
+    
+    long offset = addStudentRecord(&newStudent);
+    
+    if(offset == -2) {
+        printf("\n⚠ Error: Roll number %d was just added by another user!\n", newStudent.roll_no);
+    } else if(offset < 0) {
+        printf("\n⚠ Error: Failed to save student data!\n");
+    } else {
+        printf("\n╔════════════════════════════════════════════════╗\n");
+        printf("║     ✓ Student added successfully!              ║\n");
+        printf("║     Roll Number %d has been registered.        ║\n", newStudent.roll_no);
+        printf("╚════════════════════════════════════════════════╝\n");
+    }
+    
+    pressEnterToContinue();
+}
+
+static const char tableHeader[] =
+    "\n╔════════╦══════════════════════════════╦═══════════════╦════════════════════╦══════╦═════╗\n"
+    "║ Roll # ║ Name                         ║ Department    ║ Course             ║ Year ║ GPA ║\n"
+    "╠════════╬══════════════════════════════╬═══════════════╬════════════════════╬══════╬═════╣\n";
+static const char tableFooter[] =
+    "╚════════╩══════════════════════════════╩═══════════════╩════════════════════╩══════╩═════╝\n";
+
+// Format one table row (at most EXPORT_ROW_MAX bytes); returns its length
+static size_t formatTableRow(char *out, const Student *s) {
+    return (size_t)snprintf(out, EXPORT_ROW_MAX, "║ %-6d ║ %-28s ║ %-13s ║ %-18s ║ %4d ║ %.1f ║\n",
+                            s->roll_no, s->name, s->department, s->course, s->year_joined, s->gpa);
+}
+
+// Print table header
+void printHeader() {
+    fputs(tableHeader, stdout);
+}
+
+// Print single student in table format
+void printStudent(Student s) {
+    char row[EXPORT_ROW_MAX];
+    
+    fwrite(row, 1, formatTableRow(row, &s), stdout);
+}
+
+static int printRow(const Student *s, long offset, void *ctx) {
+    (void)offset;
+    (void)ctx;
+    printStudent(*s);
+    return 0;
+}
+
+// Display all students, in file order or sorted, a page at a time
+void displayAll() {
+    ReportSpec spec = { -1, 0, 0 };
+    char buffer[100];
+    DbStamp stamp;
+    long count;
+    
+    if(getDbStamp(&stamp) != 0) {
+        printf("\n╔════════════════════════════════════════════════╗\n");
+        printf("║     ⚠ No records found!                        ║\n");
+        printf("║     Database is empty.                         ║\n");
+        printf("║     Add some students first.                   ║\n");
+        printf("╚════════════════════════════════════════════════╝\n");
+        pressEnterToContinue();
+        return;
+    }
+    
+    printf("\nSort by roll, name, department, course, year or gpa, with :desc to reverse\n");
+    printf("(press Enter for file order): ");
+    if(fgets(buffer, sizeof(buffer), stdin) != NULL && buffer[0] != '\n') {
+        buffer[strcspn(buffer, "\n")] = '\0';
+        if(parseSortSpec(buffer, &spec) != 0) {
+            printf("\n⚠ Unknown sort order %s!\n", buffer);
+            pressEnterToContinue();
+            return;
+        }
+        printf("How many to show (press Enter for all): ");
+        if(fgets(buffer, sizeof(buffer), stdin) != NULL && atol(buffer) > 0) spec.limit = atol(buffer);
+    }
+    
+    count = pageReport(&spec);
+    if(count < 0) count = 0;
+    
+    printf("\nTotal Students: %ld\n", count);
+    
+    pressEnterToContinue();
+}
+
+// Search for a student
+void searchStudent() {
+    Student student;
+    int searchRoll, found = 0;
+    char buffer[100], *end;
+    
+    printf("\n╔════════════════════════════════════════════════╗\n");
+    printf("║              SEARCH STUDENT                    ║\n");
+    printf("╚════════════════════════════════════════════════╝\n");
+    
+    printf("\nEnter Roll Number or part of a name (0 to filter by department, course, year or GPA): ");
+    if(fgets(buffer, sizeof(buffer), stdin) == NULL || buffer[strcspn(buffer, "\n")] != '\n') {
+        printf("\n⚠ Invalid input!\n");
+        if(!feof(stdin)) clearInputBuffer();
+        pressEnterToContinue();
+        return;
+    }
+    buffer[strcspn(buffer, "\n")] = '\0';
+    if(buffer[0] == '\0') {
+        printf("\n⚠ Invalid input!\n");
+        pressEnterToContinue();
+        return;
+    }
+    
+    // Anything but a number is part of a name
+    searchRoll = (int)strtol(buffer, &end, 10);
+    if(end == buffer || *end != '\0') {
+        searchByName(buffer);
+        pressEnterToContinue();
+        return;
+    }
+    
+    if(searchRoll == 0) {
+        searchByFilters();
+        return;
+    }
+    
+    if(findStudent(searchRoll, &student) >= 0) {
+        printf("\n╔════════════════════════════════════════════════╗\n");
+        printf("║           ✓ STUDENT FOUND!                     ║\n");
+        printf("╠════════════════════════════════════════════════╣\n");
+        printf("║  Roll Number : %-32d ║\n", student.roll_no);
+        printf("║  Name        : %-32s ║\n", student.name);
+        printf("║  Department  : %-32s ║\n", student.department);
+        printf("║  Course      : %-32s ║\n", student.course);
+        printf("║  Year Joined : %-32d ║\n", student.year_joined);
+        printf("║  GPA         : %-32.2f ║\n", student.gpa);
+        printf("╚════════════════════════════════════════════════╝\n");
+        found = 1;
+    }
+    
+    if(!found) {
+        printf("\n╔════════════════════════════════════════════════╗\n");
+        printf("║     ⚠ Student with Roll Number %d not found!   ║\n", searchRoll);
+        printf("╚════════════════════════════════════════════════╝\n");
+    }
+    
+    pressEnterToContinue();
+}
+
+// Update student details
+void updateStudent() {
+    Student student;
+    int searchRoll, found = 0;
+    long pos;
+    char buffer[100];
+    
+    printf("\n╔════════════════════════════════════════════════╗\n");
+    printf("║            UPDATE STUDENT DETAILS              ║\n");
+    printf("╚════════════════════════════════════════════════╝\n");
+    
+    printf("\nEnter Roll Number to update: ");
+    if(scanf("%d", &searchRoll) != 1) {
+        printf("\n⚠ Invalid input!\n");
+        clearInputBuffer();
+        pressEnterToContinue();
+        return;
+    }
+    clearInputBuffer();
+    
+    pos = findStudent(searchRoll, &student);
+    if(pos >= 0) {
+        found = 1;
+        
+        printf("\n┌─── Current Details ───┐\n");
+        printf("│ Name       : %s\n", student.name);
+        printf("│ Department : %s\n", student.department);
+        printf("│ Course     : %s\n", student.course);
+        printf("│ Year       : %d\n", student.year_joined);
+        printf("│ GPA        : %.2f\n", student.gpa);
+        printf("└───────────────────────┘\n");
+        
+        printf("\n📝 Enter new details (press Enter to keep current):\n\n");
+        
+        // Update name
+        printf("New Name [%s]: ", student.name);
+        fgets(buffer, sizeof(buffer), stdin);
+        if(buffer[0] != '\n') {
+            buffer[strcspn(buffer, "\n")] = '\0';
+            strcpy(student.name, buffer);
+        }
+        
+        // Update department
+        printf("New Department [%s]: ", student.department);
+        fgets(buffer, sizeof(buffer), stdin);
+        if(buffer[0] != '\n') {
+            buffer[strcspn(buffer, "\n")] = '\0';
+            strcpy(student.department, buffer);
+        }
+        
+        // Update course
+        printf("New Course [%s]: ", student.course);
+        fgets(buffer, sizeof(buffer), stdin);
+        if(buffer[0] != '\n') {
+            buffer[strcspn(buffer, "\n")] = '\0';
+            strcpy(student.course, buffer);
+        }
+        
+        // Update year
+        printf("New Year [%d]: ", student.year_joined);
+        fgets(buffer, sizeof(buffer), stdin);
+        if(buffer[0] != '\n') {
+            int newYear;
+            if(sscanf(buffer, "%d", &newYear) == 1 && isValidYear(newYear)) {
+                student.year_joined = newYear;
+            }
+        }
+        
+        // Update GPA
+        printf("New GPA [%.2f]: ", student.gpa);
+        fgets(buffer, sizeof(buffer), stdin);
+        if(buffer[0] != '\n') {
+            float newGpa;
+            if(sscanf(buffer, "%f", &newGpa) == 1 && isValidGPA(newGpa)) {
+                student.gpa = newGpa;
+            }
+        }
+        
+        // Write the updated record back over its slot
+        if(updateStudentRecord(&student) < 0) {
+            printf("\n⚠ Error: Update failed!\n");
+        } else {
+            printf("\n╔════════════════════════════════════════════════╗\n");
+            printf("║     ✓ Student record updated successfully!     ║\n");
+            printf("╚════════════════════════════════════════════════╝\n");
+        }
+    }
+    
+    if(!found) {
+        printf("\n⚠ Student with Roll Number %d not found!\n", searchRoll);
+    }
+    
+    pressEnterToContinue();
+}
+
+// Delete a student
+void deleteStudent() {
+    int searchRoll, found = 0;
+    long pos;
+    char confirm;
+    
+    printf("\n╔════════════════════════════════════════════════╗\n");
+    printf("║              DELETE STUDENT                    ║\n");
+    printf("╚════════════════════════════════════════════════╝\n");
+    
+    printf("\nEnter Roll Number to delete: ");
+    if(scanf("%d", &searchRoll) != 1) {
+        printf("\n⚠ Invalid input!\n");
+        clearInputBuffer();
+        pressEnterToContinue();
+        return;
+    }
+    clearInputBuffer();
+    
+    // First, find and display the student
+    Student toDelete;
+    pos = findStudent(searchRoll, &toDelete);
+    found = pos >= 0;
+    
+    if(!found) {
+        printf("\n⚠ Student with Roll Number %d not found!\n", searchRoll);
+        pressEnterToContinue();
+        return;
+    }
+    
+    // Show student details and confirm deletion
+    printf("\n┌─── Student to Delete ───┐\n");
+    printf("│ Roll Number : %d\n", toDelete.roll_no);
+    printf("│ Name        : %s\n", toDelete.name);
+    printf("│ Department  : %s\n", toDelete.department);
+    printf("│ GPA         : %.2f\n", toDelete.gpa);
+    printf("└─────────────────────────┘\n");
+    
+    printf("\n⚠ Are you sure you want to delete this student? (y/n): ");
+    scanf(" %c", &confirm);
+    clearInputBuffer();
+    
+    if(confirm != 'y' && confirm != 'Y') {
+        printf("\n✓ Deletion cancelled.\n");
+        pressEnterToContinue();
+        return;
+    }
+    
+    // The slot is looked up again under the writer lock
+    if(deleteStudentRecord(toDelete.roll_no) < 0) {
+        printf("\n⚠ Error: Cannot update database file!\n");
+        pressEnterToContinue();
+        return;
+    }
+    
+    printf("\n╔════════════════════════════════════════════════╗\n");
+    printf("║     ✓ Student deleted successfully!            ║\n");
+    printf("╚════════════════════════════════════════════════╝\n");
+    
+    pressEnterToContinue();
+}
+
+// Fraction of dead slots that makes compaction worthwhile
+static double compactThreshold() {
+    const char *env = getenv("SMS_COMPACT_THRESHOLD");
+    double threshold;
+    
+    if(env != NULL && sscanf(env, "%lf", &threshold) == 1 &&
+       threshold >= 0.0 && threshold <= 1.0) {
+        return threshold;
+    }
+    return DEFAULT_COMPACT_THRESHOLD;
+}
+
+// Rewrite DB_FILE without its tombstones. Unless `force` is set this only
+// runs once the dead fraction reaches compactThreshold(). Returns the
+// number of slots reclaimed, -1 on error, or -2 while snapshot readers in
+// other processes still rely on the current layout.
+typedef struct {
+    PageStream out;
+    long reclaimed;
+} CompactState;
+
+static int copyLiveRecord(const Student *s, long offset, void *ctx) {
+    CompactState *st = ctx;
+    (void)offset;
+    
+    if(!IS_LIVE(*s)) {
+        st->reclaimed++;
+        return 0;
+    }
+    streamAdd(&st->out, s);
+    return st->out.failed;
+}
+
+// Newest entry first for each roll number
+static int compareFeedRolls(const void *a, const void *b) {
+    const FeedEntry *x = a, *y = b;
+    int rx = abs(x->roll_no), ry = abs(y->roll_no);
+    
+    if(rx != ry) return rx < ry ? -1 : 1;
+    return x->seq > y->seq ? -1 : x->seq < y->seq;
+}
+
+static int compareFeedSeqs(const void *a, const void *b) {
+    const FeedEntry *x = a, *y = b;
+    
+    if(x->seq != y->seq) return x->seq < y->seq ? -1 : 1;
+    return compareFeedRolls(a, b);
+}
+
+// Keep only the newest of each roll number's entries, in sequence order;
+// returns how many are left
+static long feedNewest(FeedEntry *entries, long n) {
+    long kept = 0;
+    
+    if(n == 0) return 0;
+    qsort(entries, (size_t)n, sizeof(FeedEntry), compareFeedRolls);
+    for(long i = 0; i < n; i++) {
+        if(kept == 0 || abs(entries[i].roll_no) != abs(entries[kept - 1].roll_no)) entries[kept++] = entries[i];
+    }
+    qsort(entries, (size_t)kept, sizeof(FeedEntry), compareFeedSeqs);
+    return kept;
+}
+
+// Write a whole feed file and have it on disk
+static int feedWrite(const char *path, const FeedEntry *entries, long n) {
+    unsigned char h[FEED_HEADER_SIZE];
+    unsigned char *buf = malloc((size_t)n * FEED_ENTRY_SIZE + 1);
+    int fd = buf == NULL ? -1 : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int failed = fd < 0;
+    
+    if(!failed) {
+        memset(h, 0, sizeof(h));
+        memcpy(h, FEED_MAGIC, sizeof(FEED_MAGIC));
+        for(long i = 0; i < n; i++) feedEncode(buf + i * FEED_ENTRY_SIZE, entries[i].seq, entries[i].roll_no);
+        failed = writeAll(fd, (const char *)h, sizeof(h)) != 0 ||
+                 writeAll(fd, (const char *)buf, (size_t)n * FEED_ENTRY_SIZE) != 0 || syncData(fd) != 0;
+        if(close(fd) != 0) failed = 1;
+    }
+    free(buf);
+    return failed ? -1 : 0;
+}
+
+// Rewrite the change feed with only the newest entry of each roll number;
+// the entries it drops say nothing an export since any point still needs
+static int compactFeed() {
+    char tmpName[256];
+    FeedEntry *entries;
+    long n, last;
+    int failed;
+    
+    n = feedRead(0, &entries, &last);
+    if(n <= 0) return n < 0 ? -1 : 0;
+    
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", CHG_FILE);
+    failed = feedWrite(tmpName, entries, feedNewest(entries, n)) != 0;
+    if(failed || rename(tmpName, CHG_FILE) != 0) {
+        remove(tmpName);
+        failed = 1;
+    } else {
+        syncDirectory(CHG_FILE);
+    }
+    free(entries);
+    return failed ? -1 : 0;
+}
+
+// Rewrite DB_FILE with only its live records, in slot layout `layout`, or
+// its own if 0. The new file's pages have the room new files get. Call
+// with the writer lock held; returns as compactDatabase() does.
+static int rewriteLocked(int layout) {
+    char oldHeap[256], newHeap[256];
+    unsigned int generation;
+    CompactState st;
+    DbFile db;
+    int failed;
+    
+    // Log offsets point into the old layout, so the log must be empty first
+    switch(walCheckpoint()) {
+        case 0:
+            break;
+        case 1:
+            return -2;
+        default:
+            return -1;
+    }
+    
+    // The new file gets a heap of its own, without the names of dead or
+    // overwritten records; the dictionary carries over with the same ids
+    if(dbOpen(&db, O_RDONLY) != 0) return -1;
+    generation = db.heap.generation;
+    if(layout == 0) layout = db.layout;
+    failed = dictSync(db.heap.fd) != 0;
+    dbClose(&db);
+    if(failed) return -1;
+    heapPath(oldHeap, sizeof(oldHeap), generation);
+    heapPath(newHeap, sizeof(newHeap), generation + 1);
+    
+    // Copy only the live records, and have them on disk before the rename
+    memset(&st, 0, sizeof(st));
+    if(streamOpen(&st.out, TEMP_FILE, generation + 1, layout) == 0 &&
+       scanDatabase(SCAN_ALL, copyLiveRecord, &st) < 0) {
+        st.out.failed = 1;
+    }
+    if(streamClose(&st.out) != 0 || rename(TEMP_FILE, DB_FILE) != 0) {
+        remove(TEMP_FILE);
+        remove(newHeap);
+        return -1;
+    }
+    syncDirectory(DB_FILE);
+    remove(oldHeap);
+    
+    // Record offsets changed, so re-index
+    rebuildIndex();
+    compactFeed();
+    return st.reclaimed;
+}
+
+static int compactLocked(int force) {
+    IndexHeader hdr;
+    FILE *idx;
+    long total;
+    
+    idx = openIndex(&hdr);
+    if(idx == NULL) return 0;
+    fclose(idx);
+    
+    total = hdr.count + hdr.freeCount;
+    if(hdr.freeCount == 0) return 0;
+    if(!force && (double)hdr.freeCount < compactThreshold() * (double)total) return 0;
+    return rewriteLocked(0);
+}
+
+// Writers in every process are held off for the whole rewrite
+int compactDatabase(int force) {
+    long start = metricsStart();
+    int reclaimed;
+    
+    if(lockWriter() != 0) return -1;
+    reclaimed = compactLocked(force);
+    unlockWriter();
+    
+    // Most calls find nothing worth compacting; only real runs are timed
+    if(reclaimed > 0) metricsEnd(OP_COMPACT, start);
+    return reclaimed;
+}
+
+// Show how much of the database is dead and compact on request; each
+// shard with anything to reclaim is compacted on its own
+void compactMenu() {
+    IndexHeader hdr;
+    FILE *idx;
+    long total = 0, dead = 0, reclaimed = 0;
+    int found = 0;
+    char confirm;
+    
+    printf("\n╔════════════════════════════════════════════════╗\n");
+    printf("║              COMPACT DATABASE                  ║\n");
+    printf("╚════════════════════════════════════════════════╝\n");
+    
+    for(int k = 0; k < shardTotal(); k++) {
+        useShard(k);
+        idx = openIndex(&hdr);
+        if(idx == NULL) continue;
+        fclose(idx);
+        found = 1;
+        total += hdr.count + hdr.freeCount;
+        dead += hdr.freeCount;
+    }
+    useShard(0);
+    if(!found) {
+        printf("\n⚠ Database is empty!\n");
+        pressEnterToContinue();
+        return;
+    }
+    
+    printf("\n  Record slots      : %ld\n", total);
+    printf("  Deleted (free)    : %ld\n", dead);
+    printf("  Dead ratio        : %.1f%%\n", total ? 100.0 * dead / total : 0.0);
+    printf("  Auto-compact at   : %.1f%%\n", 100.0 * compactThreshold());
+    
+    if(dead == 0) {
+        printf("\n✓ Nothing to reclaim.\n");
+        pressEnterToContinue();
+        return;
+    }
+    
+    printf("\nCompact now? (y/n): ");
+    scanf(" %c", &confirm);
+    clearInputBuffer();
+    
+    if(confirm != 'y' && confirm != 'Y') {
+        printf("\n✓ Compaction cancelled.\n");
+        pressEnterToContinue();
+        return;
+    }
+    
+    for(int k = 0; k < shardTotal() && reclaimed >= 0; k++) {
+        long n;
+        
+        useShard(k);
+        n = compactDatabase(1);
+        reclaimed = n < 0 ? n : reclaimed + n;
+    }
+    useShard(0);
+    if(reclaimed == -2) {
+        printf("\n⚠ Reports are reading the database; try again when they finish.\n");
+    } else if(reclaimed < 0) {
+        printf("\n⚠ Error: Compaction failed!\n");
+    } else {
+        printf("\n✓ Reclaimed %ld record slots.\n", reclaimed);
+    }
+    pressEnterToContinue();
+}
+
+// Convert a DB_FILE of raw records, as older releases wrote it, to the
+// paged format; the old file is kept as DB_FILE.v1. Committed transactions
+// still in the log are replayed afterwards, as log offsets do not depend
+// on the format. Returns the process exit status.
+int migrateDatabase() {
+    char backup[256], heap[256];
+    PageStream out;
+    Student s;
+    FILE *in;
+    int failed;
+    
+    if(!legacyDatabase()) {
+        if(access(DB_FILE, F_OK) != 0) {
+            fprintf(stderr, "⚠ No database to migrate!\n");
+            return 1;
+        }
+        printf("✓ %s is already in the current format.\n", DB_FILE);
+        return 0;
+    }
+    
+    // Other processes would read the old file in place
+    if(openLockFile() != 0 || lockByte(F_WRLCK, LOCK_WRITER, 1) != 0) {
+        fprintf(stderr, "⚠ Error: Cannot lock %s!\n", LOCK_FILE);
+        return 1;
+    }
+    if(lockByte(F_WRLCK, LOCK_ALIVE, 0) != 0) {
+        fprintf(stderr, "⚠ Stop the other student_mgmt processes before migrating!\n");
+        lockByte(F_UNLCK, LOCK_WRITER, 0);
+        return 1;
+    }
+    
+    snprintf(backup, sizeof(backup), "%s.v1", DB_FILE);
+    heapPath(heap, sizeof(heap), 1);
+    in = fopen(DB_FILE, "rb");
+    failed = streamOpen(&out, TEMP_FILE, 1, DB_LAYOUT) != 0 || in == NULL;
+    while(!failed && !out.failed && countedRead(&s, sizeof(s), 1, in) == 1) streamAdd(&out, &s);
+    if(in != NULL) fclose(in);
+    
+    if(streamClose(&out) != 0 || failed || (remove(backup) != 0 && errno != ENOENT) ||
+       link(DB_FILE, backup) != 0 || rename(TEMP_FILE, DB_FILE) != 0) {
+        fprintf(stderr, "⚠ Error: Migration failed; %s is unchanged.\n", DB_FILE);
+        remove(TEMP_FILE);
+        remove(heap);
+        lockByte(F_UNLCK, LOCK_ALIVE, 0);
+        lockByte(F_UNLCK, LOCK_WRITER, 0);
+        return 1;
+    }
+    syncDirectory(DB_FILE);
+    printf("✓ Migrated %ld record slots; the old file is kept as %s.\n", out.count, backup);
+    lockByte(F_UNLCK, LOCK_ALIVE, 0);
+    lockByte(F_UNLCK, LOCK_WRITER, 0);
+    
+    if(walRecover() != 0) {
+        fprintf(stderr, "⚠ Error: Could not replay the write-ahead log %s!\n", WAL_FILE);
+        return 1;
+    }
+    walCheckpoint();
+    return 0;
+}
+
+// Records being split into shards: one new data file for each
+typedef struct {
+    PageStream out[SHARD_MAX];
+    int maxRoll;
+} ShardSplit;
+
+static int findMaxRoll(const Student *s, long offset, void *ctx) {
+    ShardSplit *sp = ctx;
+    (void)offset;
+    
+    if(s->roll_no > sp->maxRoll) sp->maxRoll = s->roll_no;
+    return 0;
+}
+
+static int splitRecord(const Student *s, long offset, void *ctx) {
+    PageStream *out = &((ShardSplit *)ctx)->out[shardOf(s->roll_no)];
+    (void)offset;
+    
+    streamAdd(out, s);
+    return out->failed;
+}
+
+// Split the database into shards: "shard <count> [range=WIDTH|hash]".
+// Ranges default to equal slices up to the highest roll number. The live
+// records are streamed into shard<k>/, each with the whole dictionary, and
+// SHARD_FILE is written last: until then the old files are the database.
+// Returns the process exit status.
+int shardCommand(int argc, char *argv[]) {
+    const char *base[SHARD_FILES];
+    char oldHeap[256], dir[32], tmpName[256];
+    static ShardSplit sp;
+    ShardMap map;
+    Snapshot snap;
+    FILE *out;
+    long moved = 0;
+    int failed = 0, opened = 0;
+    char *end = NULL;
+    
+    memset(&map, 0, sizeof(map));
+    memcpy(map.magic, SHARD_MAGIC, sizeof(map.magic));
+    map.mode = SHARD_RANGE;
+    if(argc >= 1) map.count = (int)strtol(argv[0], &end, 10);
+    if(argc < 1 || argc > 2 || *end != '\0' || map.count < 2 || map.count > SHARD_MAX) {
+        fprintf(stderr, "⚠ Expected a shard count from 2 to %d, then range=WIDTH or hash\n", SHARD_MAX);
+        return 2;
+    }
+    if(argc == 2 && strcmp(argv[1], "hash") == 0) {
+        map.mode = SHARD_HASH;
+    } else if(argc == 2 && (strncmp(argv[1], "range=", 6) != 0 || (map.width = atol(argv[1] + 6)) < 1)) {
+        fprintf(stderr, "⚠ Invalid option %s\n", argv[1]);
+        return 2;
+    }
+    if(shardMap.count > 0) {
+        fprintf(stderr, "⚠ The database is already split into %d shards.\n", shardMap.count);
+        return 1;
+    }
+    
+    // Other processes would go on using the old files
+    if(lockWriter() != 0) {
+        fprintf(stderr, "⚠ Error: Cannot lock %s!\n", LOCK_FILE);
+        return 1;
+    }
+    if(lockByte(F_WRLCK, LOCK_ALIVE, 0) != 0) {
+        fprintf(stderr, "⚠ Stop the other student_mgmt processes before splitting!\n");
+        unlockWriter();
+        return 1;
+    }
+    if(walCheckpoint() != 0 || snapshotOpen(&snap) != 0) {
+        if(access(DB_FILE, F_OK) == 0) {
+            fprintf(stderr, "⚠ Reports are reading the database; try again when they finish.\n");
+        } else {
+            fprintf(stderr, "⚠ No database to split!\n");
+        }
+        lockByte(F_RDLCK, LOCK_ALIVE, 1);
+        unlockWriter();
+        return 1;
+    }
+    
+    // Every shard starts from this dictionary, so it must be complete
+    for(int i = 0; i < SHARD_FILES; i++) base[i] = *shardFiles[i];
+    heapPath(oldHeap, sizeof(oldHeap), snap.db.heap.generation);
+    if(dictSync(snap.db.heap.fd) != 0) failed = 1;
+    if(!failed && map.mode == SHARD_RANGE && map.width == 0) {
+        scanSnapshot(&snap, SCAN_LIVE, findMaxRoll, &sp);
+        map.width = (sp.maxRoll + map.count - 1) / map.count;
+        if(map.width < 1) map.width = 1;
+    }
+    
+    shardMap = map;
+    setShardNames(&shardMap);
+    for(int k = 0; k < map.count && !failed; k++) {
+        snprintf(dir, sizeof(dir), "shard%d", k);
+        if(mkdir(dir, 0755) != 0 && errno != EEXIST) failed = 1;
+        useShard(k);
+        dict = &dicts[0];
+        if(!failed && streamOpen(&sp.out[opened++], TEMP_FILE, 1, snap.db.layout) != 0) failed = 1;
+    }
+    if(!failed && scanSnapshot(&snap, SCAN_LIVE, splitRecord, &sp) < 0) failed = 1;
+    snapshotClose(&snap);
+    
+    for(int k = 0; k < opened; k++) {
+        if(streamClose(&sp.out[k]) != 0 || failed || rename(shardNames[k][1], shardNames[k][0]) != 0) failed = 1;
+        moved += sp.out[k].count;
+    }
+    
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", SHARD_FILE);
+    out = failed ? NULL : fopen(tmpName, "wb");
+    if(out == NULL || countedWrite(&map, sizeof(map), 1, out) != 1 || fflush(out) != 0 ||
+       syncFile(fileno(out)) != 0 || fclose(out) != 0 || rename(tmpName, SHARD_FILE) != 0) {
+        if(out != NULL) remove(tmpName);
+        memset(&shardMap, 0, sizeof(shardMap));
+        setShardNames(&shardMap);
+        useShard(0);
+        fprintf(stderr, "⚠ Error: Could not split the database; %s is unchanged.\n", base[0]);
+        lockByte(F_RDLCK, LOCK_ALIVE, 1);
+        unlockWriter();
+        return 1;
+    }
+    syncDirectory(SHARD_FILE);
+    
+    // The old files, sidecars and all, are no longer the database
+    for(int i = 0; i < SHARD_FILES; i++) remove(base[i]);
+    remove(oldHeap);
+    useShard(0);
+    lockByte(F_RDLCK, LOCK_ALIVE, 1);
+    unlockWriter();
+    
+    if(map.mode == SHARD_HASH) {
+        printf("✓ Split %ld students into %d shards by hash.\n", moved, map.count);
+    } else {
+        printf("✓ Split %ld students into %d shards of %ld roll numbers.\n", moved, map.count, map.width);
+    }
+    return 0;
+}
+
+// Display statistics
+void displayStatistics() {
+    StatsBlock stats;
+    int rc = databaseStats(&stats);
+    
+    if(rc != 0) {
+        printf(rc == -1 ? "\n⚠ No data available for statistics!\n" : "\n⚠ Error: The database could not be read!\n");
+        pressEnterToContinue();
+        return;
+    }
+    
+    long count = stats.count;
+    
+    if(count == 0) {
+        printf("\n⚠ No students in database!\n");
+        pressEnterToContinue();
+        return;
+    }
+    
+    float averageGPA = (float)((double)stats.gpaSum / 1e6 / (double)count);
+    float highestGPA = stats.high[0].gpa;
+    float lowestGPA = stats.low[0].gpa;
+    
+    printf("\n╔════════════════════════════════════════════════╗\n");
+    printf("║            📊 DATABASE STATISTICS              ║\n");
+    printf("╠════════════════════════════════════════════════╣\n");
+    printf("║  Total Students    : %-25ld ║\n", count);
+    printf("║  Average GPA       : %-25.2f ║\n", averageGPA);
+    printf("║  Highest GPA       : %-25.2f ║\n", highestGPA);
+    printf("║  Top Performer     : %-25.50s ║\n", stats.high[0].name);
+    printf("║  Lowest GPA        : %-25.2f ║\n", lowestGPA);
+    printf("║  Needs Improvement : %-25.50s ║\n", stats.low[0].name);
+    printf("╚════════════════════════════════════════════════╝\n");
+    
+    // GPA Distribution
+    printf("\n📈 GPA Distribution:\n");
+    printf("   Excellent (3.5-4.0): ");
+    
+    printf("%ld students\n", stats.atLeast35);
+    printf("   Good (3.0-3.49)    : %ld students\n", stats.atLeast30 - stats.atLeast35);
+    printf("   Average (2.0-2.99) : %ld students\n", stats.atLeast20 - stats.atLeast30);
+    printf("   Poor (Below 2.0)   : %ld students\n", count - stats.atLeast20);
+    
+    pressEnterToContinue();
+}
+
+// ─── Parallel CSV export engine ─────────────────────────────
+
+// Append a decimal integer
+static char *formatInt(char *p, int v) {
+    char tmp[12];
+    unsigned int u = v < 0 ? 0u - (unsigned int)v : (unsigned int)v;
+    int n = 0;
+    
+    if(v < 0) *p++ = '-';
+    do {
+        tmp[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while(u != 0);
+    while(n > 0) *p++ = tmp[--n];
+    return p;
+}
+
+// Append a GPA with two decimals. A float times 100 is exact in a double,
+// so rint() rounds half-to-even exactly as printf("%.2f") does.
+static char *formatGpa(char *p, float gpa) {
+    double scaled = rint((double)gpa * 100.0);
+    long v;
+    
+    // Values no valid record holds take the slow path
+    if(!(scaled > -1e9 && scaled < 1e9)) {
+        return p + sprintf(p, "%.2f", gpa);
+    }
+    if(scaled < 0) {
+        *p++ = '-';
+        scaled = -scaled;
+    }
+    v = (long)scaled;
+    p = formatInt(p, (int)(v / 100));
+    *p++ = '.';
+    *p++ = (char)('0' + (v / 10) % 10);
+    *p++ = (char)('0' + v % 10);
+    return p;
+}
+
+// Append a text field, quoting it if it holds a comma, quote or line break
+static char *formatField(char *p, const char *s, size_t max) {
+    size_t len = strnlen(s, max);
+    int special = 0;
+    
+    for(size_t i = 0; i < len; i++) {
+        if(s[i] == ',' || s[i] == '"' || s[i] == '\r' || s[i] == '\n') special = 1;
+    }
+    if(!special) {
+        memcpy(p, s, len);
+        return p + len;
+    }
+    
+    *p++ = '"';
+    for(size_t i = 0; i < len; i++) {
+        if(s[i] == '"') *p++ = '"';
+        *p++ = s[i];
+    }
+    *p++ = '"';
+    return p;
+}
+
+// Format one CSV row (at most EXPORT_ROW_MAX bytes); returns its length
+static size_t formatCsvRow(char *out, const Student *s) {
+    char *p = out;
+    
+    p = formatInt(p, s->roll_no);
+    *p++ = ',';
+    p = formatField(p, s->name, sizeof(s->name));
+    *p++ = ',';
+    p = formatField(p, s->department, sizeof(s->department));
+    *p++ = ',';
+    p = formatField(p, s->course, sizeof(s->course));
+    *p++ = ',';
+    p = formatInt(p, s->year_joined);
+    *p++ = ',';
+    p = formatGpa(p, s->gpa);
+    *p++ = '\n';
+    return (size_t)(p - out);
+}
+
+// Batches are formatted at once on the consumers and written in file
+// order: each waits for the batches before its own to be written
+typedef struct {
+    int fd;
+    long written;           // records up to here are written
+    long rows;
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+} ExportJob;
+
+typedef struct {
+    ExportJob *job;
+    char *buf;              // SCAN_BATCH rows
+} ExportConsumer;
+
+static int exportBatch(const Student *batch, long first, long n, void *ctx) {
+    ExportConsumer *c = ctx;
+    ExportJob *job = c->job;
+    char *p = c->buf;
+    long rows = 0;
+    int failed;
+    
+    for(long i = 0; i < n; i++) {
+        if(!IS_LIVE(batch[i])) continue;
+        p += formatCsvRow(p, &batch[i]);
+        rows++;
+    }
+    
+    pthread_mutex_lock(&job->lock);
+    while(job->written != first && !job->failed) pthread_cond_wait(&job->turn, &job->lock);
+    failed = job->failed;
+    pthread_mutex_unlock(&job->lock);
+    if(!failed) failed = writeAll(job->fd, c->buf, (size_t)(p - c->buf)) != 0;
+    
+    pthread_mutex_lock(&job->lock);
+    if(failed) job->failed = 1;
+    job->written = first + n;
+    job->rows += rows;
+    pthread_cond_broadcast(&job->turn);
+    pthread_mutex_unlock(&job->lock);
+    return failed;
+}
+
+// Number of export consumers; SMS_EXPORT_THREADS overrides
+static int exportThreads() {
+    const char *env = getenv("SMS_EXPORT_THREADS");
+    long n = env != NULL ? atol(env) : scanThreads();
+    
+    if(n < 1) n = 1;
+    if(n > SCAN_MAX_CONSUMERS) n = SCAN_MAX_CONSUMERS;
+    return (int)n;
+}
+
+// Format the live records of an array, or of a snapshot when `snap` is
+// given, as CSV rows on the scan pipeline and write them to fd in order.
+// Returns the number of rows written, -1 if fd could not be written or -2
+// if a record could not be read.
+long exportRecords(int fd, const Student *records, long count, Snapshot *snap) {
+    ExportConsumer consumers[SCAN_MAX_CONSUMERS];
+    void *ctxs[SCAN_MAX_CONSUMERS];
+    int n = exportThreads(), rc = 0;
+    ExportJob job;
+    
+    memset(&job, 0, sizeof(job));
+    job.fd = fd;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.turn, NULL);
+    for(int t = 0; t < n; t++) {
+        consumers[t].job = &job;
+        consumers[t].buf = malloc((size_t)SCAN_BATCH * EXPORT_ROW_MAX);
+        if(consumers[t].buf == NULL) rc = -1;
+        ctxs[t] = &consumers[t];
+    }
+    
+    if(rc == 0 && scanPipeline(snap, records, count, exportBatch, ctxs, n) < 0) rc = -2;
+    
+    for(int t = 0; t < n; t++) free(consumers[t].buf);
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.turn);
+    if(rc != 0) return rc;
+    return job.failed ? -1 : job.rows;
+}
+
+static const char csvHeader[] = "Roll Number,Name,Department,Course,Year Joined,GPA\n";
+
+// Export an array of records, skipping tombstones, to a CSV file (see
+// exportRecords()). Returns the number of rows written, -2 if the CSV
+// could not be written or -3 if a record could not be read.
+long exportArrayToCsv(const char *path, const Student *records, long count, Snapshot *snap) {
+    long start = metricsStart(), rows;
+    int fd;
+    
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) return -2;
+    
+    rows = -1;
+    if(writeAll(fd, csvHeader, sizeof(csvHeader) - 1) == 0) rows = exportRecords(fd, records, count, snap);
+    if(close(fd) != 0 && rows >= 0) rows = -1;
+    if(rows < 0) rows = rows == -2 ? -3 : -2;
+    metricsEnd(OP_EXPORT, start);
+    return rows;
+}
+
+// Export the current shard, without the header, to PATH.<shard>. The
+// result is the rows written, -1 if the shard has no database, -2 if the
+// part could not be written or -3 if a record could not be read.
+static int exportShard(void *result, void *ctx) {
+    char part[4096];
+    Snapshot snap;
+    long *rows = result;
+    int fd;
+    
+    *rows = -1;
+    if(snapshotOpen(&snap) != 0) return 0;
+    snprintf(part, sizeof(part), "%s.%d", (const char *)ctx, currentShard);
+    fd = open(part, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    *rows = fd < 0 ? -1 : exportRecords(fd, NULL, snap.count, &snap);
+    if(fd >= 0 && close(fd) != 0 && *rows >= 0) *rows = -1;
+    if(*rows < 0) *rows = *rows == -2 ? -3 : -2;
+    snapshotClose(&snap);
+    return 0;
+}
+
+// Append a shard's part to the CSV and remove it
+static int appendPart(int fd, const char *path, int k, char *buf) {
+    char part[4096];
+    ssize_t n;
+    int in, failed = 0;
+    
+    snprintf(part, sizeof(part), "%s.%d", path, k);
+    in = open(part, O_RDONLY);
+    if(in < 0) return -1;
+    while((n = read(in, buf, REPORT_BUFFER)) != 0) {
+        if(n < 0 && errno == EINTR) continue;
+        if(n < 0 || writeAll(fd, buf, (size_t)n) != 0) {
+            failed = 1;
+            break;
+        }
+    }
+    close(in);
+    remove(part);
+    return failed ? -1 : 0;
+}
+
+// Export DB_FILE to a CSV file. The shards of a split table are exported
+// at once, each to a part file, and the parts joined in shard order.
+// Returns the number of rows written, -1 if there is no database, -2 if
+// the CSV could not be written and -3 if a record could not be read.
+long exportCsvFile(const char *path) {
+    long start, total = -1;
+    long rows[SHARD_MAX];
+    Snapshot snap;
+    char *buf;
+    int fd, failed, unread = 0;
+    
+    // Rows come from a snapshot, so writers carry on during the export
+    if(shardTotal() == 1) {
+        if(snapshotOpen(&snap) != 0) return -1;
+        total = exportArrayToCsv(path, NULL, snap.count, &snap);
+        snapshotClose(&snap);
+        return total;
+    }
+    
+    start = metricsStart();
+    failed = fanOutShards(exportShard, (void *)path, rows, sizeof(long)) != 0;
+    
+    buf = malloc(REPORT_BUFFER);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(buf == NULL || fd < 0 || writeAll(fd, csvHeader, sizeof(csvHeader) - 1) != 0) failed = 1;
+    for(int k = 0; k < shardTotal(); k++) {
+        if(!failed && rows[k] == -3) unread = 1;
+        if(failed || rows[k] == -1) continue;
+        if(rows[k] < 0 || appendPart(fd, path, k, buf) != 0) {
+            failed = 1;
+            continue;
+        }
+        total = (total < 0 ? 0 : total) + rows[k];
+    }
+    
+    // Parts a failure left behind
+    for(int k = 0; k < shardTotal() && failed; k++) {
+        char part[4096];
+        
+        snprintf(part, sizeof(part), "%s.%d", path, k);
+        remove(part);
+    }
+    if(fd >= 0 && close(fd) != 0) failed = 1;
+    free(buf);
+    metricsEnd(OP_EXPORT, start);
+    if(failed) return unread ? -3 : -2;
+    return total;
+}
+
+// Export data to CSV
+void exportToCSV() {
+    long count = exportCsvFile(CSV_FILE);
+    
+    if(count == -1) {
+        printf("\n⚠ No data to export!\n");
+        pressEnterToContinue();
+        return;
+    }
+    
+    if(count < 0) {
+        printf(count == -3 ? "\n⚠ Error: The database could not be read!\n" : "\n⚠ Cannot create CSV file!\n");
+        pressEnterToContinue();
+        return;
+    }
+    
+    printf("\n╔════════════════════════════════════════════════╗\n");
+    printf("║     ✓ Export Successful!                       ║\n");
+    printf("║     %ld records exported to %s     ║\n", count, CSV_FILE);
+    printf("║     You can open this file in Excel.           ║\n");
+    printf("╚════════════════════════════════════════════════╝\n");
+    
+    pressEnterToContinue();
+}
+
+// ─── Columnar export ────────────────────────────────────────
+
+enum { COLS_INT32 = 1, COLS_FLOAT32 = 2, COLS_UTF8 = 3 };
+
+static const struct {
+    const char *name;
+    int type;
+} colsSchema[COLS_COLUMNS] = {
+    { "roll_no", COLS_INT32 }, { "name", COLS_UTF8 }, { "department", COLS_UTF8 },
+    { "course", COLS_UTF8 }, { "year_joined", COLS_INT32 }, { "gpa", COLS_FLOAT32 }
+};
+
+// Buffers of a batch, in file order
+enum {
+    COLS_ROLL, COLS_NAME_OFFSETS, COLS_NAME, COLS_DEPT_OFFSETS, COLS_DEPT,
+    COLS_COURSE_OFFSETS, COLS_COURSE, COLS_YEAR, COLS_GPA
+};
+
+// Writer for one columnar file. The batch being filled is held in its
+// on-disk encoding, so a full batch goes out as it stands and memory
+// stays at one batch however large the table.
+typedef struct {
+    int fd;
+    long pos;                           // bytes written so far
+    long rows;                          // rows in the batch being filled
+    long total;
+    unsigned char *buf[COLS_BUFFERS];
+    long len[COLS_BUFFERS];
+    long *batches;                      // file offset of each batch written
+    long nbatches;
+    long batchCap;
+    int failed;
+} ColumnWriter;
+
+static long colsPadded(long len) {
+    return (len + COLS_ALIGN - 1) / COLS_ALIGN * COLS_ALIGN;
+}
+
+// Bytes buffer b can need for a full batch
+static long colsCapacity(int b) {
+    switch(b) {
+        case COLS_NAME: return COLS_BATCH_ROWS * (long)(sizeof(((Student *)0)->name) - 1);
+        case COLS_DEPT: return COLS_BATCH_ROWS * (long)(sizeof(((Student *)0)->department) - 1);
+        case COLS_COURSE: return COLS_BATCH_ROWS * (long)(sizeof(((Student *)0)->course) - 1);
+        case COLS_NAME_OFFSETS: case COLS_DEPT_OFFSETS: case COLS_COURSE_OFFSETS:
+            return (COLS_BATCH_ROWS + 1) * 4L;
+    }
+    return COLS_BATCH_ROWS * 4L;
+}
+
+// Write len bytes and pad them with zeros to the next COLS_ALIGN boundary
+static int colsWrite(ColumnWriter *w, const void *data, long len) {
+    static const char zeros[COLS_ALIGN];
+    long pad = colsPadded(len) - len;
+    
+    if(writeAll(w->fd, data, (size_t)len) != 0 || writeAll(w->fd, zeros, (size_t)pad) != 0) {
+        w->failed = 1;
+        return -1;
+    }
+    w->pos += len + pad;
+    return 0;
+}
+
+// Empty the batch; each offsets buffer starts with a 0
+static void colsReset(ColumnWriter *w) {
+    w->rows = 0;
+    for(int b = 0; b < COLS_BUFFERS; b++) w->len[b] = 0;
+    for(int b = COLS_NAME_OFFSETS; b <= COLS_COURSE_OFFSETS; b += 2) {
+        putU32(w->buf[b], 0);
+        w->len[b] = 4;
+    }
+}
+
+// Write the batch being filled, if it has rows
+static int flushColumns(ColumnWriter *w) {
+    unsigned char header[COLS_HEADER_SIZE];
+    long offset = COLS_HEADER_SIZE;
+    
+    if(w->rows == 0) return 0;
+    if(w->nbatches == w->batchCap) {
+        long newCap = w->batchCap ? w->batchCap * 2 : 64;
+        long *batches = realloc(w->batches, (size_t)newCap * sizeof(long));
+        if(batches == NULL) {
+            w->failed = 1;
+            return -1;
+        }
+        w->batches = batches;
+        w->batchCap = newCap;
+    }
+    w->batches[w->nbatches++] = w->pos;
+    
+    memset(header, 0, sizeof(header));
+    putU64(header, (unsigned long)w->rows);
+    for(int b = 0; b < COLS_BUFFERS; b++) {
+        putU64(header + 16 + b * 16, (unsigned long)offset);
+        putU64(header + 24 + b * 16, (unsigned long)w->len[b]);
+        offset += colsPadded(w->len[b]);
+    }
+    putU64(header + 8, (unsigned long)offset);
+    
+    if(colsWrite(w, header, sizeof(header)) != 0) return -1;
+    for(int b = 0; b < COLS_BUFFERS; b++) {
+        if(colsWrite(w, w->buf[b], w->len[b]) != 0) return -1;
+    }
+    colsReset(w);
+    return 0;
+}
+
+// Append a string to a text column and close its offsets entry
+static void colsText(ColumnWriter *w, int b, const char *s, size_t max) {
+    size_t n = strnlen(s, max);
+    
+    memcpy(w->buf[b + 1] + w->len[b + 1], s, n);
+    w->len[b + 1] += (long)n;
+    putU32(w->buf[b] + w->len[b], (unsigned int)w->len[b + 1]);
+    w->len[b] += 4;
+}
+
+static void colsInt(ColumnWriter *w, int b, unsigned int v) {
+    putU32(w->buf[b] + w->len[b], v);
+    w->len[b] += 4;
+}
+
+static int columnRow(const Student *s, long offset, void *ctx) {
+    ColumnWriter *w = ctx;
+    unsigned int gpa;
+    (void)offset;
+    
+    if(w->failed) return 1;
+    memcpy(&gpa, &s->gpa, sizeof(gpa));
+    colsInt(w, COLS_ROLL, (unsigned int)s->roll_no);
+    colsText(w, COLS_NAME_OFFSETS, s->name, sizeof(s->name));
+    colsText(w, COLS_DEPT_OFFSETS, s->department, sizeof(s->department));
+    colsText(w, COLS_COURSE_OFFSETS, s->course, sizeof(s->course));
+    colsInt(w, COLS_YEAR, (unsigned int)s->year_joined);
+    colsInt(w, COLS_GPA, gpa);
+    w->total++;
+    
+    if(++w->rows == COLS_BATCH_ROWS) return flushColumns(w) != 0;
+    return 0;
+}
+
+// Export DB_FILE, every shard in turn, to a columnar file in one pass.
+// Returns the number of rows written, -1 if there is no database, -2 if
+// the file could not be written and -3 if a record could not be read.
+long exportColumnsFile(const char *path) {
+    unsigned char header[COLS_HEADER_SIZE], *footer = NULL, *block;
+    long start, size = 0, scanned = -1, footerLen;
+    ColumnWriter w;
+    
+    memset(&w, 0, sizeof(w));
+    for(int b = 0; b < COLS_BUFFERS; b++) size += colsCapacity(b);
+    block = malloc((size_t)size);
+    if(block == NULL) return -2;
+    size = 0;
+    for(int b = 0; b < COLS_BUFFERS; b++) {
+        w.buf[b] = block + size;
+        size += colsCapacity(b);
+    }
+    colsReset(&w);
+    
+    w.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(w.fd < 0) {
+        free(block);
+        return -2;
+    }
+    start = metricsStart();
+    
+    memset(header, 0, sizeof(header));
+    memcpy(header, COLS_MAGIC, sizeof(COLS_MAGIC));
+    putU32(header + 8, COLS_VERSION);
+    putU32(header + 12, COLS_COLUMNS);
+    putU32(header + 16, COLS_BATCH_ROWS);
+    for(int c = 0; c < COLS_COLUMNS; c++) {
+        unsigned char *col = header + 32 + c * 24;
+        
+        memcpy(col, colsSchema[c].name, strlen(colsSchema[c].name));
+        putU32(col + 16, (unsigned int)colsSchema[c].type);
+    }
+    
+    if(colsWrite(&w, header, sizeof(header)) == 0) {
+        scanned = scanShards(SCAN_LIVE, columnRow, &w);
+        if(scanned >= 0) flushColumns(&w);
+    }
+    
+    // Footer: the batch directory, then the trailer a reader finds first
+    footerLen = w.nbatches * 8 + COLS_TRAILER_SIZE;
+    if(scanned >= 0 && !w.failed && (footer = calloc(1, (size_t)footerLen)) != NULL) {
+        unsigned char *trailer = footer + w.nbatches * 8;
+        
+        for(long i = 0; i < w.nbatches; i++) putU64(footer + i * 8, (unsigned long)w.batches[i]);
+        putU64(trailer, (unsigned long)w.nbatches);
+        putU64(trailer + 8, (unsigned long)w.total);
+        putU32(trailer + 16, crc32c(footer, (size_t)(w.nbatches * 8 + 16)));
+        memcpy(trailer + 24, COLS_MAGIC, sizeof(COLS_MAGIC));
+        if(writeAll(w.fd, (const char *)footer, (size_t)footerLen) != 0) w.failed = 1;
+    }
+    if(footer == NULL) w.failed = 1;
+    if(close(w.fd) != 0) w.failed = 1;
+    
+    free(footer);
+    free(w.batches);
+    free(block);
+    metricsEnd(OP_EXPORT, start);
+    if(scanned < 0 || w.failed) remove(path);
+    if(scanned < 0) return scanned == -2 ? -3 : -1;
+    return w.failed ? -2 : w.total;
+}
+
+// ─── Incremental export ─────────────────────────────────────
+
+// A change row is "upsert" or "delete", the sequence number of the change,
+// then the student's fields, empty but for the roll number for a delete
+static const char changesHeader[] = "Change,Sequence,Roll Number,Name,Department,Course,Year Joined,GPA\n";
+
+typedef struct {
+    int fd;
+    char *buf;
+    size_t len;
+    long rows;
+    const FeedEntry *newest;    // for a full export, each roll number's
+    long nnewest;               // newest change, by roll number
+    int failed;
+} ChangeWriter;
+
+// Queue one row; s is NULL for a delete
+static void changeRow(ChangeWriter *w, long seq, int roll_no, const Student *s) {
+    char *p;
+    
+    if(w->failed) return;
+    if(w->len + EXPORT_ROW_MAX + 32 > REPORT_BUFFER) {
+        if(writeAll(w->fd, w->buf, w->len) != 0) {
+            w->failed = 1;
+            return;
+        }
+        w->len = 0;
+    }
+    p = w->buf + w->len;
+    p += sprintf(p, "%s,%ld,", s != NULL ? "upsert" : "delete", seq);
+    if(s != NULL) {
+        p += formatCsvRow(p, s);
+    } else {
+        p = formatInt(p, roll_no);
+        memcpy(p, ",,,,,\n", 6);
+        p += 6;
+    }
+    w->len = (size_t)(p - w->buf);
+    w->rows++;
+}
+
+static int findFeedRoll(const void *key, const void *entry) {
+    int roll_no = *(const int *)key, other = abs(((const FeedEntry *)entry)->roll_no);
+    
+    return roll_no < other ? -1 : roll_no > other;
+}
+
+// A row of a full export, with the student's last change in the feed, or
+// 0 if the feed has none
+static int fullChangeRow(const Student *s, long offset, void *ctx) {
+    ChangeWriter *w = ctx;
+    const FeedEntry *e = w->nnewest > 0 ? bsearch(&s->roll_no, w->newest, (size_t)w->nnewest, sizeof(FeedEntry),
+                                                  findFeedRoll) : NULL;
+    (void)offset;
+    
+    changeRow(w, e != NULL ? e->seq : 0, s->roll_no, s);
+    return w->failed;
+}
+
+// Export the students changed after sequence number `since` to a CSV
+// file, each once and as it is now: an upsert with its fields, or a delete
+// if it is gone. Only the change feed is searched, not the table. A
+// negative `since` takes a baseline instead: every student, each with the
+// sequence number of its last change. *high gets the sequence number the
+// next run starts after. Returns the number of rows written, -1 if the feed cannot
+// be read, -2 if the file could not be written and -3 if a record could
+// not be read.
+long exportChangesFile(const char *path, long since, long *high) {
+    FeedEntry *entries;
+    ChangeWriter w;
+    long n, start = metricsStart();
+    int unread = 0;
+    
+    // The feed is read first; records read after it can only be newer
+    n = feedRead(since, &entries, high);
+    if(n < 0) return -1;
+    
+    // Each roll number once, at its newest change
+    n = feedNewest(entries, n);
+    
+    memset(&w, 0, sizeof(w));
+    w.buf = malloc(REPORT_BUFFER);
+    w.fd = w.buf == NULL ? -1 : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(w.fd < 0 || writeAll(w.fd, changesHeader, sizeof(changesHeader) - 1) != 0) w.failed = 1;
+    
+    if(since < 0) {
+        qsort(entries, (size_t)n, sizeof(FeedEntry), compareFeedRolls);
+        w.newest = entries;
+        w.nnewest = n;
+        if(!w.failed && scanShards(SCAN_LIVE, fullChangeRow, &w) == -2) unread = 1;
+    } else {
+        for(long i = 0; i < n && !w.failed; i++) {
+            int roll_no = abs(entries[i].roll_no);
+            Student s;
+            
+            changeRow(&w, entries[i].seq, roll_no, findStudent(roll_no, &s) >= 0 ? &s : NULL);
+        }
+        useShard(0);
+    }
+    
+    if(!w.failed && writeAll(w.fd, w.buf, w.len) != 0) w.failed = 1;
+    if(w.fd >= 0 && close(w.fd) != 0) w.failed = 1;
+    free(entries);
+    free(w.buf);
+    metricsEnd(OP_EXPORT, start);
+    if(unread) return -3;
+    return w.failed ? -2 : w.rows;
+}
+
+// The file beside an incremental export that holds its high-water mark
+static void markPath(char *buf, size_t size, const char *path) {
+    snprintf(buf, size, "%s.seq", path);
+}
+
+// The high-water mark the last export to `path` saved, -1 if there is
+// none and the next export must be a baseline. 0 is a real mark: the feed
+// was empty when it was taken.
+static long readMark(const char *path) {
+    char name[4096];
+    long mark = -1;
+    FILE *fp;
+    
+    markPath(name, sizeof(name), path);
+    fp = fopen(name, "r");
+    if(fp == NULL) return -1;
+    if(fscanf(fp, "%ld", &mark) != 1 || mark < 0) mark = -1;
+    fclose(fp);
+    return mark;
+}
+
+static int writeMark(const char *path, long mark) {
+    char name[4096], tmpName[4200];
+    FILE *fp;
+    
+    markPath(name, sizeof(name), path);
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", name);
+    fp = fopen(tmpName, "w");
+    if(fp == NULL) return -1;
+    if(fprintf(fp, "%ld\n", mark) < 0 || fclose(fp) != 0 || rename(tmpName, name) != 0) {
+        remove(tmpName);
+        return -1;
+    }
+    return 0;
+}
+
+// Export to a CSV or columnar file, or the changes since a sequence
+// number, from the command line; returns the process exit status
+int exportCommand(int argc, char *argv[]) {
+    const char *path = NULL;
+    int columns = 0, incremental = 0, fromMark = 0;
+    long count, since = 0, high;
+    char *end;
+    
+    for(int i = 0; i < argc; i++) {
+        if(strcmp(argv[i], "format=csv") == 0 || strcmp(argv[i], "format=columns") == 0) {
+            columns = argv[i][7] == 'c' && argv[i][8] == 'o';
+        } else if(strcmp(argv[i], "since=last") == 0) {
+            incremental = fromMark = 1;
+        } else if(strncmp(argv[i], "since=", 6) == 0) {
+            since = strtol(argv[i] + 6, &end, 10);
+            if(argv[i][6] == '\0' || *end != '\0' || since < 0) {
+                fprintf(stderr, "⚠ Invalid option %s\n", argv[i]);
+                return 2;
+            }
+            incremental = 1;
+        } else if(path == NULL && strchr(argv[i], '=') == NULL) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "⚠ Unknown export option: %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if(path == NULL) path = CSV_FILE;
+    
+    if(incremental) {
+        if(columns) {
+            fprintf(stderr, "⚠ Changes are exported as CSV only!\n");
+            return 2;
+        }
+        if(fromMark) since = readMark(path);
+        count = exportChangesFile(path, since, &high);
+        if(count == -1) {
+            fprintf(stderr, "⚠ Cannot read the change feed %s!\n", CHG_FILE);
+            return 1;
+        }
+        if(count == -3) {
+            fprintf(stderr, "⚠ Error: The database could not be read!\n");
+            return 1;
+        }
+        if(count < 0 || writeMark(path, high) != 0) {
+            fprintf(stderr, "⚠ Cannot write %s!\n", path);
+            return 1;
+        }
+        if(since < 0) {
+            printf("✓ %ld students exported to %s as a baseline\n", count, path);
+        } else {
+            printf("✓ %ld changes after sequence %ld exported to %s\n", count, since, path);
+        }
+        printf("  Next run starts after sequence %ld (since=last)\n", high);
+        return 0;
+    }
+    
+    count = columns ? exportColumnsFile(path) : exportCsvFile(path);
+    if(count == -1) {
+        fprintf(stderr, "⚠ No data to export!\n");
+        return 1;
+    }
+    if(count == -3) {
+        fprintf(stderr, "⚠ Error: The database could not be read!\n");
+        return 1;
+    }
+    if(count < 0) {
+        fprintf(stderr, "⚠ Cannot write %s!\n", path);
+        return 1;
+    }
+    printf("✓ %ld records exported to %s\n", count, path);
+    return 0;
+}
+
+// ─── Sorted reports ─────────────────────────────────────────
+
+static const char *const sortFields[SORT_FIELD_COUNT] = {
+    "roll", "name", "department", "course", "year", "gpa"
+};
+
+// Parse "FIELD" or "FIELD:asc|desc" into a report spec
+int parseSortSpec(const char *s, ReportSpec *spec) {
+    size_t len = strcspn(s, ":");
+    
+    for(int f = 0; f < SORT_FIELD_COUNT; f++) {
+        if(strlen(sortFields[f]) != len || strncasecmp(s, sortFields[f], len) != 0) continue;
+        if(s[len] == '\0' || strcasecmp(s + len, ":asc") == 0) {
+            spec->descending = 0;
+        } else if(strcasecmp(s + len, ":desc") == 0) {
+            spec->descending = 1;
+        } else {
+            return -1;
+        }
+        spec->field = f;
+        return 0;
+    }
+    return -1;
+}
+
+// Big-endian bytes, which memcmp orders as it orders the numbers
+static void putOrdered(unsigned char *p, unsigned int u) {
+    p[0] = (unsigned char)(u >> 24);
+    p[1] = (unsigned char)(u >> 16);
+    p[2] = (unsigned char)(u >> 8);
+    p[3] = (unsigned char)u;
+}
+
+// Fill in a row's sort key: the field, made byte-comparable (text is
+// case-folded, descending fields are inverted), then the slot, so equal
+// fields keep file order and memcmp alone orders rows
+static void buildSortRow(SortRow *row, const Student *s, long slot, const ReportSpec *spec) {
+    unsigned char *k = row->key;
+    size_t len = 4;
+    
+    memset(k, 0, sizeof(row->key));
+    switch(spec->field) {
+        case SORT_ROLL:
+            putOrdered(k, (unsigned int)s->roll_no ^ 0x80000000u);
+            break;
+        case SORT_YEAR:
+            putOrdered(k, (unsigned int)s->year_joined ^ 0x80000000u);
+            break;
+        case SORT_GPA: {
+            unsigned int bits;
+            
+            // Negative floats order backwards, so flip all their bits
+            memcpy(&bits, &s->gpa, sizeof(bits));
+            putOrdered(k, (bits & 0x80000000u) ? ~bits : bits ^ 0x80000000u);
+            break;
+        }
+        default: {
+            const char *text = spec->field == SORT_NAME ? s->name :
+                               spec->field == SORT_DEPARTMENT ? s->department : s->course;
+            size_t max = spec->field == SORT_NAME ? sizeof(s->name) :
+                         spec->field == SORT_DEPARTMENT ? sizeof(s->department) : sizeof(s->course);
+            
+            len = strnlen(text, max);
+            for(size_t i = 0; i < len; i++) k[i] = (unsigned char)tolower((unsigned char)text[i]);
+            len = SORT_KEY_SIZE - 8;
+        }
+    }
+    if(spec->descending) {
+        for(size_t i = 0; i < len; i++) k[i] = (unsigned char)~k[i];
+    }
+    for(int i = 0; i < 8; i++) k[SORT_KEY_SIZE - 1 - i] = (unsigned char)((unsigned long)slot >> (8 * i));
+    row->s = *s;
+    row->slot = slot;
+}
+
+static int compareSortRows(const void *a, const void *b) {
+    return memcmp(((const SortRow *)a)->key, ((const SortRow *)b)->key, SORT_KEY_SIZE);
+}
+
+// Rows a report may hold in memory; SMS_SORT_MEMORY (bytes) overrides
+static long reportRows() {
+    const char *env = getenv("SMS_SORT_MEMORY");
+    long bytes = env != NULL ? atol(env) : REPORT_DEFAULT_MEMORY;
+    long rows = bytes / (long)sizeof(SortRow);
+    
+    return rows < REPORT_MERGE_ROWS ? REPORT_MERGE_ROWS : rows;
+}
+
+// A sorted run spilled to the scratch file, and the window of it in memory
+typedef struct {
+    off_t next;         // file offset of the next unread row
+    long left;          // rows still in the file
+    SortRow *buf;
+    long pos, len;
+} SortRun;
+
+typedef struct {
+    const ReportSpec *spec;
+    SortRow *rows;      // the run being filled, or the top-N heap
+    long count;
+    long capacity;
+    int fd;             // scratch file for spilled runs, -1 until needed
+    off_t end;
+    SortRun *runs;
+    long nruns;
+    long base;          // added to slots, so rows of different shards never tie
+    long budget;        // most rows held in memory
+    int failed;
+} ReportSort;
+
+// Sort the rows in memory and append them to the scratch file as a run
+static int spillRun(ReportSort *rs) {
+    SortRun *runs;
+    
+    if(rs->fd < 0) {
+        char path[] = "students.sort.XXXXXX";
+        
+        // Unlinked at once, so nothing is left behind if the process dies
+        rs->fd = mkstemp(path);
+        if(rs->fd < 0) return -1;
+        unlink(path);
+    }
+    runs = realloc(rs->runs, (size_t)(rs->nruns + 1) * sizeof(SortRun));
+    if(runs == NULL) return -1;
+    rs->runs = runs;
+    
+    qsort(rs->rows, (size_t)rs->count, sizeof(SortRow), compareSortRows);
+    if(pwriteAll(rs->fd, rs->rows, (size_t)rs->count * sizeof(SortRow), rs->end) != 0) return -1;
+    memset(&runs[rs->nruns], 0, sizeof(SortRun));
+    runs[rs->nruns].next = rs->end;
+    runs[rs->nruns].left = rs->count;
+    rs->nruns++;
+    rs->end += (off_t)rs->count * (off_t)sizeof(SortRow);
+    rs->count = 0;
+    return 0;
+}
+
+static int collectSortRow(const Student *s, long offset, void *ctx) {
+    ReportSort *rs = ctx;
+    
+    // A later shard can outgrow the guess made from the first one
+    if(rs->count == rs->capacity && rs->capacity < rs->budget) {
+        long cap = rs->capacity * 2 < rs->budget ? rs->capacity * 2 : rs->budget;
+        SortRow *rows = realloc(rs->rows, (size_t)cap * sizeof(SortRow));
+        
+        if(rows != NULL) {
+            rs->rows = rows;
+            rs->capacity = cap;
+        }
+    }
+    if(rs->count == rs->capacity && spillRun(rs) != 0) {
+        rs->failed = 1;
+        return 1;
+    }
+    buildSortRow(&rs->rows[rs->count++], s, slotOf(offset) + rs->base, rs->spec);
+    return 0;
+}
+
+// The top-N rows are kept in a heap with the last of them at the root
+static void topSiftDown(SortRow *h, long n, long i) {
+    for(;;) {
+        long worst = i, l = 2 * i + 1, r = l + 1;
+        SortRow tmp;
+        
+        if(l < n && compareSortRows(&h[l], &h[worst]) > 0) worst = l;
+        if(r < n && compareSortRows(&h[r], &h[worst]) > 0) worst = r;
+        if(worst == i) return;
+        tmp = h[i];
+        h[i] = h[worst];
+        h[worst] = tmp;
+        i = worst;
+    }
+}
+
+static int collectTopRow(const Student *s, long offset, void *ctx) {
+    ReportSort *rs = ctx;
+    SortRow row;
+    
+    buildSortRow(&row, s, slotOf(offset) + rs->base, rs->spec);
+    if(rs->count < rs->capacity) {
+        long i = rs->count++;
+        
+        rs->rows[i] = row;
+        while(i > 0 && compareSortRows(&rs->rows[(i - 1) / 2], &rs->rows[i]) < 0) {
+            SortRow tmp = rs->rows[i];
+            rs->rows[i] = rs->rows[(i - 1) / 2];
+            rs->rows[(i - 1) / 2] = tmp;
+            i = (i - 1) / 2;
+        }
+    } else if(compareSortRows(&row, &rs->rows[0]) < 0) {
+        rs->rows[0] = row;
+        topSiftDown(rs->rows, rs->count, 0);
+    }
+    return 0;
+}
+
+// Refill a run's window; returns 0, or -1 on a read error
+static int refillRun(int fd, SortRun *run, long window) {
+    long n = run->left < window ? run->left : window;
+    
+    if(n > 0 && preadAll(fd, run->buf, (size_t)n * sizeof(SortRow), run->next) != 0) return -1;
+    run->next += (off_t)n * (off_t)sizeof(SortRow);
+    run->left -= n;
+    run->pos = 0;
+    run->len = n;
+    return 0;
+}
+
+static int runBefore(const SortRun *runs, long a, long b) {
+    return compareSortRows(&runs[a].buf[runs[a].pos], &runs[b].buf[runs[b].pos]) < 0;
+}
+
+static void runSiftDown(const SortRun *runs, long *order, long live, long i) {
+    for(;;) {
+        long first = i, l = 2 * i + 1, r = l + 1, tmp;
+        
+        if(l < live && runBefore(runs, order[l], order[first])) first = l;
+        if(r < live && runBefore(runs, order[r], order[first])) first = r;
+        if(first == i) return;
+        tmp = order[i];
+        order[i] = order[first];
+        order[first] = tmp;
+        i = first;
+    }
+}
+
+// Merge the spilled runs in one pass, keeping a min-heap of run numbers
+// ordered by each run's next row. Returns the rows emitted, or -1.
+static long mergeRuns(ReportSort *rs, long limit, RecordVisitor emit, void *ctx) {
+    long window = reportRows() / rs->nruns, live = 0, emitted = 0;
+    long *order = malloc((size_t)rs->nruns * sizeof(long));
+    SortRow *space;
+    
+    if(window < REPORT_MERGE_ROWS) window = REPORT_MERGE_ROWS;
+    space = malloc((size_t)rs->nruns * (size_t)window * sizeof(SortRow));
+    if(order == NULL || space == NULL) {
+        free(order);
+        free(space);
+        return -1;
+    }
+    
+    for(long r = 0; r < rs->nruns; r++) {
+        rs->runs[r].buf = space + r * window;
+        if(refillRun(rs->fd, &rs->runs[r], window) != 0) emitted = -1;
+        if(rs->runs[r].len > 0) order[live++] = r;
+    }
+    for(long i = live / 2 - 1; i >= 0; i--) runSiftDown(rs->runs, order, live, i);
+    
+    while(live > 0 && emitted >= 0 && (limit == 0 || emitted < limit)) {
+        SortRun *run = &rs->runs[order[0]];
+        SortRow *row = &run->buf[run->pos++];
+        
+        emitted++;
+        if(emit(&row->s, row->slot * (long)sizeof(Student), ctx)) break;
+        
+        if(run->pos == run->len && refillRun(rs->fd, run, window) != 0) {
+            emitted = -1;
+            break;
+        }
+        if(run->len == 0) order[0] = order[--live];
+        runSiftDown(rs->runs, order, live, 0);
+    }
+    
+    free(order);
+    free(space);
+    return emitted;
+}
+
+// Stops a file-order listing after `limit` rows
+typedef struct {
+    RecordVisitor emit;
+    void *ctx;
+    long limit;
+    long emitted;
+    int stopped;        // the receiver asked for no more; the next shard must not start
+} ReportLimit;
+
+static int emitLimited(const Student *s, long offset, void *ctx) {
+    ReportLimit *rl = ctx;
+    
+    if(rl->stopped || (rl->limit > 0 && rl->emitted == rl->limit)) return 1;
+    rl->emitted++;
+    rl->stopped = rl->emit(s, offset, rl->ctx) != 0;
+    return rl->stopped;
+}
+
+// Hand the live students to `emit` in the order a spec asks for, at most
+// spec->limit of them. A top-N that fits in memory is kept in a heap;
+// anything larger is sorted in runs of bounded size that spill to a
+// scratch file and are merged. The shards of a split table are collected
+// one after another into the same heap or runs. Returns the number
+// emitted, or -1.
+long reportStudents(const ReportSpec *spec, RecordVisitor emit, void *ctx) {
+    ReportSort rs;
+    Snapshot snap;
+    long budget = reportRows(), emitted = 0;
+    int top, found = 0;
+    
+    if(spec->field < 0) {
+        ReportLimit rl = { emit, ctx, spec->limit, 0, 0 };
+        
+        if(scanShards(SCAN_LIVE, emitLimited, &rl) < 0) return -1;
+        return rl.emitted;
+    }
+    
+    memset(&rs, 0, sizeof(rs));
+    rs.spec = spec;
+    rs.fd = -1;
+    rs.budget = budget;
+    top = spec->limit > 0 && spec->limit <= budget;
+    
+    for(int k = 0; k < shardTotal() && emitted == 0; k++) {
+        useShard(k);
+        if(snapshotOpen(&snap) != 0) continue;
+        found = 1;
+        rs.base = (long)k << 40;
+        
+        // Room for the whole table if it fits, as far as can be told
+        if(rs.rows == NULL) {
+            rs.capacity = top ? spec->limit : (snap.count * shardTotal() < budget ? snap.count * shardTotal() : budget);
+            if(rs.capacity < 1) rs.capacity = 1;
+            rs.rows = malloc((size_t)rs.capacity * sizeof(SortRow));
+        }
+        if(rs.rows == NULL ||
+           scanSnapshot(&snap, SCAN_LIVE, top ? collectTopRow : collectSortRow, &rs) < 0 || rs.failed) {
+            emitted = -1;
+        }
+        
+        // The rows are copied out, so writers need not wait for the output
+        snapshotClose(&snap);
+    }
+    useShard(0);
+    if(!found) emitted = -1;
+    if(emitted == 0 && rs.nruns > 0 && rs.count > 0 && spillRun(&rs) != 0) emitted = -1;
+    
+    if(emitted == 0 && rs.nruns > 0) {
+        free(rs.rows);
+        rs.rows = NULL;
+        emitted = mergeRuns(&rs, spec->limit, emit, ctx);
+    } else if(emitted == 0) {
+        qsort(rs.rows, (size_t)rs.count, sizeof(SortRow), compareSortRows);
+        for(long i = 0; i < rs.count && (spec->limit == 0 || i < spec->limit); i++) {
+            emitted++;
+            if(emit(&rs.rows[i].s, rs.rows[i].slot * (long)sizeof(Student), ctx)) break;
+        }
+    }
+    
+    if(rs.fd >= 0) close(rs.fd);
+    free(rs.runs);
+    free(rs.rows);
+    return emitted;
+}
+
+// Buffered report output: CSV or table rows, written a buffer at a time
+typedef struct {
+    int fd;
+    int csv;
+    char *buf;
+    size_t len;
+    long rows;
+    int failed;
+} ReportWriter;
+
+static void reportWrite(ReportWriter *w, const char *text, size_t len) {
+    if(w->len + len > REPORT_BUFFER) {
+        if(writeAll(w->fd, w->buf, w->len) != 0) w->failed = 1;
+        w->len = 0;
+    }
+    memcpy(w->buf + w->len, text, len);
+    w->len += len;
+}
+
+static int writeReportRow(const Student *s, long offset, void *ctx) {
+    ReportWriter *w = ctx;
+    char row[EXPORT_ROW_MAX];
+    (void)offset;
+    
+    reportWrite(w, row, w->csv ? formatCsvRow(row, s) : formatTableRow(row, s));
+    w->rows++;
+    return w->failed;
+}
+
+// Interactive pages of REPORT_PAGE_ROWS rows, each printed with one write
+typedef struct {
+    ReportWriter out;
+    long onPage;
+    int stopped;        // the reader asked for no more
+} ReportPager;
+
+static int pageRow(const Student *s, long offset, void *ctx) {
+    ReportPager *pg = ctx;
+    char answer[16];
+    
+    // Ask before starting a page, so the last page needs no prompt
+    if(pg->onPage == REPORT_PAGE_ROWS) {
+        reportWrite(&pg->out, tableFooter, sizeof(tableFooter) - 1);
+        fflush(stdout);
+        if(writeAll(STDOUT_FILENO, pg->out.buf, pg->out.len) != 0) pg->out.failed = 1;
+        pg->out.len = 0;
+        printf("-- %ld shown; Enter for more, q to stop: ", pg->out.rows);
+        fflush(stdout);
+        if(fgets(answer, sizeof(answer), stdin) == NULL || answer[0] == 'q' || answer[0] == 'Q') {
+            pg->stopped = 1;
+            return 1;
+        }
+        reportWrite(&pg->out, tableHeader, sizeof(tableHeader) - 1);
+        pg->onPage = 0;
+    }
+    pg->onPage++;
+    return writeReportRow(s, offset, &pg->out);
+}
+
+// Print a report as a table a page at a time. Returns the rows shown, or
+// -1 if the database could not be read.
+long pageReport(const ReportSpec *spec) {
+    ReportPager pg;
+    long rows;
+    
+    memset(&pg, 0, sizeof(pg));
+    pg.out.fd = STDOUT_FILENO;
+    pg.out.buf = malloc(REPORT_BUFFER);
+    if(pg.out.buf == NULL) return -1;
+    
+    fflush(stdout);
+    reportWrite(&pg.out, tableHeader, sizeof(tableHeader) - 1);
+    rows = reportStudents(spec, pageRow, &pg);
+    if(!pg.stopped) reportWrite(&pg.out, tableFooter, sizeof(tableFooter) - 1);
+    writeAll(STDOUT_FILENO, pg.out.buf, pg.out.len);
+    free(pg.out.buf);
+    return rows < 0 ? -1 : pg.out.rows;
+}
+
+// Sorted report from the command line, as a table or CSV, on stdout or
+// into a file. Returns the process exit status.
+int reportCommand(int argc, char *argv[]) {
+    ReportSpec spec = { -1, 0, 0 };
+    ReportWriter w;
+    const char *path = NULL;
+    long rows;
+    char *end;
+    
+    memset(&w, 0, sizeof(w));
+    w.fd = STDOUT_FILENO;
+    for(int i = 0; i < argc; i++) {
+        if(strncmp(argv[i], "sort=", 5) == 0 && parseSortSpec(argv[i] + 5, &spec) == 0) {
+            continue;
+        } else if(strncmp(argv[i], "top=", 4) == 0) {
+            spec.limit = strtol(argv[i] + 4, &end, 10);
+            if(*end == '\0' && spec.limit > 0) continue;
+        } else if(strcmp(argv[i], "format=csv") == 0 || strcmp(argv[i], "format=table") == 0) {
+            w.csv = argv[i][7] == 'c';
+            continue;
+        } else if(strncmp(argv[i], "out=", 4) == 0 && argv[i][4] != '\0') {
+            path = argv[i] + 4;
+            continue;
+        }
+        fprintf(stderr, "⚠ Invalid option %s\n", argv[i]);
+        fprintf(stderr, "  sort=roll|name|department|course|year|gpa[:desc] top=N format=table|csv out=FILE\n");
+        return 2;
+    }
+    
+    if(path != NULL) {
+        w.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(w.fd < 0) {
+            fprintf(stderr, "⚠ Cannot create %s!\n", path);
+            return 1;
+        }
+    }
+    w.buf = malloc(REPORT_BUFFER);
+    if(w.buf == NULL) {
+        if(path != NULL) close(w.fd);
+        return 1;
+    }
+    
+    if(w.csv) {
+        reportWrite(&w, csvHeader, sizeof(csvHeader) - 1);
+    } else {
+        reportWrite(&w, tableHeader + 1, sizeof(tableHeader) - 2);
+    }
+    rows = reportStudents(&spec, writeReportRow, &w);
+    if(!w.csv) reportWrite(&w, tableFooter, sizeof(tableFooter) - 1);
+    if(writeAll(w.fd, w.buf, w.len) != 0) w.failed = 1;
+    if(path != NULL && close(w.fd) != 0) w.failed = 1;
+    free(w.buf);
+    
+    if(rows < 0 || w.failed) {
+        fprintf(stderr, "⚠ Error: The report could not be %s!\n", rows < 0 ? "read" : "written");
+        return 1;
+    }
+    fprintf(stderr, "✓ %ld students listed\n", rows);
+    return 0;
+}
+
+// ─── Group-by aggregation ───────────────────────────────────
+
+static int compareFloats(const void *a, const void *b) {
+    float x = *(const float *)a, y = *(const float *)b;
+    
+    return (x > y) - (x < y);
+}
+
+// Add a value standing for 2^lvl students to a sketch. A level that fills
+// up is sorted, and its odd or its even values, in turn, move up.
+static int sketchPush(QuantileSketch *sk, int lvl, float v) {
+    if(sk->size[lvl] == sk->cap[lvl]) {
+        int cap = sk->cap[lvl] ? sk->cap[lvl] * 2 : 8;
+        float *values = realloc(sk->level[lvl], (size_t)cap * sizeof(float));
+        
+        if(values == NULL) return -1;
+        sk->level[lvl] = values;
+        sk->cap[lvl] = cap;
+    }
+    sk->level[lvl][sk->size[lvl]++] = v;
+    if(lvl >= sk->levels) sk->levels = lvl + 1;
+    if(sk->size[lvl] < GROUP_SKETCH_K || lvl == GROUP_SKETCH_LEVELS - 1) return 0;
+    
+    qsort(sk->level[lvl], GROUP_SKETCH_K, sizeof(float), compareFloats);
+    sk->size[lvl] = 0;
+    for(int i = (int)(sk->coin++ & 1); i < GROUP_SKETCH_K; i += 2) {
+        if(sketchPush(sk, lvl + 1, sk->level[lvl][i]) != 0) return -1;
+    }
+    return 0;
+}
+
+static int sketchMerge(QuantileSketch *into, const QuantileSketch *from) {
+    for(int lvl = 0; lvl < from->levels; lvl++) {
+        for(int i = 0; i < from->size[lvl]; i++) {
+            if(sketchPush(into, lvl, from->level[lvl][i]) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+static void sketchFree(QuantileSketch *sk) {
+    for(int lvl = 0; lvl < sk->levels; lvl++) free(sk->level[lvl]);
+    memset(sk, 0, sizeof(*sk));
+}
+
+typedef struct {
+    float value;
+    long weight;
+} WeightedValue;
+
+static int compareWeighted(const void *a, const void *b) {
+    return compareFloats(&((const WeightedValue *)a)->value, &((const WeightedValue *)b)->value);
+}
+
+// Fill in the GPA at each rank ceil(q * n) of the n students a sketch
+// stands for, for the fractions in `q`
+static int sketchQuantiles(const QuantileSketch *sk, const double *q, float *out, int nq) {
+    WeightedValue *values;
+    long n = 0, total = 0;
+    
+    for(int lvl = 0; lvl < sk->levels; lvl++) n += sk->size[lvl];
+    values = malloc((size_t)(n > 0 ? n : 1) * sizeof(WeightedValue));
+    if(values == NULL) return -1;
+    n = 0;
+    for(int lvl = 0; lvl < sk->levels; lvl++) {
+        for(int i = 0; i < sk->size[lvl]; i++) {
+            values[n].value = sk->level[lvl][i];
+            values[n++].weight = 1L << lvl;
+            total += 1L << lvl;
+        }
+    }
+    qsort(values, (size_t)n, sizeof(WeightedValue), compareWeighted);
+    
+    for(int j = 0; j < nq; j++) {
+        long rank = (long)ceil(q[j] * (double)total), seen = 0, i = 0;
+        
+        if(rank < 1) rank = 1;
+        while(i < n - 1 && seen + values[i].weight < rank) seen += values[i++].weight;
+        out[j] = n > 0 ? values[i].value : 0.0f;
+    }
+    free(values);
+    return 0;
+}
+
+// The grouping fields of a student, the others left empty
+static void groupKey(GroupRow *key, const Student *s, int keys) {
+    memset(key, 0, sizeof(*key));
+    if(keys & GROUP_DEPARTMENT) {
+        copyText(key->department, sizeof(key->department) - 1, s->department);
+        key->hash = textKey(key->department, sizeof(key->department));
+    }
+    if(keys & GROUP_COURSE) {
+        copyText(key->course, sizeof(key->course) - 1, s->course);
+        key->hash = key->hash * 31 + textKey(key->course, sizeof(key->course));
+    }
+    if(keys & GROUP_YEAR) {
+        key->year = s->year_joined;
+        key->hash = key->hash * 31 + (unsigned int)s->year_joined;
+    }
+    key->hash *= 0x9E3779B97F4A7C15UL;
+    key->hash ^= key->hash >> 29;
+}
+
+// The group with a key, added empty if new; NULL when out of memory
+static GroupRow *groupFind(GroupTable *t, const GroupRow *key) {
+    GroupRow *r;
+    long mask, i;
+    
+    if((t->count + 1) * 2 > t->capacity) {
+        long cap = t->capacity ? t->capacity * 2 : GROUP_MIN_CAPACITY;
+        long *slots = malloc((size_t)cap * sizeof(long));
+        GroupRow *rows = realloc(t->rows, (size_t)(cap / 2) * sizeof(GroupRow));
+        
+        if(rows != NULL) t->rows = rows;
+        if(slots == NULL || rows == NULL) {
+            free(slots);
+            t->failed = 1;
+            return NULL;
+        }
+        for(i = 0; i < cap; i++) slots[i] = -1;
+        for(long g = 0; g < t->count; g++) {
+            i = (long)(rows[g].hash & (unsigned long)(cap - 1));
+            while(slots[i] >= 0) i = (i + 1) & (cap - 1);
+            slots[i] = g;
+        }
+        free(t->slots);
+        t->slots = slots;
+        t->capacity = cap;
+    }
+    
+    mask = t->capacity - 1;
+    for(i = (long)(key->hash & (unsigned long)mask); t->slots[i] >= 0; i = (i + 1) & mask) {
+        r = &t->rows[t->slots[i]];
+        if(r->hash == key->hash && r->year == key->year &&
+           memcmp(r->department, key->department, sizeof(r->department)) == 0 &&
+           memcmp(r->course, key->course, sizeof(r->course)) == 0) {
+            return r;
+        }
+    }
+    t->slots[i] = t->count;
+    r = &t->rows[t->count++];
+    memset(r, 0, sizeof(*r));
+    memcpy(r->department, key->department, sizeof(r->department));
+    memcpy(r->course, key->course, sizeof(r->course));
+    r->year = key->year;
+    r->hash = key->hash;
+    return r;
+}
+
+static int groupAdd(GroupRow *r, float gpa) {
+    if(r->count == 0 || gpa < r->min) r->min = gpa;
+    if(r->count == 0 || gpa > r->max) r->max = gpa;
+    r->count++;
+    r->sum += gpa;
+    return sketchPush(&r->sketch, 0, gpa);
+}
+
+static int groupBatch(const Student *batch, long first, long n, void *ctx) {
+    GroupTable *t = ctx;
+    GroupRow key, *r;
+    (void)first;
+    
+    for(long i = 0; i < n && !t->failed; i++) {
+        if(!IS_LIVE(batch[i])) continue;
+        groupKey(&key, &batch[i], t->keys);
+        r = groupFind(t, &key);
+        if(r == NULL || groupAdd(r, batch[i].gpa) != 0) t->failed = 1;
+    }
+    return t->failed;
+}
+
+static void groupFree(GroupTable *t) {
+    for(long g = 0; g < t->count; g++) sketchFree(&t->rows[g].sketch);
+    free(t->rows);
+    free(t->slots);
+    memset(t, 0, sizeof(*t));
+}
+
+static int compareGroups(const void *a, const void *b) {
+    const GroupRow *x = a, *y = b;
+    int c = strcmp(x->department, y->department);
+    
+    if(c == 0) c = strcmp(x->course, y->course);
+    return c != 0 ? c : (x->year > y->year) - (x->year < y->year);
+}
+
+// Group the live students by the `keys` fields into `out`, sorted by key.
+// The shards of a split table are read from snapshots taken at one moment,
+// one after another, each by all the scan pipeline's consumers; every
+// consumer fills a table of its own, and the tables are merged at the
+// end. Returns 0, -1 if there is no database, or -2 on error.
+int groupStudents(int keys, GroupTable *out) {
+    static Snapshot snaps[SHARD_MAX];
+    static GroupTable tables[SCAN_MAX_CONSUMERS];
+    void *ctxs[SCAN_MAX_CONSUMERS];
+    int n = scanThreads(), rc = 0;
+    long start = metricsStart();
+    
+    if(snapshotOpenShards(snaps) != 0) return -1;
+    for(int t = 0; t < n; t++) {
+        memset(&tables[t], 0, sizeof(tables[t]));
+        tables[t].keys = keys;
+        ctxs[t] = &tables[t];
+    }
+    for(int k = 0; k < shardTotal(); k++) {
+        useShard(k);
+        if(rc == 0 && scanPipeline(&snaps[k], NULL, snaps[k].count, groupBatch, ctxs, n) != 0) rc = -2;
+        snapshotClose(&snaps[k]);
+    }
+    useShard(0);
+    
+    *out = tables[0];
+    for(int t = 1; t < n; t++) {
+        for(long g = 0; g < tables[t].count && rc == 0 && !out->failed; g++) {
+            const GroupRow *from = &tables[t].rows[g];
+            GroupRow *into = groupFind(out, from);
+            
+            if(into == NULL || sketchMerge(&into->sketch, &from->sketch) != 0) {
+                out->failed = 1;
+                break;
+            }
+            if(into->count == 0 || from->min < into->min) into->min = from->min;
+            if(into->count == 0 || from->max > into->max) into->max = from->max;
+            into->count += from->count;
+            into->sum += from->sum;
+        }
+        if(tables[t].failed) rc = -2;
+        groupFree(&tables[t]);
+    }
+    if(out->failed) rc = -2;
+    
+    // The slots no longer match once the rows are sorted
+    free(out->slots);
+    out->slots = NULL;
+    if(rc == 0) {
+        qsort(out->rows, (size_t)out->count, sizeof(GroupRow), compareGroups);
+        metricsEnd(OP_SCAN, start);
+    } else {
+        groupFree(out);
+    }
+    return rc;
+}
+
+static const int groupWidths[] = { 20, 20, 4, 8, 7, 4, 6, 4, 4 };
+static const char *const groupTitles[] = {
+    "Department", "Course", "Year", "Students", "Average", "Min", "Median", "P90", "Max"
+};
+
+// A rule across the table's columns: `left`, a bar over each column with
+// `mid` between them, then `right`
+static size_t groupRule(char *out, int keys, const char *left, const char *mid, const char *right) {
+    char *p = out + sprintf(out, "%s", left);
+    int last = (int)(sizeof(groupWidths) / sizeof(groupWidths[0])) - 1;
+    
+    for(int c = 0; c <= last; c++) {
+        if(c < 3 && !(keys & (1 << c))) continue;
+        for(int i = 0; i < groupWidths[c] + 2; i++) p += sprintf(p, "═");
+        p += sprintf(p, "%s", c < last ? mid : right);
+    }
+    *p++ = '\n';
+    return (size_t)(p - out);
+}
+
+// One table line of the given cells; GPA figures come preformatted
+static size_t groupLine(char *out, int keys, const char *const *cells) {
+    char *p = out + sprintf(out, "║");
+    
+    for(int c = 0; c < 9; c++) {
+        if(c < 3 && !(keys & (1 << c))) continue;
+        p += sprintf(p, c == 0 || c == 1 ? " %-*s ║" : " %*s ║", groupWidths[c], cells[c]);
+    }
+    *p++ = '\n';
+    return (size_t)(p - out);
+}
+
+// Write one group as a table line or CSV row
+static void writeGroupRow(ReportWriter *w, const GroupRow *r, int keys) {
+    static const double q[2] = { 0.5, 0.9 };
+    char line[1024], text[9][64], *p = line;
+    const char *cells[9];
+    float quantiles[2];
+    
+    if(sketchQuantiles(&r->sketch, q, quantiles, 2) != 0) {
+        w->failed = 1;
+        return;
+    }
+    if(w->csv) {
+        if(keys & GROUP_DEPARTMENT) {
+            p = formatField(p, r->department, sizeof(r->department));
+            *p++ = ',';
+        }
+        if(keys & GROUP_COURSE) {
+            p = formatField(p, r->course, sizeof(r->course));
+            *p++ = ',';
+        }
+        if(keys & GROUP_YEAR) p += sprintf(p, "%d,", r->year);
+        p += sprintf(p, "%ld,%.4f,", r->count, r->sum / (double)r->count);
+        p = formatGpa(p, r->min);
+        *p++ = ',';
+        p = formatGpa(p, quantiles[0]);
+        *p++ = ',';
+        p = formatGpa(p, quantiles[1]);
+        *p++ = ',';
+        p = formatGpa(p, r->max);
+        *p++ = '\n';
+        reportWrite(w, line, (size_t)(p - line));
+    } else {
+        cells[0] = r->department;
+        cells[1] = r->course;
+        snprintf(text[2], sizeof(text[2]), "%d", r->year);
+        snprintf(text[3], sizeof(text[3]), "%ld", r->count);
+        snprintf(text[4], sizeof(text[4]), "%.2f", r->sum / (double)r->count);
+        snprintf(text[5], sizeof(text[5]), "%.2f", r->min);
+        snprintf(text[6], sizeof(text[6]), "%.2f", quantiles[0]);
+        snprintf(text[7], sizeof(text[7]), "%.2f", quantiles[1]);
+        snprintf(text[8], sizeof(text[8]), "%.2f", r->max);
+        for(int c = 2; c < 9; c++) cells[c] = text[c];
+        reportWrite(w, line, groupLine(line, keys, cells));
+    }
+    w->rows++;
+}
+
+// Per-group GPA breakdown from the command line, as a table or CSV, on
+// stdout or into a file: "group [by=FIELD,...] [format=table|csv]
+// [out=FILE]". Returns the process exit status.
+int groupCommand(int argc, char *argv[]) {
+    char line[1024], fields[64];
+    const char *path = NULL;
+    GroupTable t;
+    ReportWriter w;
+    long students = 0;
+    int keys = GROUP_DEPARTMENT, rc;
+    
+    memset(&w, 0, sizeof(w));
+    w.fd = STDOUT_FILENO;
+    for(int i = 0; i < argc; i++) {
+        if(strncmp(argv[i], "by=", 3) == 0 && strlen(argv[i] + 3) < sizeof(fields)) {
+            strcpy(fields, argv[i] + 3);
+            keys = 0;
+            for(char *f = strtok(fields, ","); f != NULL && keys >= 0; f = strtok(NULL, ",")) {
+                if(strcasecmp(f, "department") == 0) {
+                    keys |= GROUP_DEPARTMENT;
+                } else if(strcasecmp(f, "course") == 0) {
+                    keys |= GROUP_COURSE;
+                } else if(strcasecmp(f, "year") == 0) {
+                    keys |= GROUP_YEAR;
+                } else {
+                    keys = -1;
+                }
+            }
+            if(keys > 0) continue;
+        } else if(strcmp(argv[i], "format=csv") == 0 || strcmp(argv[i], "format=table") == 0) {
+            w.csv = argv[i][7] == 'c';
+            continue;
+        } else if(strncmp(argv[i], "out=", 4) == 0 && argv[i][4] != '\0') {
+            path = argv[i] + 4;
+            continue;
+        }
+        fprintf(stderr, "⚠ Invalid option %s\n", argv[i]);
+        fprintf(stderr, "  by=department|course|year[,...] format=table|csv out=FILE\n");
+        return 2;
+    }
+    
+    rc = groupStudents(keys, &t);
+    if(rc != 0) {
+        fprintf(stderr, rc == -1 ? "⚠ No data available for statistics!\n" : "⚠ Error: The database could not be read!\n");
+        return 1;
+    }
+    if(path != NULL) {
+        w.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(w.fd < 0) {
+            fprintf(stderr, "⚠ Cannot create %s!\n", path);
+            groupFree(&t);
+            return 1;
+        }
+    }
+    w.buf = malloc(REPORT_BUFFER);
+    if(w.buf == NULL) {
+        if(path != NULL) close(w.fd);
+        groupFree(&t);
+        return 1;
+    }
+    
+    if(w.csv) {
+        char *p = line;
+        
+        if(keys & GROUP_DEPARTMENT) p += sprintf(p, "Department,");
+        if(keys & GROUP_COURSE) p += sprintf(p, "Course,");
+        if(keys & GROUP_YEAR) p += sprintf(p, "Year Joined,");
+        p += sprintf(p, "Students,Average GPA,Min GPA,Median GPA,P90 GPA,Max GPA\n");
+        reportWrite(&w, line, (size_t)(p - line));
+    } else {
+        reportWrite(&w, line, groupRule(line, keys, "╔", "╦", "╗"));
+        reportWrite(&w, line, groupLine(line, keys, groupTitles));
+        reportWrite(&w, line, groupRule(line, keys, "╠", "╬", "╣"));
+    }
+    for(long g = 0; g < t.count && !w.failed; g++) {
+        writeGroupRow(&w, &t.rows[g], keys);
+        students += t.rows[g].count;
+    }
+    if(!w.csv) reportWrite(&w, line, groupRule(line, keys, "╚", "╩", "╝"));
+    if(writeAll(w.fd, w.buf, w.len) != 0) w.failed = 1;
+    if(path != NULL && close(w.fd) != 0) w.failed = 1;
+    free(w.buf);
+    groupFree(&t);
+    
+    if(w.failed) {
+        fprintf(stderr, "⚠ Error: The breakdown could not be written!\n");
+        return 1;
+    }
+    fprintf(stderr, "✓ %ld groups of %ld students\n", w.rows, students);
+    return 0;
+}
+
+// ─── Predicate queries ──────────────────────────────────────
+
+// A query that matches every student
+void queryInit(StudentQuery *q) {
+    memset(q, 0, sizeof(*q));
+    q->yearMin = MIN_YEAR;
+    q->yearMax = MAX_YEAR;
+    q->gpaMin = MIN_GPA;
+    q->gpaMax = MAX_GPA;
+}
+
+int queryMatches(const StudentQuery *q, const Student *s) {
+    return IS_LIVE(*s) &&
+           (q->department[0] == '\0' ||
+            strncasecmp(s->department, q->department, sizeof(s->department)) == 0) &&
+           (q->course[0] == '\0' || strncasecmp(s->course, q->course, sizeof(s->course)) == 0) &&
+           s->year_joined >= q->yearMin && s->year_joined <= q->yearMax &&
+           s->gpa >= q->gpaMin && s->gpa <= q->gpaMax;
+}
+
+// SEC_FILE as of a snapshot: the header and directory read into memory
+typedef struct {
+    int fd;
+    SecondaryHeader hdr;
+    SecondaryKey *keys;
+    SecondaryDelta *delta;
+} SecondaryIndex;
+
+static void closeSecondary(SecondaryIndex *sec) {
+    if(sec->fd >= 0) close(sec->fd);
+    free(sec->keys);
+    free(sec->delta);
+    memset(sec, 0, sizeof(*sec));
+    sec->fd = -1;
+}
+
+// Open SEC_FILE if it describes exactly the snapshot, rebuilding it from
+// the snapshot if it is missing or stale. Returns -1 if it cannot be used.
+static int openSecondary(Snapshot *snap, SecondaryIndex *sec) {
+    memset(sec, 0, sizeof(*sec));
+    sec->fd = -1;
+    
+    for(int attempt = 0; attempt < 2; attempt++) {
+        sec->fd = open(SEC_FILE, O_RDONLY);
+        
+        // Writers only append to the delta area past the count read here
+        if(sec->fd >= 0 && preadAll(sec->fd, &sec->hdr, sizeof(sec->hdr), 0) == 0 &&
+           memcmp(sec->hdr.magic, SECONDARY_MAGIC, sizeof(sec->hdr.magic)) == 0 &&
+           sameStamp(&sec->hdr.stamp, &snap->stamp)) {
+            sec->keys = malloc((size_t)(sec->hdr.keys + 1) * sizeof(SecondaryKey));
+            sec->delta = malloc((size_t)(sec->hdr.deltaCount + 1) * sizeof(SecondaryDelta));
+            if(sec->keys != NULL && sec->delta != NULL &&
+               preadAll(sec->fd, sec->keys, (size_t)sec->hdr.keys * sizeof(SecondaryKey),
+                        secondaryKeyPos(&sec->hdr, 0)) == 0 &&
+               preadAll(sec->fd, sec->delta, (size_t)sec->hdr.deltaCount * sizeof(SecondaryDelta),
+                        secondaryDeltaPos(&sec->hdr, 0)) == 0) {
+                return 0;
+            }
+        }
+        closeSecondary(sec);
+        if(attempt == 0 && rebuildSecondary(snap) != 0) break;
+    }
+    return -1;
+}
+
+// First directory entry at or after (attr, key)
+static long secondaryLowerBound(const SecondaryIndex *sec, int attr, unsigned long key) {
+    long lo = 0, hi = sec->hdr.keys;
+    
+    while(lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        const SecondaryKey *k = &sec->keys[mid];
+        
+        if(k->attr < attr || (k->attr == attr && k->key < key)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Upper bound on the slots listed under keys [lo, hi] of an attribute
+static long secondaryEstimate(const SecondaryIndex *sec, int attr, unsigned long lo, unsigned long hi) {
+    long n = 0;
+    
+    for(long k = secondaryLowerBound(sec, attr, lo);
+        k < sec->hdr.keys && sec->keys[k].attr == attr && sec->keys[k].key <= hi; k++) {
+        n += sec->keys[k].length;
+    }
+    for(long d = 0; d < sec->hdr.deltaCount; d++) {
+        if(sec->delta[d].attr == attr && sec->delta[d].key >= lo && sec->delta[d].key <= hi) n++;
+    }
+    return n;
+}
+
+static int compareSlots(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+// Read the slots listed under keys [lo, hi] of an attribute, sorted and
+// without repeats. Returns the number read, or -1.
+static long secondaryPostings(const SecondaryIndex *sec, int attr, unsigned long lo,
+                              unsigned long hi, long **out) {
+    long capacity = secondaryEstimate(sec, attr, lo, hi), n = 0, kept = 0;
+    long *slots = malloc((size_t)(capacity + 1) * sizeof(long));
+    
+    *out = slots;
+    if(slots == NULL) return -1;
+    
+    for(long k = secondaryLowerBound(sec, attr, lo);
+        k < sec->hdr.keys && sec->keys[k].attr == attr && sec->keys[k].key <= hi; k++) {
+        if(preadAll(sec->fd, slots + n, (size_t)sec->keys[k].length * sizeof(long),
+                    secondaryPostingPos(sec->keys[k].start)) != 0) {
+            return -1;
+        }
+        n += sec->keys[k].length;
+    }
+    for(long d = 0; d < sec->hdr.deltaCount; d++) {
+        if(sec->delta[d].attr == attr && sec->delta[d].key >= lo && sec->delta[d].key <= hi) {
+            slots[n++] = sec->delta[d].slot;
+        }
+    }
+    
+    // Lists of several keys, or with delta entries, need merging
+    qsort(slots, (size_t)n, sizeof(long), compareSlots);
+    for(long i = 0; i < n; i++) {
+        if(kept == 0 || slots[i] != slots[kept - 1]) slots[kept++] = slots[i];
+    }
+    return kept;
+}
+
+// Keep the slots of `a` that are also in `b`; both sorted
+static long intersectSlots(long *a, long na, const long *b, long nb) {
+    long i = 0, j = 0, kept = 0;
+    
+    while(i < na && j < nb) {
+        if(a[i] < b[j]) i++;
+        else if(a[i] > b[j]) j++;
+        else {
+            a[kept++] = a[i++];
+            j++;
+        }
+    }
+    return kept;
+}
+
+typedef struct {
+    const StudentQuery *query;
+    RecordVisitor visit;
+    void *ctx;
+    long matched;
+    int stopped;
+} QueryScan;
+
+static int visitIfMatches(const Student *s, long offset, void *ctx) {
+    QueryScan *qs = ctx;
+    
+    if(!queryMatches(qs->query, s)) return 0;
+    qs->matched++;
+    qs->stopped = qs->visit(s, offset, qs->ctx) != 0;
+    return qs->stopped;
+}
+
+// Run a query on the current shard (see queryDatabase()). Returns 0, -1
+// if the shard has no database or -2 if a record could not be read.
+static int queryShard(QueryScan *qs, long *examined) {
+    struct { int attr; unsigned long lo, hi; long estimate; } preds[ATTR_COUNT], tmp;
+    const StudentQuery *q = qs->query;
+    SecondaryIndex sec;
+    Snapshot snap;
+    Student *batch = NULL;
+    long *slots = NULL, n = 0;
+    int npreds = 0, rc = 0;
+    
+    if(snapshotOpen(&snap) != 0) return -1;
+    
+    if(q->department[0] != '\0') {
+        preds[npreds].attr = ATTR_DEPARTMENT;
+        preds[npreds].lo = preds[npreds].hi = textKey(q->department, sizeof(q->department));
+        npreds++;
+    }
+    if(q->course[0] != '\0') {
+        preds[npreds].attr = ATTR_COURSE;
+        preds[npreds].lo = preds[npreds].hi = textKey(q->course, sizeof(q->course));
+        npreds++;
+    }
+    if(q->yearMin > MIN_YEAR || q->yearMax < MAX_YEAR) {
+        preds[npreds].attr = ATTR_YEAR;
+        preds[npreds].lo = q->yearMin < 0 ? 0 : (unsigned long)q->yearMin;
+        preds[npreds].hi = q->yearMax < 0 ? 0 : (unsigned long)q->yearMax;
+        npreds++;
+    }
+    
+    if(npreds == 0 || q->yearMin > q->yearMax || openSecondary(&snap, &sec) != 0) {
+        // Nothing to narrow the search with
+        *examined += snap.count;
+        if(scanSnapshot(&snap, SCAN_LIVE, visitIfMatches, qs) < 0) rc = -2;
+        snapshotClose(&snap);
+        return rc;
+    }
+    
+    // Most selective list first
+    for(int i = 0; i < npreds; i++) {
+        preds[i].estimate = secondaryEstimate(&sec, preds[i].attr, preds[i].lo, preds[i].hi);
+        for(int j = i; j > 0 && preds[j].estimate < preds[j - 1].estimate; j--) {
+            tmp = preds[j];
+            preds[j] = preds[j - 1];
+            preds[j - 1] = tmp;
+        }
+    }
+    
+    n = secondaryPostings(&sec, preds[0].attr, preds[0].lo, preds[0].hi, &slots);
+    for(int i = 1; i < npreds && n > 0; i++) {
+        long *other, m;
+        
+        // Checking a few records beats reading a much longer list
+        if(preds[i].estimate > SECONDARY_INTERSECT_RATIO * n) break;
+        m = secondaryPostings(&sec, preds[i].attr, preds[i].lo, preds[i].hi, &other);
+        if(m >= 0) n = intersectSlots(slots, n, other, m);
+        free(other);
+    }
+    closeSecondary(&sec);
+    
+    // Fetch the candidates a batch at a time and check them in full
+    if(n > 0) batch = malloc(SCAN_BATCH * sizeof(Student));
+    if(n > 0 && batch == NULL) n = -1;
+    for(long first = 0; first < n && !qs->stopped; first += SCAN_BATCH) {
+        long count = n - first < SCAN_BATCH ? n - first : SCAN_BATCH;
+        
+        if(snapshotReadSlots(&snap, slots + first, count, batch) != 0) {
+            rc = -2;
+            break;
+        }
+        *examined += count;
+        
+        for(long i = 0; i < count && !qs->stopped; i++) {
+            visitIfMatches(&batch[i], slots[first + i] * (long)sizeof(Student), qs);
+        }
+    }
+    
+    free(batch);
+    free(slots);
+    snapshotClose(&snap);
+    return rc;
+}
+
+// Call `visit`, in file order, for every student matching a query as of
+// the start of the call. The equality and year predicates are answered from
+// the secondary indexes, most selective first; only records in every list
+// short enough to intersect are read. Queries without an indexed predicate
+// scan the table. The shards of a split table are queried in turn.
+// Returns the number of matches, -1 if there is no database or -2 if a
+// record could not be read; `examined` receives the number of records read.
+long queryDatabase(const StudentQuery *q, RecordVisitor visit, void *ctx, long *examined) {
+    QueryScan qs;
+    long start = metricsStart();
+    int found = 0, failed = 0;
+    
+    memset(&qs, 0, sizeof(qs));
+    qs.query = q;
+    qs.visit = visit;
+    qs.ctx = ctx;
+    *examined = 0;
+    
+    for(int k = 0; k < shardTotal() && !qs.stopped && !failed; k++) {
+        int rc;
+        
+        useShard(k);
+        rc = queryShard(&qs, examined);
+        if(rc != -1) found = 1;
+        if(rc == -2) failed = 1;
+    }
+    useShard(0);
+    metricsEnd(OP_QUERY, start);
+    if(failed) return -2;
+    return found ? qs.matched : -1;
+}
+
+// Parse "FROM[-TO]"; a single value is both ends
+static int parseRange(const char *s, float *lo, float *hi) {
+    char *end;
+    
+    *lo = strtof(s, &end);
+    if(end == s) return 0;
+    *hi = *lo;
+    if(*end == '-') {
+        s = end + 1;
+        *hi = strtof(s, &end);
+        if(end == s) return 0;
+    }
+    return *end == '\0';
+}
+
+static int writeCsvRow(const Student *s, long offset, void *ctx) {
+    char row[EXPORT_ROW_MAX];
+    (void)offset;
+    
+    fwrite(row, 1, formatCsvRow(row, s), (FILE *)ctx);
+    return 0;
+}
+
+// student_mgmt query [department=NAME] [course=NAME] [year=FROM[-TO]] [gpa=MIN[-MAX]]:
+// write the matching students to stdout as CSV
+int queryCommand(int argc, char *argv[]) {
+    StudentQuery q;
+    long matched, examined;
+    float lo, hi;
+    
+    queryInit(&q);
+    for(int i = 0; i < argc; i++) {
+        const char *value = strchr(argv[i], '=');
+        size_t name = value != NULL ? (size_t)(value - argv[i]) : 0;
+        
+        if(value == NULL) {
+            fprintf(stderr, "⚠ Expected name=value, got %s\n", argv[i]);
+            return 2;
+        }
+        value++;
+        
+        if(strncmp(argv[i], "department", name) == 0 && name > 0 && strlen(value) < sizeof(q.department)) {
+            strcpy(q.department, value);
+        } else if(strncmp(argv[i], "course", name) == 0 && name > 0 && strlen(value) < sizeof(q.course)) {
+            strcpy(q.course, value);
+        } else if(strncmp(argv[i], "year", name) == 0 && name > 0 && parseRange(value, &lo, &hi)) {
+            q.yearMin = (int)lo;
+            q.yearMax = (int)hi;
+        } else if(strncmp(argv[i], "gpa", name) == 0 && name > 0 && parseRange(value, &lo, &hi)) {
+            q.gpaMin = lo;
+            q.gpaMax = strchr(value, '-') != NULL ? hi : MAX_GPA;
+        } else {
+            fprintf(stderr, "⚠ Invalid filter %s\n", argv[i]);
+            return 2;
+        }
+    }
+    
+    printf("Roll Number,Name,Department,Course,Year Joined,GPA\n");
+    matched = queryDatabase(&q, writeCsvRow, stdout, &examined);
+    if(fflush(stdout) != 0) return 1;
+    if(matched < 0) {
+        fprintf(stderr, matched == -1 ? "⚠ No database to query!\n" : "⚠ Error: The database could not be read!\n");
+        return 1;
+    }
+    fprintf(stderr, "✓ %ld students matched (%ld records read)\n", matched, examined);
+    return 0;
+}
+
+// Search by department, course, year and GPA
+void searchByFilters() {
+    StudentQuery q;
+    char buffer[100];
+    long matched, examined;
+    float lo, hi;
+    
+    queryInit(&q);
+    printf("\n🔍 Enter filters (press Enter to skip one):\n\n");
+    
+    printf("Department: ");
+    if(fgets(buffer, sizeof(buffer), stdin) != NULL && buffer[0] != '\n') {
+        buffer[strcspn(buffer, "\n")] = '\0';
+        snprintf(q.department, sizeof(q.department), "%.*s", (int)sizeof(q.department) - 1, buffer);
+    }
+    
+    printf("Course: ");
+    if(fgets(buffer, sizeof(buffer), stdin) != NULL && buffer[0] != '\n') {
+        buffer[strcspn(buffer, "\n")] = '\0';
+        snprintf(q.course, sizeof(q.course), "%.*s", (int)sizeof(q.course) - 1, buffer);
+    }
+    
+    printf("Year joined (e.g. 2023 or 2020-2023): ");
+    if(fgets(buffer, sizeof(buffer), stdin) != NULL && buffer[0] != '\n') {
+        buffer[strcspn(buffer, "\n")] = '\0';
+        if(parseRange(buffer, &lo, &hi)) {
+            q.yearMin = (int)lo;
+            q.yearMax = (int)hi;
+        }
+    }
+    
+    printf("GPA range (e.g. 3.0-4.0): ");
+    if(fgets(buffer, sizeof(buffer), stdin) != NULL && buffer[0] != '\n') {
+        buffer[strcspn(buffer, "\n")] = '\0';
+        if(parseRange(buffer, &lo, &hi)) {
+            q.gpaMin = lo;
+            q.gpaMax = strchr(buffer, '-') != NULL ? hi : MAX_GPA;
+        }
+    }
+    
+    printHeader();
+    matched = queryDatabase(&q, printRow, NULL, &examined);
+    fputs(tableFooter, stdout);
+    if(matched == -2) {
+        printf("\n⚠ Error: The database could not be read!\n");
+    } else {
+        printf("\n%ld students found (%ld records read)\n", matched < 0 ? 0 : matched, examined);
+    }
+    
+    pressEnterToContinue();
+}
+
+// ─── Name search ────────────────────────────────────────────
+
+#define SEARCH_FIRST_BATCH 16               // candidates checked before the first answers
+#define TRIGRAM_READ 1024                   // postings read from a list at a time
+
+// TRI_FILE as of a snapshot: the header, directory and delta area read into memory
+typedef struct {
+    int fd;
+    SecondaryHeader hdr;
+    TrigramKey *keys;
+    TrigramDelta *delta;
+} TrigramIndex;
+
+static void closeTrigrams(TrigramIndex *tri) {
+    if(tri->fd >= 0) close(tri->fd);
+    free(tri->keys);
+    free(tri->delta);
+    memset(tri, 0, sizeof(*tri));
+    tri->fd = -1;
+}
+
+// Order delta entries by key, then slot, so a list's entries are together
+static int compareTrigramDeltas(const void *a, const void *b) {
+    const TrigramDelta *x = a, *y = b;
+    
+    if(x->key != y->key) return x->key < y->key ? -1 : 1;
+    return (x->slot > y->slot) - (x->slot < y->slot);
+}
+
+// Open TRI_FILE if it describes exactly the snapshot, rebuilding it from
+// the snapshot if it is missing or stale. Returns -1 if it cannot be used.
+static int openTrigrams(Snapshot *snap, TrigramIndex *tri) {
+    memset(tri, 0, sizeof(*tri));
+    tri->fd = -1;
+    
+    for(int attempt = 0; attempt < 2; attempt++) {
+        tri->fd = open(TRI_FILE, O_RDONLY);
+        
+        if(tri->fd >= 0 && preadAll(tri->fd, &tri->hdr, sizeof(tri->hdr), 0) == 0 &&
+           memcmp(tri->hdr.magic, TRIGRAM_MAGIC, sizeof(tri->hdr.magic)) == 0 &&
+           sameStamp(&tri->hdr.stamp, &snap->stamp)) {
+            tri->keys = malloc((size_t)(tri->hdr.keys + 1) * sizeof(TrigramKey));
+            tri->delta = malloc((size_t)(tri->hdr.deltaCount + 1) * sizeof(TrigramDelta));
+            if(tri->keys != NULL && tri->delta != NULL &&
+               preadAll(tri->fd, tri->keys, (size_t)tri->hdr.keys * sizeof(TrigramKey),
+                        trigramKeyPos(&tri->hdr, 0)) == 0 &&
+               preadAll(tri->fd, tri->delta, (size_t)tri->hdr.deltaCount * sizeof(TrigramDelta),
+                        trigramDeltaPos(&tri->hdr, 0)) == 0) {
+                qsort(tri->delta, (size_t)tri->hdr.deltaCount, sizeof(TrigramDelta), compareTrigramDeltas);
+                return 0;
+            }
+        }
+        closeTrigrams(tri);
+        if(attempt == 0 && rebuildTrigrams(snap) != 0) break;
+    }
+    return -1;
+}
+
+// A position in one key's list, read from TRI_FILE a block at a time and
+// merged with the list's delta entries
+typedef struct {
+    int fd;
+    long next, end;             // postings not read yet
+    unsigned int buf[TRIGRAM_READ];
+    int have, at;
+    const TrigramDelta *delta;  // the list's delta entries, by slot
+    long ndelta, dat;
+    long estimate;              // postings plus delta entries
+    long slot;                  // current slot, or -1 past the end
+} TrigramCursor;
+
+static int cursorFill(TrigramCursor *c) {
+    long n = c->end - c->next < TRIGRAM_READ ? c->end - c->next : TRIGRAM_READ;
+    
+    if(c->at < c->have || n == 0) return 0;
+    if(preadAll(c->fd, c->buf, (size_t)n * sizeof(unsigned int), trigramPostingPos(c->next)) != 0) {
+        return -1;
+    }
+    c->next += n;
+    c->have = (int)n;
+    c->at = 0;
+    return 0;
+}
+
+// Move to the first slot at or after `target`
+static int cursorSeek(TrigramCursor *c, long target) {
+    long posting, delta;
+    
+    for(;;) {
+        int lo, hi;
+        
+        if(cursorFill(c) != 0) return -1;
+        if(c->at == c->have) break;
+        if(c->buf[c->have - 1] < target) {
+            c->at = c->have;
+            continue;
+        }
+        lo = c->at;
+        hi = c->have - 1;
+        while(lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            
+            if(c->buf[mid] < target) lo = mid + 1;
+            else hi = mid;
+        }
+        c->at = lo;
+        break;
+    }
+    while(c->dat < c->ndelta && c->delta[c->dat].slot < target) c->dat++;
+    
+    posting = c->at < c->have ? (long)c->buf[c->at] : -1;
+    delta = c->dat < c->ndelta ? (long)c->delta[c->dat].slot : -1;
+    c->slot = posting < 0 ? delta : delta < 0 || posting < delta ? posting : delta;
+    return 0;
+}
+
+static int cursorOpen(const TrigramIndex *tri, unsigned int key, TrigramCursor *c) {
+    long lo = 0, hi = tri->hdr.keys;
+    
+    memset(c, 0, sizeof(*c));
+    c->fd = tri->fd;
+    while(lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        
+        if(tri->keys[mid].key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    if(lo < tri->hdr.keys && tri->keys[lo].key == key) {
+        c->next = tri->keys[lo].start;
+        c->end = c->next + tri->keys[lo].length;
+    }
+    
+    lo = 0;
+    hi = tri->hdr.deltaCount;
+    while(lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        
+        if(tri->delta[mid].key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    c->delta = tri->delta + lo;
+    while(lo + c->ndelta < tri->hdr.deltaCount && c->delta[c->ndelta].key == key) c->ndelta++;
+    
+    c->estimate = c->end - c->next + c->ndelta;
+    return cursorSeek(c, 0);
+}
+
+// The keys every name of a rank is listed under, sorted; 0 if the
+// pattern is too short to have any
+static int patternTrigrams(const char *pattern, size_t length, int rank, unsigned int *keys) {
+    char framed[sizeof(((Student *)0)->name) + 3];
+    size_t n = 0;
+    int count = 0;
+    
+    if(rank == MATCH_EXACT || rank == MATCH_PREFIX) framed[n++] = NAME_START;
+    if(rank == MATCH_WORD) framed[n++] = WORD_START;
+    memcpy(framed + n, pattern, length);
+    n += length;
+    if(rank == MATCH_EXACT) framed[n++] = NAME_END;
+    
+    for(size_t i = 0; i + 3 <= n; i++) keys[count++] = trigramAt(framed + i);
+    return uniqueTrigrams(keys, count);
+}
+
+typedef struct {
+    char pattern[sizeof(((Student *)0)->name) + 1];     // folded
+    size_t length;
+    int rank;           // the one rank visited in this pass
+    RecordVisitor visit;
+    void *ctx;
+    long matched;
+    int stopped;
+} NameSearch;
+
+static int visitIfRank(const Student *s, long offset, void *ctx) {
+    NameSearch *ns = ctx;
+    
+    if(!IS_LIVE(*s) || nameMatch(s->name, sizeof(s->name), ns->pattern, ns->length) != ns->rank) return 0;
+    ns->matched++;
+    ns->stopped = ns->visit(s, offset, ns->ctx) != 0;
+    return ns->stopped;
+}
+
+// Read a batch of candidates and check them in full
+static int checkCandidates(Snapshot *snap, const long *slots, long n, Student *batch,
+                           NameSearch *ns, long *examined) {
+    if(snapshotReadSlots(snap, slots, n, batch) != 0) return -1;
+    *examined += n;
+    for(long i = 0; i < n && !ns->stopped; i++) {
+        visitIfRank(&batch[i], slots[i] * (long)sizeof(Student), ns);
+    }
+    return 0;
+}
+
+// Visit the names of one rank, reading only the records listed under all
+// of its keys short enough to intersect. The lists are walked together a
+// block at a time, and the first batch of candidates is small, so the best
+// matches come back long before the lists have been read.
+static int searchRank(Snapshot *snap, const TrigramIndex *tri, const unsigned int *keys, int nkeys,
+                      NameSearch *ns, long *examined) {
+    TrigramCursor *cursors = malloc((size_t)nkeys * sizeof(TrigramCursor)), tmp;
+    Student *batch = malloc(SCAN_BATCH * sizeof(Student));
+    long *slots = malloc(SCAN_BATCH * sizeof(long));
+    long n = 0, want = SEARCH_FIRST_BATCH, candidate;
+    int used = 0, failed = 0;
+    
+    if(cursors == NULL || batch == NULL || slots == NULL) failed = 1;
+    
+    // Rarest list first; much longer ones are left to the full check
+    for(int i = 0; i < nkeys && !failed; i++) {
+        if(cursorOpen(tri, keys[i], &cursors[i]) != 0) failed = 1;
+        for(int j = i; j > 0 && cursors[j].estimate < cursors[j - 1].estimate; j--) {
+            tmp = cursors[j];
+            cursors[j] = cursors[j - 1];
+            cursors[j - 1] = tmp;
+        }
+    }
+    while(!failed && used < nkeys &&
+          (used == 0 || cursors[used].estimate <= SECONDARY_INTERSECT_RATIO * cursors[0].estimate)) {
+        used++;
+    }
+    
+    candidate = failed ? -1 : cursors[0].slot;
+    while(candidate >= 0 && !ns->stopped) {
+        int agreed = 1;
+        
+        for(int i = 1; i < used && agreed; i++) {
+            if(cursorSeek(&cursors[i], candidate) != 0) {
+                failed = 1;
+                candidate = -1;
+                break;
+            }
+            if(cursors[i].slot != candidate) {
+                agreed = 0;
+                candidate = cursors[i].slot;
+            }
+        }
+        if(candidate < 0) break;
+        if(!agreed) {
+            if(cursorSeek(&cursors[0], candidate) != 0) failed = 1;
+            candidate = failed ? -1 : cursors[0].slot;
+            continue;
+        }
+        
+        slots[n++] = candidate;
+        if(n == want) {
+            if(checkCandidates(snap, slots, n, batch, ns, examined) != 0) failed = 1;
+            n = 0;
+            want = want * 2 < SCAN_BATCH ? want * 2 : SCAN_BATCH;
+        }
+        if(!failed && cursorSeek(&cursors[0], candidate + 1) != 0) failed = 1;
+        candidate = failed ? -1 : cursors[0].slot;
+    }
+    if(!failed && n > 0 && !ns->stopped && checkCandidates(snap, slots, n, batch, ns, examined) != 0) {
+        failed = 1;
+    }
+    
+    free(cursors);
+    free(batch);
+    free(slots);
+    return failed ? -1 : 0;
+}
+
+// Call `visit` for every student whose name contains `pattern`, ignoring
+// case, as of the start of the call: exact names first, then names that
+// start with it, then names with a later word that does, then the rest;
+// file order within each, shard by shard. Ranks the pattern is too short
+// to have keys for scan the table. Returns the number of matches, -1 if
+// there is no database or -2 if a record could not be read; `examined`
+// receives the number of records read.
+long searchNames(const char *pattern, RecordVisitor visit, void *ctx, long *examined) {
+    int total = shardTotal(), found = 0;
+    NameSearch ns;
+    TrigramIndex *tri = calloc((size_t)total, sizeof(TrigramIndex));
+    Snapshot *snap = calloc((size_t)total, sizeof(Snapshot));
+    int *open = calloc((size_t)total, sizeof(int)), *indexed = calloc((size_t)total, sizeof(int));
+    long start = metricsStart();
+    
+    memset(&ns, 0, sizeof(ns));
+    ns.visit = visit;
+    ns.ctx = ctx;
+    *examined = 0;
+    
+    // Every shard is read as of the same moment
+    for(int k = 0; k < total && tri != NULL && snap != NULL && open != NULL && indexed != NULL; k++) {
+        useShard(k);
+        open[k] = snapshotOpen(&snap[k]) == 0;
+        found |= open[k];
+    }
+    
+    // Longer patterns cannot match any name
+    ns.length = strlen(pattern);
+    if(!found || ns.length == 0 || ns.length >= sizeof(ns.pattern)) {
+        ns.matched = found ? 0 : -1;
+        total = found ? total : 0;
+        goto done;
+    }
+    foldName(ns.pattern, pattern, ns.length);
+    for(int k = 0; k < total; k++) {
+        useShard(k);
+        indexed[k] = open[k] && openTrigrams(&snap[k], &tri[k]) == 0;
+    }
+    
+    for(ns.rank = MATCH_EXACT; ns.rank < MATCH_COUNT && !ns.stopped; ns.rank++) {
+        for(int k = 0; k < total && !ns.stopped; k++) {
+            unsigned int keys[TRIGRAM_MAX_KEYS];
+            int nkeys = indexed[k] ? patternTrigrams(ns.pattern, ns.length, ns.rank, keys) : 0;
+            
+            if(!open[k]) continue;
+            useShard(k);
+            if(nkeys == 0) {
+                *examined += snap[k].count;
+                if(scanSnapshot(&snap[k], SCAN_LIVE, visitIfRank, &ns) < 0) {
+                    ns.matched = -2;
+                    ns.stopped = 1;
+                }
+            } else if(searchRank(&snap[k], &tri[k], keys, nkeys, &ns, examined) != 0) {
+                ns.matched = -2;
+                ns.stopped = 1;
+            }
+        }
+    }
+    
+done:
+    for(int k = 0; k < total; k++) {
+        if(indexed[k]) closeTrigrams(&tri[k]);
+        if(open[k]) snapshotClose(&snap[k]);
+    }
+    useShard(0);
+    free(tri);
+    free(snap);
+    free(open);
+    free(indexed);
+    metricsEnd(OP_SEARCH, start);
+    return ns.matched;
+}
+
+typedef struct {
+    long limit;         // 0 for all
+    long rows;
+    long start;         // when the search began ...
+    long first;         // ... and when the first match came back
+} SearchOutput;
+
+static int writeSearchRow(const Student *s, long offset, void *ctx) {
+    SearchOutput *out = ctx;
+    
+    if(out->rows++ == 0) out->first = monotonicNs();
+    writeCsvRow(s, offset, stdout);
+    return out->limit > 0 && out->rows >= out->limit;
+}
+
+// student_mgmt search TEXT... [limit=N]: write the students whose names
+// contain TEXT to stdout as CSV, best matches first
+int searchCommand(int argc, char *argv[]) {
+    SearchOutput out;
+    char pattern[sizeof(((Student *)0)->name) + 1] = "";
+    long matched, examined;
+    size_t len = 0;
+    char *end;
+    
+    memset(&out, 0, sizeof(out));
+    for(int i = 0; i < argc; i++) {
+        if(strncmp(argv[i], "limit=", 6) == 0) {
+            out.limit = strtol(argv[i] + 6, &end, 10);
+            if(*end != '\0' || out.limit <= 0) {
+                fprintf(stderr, "⚠ Invalid option %s\n", argv[i]);
+                return 2;
+            }
+            continue;
+        }
+        
+        // Words of a name may come as separate arguments
+        if(len + (len > 0) + strlen(argv[i]) >= sizeof(pattern)) {
+            fprintf(stderr, "⚠ Name to search for is too long\n");
+            return 2;
+        }
+        len += (size_t)snprintf(pattern + len, sizeof(pattern) - len, "%s%s", len > 0 ? " " : "", argv[i]);
+    }
+    if(len == 0) {
+        fprintf(stderr, "⚠ Expected a name to search for\n");
+        return 2;
+    }
+    
+    printf("Roll Number,Name,Department,Course,Year Joined,GPA\n");
+    out.start = monotonicNs();
+    matched = searchNames(pattern, writeSearchRow, &out, &examined);
+    if(fflush(stdout) != 0) return 1;
+    if(matched < 0) {
+        fprintf(stderr, matched == -1 ? "⚠ No database to search!\n" : "⚠ Error: The database could not be read!\n");
+        return 1;
+    }
+    if(out.rows > 0) {
+        fprintf(stderr, "✓ %ld students matched (%ld records read, first after %.0f us)\n",
+                out.rows, examined, (out.first - out.start) / 1e3);
+    } else {
+        fprintf(stderr, "✓ No student's name contains \"%s\" (%ld records read)\n", pattern, examined);
+    }
+    return 0;
+}
+
+// Search by name from the menu, a page at a time
+void searchByName(const char *pattern) {
+    ReportPager pg;
+    long matched, examined;
+    
+    memset(&pg, 0, sizeof(pg));
+    pg.out.fd = STDOUT_FILENO;
+    pg.out.buf = malloc(REPORT_BUFFER);
+    if(pg.out.buf == NULL) return;
+    
+    fflush(stdout);
+    reportWrite(&pg.out, tableHeader, sizeof(tableHeader) - 1);
+    matched = searchNames(pattern, pageRow, &pg, &examined);
+    if(!pg.stopped) reportWrite(&pg.out, tableFooter, sizeof(tableFooter) - 1);
+    writeAll(STDOUT_FILENO, pg.out.buf, pg.out.len);
+    free(pg.out.buf);
+    
+    if(matched == -2) printf("\n⚠ Error: The database could not be read!\n");
+    else if(pg.stopped) printf("\n%ld students shown\n", pg.out.rows);
+    else printf("\n%ld students found (%ld records read)\n", matched < 0 ? 0 : matched, examined);
+}
+
+// Run a non-interactive command; returns the process exit status
+int runCommand(int argc, char *argv[]) {
+    if(strcmp(argv[0], "import") == 0 && argc == 2) {
+        long start = metricsStart();
+        int status = importCSV(argv[1]);
+        
+        metricsEnd(OP_IMPORT, start);
+        return status;
+    }
+    if(strcmp(argv[0], "update") == 0 && argc == 2) {
+        return updateCSV(argv[1]);
+    }
+    if(strcmp(argv[0], "export") == 0) {
+        return exportCommand(argc - 1, argv + 1);
+    }
+    if(strcmp(argv[0], "report") == 0) {
+        return reportCommand(argc - 1, argv + 1);
+    }
+    if(strcmp(argv[0], "group") == 0) {
+        return groupCommand(argc - 1, argv + 1);
+    }
+    if(strcmp(argv[0], "stats") == 0) {
+        return metricsCommand(argc - 1, argv + 1);
+    }
+    if(strcmp(argv[0], "query") == 0) {
+        return queryCommand(argc - 1, argv + 1);
+    }
+    if(strcmp(argv[0], "search") == 0) {
+        return searchCommand(argc - 1, argv + 1);
+    }
+    if(strcmp(argv[0], "verify-stats") == 0 && argc == 1) {
+        int drift = verifyStats();
+        
+        if(drift < 0) {
+            fprintf(stderr, drift == -1 ? "⚠ No database to verify!\n" : "⚠ Error: The database could not be read!\n");
+            return 1;
+        }
+        if(drift > 0) {
+            printf("⚠ Statistics had drifted in %d field(s); rebuilt from the records.\n", drift);
+            return 1;
+        }
+        printf("✓ Statistics match the records.\n");
+        return 0;
+    }
+    if(strcmp(argv[0], "generate") == 0) {
+        return generateCommand(argc - 1, argv + 1);
+    }
+    if(strcmp(argv[0], "bench") == 0) {
+        return benchCommand(argc - 1, argv + 1);
+    }
+    if(strcmp(argv[0], "serve") == 0 && argc <= 2) {
+        return serveDatabase(argc == 2 ? argv[1] : SOCKET_FILE);
+    }
+    if(strcmp(argv[0], "shard") == 0) {
+        return shardCommand(argc - 1, argv + 1);
+    }
+    if(strcmp(argv[0], "backup") == 0) {
+        return backupCommand(argc - 1, argv + 1);
+    }
+    if(strcmp(argv[0], "restore") == 0) {
+        return restoreCommand(argc - 1, argv + 1);
+    }
+    if(strcmp(argv[0], "schema") == 0) {
+        return schemaCommand(argc - 1, argv + 1);
+    }
+    if(strcmp(argv[0], "client") == 0 && argc >= 2) {
+        if(strcmp(argv[1], "-s") == 0 && argc >= 4) return runClient(argv[2], argc - 3, argv + 3);
+        return runClient(SOCKET_FILE, argc - 1, argv + 1);
+    }
+    
+    fprintf(stderr, "Usage: student_mgmt                    (interactive menu)\n");
+    fprintf(stderr, "       student_mgmt import <file.csv>\n");
+    fprintf(stderr, "       student_mgmt update <changes.csv>   (lines of roll_no,field,value)\n");
+    fprintf(stderr, "       student_mgmt export [file] [format=csv|columns]\n");
+    fprintf(stderr, "       student_mgmt export [file] since=SEQUENCE|last   (changed students only)\n");
+    fprintf(stderr, "       student_mgmt query [department=NAME] [course=NAME] [year=FROM[-TO]] [gpa=MIN[-MAX]]\n");
+    fprintf(stderr, "       student_mgmt search <name> [limit=N]\n");
+    fprintf(stderr, "       student_mgmt report [sort=FIELD[:desc]] [top=N] [format=table|csv] [out=FILE]\n");
+    fprintf(stderr, "       student_mgmt group [by=department,course,year] [format=table|csv] [out=FILE]\n");
+    fprintf(stderr, "       student_mgmt verify-stats\n");
+    fprintf(stderr, "       student_mgmt stats [prometheus]   (metrics recorded with SMS_METRICS=1)\n");
+    fprintf(stderr, "       student_mgmt migrate\n");
+    fprintf(stderr, "       student_mgmt schema [upgrade | migrate [rate=PAGES]]   (slot layouts, upgraded in place)\n");
+    fprintf(stderr, "       student_mgmt shard <count> [range=WIDTH|hash]\n");
+    fprintf(stderr, "       student_mgmt backup <dir>   (a consistent copy, taken while writers go on)\n");
+    fprintf(stderr, "       student_mgmt restore <dir> [check]\n");
+    fprintf(stderr, "       student_mgmt generate <count> [seed=N] [dept-skew=S] [course-skew=S]\n");
+    fprintf(stderr, "       student_mgmt bench [ops=N] [scans=N] [seed=N]\n");
+    fprintf(stderr, "       student_mgmt serve [socket]\n");
+    fprintf(stderr, "       student_mgmt client [-s socket] <get|add|put|del|stats|export|ping> [args...]\n");
+    fprintf(stderr, "       student_mgmt client [-s socket] -     (request lines from stdin)\n");
+    return 2;
+}
+
+// ─── Batch CSV import ───────────────────────────────────────
+
+#define IMPORT_CHUNK (1 << 20)
+#define IMPORT_MAX_REPORTED 20
+#define CSV_FIELDS 6
+#define CSV_FIELD_MAX 256
+
+// Open-addressing set of roll numbers used for duplicate detection
+typedef struct {
+    int *keys;          // 0 marks an empty slot; roll numbers are positive
+    long capacity;      // power of two
+    long count;
+} RollSet;
+
+// Add roll_no to the set. Returns 1 if added, 0 if already present, -1 on OOM.
+static int rollSetAdd(RollSet *set, int roll_no) {
+    long i;
+    
+    if((set->count + 1) * 2 > set->capacity) {
+        long newCap = set->capacity ? set->capacity * 2 : 1024;
+        int *keys = calloc((size_t)newCap, sizeof(int));
+        if(keys == NULL) return -1;
+        
+        for(long j = 0; j < set->capacity; j++) {
+            if(set->keys[j] == 0) continue;
+            i = hashSlot(set->keys[j], newCap);
+            while(keys[i] != 0) i = (i + 1) & (newCap - 1);
+            keys[i] = set->keys[j];
+        }
+        free(set->keys);
+        set->keys = keys;
+        set->capacity = newCap;
+    }
+    
+    i = hashSlot(roll_no, set->capacity);
+    while(set->keys[i] != 0) {
+        if(set->keys[i] == roll_no) return 0;
+        i = (i + 1) & (set->capacity - 1);
+    }
+    set->keys[i] = roll_no;
+    set->count++;
+    return 1;
+}
+
+// Incremental CSV parser (RFC 4180 quoting) fed one buffer at a time
+typedef struct {
+    char fields[CSV_FIELDS][CSV_FIELD_MAX];
+    int lens[CSV_FIELDS];
+    int nfields;        // fields seen in the current row
+    int overflow;       // a field was too long, or the row had too many
+    int state;
+    long line;          // current physical line
+    long rowLine;       // line the current row started on
+} CsvParser;
+
+enum { CSV_FIELD_START, CSV_UNQUOTED, CSV_QUOTED, CSV_QUOTE_IN_QUOTED };
+
+typedef void (*CsvRowHandler)(CsvParser *p, void *ctx);
+
+static void csvAppend(CsvParser *p, char c) {
+    int f = p->nfields - 1;
+    
+    if(f >= CSV_FIELDS || p->lens[f] >= CSV_FIELD_MAX - 1) {
+        p->overflow = 1;
+        return;
+    }
+    p->fields[f][p->lens[f]++] = c;
+}
+
+static void csvStartField(CsvParser *p) {
+    if(p->nfields >= CSV_FIELDS) {
+        p->overflow = 1;
+        p->nfields++;
+        return;
+    }
+    p->lens[p->nfields++] = 0;
+}
+
+static void csvEndRow(CsvParser *p, CsvRowHandler onRow, void *ctx) {
+    int n = p->nfields < CSV_FIELDS ? p->nfields : CSV_FIELDS;
+    
+    for(int f = 0; f < n; f++) p->fields[f][p->lens[f]] = '\0';
+    
+    // Blank lines are not rows
+    if(!(p->nfields == 1 && p->lens[0] == 0)) onRow(p, ctx);
+    
+    p->nfields = 0;
+    p->overflow = 0;
+    p->state = CSV_FIELD_START;
+    p->rowLine = p->line;
+}
+
+static void csvFeed(CsvParser *p, const char *buf, size_t n, CsvRowHandler onRow, void *ctx) {
+    for(size_t i = 0; i < n; i++) {
+        char c = buf[i];
+        
+        if(p->nfields == 0) csvStartField(p);
+        
+        switch(p->state) {
+            case CSV_FIELD_START:
+                if(c == '"') {
+                    p->state = CSV_QUOTED;
+                    break;
+                }
+                p->state = CSV_UNQUOTED;
+                /* fall through */
+            case CSV_UNQUOTED:
+                if(c == ',') {
+                    csvStartField(p);
+                    p->state = CSV_FIELD_START;
+                } else if(c == '\n') {
+                    p->line++;
+                    csvEndRow(p, onRow, ctx);
+                } else if(c != '\r') {
+                    csvAppend(p, c);
+                }
+                break;
+            case CSV_QUOTED:
+                if(c == '"') {
+                    p->state = CSV_QUOTE_IN_QUOTED;
+                } else {
+                    if(c == '\n') p->line++;
+                    csvAppend(p, c);
+                }
+                break;
+            case CSV_QUOTE_IN_QUOTED:
+                if(c == '"') {
+                    csvAppend(p, '"');
+                    p->state = CSV_QUOTED;
+                } else {
+                    // Closing quote; reprocess this byte as unquoted text
+                    p->state = CSV_UNQUOTED;
+                    i--;
+                }
+                break;
+        }
+    }
+}
+
+static void csvFinish(CsvParser *p, CsvRowHandler onRow, void *ctx) {
+    if(p->nfields > 0) csvEndRow(p, onRow, ctx);
+}
+
+// Parse a whole field as an int; rejects blanks and trailing junk
+static int parseIntField(const char *s, int *out) {
+    char *end;
+    long v;
+    
+    while(isspace((unsigned char)*s)) s++;
+    if(*s == '\0') return 0;
+    v = strtol(s, &end, 10);
+    while(isspace((unsigned char)*end)) end++;
+    if(*end != '\0' || v < -2147483647L || v > 2147483647L) return 0;
+    *out = (int)v;
+    return 1;
+}
+
+// Parse a whole field as a float; rejects blanks and trailing junk
+static int parseFloatField(const char *s, float *out) {
+    char *end;
+    
+    while(isspace((unsigned char)*s)) s++;
+    if(*s == '\0') return 0;
+    *out = strtof(s, &end);
+    while(isspace((unsigned char)*end)) end++;
+    return *end == '\0';
+}
+
+typedef struct {
+    RollSet seen;       // roll numbers already in DB_FILE or earlier rows
+    Student *rows;      // validated rows waiting to be written
+    long count;
+    long capacity;
+    long rowsRead;
+    long rejected;
+    int failed;         // out of memory
+} ImportState;
+
+// Report a bad input row; past IMPORT_MAX_REPORTED they are only counted
+static void rejectRow(long *rejected, long line, const char *reason) {
+    if(*rejected < IMPORT_MAX_REPORTED) {
+        printf("  ⚠ line %-8ld %s\n", line, reason);
+    }
+    (*rejected)++;
+}
+
+// Validate one CSV row with the same rules addStudent() enforces
+static void importRow(CsvParser *p, void *ctx) {
+    ImportState *st = ctx;
+    Student s;
+    
+    // Skip the header exportToCSV() writes
+    if(p->rowLine == 1 && strcmp(p->fields[0], "Roll Number") == 0) {
+        return;
+    }
+    st->rowsRead++;
+    
+    if(p->nfields != CSV_FIELDS) {
+        rejectRow(&st->rejected, p->rowLine, "wrong number of fields (expected 6)");
+        return;
+    }
+    if(p->overflow) {
+        rejectRow(&st->rejected, p->rowLine, "field too long");
+        return;
+    }
+    
+    memset(&s, 0, sizeof(s));
+    if(!parseIntField(p->fields[0], &s.roll_no) || s.roll_no <= 0) {
+        rejectRow(&st->rejected, p->rowLine, "roll number must be a positive integer");
+        return;
+    }
+    if(p->lens[1] == 0) {
+        rejectRow(&st->rejected, p->rowLine, "name cannot be empty");
+        return;
+    }
+    if(p->lens[1] >= (int)sizeof(s.name) || p->lens[2] >= (int)sizeof(s.department) ||
+       p->lens[3] >= (int)sizeof(s.course)) {
+        rejectRow(&st->rejected, p->rowLine, "name, department or course too long");
+        return;
+    }
+    if(!parseIntField(p->fields[4], &s.year_joined) || !isValidYear(s.year_joined)) {
+        rejectRow(&st->rejected, p->rowLine, "year must be between 2000 and 2025");
+        return;
+    }
+    if(!parseFloatField(p->fields[5], &s.gpa) || !isValidGPA(s.gpa)) {
+        rejectRow(&st->rejected, p->rowLine, "GPA must be between 0.0 and 4.0");
+        return;
+    }
+    memcpy(s.name, p->fields[1], (size_t)p->lens[1]);
+    memcpy(s.department, p->fields[2], (size_t)p->lens[2]);
+    memcpy(s.course, p->fields[3], (size_t)p->lens[3]);
+    
+    switch(rollSetAdd(&st->seen, s.roll_no)) {
+        case 0:
+            rejectRow(&st->rejected, p->rowLine, "duplicate roll number");
+            return;
+        case -1:
+            st->failed = 1;
+            return;
+    }
+    
+    if(st->count == st->capacity) {
+        long newCap = st->capacity ? st->capacity * 2 : 4096;
+        Student *rows = realloc(st->rows, (size_t)newCap * sizeof(Student));
+        if(rows == NULL) {
+            st->failed = 1;
+            return;
+        }
+        st->rows = rows;
+        st->capacity = newCap;
+    }
+    st->rows[st->count++] = s;
+}
+
+static int seedRollSet(const Student *s, long offset, void *ctx) {
+    ImportState *st = ctx;
+    (void)offset;
+    
+    if(rollSetAdd(&st->seen, s->roll_no) < 0) {
+        st->failed = 1;
+        return 1;
+    }
+    return 0;
+}
+
+// Import students from a CSV file in the format exportToCSV() writes.
+// Valid rows are appended to DB_FILE as one transaction, one per shard of
+// a split table; bad rows are reported.
+int importCSV(const char *path) {
+    ImportState st;
+    CsvParser parser;
+    FILE *in;
+    char *buf;
+    size_t n;
+    int failed = 0;
+    
+    memset(&st, 0, sizeof(st));
+    memset(&parser, 0, sizeof(parser));
+    parser.line = parser.rowLine = 1;
+    
+    in = fopen(path, "rb");
+    if(in == NULL) {
+        fprintf(stderr, "⚠ Cannot open %s\n", path);
+        return 1;
+    }
+    
+    buf = malloc(IMPORT_CHUNK);
+    if(buf == NULL) {
+        fclose(in);
+        return 1;
+    }
+    
+    // One pass over the database seeds the duplicate set. The writer lock
+    // keeps other writers out until the rows are in.
+    if(lockWriter() != 0) {
+        fprintf(stderr, "⚠ Error: Cannot lock %s!\n", LOCK_FILE);
+        fclose(in);
+        free(buf);
+        return 1;
+    }
+    if(scanShards(SCAN_LIVE, seedRollSet, &st) == -2) {
+        unlockWriter();
+        fprintf(stderr, "⚠ Error: The database could not be read!\n");
+        fclose(in);
+        free(buf);
+        free(st.seen.keys);
+        return 1;
+    }
+    
+    printf("Importing %s...\n", path);
+    while(!st.failed && (n = countedRead(buf, 1, IMPORT_CHUNK, in)) > 0) {
+        csvFeed(&parser, buf, n, importRow, &st);
+    }
+    if(!st.failed) csvFinish(&parser, importRow, &st);
+    fclose(in);
+    free(buf);
+    
+    if(st.failed) {
+        unlockWriter();
+        fprintf(stderr, "⚠ Out of memory while importing!\n");
+        free(st.seen.keys);
+        free(st.rows);
+        return 1;
+    }
+    
+    if(st.rejected > IMPORT_MAX_REPORTED) {
+        printf("  ... and %ld more rejected rows\n", st.rejected - IMPORT_MAX_REPORTED);
+    }
+    
+    // Append every valid row and commit, then re-index
+    for(int k = 0; k < shardTotal() && !failed; k++) {
+        long added = 0;
+        
+        useShard(k);
+        walBegin();
+        for(long i = 0; i < st.count; i++) {
+            if(shardOf(st.rows[i].roll_no) != k) continue;
+            writeStudent(&st.rows[i], -1, INDEX_PUT);
+            added++;
+        }
+        failed = walCommit() != 0;
+        if(!failed && added > 0) rebuildIndex();
+    }
+    useShard(0);
+    unlockWriter();
+    if(failed) {
+        fprintf(stderr, "⚠ Error: Failed to save imported students!\n");
+        free(st.seen.keys);
+        free(st.rows);
+        return 1;
+    }
+    
+    printf("\n✓ Import complete: %ld rows read, %ld imported, %ld rejected.\n",
+           st.rowsRead, st.count, st.rejected);
+    
+    free(st.seen.keys);
+    free(st.rows);
+    return 0;
+}
+
+// ─── Batch updates ──────────────────────────────────────────
+
+enum { CHANGE_NAME, CHANGE_DEPARTMENT, CHANGE_COURSE, CHANGE_YEAR, CHANGE_GPA, CHANGE_FIELD_COUNT };
+
+static const char *const changeFields[CHANGE_FIELD_COUNT] = {
+    "name", "department", "course", "year", "gpa"
+};
+
+// One validated line of an update file
+typedef struct {
+    int roll_no;
+    int field;          // CHANGE_*
+    long line;
+    int year;
+    float gpa;
+    char text[50];      // room for the longest text field
+} Change;
+
+typedef struct {
+    Change *changes;
+    long count;
+    long capacity;
+    long rowsRead;
+    long rejected;
+    int failed;         // out of memory
+} UpdateBatch;
+
+// A student's record with its changes applied, and the slot it goes back to
+typedef struct {
+    long offset;
+    Student s;
+} PendingUpdate;
+
+// Validate one "roll_no,field,value" row with the rules updateStudent()
+// and addStudent() enforce
+static void updateRow(CsvParser *p, void *ctx) {
+    UpdateBatch *b = ctx;
+    Student s;
+    Change c;
+    
+    // An optional header
+    if(p->rowLine == 1 && strcmp(p->fields[0], "roll_no") == 0) return;
+    b->rowsRead++;
+    
+    if(p->nfields != 3) {
+        rejectRow(&b->rejected, p->rowLine, "wrong number of fields (expected roll_no,field,value)");
+        return;
+    }
+    if(p->overflow) {
+        rejectRow(&b->rejected, p->rowLine, "field too long");
+        return;
+    }
+    
+    memset(&c, 0, sizeof(c));
+    c.line = p->rowLine;
+    if(!parseIntField(p->fields[0], &c.roll_no) || c.roll_no <= 0) {
+        rejectRow(&b->rejected, p->rowLine, "roll number must be a positive integer");
+        return;
+    }
+    for(c.field = 0; c.field < CHANGE_FIELD_COUNT; c.field++) {
+        if(strcmp(p->fields[1], changeFields[c.field]) == 0) break;
+    }
+    
+    switch(c.field) {
+        case CHANGE_NAME:
+            if(p->lens[2] == 0) {
+                rejectRow(&b->rejected, p->rowLine, "name cannot be empty");
+                return;
+            }
+            /* fall through */
+        case CHANGE_DEPARTMENT:
+        case CHANGE_COURSE:
+            if(p->lens[2] >= (int)(c.field == CHANGE_COURSE ? sizeof(s.course) : sizeof(s.name))) {
+                rejectRow(&b->rejected, p->rowLine, "name, department or course too long");
+                return;
+            }
+            memcpy(c.text, p->fields[2], (size_t)p->lens[2]);
+            break;
+        case CHANGE_YEAR:
+            if(!parseIntField(p->fields[2], &c.year) || !isValidYear(c.year)) {
+                rejectRow(&b->rejected, p->rowLine, "year must be between 2000 and 2025");
+                return;
+            }
+            break;
+        case CHANGE_GPA:
+            if(!parseFloatField(p->fields[2], &c.gpa) || !isValidGPA(c.gpa)) {
+                rejectRow(&b->rejected, p->rowLine, "GPA must be between 0.0 and 4.0");
+                return;
+            }
+            break;
+        default:
+            rejectRow(&b->rejected, p->rowLine, "field must be name, department, course, year or gpa");
+            return;
+    }
+    
+    if(b->count == b->capacity) {
+        long newCap = b->capacity ? b->capacity * 2 : 4096;
+        Change *changes = realloc(b->changes, (size_t)newCap * sizeof(Change));
+        if(changes == NULL) {
+            b->failed = 1;
+            return;
+        }
+        b->changes = changes;
+        b->capacity = newCap;
+    }
+    b->changes[b->count++] = c;
+}
+
+// By roll number, then file order so a later line wins
+static int compareChanges(const void *a, const void *b) {
+    const Change *x = a, *y = b;
+    
+    if(x->roll_no != y->roll_no) return x->roll_no < y->roll_no ? -1 : 1;
+    return (x->line > y->line) - (x->line < y->line);
+}
+
+static int comparePending(const void *a, const void *b) {
+    const PendingUpdate *x = a, *y = b;
+    
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+static void applyChange(Student *s, const Change *c) {
+    switch(c->field) {
+        case CHANGE_NAME: memcpy(s->name, c->text, sizeof(s->name)); break;
+        case CHANGE_DEPARTMENT: memcpy(s->department, c->text, sizeof(s->department)); break;
+        case CHANGE_COURSE:
+            memcpy(s->course, c->text, sizeof(s->course) - 1);
+            s->course[sizeof(s->course) - 1] = '\0';
+            break;
+        case CHANGE_YEAR: s->year_joined = c->year; break;
+        case CHANGE_GPA: s->gpa = c->gpa; break;
+    }
+}
+
+// Apply a file of "roll_no,field,value" changes as one batch. Every line
+// is validated and every student found before anything is written; if any
+// line is rejected nothing changes. The changes are sorted by roll number,
+// merged into one new image per student and written in file order, so a
+// large batch reaches DB_FILE as runs of adjacent pages. A split table
+// prepares one transaction per shard and commits them together with
+// commitShards(). Returns the process exit status.
+int updateCSV(const char *path) {
+    UpdateBatch b;
+    CsvParser parser;
+    PendingUpdate *pending = NULL;
+    PreparedTxn prepared[SHARD_MAX];
+    long shardStart[SHARD_MAX + 1], npending = 0;
+    FILE *in;
+    char *buf;
+    size_t n;
+    int nprepared = 0, failed = 0;
+    
+    memset(&b, 0, sizeof(b));
+    memset(&parser, 0, sizeof(parser));
+    parser.line = parser.rowLine = 1;
+    
+    in = fopen(path, "rb");
+    if(in == NULL) {
+        fprintf(stderr, "⚠ Cannot open %s\n", path);
+        return 1;
+    }
+    buf = malloc(IMPORT_CHUNK);
+    if(buf == NULL) {
+        fclose(in);
+        return 1;
+    }
+    
+    printf("Checking %s...\n", path);
+    while(!b.failed && (n = countedRead(buf, 1, IMPORT_CHUNK, in)) > 0) {
+        csvFeed(&parser, buf, n, updateRow, &b);
+    }
+    if(!b.failed) csvFinish(&parser, updateRow, &b);
+    fclose(in);
+    free(buf);
+    
+    if(!b.failed && b.count > 0) {
+        qsort(b.changes, (size_t)b.count, sizeof(Change), compareChanges);
+        pending = malloc((size_t)b.count * sizeof(PendingUpdate));
+        if(pending == NULL) b.failed = 1;
+    }
+    if(b.failed) {
+        fprintf(stderr, "⚠ Out of memory while updating!\n");
+        free(b.changes);
+        return 1;
+    }
+    
+    // Find every student under the writer lock, shard by shard, and fold
+    // their changes into the record
+    lockWriter();
+    for(int k = 0; k < shardTotal(); k++) {
+        shardStart[k] = npending;
+        for(long i = 0, next; i < b.count; i = next) {
+            PendingUpdate *u = &pending[npending];
+            
+            for(next = i + 1; next < b.count && b.changes[next].roll_no == b.changes[i].roll_no; next++);
+            if(shardOf(b.changes[i].roll_no) != k) continue;
+            
+            u->offset = findStudent(b.changes[i].roll_no, &u->s);
+            for(long j = i; j < next; j++) {
+                if(u->offset < 0) {
+                    rejectRow(&b.rejected, b.changes[j].line, "no student with this roll number");
+                } else {
+                    applyChange(&u->s, &b.changes[j]);
+                }
+            }
+            if(u->offset >= 0) npending++;
+        }
+        qsort(pending + shardStart[k], (size_t)(npending - shardStart[k]), sizeof(PendingUpdate), comparePending);
+    }
+    shardStart[shardTotal()] = npending;
+    
+    if(b.rejected > IMPORT_MAX_REPORTED) {
+        printf("  ... and %ld more rejected lines\n", b.rejected - IMPORT_MAX_REPORTED);
+    }
+    
+    // All or nothing, across shards too
+    for(int k = 0; k < shardTotal() && b.rejected == 0 && !failed; k++) {
+        if(shardStart[k + 1] == shardStart[k]) continue;
+        useShard(k);
+        walBegin();
+        for(long i = shardStart[k]; i < shardStart[k + 1]; i++) {
+            writeStudent(&pending[i].s, pending[i].offset, INDEX_PUT);
+        }
+        if(walFinish(&prepared[nprepared]) == 0) {
+            nprepared++;
+        } else {
+            failed = -1;
+        }
+    }
+    useShard(0);
+    if(failed) {
+        abortPrepared(prepared, nprepared);
+    } else {
+        failed = commitShards(prepared, nprepared);
+    }
+    unlockWriter();
+    
+    free(pending);
+    free(b.changes);
+    if(failed == -2) {
+        fprintf(stderr, "⚠ Error: The updates are committed but not yet copied into every shard;\n"
+                        "  the next student_mgmt run finishes them.\n");
+        return 1;
+    }
+    if(failed) {
+        fprintf(stderr, "⚠ Error: Failed to save the updates; no students were updated.\n");
+        return 1;
+    }
+    if(b.rejected > 0) {
+        printf("\n⚠ %ld of %ld lines rejected; no students were updated.\n", b.rejected, b.rowsRead);
+        return 1;
+    }
+    printf("\n✓ Update complete: %ld changes applied to %ld students.\n", b.count, npending);
+    return 0;
+}
+
+// ─── Backups ────────────────────────────────────────────────
+
+static void backupPath(char *buf, size_t size, const char *dir, const char *name) {
+    snprintf(buf, size, "%s/%s", dir, name);
+}
+
+// Flush a file, and the directory entry naming it, to disk
+static int syncPath(const char *path) {
+    int fd = open(path, O_RDONLY), rc;
+    
+    if(fd < 0) return -1;
+    rc = syncFile(fd);
+    close(fd);
+    syncDirectory(path);
+    return rc;
+}
+
+// Size and CRC-32C of a whole file
+static int fileChecksum(const char *path, long *size, unsigned int *crc) {
+    unsigned char *buf = malloc(BACKUP_BUFFER);
+    int fd = buf == NULL ? -1 : open(path, O_RDONLY);
+    ssize_t n = 0;
+    
+    *size = 0;
+    *crc = 0;
+    if(fd < 0) {
+        free(buf);
+        return -1;
+    }
+    while((n = read(fd, buf, BACKUP_BUFFER)) != 0) {
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            break;
+        }
+        metricsAdd(METRIC_BYTES_READ, n);
+        *crc = crc32cUpdate(*crc, buf, (size_t)n);
+        *size += n;
+    }
+    close(fd);
+    free(buf);
+    return n < 0 ? -1 : 0;
+}
+
+// Make `to` a reflink of `from`: it shares the blocks, so this takes the
+// same time however big the file is, and either file's later writes go to
+// new blocks. Fails on a filesystem that cannot do it.
+static int cloneFile(const char *from, const char *to) {
+    int in = open(from, O_RDONLY), out, rc;
+    
+    if(in < 0) return -1;
+    out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    rc = out >= 0 && ioctl(out, FICLONE, in) == 0 ? 0 : -1;
+    close(in);
+    if(out >= 0 && close(out) != 0) rc = -1;
+    if(rc != 0 && out >= 0) remove(to);
+    return rc;
+}
+
+// Copy a file, as a reflink where the filesystem can, and have the copy on
+// disk
+static int copyFile(const char *from, const char *to) {
+    char *buf;
+    int in, out, failed = 0;
+    ssize_t n;
+    
+    if(cloneFile(from, to) == 0) return syncPath(to);
+    
+    in = open(from, O_RDONLY);
+    if(in < 0) return -1;
+    out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    buf = malloc(BACKUP_BUFFER);
+    if(out < 0 || buf == NULL) failed = 1;
+    while(!failed && (n = read(in, buf, BACKUP_BUFFER)) != 0) {
+        if(n < 0) {
+            if(errno != EINTR) failed = 1;
+            continue;
+        }
+        metricsAdd(METRIC_BYTES_READ, n);
+        if(writeAll(out, buf, (size_t)n) != 0) failed = 1;
+    }
+    if(!failed && syncData(out) != 0) failed = 1;
+    if(out >= 0 && close(out) != 0) failed = 1;
+    close(in);
+    free(buf);
+    if(failed) {
+        if(out >= 0) remove(to);
+        return -1;
+    }
+    syncDirectory(to);
+    return 0;
+}
+
+// List a file in the backup; its size and checksum come from backupSeal()
+static int backupAdd(Backup *b, const char *name) {
+    if(b->count == BACKUP_MAX_FILES || strlen(name) >= SHARD_PATH_MAX) return -1;
+    strcpy(b->files[b->count++].name, name);
+    return 0;
+}
+
+// Remove the files listed so far, for a backup that cannot be finished
+static void backupDiscard(Backup *b) {
+    char path[DB_PATH_MAX];
+    
+    for(int i = 0; i < b->count; i++) {
+        backupPath(path, sizeof(path), b->dir, b->files[i].name);
+        remove(path);
+    }
+    b->count = 0;
+}
+
+// Clone every file into the backup while writers are held off, which takes
+// about as long as one small transaction whatever the size of the table.
+// Returns 0, or -1 with nothing left behind.
+static int backupClone(Backup *b) {
+    char path[DB_PATH_MAX], heap[256];
+    DbFile db;
+    int failed = 0;
+    
+    if(lockWriter() != 0) return -1;
+    for(int k = 0; k < shardTotal() && !failed; k++) {
+        useShard(k);
+        finishApplying();
+        if(dbOpen(&db, O_RDONLY) != 0) {
+            failed = 1;
+            break;
+        }
+        heapPath(heap, sizeof(heap), db.heap.generation);
+        if(db.heap.fd >= 0) failed = backupAdd(b, heap) != 0;
+        dbClose(&db);
+        if(backupAdd(b, DB_FILE) != 0) failed = 1;
+    }
+    useShard(0);
+    
+    if(!failed && access(CHG_FILE, F_OK) == 0) failed = backupAdd(b, CHG_FILE) != 0;
+    if(!failed && shardMap.count > 0) failed = backupAdd(b, SHARD_FILE) != 0;
+    for(int i = 0; i < b->count && !failed; i++) {
+        backupPath(path, sizeof(path), b->dir, b->files[i].name);
+        if(cloneFile(b->files[i].name, path) != 0) failed = 1;
+    }
+    b->seq = feedLast();
+    unlockWriter();
+    
+    if(failed) backupDiscard(b);
+    return failed ? -1 : 0;
+}
+
+static int streamRecord(const Student *s, long offset, void *ctx) {
+    PageStream *out = ctx;
+    (void)offset;
+    
+    streamAdd(out, s);
+    return out->failed;
+}
+
+// Write out what a snapshot of every shard shows while writers go on: the
+// live records, as compaction copies them, with each shard's dictionary
+// in a heap of the same generation, and the change feed up to the
+// snapshot. Returns 0, or -1 with nothing left behind.
+static int backupStream(Backup *b) {
+    static Snapshot snaps[SHARD_MAX];
+    char path[DB_PATH_MAX], strFile[DB_PATH_MAX], heap[256];
+    FeedEntry *entries = NULL;
+    PageStream out;
+    long n, last;
+    int failed = 0;
+    
+    if(snapshotOpenShards(snaps) != 0) return -1;
+    b->seq = snaps[0].seq;
+    for(int k = 0; k < shardTotal() && !failed; k++) {
+        const char *live;
+        unsigned int generation = snaps[k].db.heap.fd >= 0 ? snaps[k].db.heap.generation : 1;
+        int layout = snaps[k].db.layout > 0 ? snaps[k].db.layout : DB_LAYOUT;
+        int rc;
+        
+        useShard(k);
+        heapPath(heap, sizeof(heap), generation);
+        if(backupAdd(b, heap) != 0 || backupAdd(b, DB_FILE) != 0 ||
+           (snaps[k].db.heap.fd >= 0 && dictSync(snaps[k].db.heap.fd) != 0)) {
+            failed = 1;
+            break;
+        }
+        
+        // streamOpen() puts the heap next to STR_FILE
+        live = STR_FILE;
+        backupPath(strFile, sizeof(strFile), b->dir, STR_FILE);
+        backupPath(path, sizeof(path), b->dir, DB_FILE);
+        STR_FILE = strFile;
+        rc = streamOpen(&out, path, generation, layout);
+        STR_FILE = live;
+        if(rc == 0 && scanSnapshot(&snaps[k], SCAN_LIVE, streamRecord, &out) < 0) out.failed = 1;
+        if(streamClose(&out) != 0) failed = 1;
+    }
+    useShard(0);
+    
+    // Compaction, which rewrites the feed, waits for the snapshots to close
+    n = failed ? 0 : feedRead(0, &entries, &last);
+    if(n < 0) failed = 1;
+    while(n > 0 && entries[n - 1].seq > b->seq) n--;
+    if(n > 0) {
+        backupPath(path, sizeof(path), b->dir, CHG_FILE);
+        if(backupAdd(b, CHG_FILE) != 0 || feedWrite(path, entries, n) != 0) failed = 1;
+    }
+    free(entries);
+    for(int k = 0; k < shardTotal(); k++) snapshotClose(&snaps[k]);
+    
+    if(!failed && shardMap.count > 0) {
+        backupPath(path, sizeof(path), b->dir, SHARD_FILE);
+        if(backupAdd(b, SHARD_FILE) != 0 || copyFile(SHARD_FILE, path) != 0) failed = 1;
+    }
+    if(failed) backupDiscard(b);
+    return failed ? -1 : 0;
+}
+
+// Have the backup's files on disk and note their sizes and checksums
+static int backupSeal(Backup *b) {
+    char path[DB_PATH_MAX];
+    
+    for(int i = 0; i < b->count; i++) {
+        backupPath(path, sizeof(path), b->dir, b->files[i].name);
+        if(syncPath(path) != 0 || fileChecksum(path, &b->files[i].size, &b->files[i].crc) != 0) return -1;
+    }
+    return 0;
+}
+
+// Write MANIFEST last; a backup directory without one is not a backup
+static int writeManifest(const Backup *b) {
+    char path[DB_PATH_MAX], tmpName[DB_PATH_MAX + 4];
+    FILE *out;
+    int failed;
+    
+    backupPath(path, sizeof(path), b->dir, BACKUP_MANIFEST);
+    snprintf(tmpName, sizeof(tmpName), "%s.tmp", path);
+    out = fopen(tmpName, "w");
+    if(out == NULL) return -1;
+    fprintf(out, "%s %d\nsequence %ld\nshards %d\n", BACKUP_MAGIC, BACKUP_VERSION, b->seq, b->shards);
+    for(int i = 0; i < b->count; i++) {
+        fprintf(out, "%s %ld %08x\n", b->files[i].name, b->files[i].size, b->files[i].crc);
+    }
+    failed = fflush(out) != 0 || syncFile(fileno(out)) != 0;
+    if(fclose(out) != 0) failed = 1;
+    if(failed || rename(tmpName, path) != 0) {
+        remove(tmpName);
+        return -1;
+    }
+    syncDirectory(path);
+    return 0;
+}
+
+// Read a backup's MANIFEST. Names must stay inside the database directory.
+// Returns 0, or -1 if it is missing or damaged.
+static int readManifest(Backup *b, const char *dir) {
+    char path[DB_PATH_MAX], magic[16];
+    FILE *in;
+    int version, ok;
+    
+    memset(b, 0, sizeof(*b));
+    b->dir = dir;
+    backupPath(path, sizeof(path), dir, BACKUP_MANIFEST);
+    in = fopen(path, "r");
+    if(in == NULL) return -1;
+    
+    ok = fscanf(in, "%15s %d sequence %ld shards %d", magic, &version, &b->seq, &b->shards) == 4 &&
+         strcmp(magic, BACKUP_MAGIC) == 0 && version == BACKUP_VERSION && b->shards >= 0 && b->shards <= SHARD_MAX;
+    while(ok) {
+        BackupFile f;
+        int n = fscanf(in, "%63s %ld %x", f.name, &f.size, &f.crc);
+        
+        if(n == EOF) break;
+        ok = n == 3 && f.size >= 0 && f.name[0] != '/' && strstr(f.name, "..") == NULL &&
+             b->count < BACKUP_MAX_FILES;
+        if(ok) b->files[b->count++] = f;
+    }
+    fclose(in);
+    return ok && b->count > 0 ? 0 : -1;
+}
+
+// Check every file of a backup against its manifest line. Returns the
+// number that do not match.
+static int verifyBackup(const Backup *b) {
+    char path[DB_PATH_MAX];
+    unsigned int crc;
+    long size;
+    int bad = 0;
+    
+    for(int i = 0; i < b->count; i++) {
+        backupPath(path, sizeof(path), b->dir, b->files[i].name);
+        if(fileChecksum(path, &size, &crc) != 0 || size != b->files[i].size || crc != b->files[i].crc) {
+            fprintf(stderr, "  ⚠ %s does not match the manifest\n", path);
+            bad++;
+        }
+    }
+    return bad;
+}
+
+// Copy the database into a new directory as it is at one moment, while
+// other processes go on writing: "backup <dir>". Where the filesystem can
+// share blocks the files are cloned under the writer lock, which holds
+// writers off for about as long as a transaction; elsewhere the copy is
+// written from a snapshot. Returns the process exit status.
+int backupCommand(int argc, char *argv[]) {
+    static Backup b;
+    char path[DB_PATH_MAX];
+    int cloned, failed;
+    
+    if(argc != 1 || strlen(argv[0]) > DB_PATH_MAX / 2) {
+        fprintf(stderr, "⚠ Expected a directory to create for the backup\n");
+        return 2;
+    }
+    for(int k = 0; k < shardTotal(); k++) {
+        useShard(k);
+        if(access(DB_FILE, F_OK) != 0) {
+            useShard(0);
+            fprintf(stderr, "⚠ No database to back up!\n");
+            return 1;
+        }
+    }
+    useShard(0);
+    
+    // A new directory, so that no stale file can pass for part of the copy
+    memset(&b, 0, sizeof(b));
+    b.dir = argv[0];
+    b.shards = shardMap.count;
+    if(mkdir(b.dir, 0755) != 0) {
+        fprintf(stderr, "⚠ Cannot create %s: %s\n", b.dir, strerror(errno));
+        return 1;
+    }
+    for(int k = 0; k < shardMap.count; k++) {
+        snprintf(path, sizeof(path), "%s/shard%d", b.dir, k);
+        if(mkdir(path, 0755) != 0) {
+            fprintf(stderr, "⚠ Cannot create %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+    }
+    
+    cloned = backupClone(&b) == 0;
+    failed = !cloned && backupStream(&b) != 0;
+    if(!failed && (backupSeal(&b) != 0 || writeManifest(&b) != 0)) {
+        backupDiscard(&b);
+        failed = 1;
+    }
+    if(failed) {
+        fprintf(stderr, "⚠ Error: Backup failed; %s holds no backup.\n", b.dir);
+        return 1;
+    }
+    printf("✓ Backed up the database as of change %ld to %s (%d files, %s).\n", b.seq, b.dir, b.count,
+           cloned ? "cloned" : "copied from a snapshot");
+    return 0;
+}
+
+// Put a verified backup in place of the database. Each file is copied
+// next to the one it replaces and checked again, and only when all are
+// there is anything renamed over the live files. The old sidecars go,
+// and the log is emptied first. Roll numbers changed since the backup go
+// into the change feed once more, past any sequence number it reached,
+// so incremental exports send those students again as they are now.
+static int restoreBackup(const Backup *b) {
+    char oldHeaps[SHARD_MAX][256], copies[BACKUP_MAX_FILES][SHARD_PATH_MAX + 8];
+    char path[DB_PATH_MAX];
+    FeedEntry *changed = NULL;
+    int *rolls = NULL;
+    int live = 0, made = 0, failed = 0, hasFeed = 0, hasMap = 0;
+    long n, last;
+    DbFile db;
+    
+    // Other processes would go on using the old files
+    if(lockWriter() != 0) {
+        fprintf(stderr, "⚠ Error: Cannot lock %s!\n", LOCK_FILE);
+        return 1;
+    }
+    if(lockByte(F_WRLCK, LOCK_ALIVE, 0) != 0) {
+        fprintf(stderr, "⚠ Stop the other student_mgmt processes before restoring!\n");
+        unlockWriter();
+        return 1;
+    }
+    
+    for(int k = 0; k < shardTotal(); k++) {
+        useShard(k);
+        oldHeaps[k][0] = '\0';
+        if(access(DB_FILE, F_OK) == 0) live = 1;
+        if(dbOpen(&db, O_RDONLY) == 0) {
+            if(db.heap.fd >= 0) heapPath(oldHeaps[k], sizeof(oldHeaps[k]), db.heap.generation);
+            dbClose(&db);
+        }
+        if(walCheckpoint() != 0) failed = 1;
+    }
+    useShard(0);
+    if(live && b->shards != shardMap.count) {
+        fprintf(stderr, "⚠ The backup has %d shards and the database %d; restore into an empty directory.\n",
+                b->shards, shardMap.count);
+        lockByte(F_RDLCK, LOCK_ALIVE, 1);
+        unlockWriter();
+        return 1;
+    }
+    n = failed ? -1 : feedRead(b->seq, &changed, &last);
+    
+    for(int k = 0; k < b->shards && n >= 0; k++) {
+        snprintf(path, sizeof(path), "shard%d", k);
+        if(mkdir(path, 0755) != 0 && errno != EEXIST) n = -1;
+    }
+    for(int i = 0; i < b->count && n >= 0 && !failed; i++) {
+        unsigned int crc;
+        long size;
+        
+        snprintf(copies[i], sizeof(copies[i]), "%s.restore", b->files[i].name);
+        backupPath(path, sizeof(path), b->dir, b->files[i].name);
+        made++;
+        if(copyFile(path, copies[i]) != 0 || fileChecksum(copies[i], &size, &crc) != 0 ||
+           size != b->files[i].size || crc != b->files[i].crc) {
+            failed = 1;
+        }
+    }
+    if(n < 0 || failed) {
+        for(int i = 0; i < made; i++) remove(copies[i]);
+        free(changed);
+        fprintf(stderr, "⚠ Error: Could not copy the backup; the database is unchanged.\n");
+        lockByte(F_RDLCK, LOCK_ALIVE, 1);
+        unlockWriter();
+        return 1;
+    }
+    
+    for(int k = 0; k < shardTotal(); k++) {
+        useShard(k);
+        remove(IDX_FILE);
+        remove(COL_FILE);
+        remove(SEC_FILE);
+        remove(TRI_FILE);
+        remove(STATS_FILE);
+        setApplying(-1);
+    }
+    useShard(0);
+    for(int i = 0; i < b->count; i++) {
+        if(rename(copies[i], b->files[i].name) != 0) failed = 1;
+        syncDirectory(b->files[i].name);
+        if(strcmp(b->files[i].name, CHG_FILE) == 0) hasFeed = 1;
+        if(strcmp(b->files[i].name, SHARD_FILE) == 0) hasMap = 1;
+    }
+    
+    // Heaps of the old files the backup did not bring back
+    for(int k = 0; k < shardTotal(); k++) {
+        int kept = oldHeaps[k][0] == '\0';
+        
+        for(int i = 0; i < b->count && !kept; i++) kept = strcmp(b->files[i].name, oldHeaps[k]) == 0;
+        if(!kept) remove(oldHeaps[k]);
+    }
+    if(!hasFeed) remove(CHG_FILE);
+    if(!hasMap) remove(SHARD_FILE);
+    
+    n = feedNewest(changed, n);
+    rolls = malloc((size_t)(n > 0 ? n : 1) * sizeof(int));
+    if(rolls == NULL) failed = 1;
+    for(long i = 0; i < n && rolls != NULL; i++) rolls[i] = abs(changed[i].roll_no);
+    if(rolls != NULL && (feedAppend((last > b->seq ? last : b->seq) + 1, rolls, n) != 0 || feedSync() != 0)) {
+        failed = 1;
+    }
+    free(rolls);
+    free(changed);
+    
+    if(loadShardMap() != 0) failed = 1;
+    lockByte(F_RDLCK, LOCK_ALIVE, 1);
+    unlockWriter();
+    if(failed) {
+        fprintf(stderr, "⚠ Error: The restore did not finish; run it again.\n");
+        return 1;
+    }
+    printf("✓ Restored the database as of change %ld from %s (%d files verified).\n", b->seq, b->dir, b->count);
+    return 0;
+}
+
+// "restore <dir> [check]": verify a backup against its manifest, then
+// unless only asked to check, restore it. Returns the process exit status.
+int restoreCommand(int argc, char *argv[]) {
+    static Backup b;
+    int bad;
+    
+    if(argc < 1 || argc > 2 || (argc == 2 && strcmp(argv[1], "check") != 0) || strlen(argv[0]) > DB_PATH_MAX / 2) {
+        fprintf(stderr, "⚠ Expected a backup directory, then check to only verify it\n");
+        return 2;
+    }
+    if(readManifest(&b, argv[0]) != 0) {
+        fprintf(stderr, "⚠ %s has no readable %s; it is not a finished backup.\n", argv[0], BACKUP_MANIFEST);
+        return 1;
+    }
+    bad = verifyBackup(&b);
+    if(bad > 0) {
+        fprintf(stderr, "⚠ %d of %d files fail their checksums; nothing was restored.\n", bad, b.count);
+        return 1;
+    }
+    if(argc == 2) {
+        printf("✓ Backup in %s is intact: %d files as of change %ld.\n", b.dir, b.count, b.seq);
+        return 0;
+    }
+    return restoreBackup(&b);
+}
+
+// ─── Schema evolution ───────────────────────────────────────
+
+// The files stamped against DB_FILE, and where their headers keep the stamp
+static const struct {
+    const char **file;
+    const char *magic;
+    size_t stampAt;
+} sidecars[] = {
+    { &IDX_FILE, INDEX_MAGIC, offsetof(IndexHeader, stamp) },
+    { &COL_FILE, COLUMN_MAGIC, offsetof(ColumnHeader, stamp) },
+    { &SEC_FILE, SECONDARY_MAGIC, offsetof(SecondaryHeader, stamp) },
+    { &TRI_FILE, TRIGRAM_MAGIC, offsetof(SecondaryHeader, stamp) },
+    { &STATS_FILE, STATS_MAGIC, offsetof(StatsBlock, stamp) },
+};
+
+// After a rewrite of DB_FILE that left every record as it was, stamp the
+// files that described it as it was `before` against it as it is now.
+// One that cannot be stamped is left stale, to be rebuilt when next used.
+// Call with the writer lock held.
+static void restampSidecars(const DbStamp *before) {
+    DbStamp now;
+    
+    if(getDbStamp(&now) != 0 || sameStamp(&now, before)) return;
+    for(size_t i = 0; i < sizeof(sidecars) / sizeof(sidecars[0]); i++) {
+        char magic[8];
+        DbStamp stamp;
+        int fd = open(*sidecars[i].file, O_RDWR);
+        
+        if(fd < 0) continue;
+        if(preadAll(fd, magic, sizeof(magic), 0) == 0 && memcmp(magic, sidecars[i].magic, sizeof(magic)) == 0 &&
+           preadAll(fd, &stamp, sizeof(stamp), (off_t)sidecars[i].stampAt) == 0 && sameStamp(&stamp, before)) {
+            pwriteAll(fd, &now, sizeof(now), (off_t)sidecars[i].stampAt);
+        }
+        close(fd);
+    }
+}
+
+// Count the data pages of the current shard in each slot layout. Returns
+// the layout new writes use, -1 if there is no database, or -2 if it
+// cannot be read.
+static int schemaCount(long counts[DB_LAYOUT + 1]) {
+    unsigned char *pages = malloc((size_t)DB_WRITE_PAGES * DB_PAGE_SIZE);
+    DbFile db;
+    int rc = pages == NULL ? -2 : dbOpen(&db, O_RDONLY);
+    
+    memset(counts, 0, (DB_LAYOUT + 1) * sizeof(long));
+    if(rc != 0) {
+        free(pages);
+        return rc;
+    }
+    for(long p = 0; p < db.pages && rc == 0; p += DB_WRITE_PAGES) {
+        long n = db.pages - p < DB_WRITE_PAGES ? db.pages - p : DB_WRITE_PAGES;
+        
+        if(preadAll(db.fd, pages, (size_t)n * DB_PAGE_SIZE, (off_t)(p + 1) * DB_PAGE_SIZE) != 0) {
+            rc = -2;
+            break;
+        }
+        for(long i = 0; i < n; i++) {
+            int layout = pageLayout(pages + i * DB_PAGE_SIZE);
+            if(layout <= DB_LAYOUT) counts[layout]++;
+        }
+    }
+    if(rc == 0) rc = db.layout;
+    dbClose(&db);
+    free(pages);
+    return rc;
+}
+
+// Have new writes to the current shard use the newest slot layout. That
+// only takes rewriting the header page when the pages have room for its
+// slots; a file from before slot room is rewritten once instead. Returns
+// 1 for a new header, 2 for a rewrite, 0 if new writes already use it,
+// -1, or -2 while snapshot readers rely on the current file. Call with
+// the writer lock held.
+static int schemaUpgradeHeader() {
+    DbStamp before;
+    DbFile db;
+    int rc = 0, rewrite = 0;
+    
+    finishApplying();
+    if(dbOpen(&db, O_RDWR) != 0) return -1;
+    if(db.layout < DB_LAYOUT && !layoutFits(DB_LAYOUT, db.perPage)) {
+        rewrite = 1;
+    } else if(db.layout < DB_LAYOUT) {
+        getDbStamp(&before);
+        rc = writeHeaderPage(db.fd, db.heap.generation, DB_LAYOUT, db.perPage) == 0 && syncData(db.fd) == 0 ? 1 : -1;
+    }
+    if(dbClose(&db) != 0) rc = -1;
+    if(rc == 1) restampSidecars(&before);
+    if(rewrite) {
+        rc = rewriteLocked(DB_LAYOUT);
+        if(rc >= 0) rc = 2;
+    }
+    return rc;
+}
+
+// Upgrade in place the pages in an older layout than the current shard's
+// header names, reading at most `batch` from page *next on and moving
+// *next past them; at the end of the file it stays put. The writer lock
+// is held for the one batch. No record changes, so the files stamped
+// against DB_FILE are stamped again afterwards rather than rebuilt.
+// Returns the pages upgraded, or -1.
+static long schemaMigrateBatch(long *next, long batch, unsigned char *pages) {
+    DbStamp before;
+    DbFile db;
+    long n, first = -1, last = -1, upgraded = 0;
+    int failed = 0;
+    
+    if(lockWriter() != 0) return -1;
+    if(dbOpen(&db, O_RDWR) != 0) {
+        dbClose(&db);
+        unlockWriter();
+        return -1;
+    }
+    getDbStamp(&before);
+    
+    n = db.pages - *next < batch ? db.pages - *next : batch;
+    if(n > 0 && preadAll(db.fd, pages, (size_t)n * DB_PAGE_SIZE, (off_t)(*next + 1) * DB_PAGE_SIZE) != 0) failed = 1;
+    for(long i = 0; i < n && !failed; i++) {
+        unsigned char *page = pages + i * DB_PAGE_SIZE;
+        long p = *next + i;
+        
+        if(!pageValid(page, p)) {
+            reportDamage(p);
+            failed = 1;
+        } else if(pageLayout(page) < db.layout) {
+            if(upgradePage(page, db.layout, db.heap.fd) != 0) failed = 1;
+            sealPage(page, p, getU16(page + 8));
+            if(first < 0) first = i;
+            last = i;
+            upgraded++;
+        }
+    }
+    if(!failed && first >= 0 &&
+       (pwriteAll(db.fd, pages + first * DB_PAGE_SIZE, (size_t)(last - first + 1) * DB_PAGE_SIZE,
+                  (off_t)(*next + first + 1) * DB_PAGE_SIZE) != 0 || syncData(db.fd) != 0)) {
+        failed = 1;
+    }
+    if(n > 0) *next += n;
+    if(dbClose(&db) != 0) failed = 1;
+    if(!failed && upgraded > 0) restampSidecars(&before);
+    unlockWriter();
+    return failed ? -1 : upgraded;
+}
+
+// Sleep for as long as `pages` take at `rate` pages a second
+static void schemaPause(long pages, long rate) {
+    long ns = (long)((double)pages * 1e9 / (double)rate);
+    struct timespec t = { ns / 1000000000L, ns % 1000000000L };
+    
+    while(nanosleep(&t, &t) != 0 && errno == EINTR) {}
+}
+
+// Upgrade every page of every shard left in an older layout, `rate`
+// pages a second. Returns the pages upgraded, or -1.
+static long schemaMigrate(long rate) {
+    unsigned char *pages = malloc((size_t)DB_WRITE_PAGES * DB_PAGE_SIZE);
+    long batch = rate < DB_WRITE_PAGES ? rate : DB_WRITE_PAGES;
+    long total = 0;
+    
+    if(pages == NULL) return -1;
+    for(int k = 0; k < shardTotal() && total >= 0; k++) {
+        long next = 0, before;
+        
+        useShard(k);
+        do {
+            long n;
+            
+            before = next;
+            n = schemaMigrateBatch(&next, batch, pages);
+            if(n < 0) {
+                total = -1;
+                break;
+            }
+            total += n;
+            if(n > 0) schemaPause(n, rate);
+        } while(next != before);
+    }
+    useShard(0);
+    free(pages);
+    return total;
+}
+
+// "schema [upgrade | migrate [rate=PAGES]]": show the slot layouts the
+// pages are in; have new writes use the newest layout, which rewrites
+// only the header pages (and once, a file whose pages have no room for
+// its slots) and upgrades each page as it is next written; or
+// do that and then upgrade the remaining pages in the background of
+// other processes, a batch at a time. Returns the process exit status.
+int schemaCommand(int argc, char *argv[]) {
+    long counts[DB_LAYOUT + 1], rate = DB_MIGRATE_RATE, upgraded;
+    int migrate = argc >= 1 && strcmp(argv[0], "migrate") == 0, files, rewritten, rc = 0;
+    char *end;
+    
+    if(argc >= 1 && !migrate && (strcmp(argv[0], "upgrade") != 0 || argc > 1)) {
+        fprintf(stderr, "⚠ Expected upgrade, or migrate [rate=PAGES]\n");
+        return 2;
+    }
+    for(int i = 1; i < argc; i++) {
+        if(strncmp(argv[i], "rate=", 5) != 0) {
+            fprintf(stderr, "⚠ Invalid option %s\n", argv[i]);
+            return 2;
+        }
+        rate = strtol(argv[i] + 5, &end, 10);
+        if(*end != '\0' || rate <= 0) {
+            fprintf(stderr, "⚠ Invalid option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    
+    for(int k = 0; k < shardTotal(); k++) {
+        useShard(k);
+        if(access(DB_FILE, F_OK) != 0) {
+            fprintf(stderr, "⚠ No database!\n");
+            useShard(0);
+            return 1;
+        }
+        if(legacyDatabase()) {
+            fprintf(stderr, "⚠ %s is in the old format; run migrate first.\n", DB_FILE);
+            useShard(0);
+            return 1;
+        }
+    }
+    useShard(0);
+    
+    if(argc == 0) {
+        for(int k = 0; k < shardTotal(); k++) {
+            int layout;
+            
+            useShard(k);
+            layout = schemaCount(counts);
+            if(layout < 0) {
+                fprintf(stderr, "⚠ Error: Cannot read %s!\n", DB_FILE);
+                useShard(0);
+                return 1;
+            }
+            printf("%s: new writes in slot layout %d of %d; pages", DB_FILE, layout, DB_LAYOUT);
+            for(int l = 1; l <= DB_LAYOUT; l++) printf("%s %ld in layout %d", l > 1 ? "," : "", counts[l], l);
+            printf("\n");
+        }
+        useShard(0);
+        return 0;
+    }
+    
+    // Writers wait for one header page per shard, or a rewrite of a file
+    // whose pages are too full for the newest slots
+    if(lockWriter() != 0) {
+        fprintf(stderr, "⚠ Error: Cannot lock %s!\n", LOCK_FILE);
+        return 1;
+    }
+    files = rewritten = 0;
+    for(int k = 0; k < shardTotal() && rc >= 0; k++) {
+        useShard(k);
+        rc = schemaUpgradeHeader();
+        if(rc > 0) files++;
+        if(rc == 2) rewritten++;
+    }
+    useShard(0);
+    unlockWriter();
+    if(rc == -2) {
+        fprintf(stderr, "⚠ %s must be rewritten for layout %d, but snapshot readers are using it; try again.\n",
+                DB_FILE, DB_LAYOUT);
+        return 1;
+    }
+    if(rc < 0) {
+        fprintf(stderr, "⚠ Error: Could not upgrade %s!\n", DB_FILE);
+        return 1;
+    }
+    printf("✓ New writes use slot layout %d (%d file(s) upgraded, %d of them rewritten to make room); "
+           "pages are upgraded as they are written.\n", DB_LAYOUT, files, rewritten);
+    if(!migrate) return 0;
+    
+    upgraded = schemaMigrate(rate);
+    if(upgraded < 0) {
+        fprintf(stderr, "⚠ Error: Migration stopped; the pages not yet upgraded still read as they are.\n");
+        return 1;
+    }
+    printf("✓ Upgraded %ld page(s) to slot layout %d.\n", upgraded, DB_LAYOUT);
+    return 0;
+}
+
+// ─── Server mode ────────────────────────────────────────────
+
+// In-memory copy of DB_FILE, used by the server and the embedding API.
+// Slot i is the record at offset i * sizeof(Student); gpa and roll mirror
+// it for the statistics kernel. The arrays live in one arena: address
+// space for TABLE_MAX_RECORDS slots is reserved up front and committed as
+// the table grows, so records never move and growth copies nothing.
+typedef struct {
+    unsigned char *arena;
+    size_t arenaSize;
+    Student *records;
+    float *gpa;
+    int *roll;
+    long count;
+    long capacity;      // slots committed
+    long *hash;         // roll number -> slot, TABLE_EMPTY or TABLE_DELETED
+    long hashCap;       // power of two
+    long hashUsed;      // live entries plus deleted markers
+    long *freeSlots;    // tombstoned slots, reused from the top
+    long freeCount;
+    DbStamp stamp;      // DB_FILE state the table mirrors
+} Table;
+
+typedef struct {
+    int fd;
+    char in[SERVER_LINE_MAX];
+    size_t inLen;
+    char *out;
+    size_t outLen, outSent, outCap;
+    int eof;            // the client closed its side
+    int wrote;          // answered after the round's first write, so its answers need the commit
+    int dead;
+} Conn;
+
+static long tableFind(const Table *t, int roll_no) {
+    long mask = t->hashCap - 1;
+    
+    for(long i = hashSlot(roll_no, t->hashCap); ; i = (i + 1) & mask) {
+        long slot = t->hash[i];
+        if(slot == TABLE_EMPTY) return -1;
+        if(slot >= 0 && t->records[slot].roll_no == roll_no) return slot;
+    }
+}
+
+static void tableHashInsert(Table *t, long slot) {
+    long mask = t->hashCap - 1;
+    long i = hashSlot(t->records[slot].roll_no, t->hashCap);
+    
+    while(t->hash[i] >= 0) i = (i + 1) & mask;
+    if(t->hash[i] == TABLE_EMPTY) t->hashUsed++;
+    t->hash[i] = slot;
+}
+
+static void tableHashRemove(Table *t, int roll_no) {
+    long mask = t->hashCap - 1;
+    
+    for(long i = hashSlot(roll_no, t->hashCap); t->hash[i] != TABLE_EMPTY; i = (i + 1) & mask) {
+        if(t->hash[i] >= 0 && t->records[t->hash[i]].roll_no == roll_no) {
+            t->hash[i] = TABLE_DELETED;
+            return;
+        }
+    }
+}
+
+// Keep the hash under 70% full, dropping deleted markers
+static int tableReserveHash(Table *t) {
+    long cap = t->hashCap ? t->hashCap : INDEX_MIN_CAPACITY;
+    long *old = t->hash;
+    
+    if(t->hash != NULL && (t->hashUsed + 1) * 10 <= t->hashCap * 7) return 0;
+    while((t->count + 1) * 10 > cap * 7) cap *= 2;
+    
+    t->hash = malloc((size_t)cap * sizeof(long));
+    if(t->hash == NULL) {
+        t->hash = old;
+        return -1;
+    }
+    for(long i = 0; i < cap; i++) t->hash[i] = TABLE_EMPTY;
+    t->hashCap = cap;
+    t->hashUsed = 0;
+    free(old);
+    
+    for(long s = 0; s < t->count; s++) {
+        if(IS_LIVE(t->records[s])) tableHashInsert(t, s);
+    }
+    return 0;
+}
+
+// Commit arena pages for `cap` slots in every array (and one more on the
+// free-slot stack), reserving the arena on first use
+static int tableReserve(Table *t, long cap) {
+    long page = sysconf(_SC_PAGESIZE);
+    
+    if(cap > TABLE_MAX_RECORDS) return -1;
+    if(t->arena == NULL) {
+        void *p;
+        
+        t->arenaSize = (size_t)TABLE_MAX_RECORDS * (sizeof(Student) + sizeof(float) + sizeof(int) + sizeof(long)) +
+                       (size_t)page;
+        p = mmap(NULL, t->arenaSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(p == MAP_FAILED) return -1;
+        t->arena = p;
+        t->records = (Student *)t->arena;
+        t->gpa = (float *)(t->records + TABLE_MAX_RECORDS);
+        t->roll = (int *)(t->gpa + TABLE_MAX_RECORDS);
+        t->freeSlots = (long *)(t->roll + TABLE_MAX_RECORDS);
+    }
+    
+    void *starts[4] = { t->records, t->gpa, t->roll, t->freeSlots };
+    size_t lengths[4] = {
+        (size_t)cap * sizeof(Student), (size_t)cap * sizeof(float),
+        (size_t)cap * sizeof(int), (size_t)(cap + 1) * sizeof(long)
+    };
+    for(int i = 0; i < 4; i++) {
+        size_t len = (lengths[i] + (size_t)page - 1) / (size_t)page * (size_t)page;
+        if(mprotect(starts[i], len, PROT_READ | PROT_WRITE) != 0) return -1;
+    }
+    t->capacity = cap;
+    return 0;
+}
+
+// Store a record in a slot, growing the arrays when it is one past the end
+static int tableSet(Table *t, long slot, const Student *s) {
+    if(slot == t->capacity && tableReserve(t, t->capacity ? t->capacity * 2 : TABLE_MIN_CAPACITY) != 0) {
+        return -1;
+    }
+    
+    t->records[slot] = *s;
+    t->gpa[slot] = s->gpa;
+    t->roll[slot] = s->roll_no;
+    if(slot == t->count) t->count++;
+    return 0;
+}
+
+static int loadTableRecord(const Student *s, long offset, void *ctx) {
+    Table *t = ctx;
+    (void)offset;
+    
+    return tableSet(t, t->count, s) != 0;
+}
+
+static void freeTable(Table *t) {
+    if(t->arena != NULL) munmap(t->arena, t->arenaSize);
+    free(t->hash);
+    memset(t, 0, sizeof(*t));
+}
+
+// Load a snapshot of DB_FILE, and the free-slot stack in the order the
+// index keeps it
+static int loadTable(Table *t) {
+    IndexHeader hdr;
+    Snapshot snap;
+    FILE *idx;
+    long expected;
+    
+    freeTable(t);
+    if(tableReserve(t, TABLE_MIN_CAPACITY) != 0) return -1;
+    if(snapshotOpen(&snap) == 0) {
+        expected = snap.count;
+        t->stamp = snap.stamp;
+        scanSnapshot(&snap, SCAN_ALL, loadTableRecord, t);
+        snapshotClose(&snap);
+        if(t->count != expected) return -1;
+    }
+    if(tableReserveHash(t) != 0) return -1;
+    
+    // An index of another state (a writer got in between) is of no use
+    idx = openIndex(&hdr);
+    if(idx != NULL && sameStamp(&hdr.stamp, &t->stamp)) {
+        fseek(idx, freeStackPos(&hdr, 0), SEEK_SET);
+        for(long i = 0; i < hdr.freeCount && t->freeCount < t->count; i++) {
+            long offset;
+            if(countedRead(&offset, sizeof(offset), 1, idx) != 1) break;
+            t->freeSlots[t->freeCount++] = offset / (long)sizeof(Student);
+        }
+    } else {
+        for(long s = 0; s < t->count; s++) {
+            if(!IS_LIVE(t->records[s])) t->freeSlots[t->freeCount++] = s;
+        }
+    }
+    if(idx != NULL) fclose(idx);
+    return 0;
+}
+
+// Add a student to the table and DB_FILE, filling the most recently freed
+// slot first as addStudent() does. The write joins the open transaction.
+static int tableAdd(Table *t, const Student *s) {
+    long slot = t->count;
+    int op = INDEX_PUT;
+    
+    if(tableFind(t, s->roll_no) >= 0) return STUDENT_DB_EXISTS;
+    if(tableReserveHash(t) != 0) return STUDENT_DB_NO_MEMORY;
+    if(t->freeCount > 0) {
+        slot = t->freeSlots[t->freeCount - 1];
+        op = INDEX_REUSE;
+    }
+    
+    if(writeStudent(s, slot * (long)sizeof(Student), op) < 0) return STUDENT_DB_IO_ERROR;
+    if(tableSet(t, slot, s) != 0) return STUDENT_DB_NO_MEMORY;
+    if(op == INDEX_REUSE) t->freeCount--;
+    tableHashInsert(t, slot);
+    return STUDENT_DB_OK;
+}
+
+// Write a student's new details over its slot
+static int tableUpdate(Table *t, const Student *s) {
+    long slot = tableFind(t, s->roll_no);
+    
+    if(slot < 0) return STUDENT_DB_NOT_FOUND;
+    if(writeStudent(s, slot * (long)sizeof(Student), INDEX_PUT) < 0) return STUDENT_DB_IO_ERROR;
+    tableSet(t, slot, s);
+    return STUDENT_DB_OK;
+}
+
+// Tombstone a student's slot and put it on the free-slot stack
+static int tableDelete(Table *t, int roll_no) {
+    long slot = roll_no > 0 ? tableFind(t, roll_no) : -1;
+    Student tomb;
+    
+    if(slot < 0) return STUDENT_DB_NOT_FOUND;
+    tomb = t->records[slot];
+    tomb.roll_no = -roll_no;
+    if(writeStudent(&tomb, slot * (long)sizeof(Student), INDEX_REMOVE) < 0) return STUDENT_DB_IO_ERROR;
+    tableHashRemove(t, roll_no);
+    tableSet(t, slot, &tomb);
+    t->freeSlots[t->freeCount++] = slot;
+    return STUDENT_DB_OK;
+}
+
+static void connWrite(Conn *c, const char *fmt, ...) {
+    va_list ap;
+    int n;
+    
+    if(c->outCap - c->outLen < 2 * SERVER_LINE_MAX) {
+        size_t cap = c->outCap ? c->outCap * 2 : 4 * SERVER_LINE_MAX;
+        char *out = realloc(c->out, cap);
+        if(out == NULL) {
+            c->dead = 1;
+            return;
+        }
+        c->out = out;
+        c->outCap = cap;
+    }
+    
+    va_start(ap, fmt);
+    n = vsnprintf(c->out + c->outLen, c->outCap - c->outLen, fmt, ap);
+    va_end(ap);
+    if(n > 0) c->outLen += (size_t)n < c->outCap - c->outLen ? (size_t)n : c->outCap - c->outLen - 1;
+}
+
+// Split a request's arguments on tabs
+static int splitFields(char *s, char *fields[], int max) {
+    int n = 0;
+    
+    if(*s == '\0') return 0;
+    while(n < max) {
+        fields[n++] = s;
+        s = strchr(s, '\t');
+        if(s == NULL) return n;
+        *s++ = '\0';
+    }
+    return n + 1;
+}
+
+// Build a record from roll, name, department, course, year and GPA fields,
+// applying the rules addStudent() enforces. Returns an error message or NULL.
+static const char *parseStudentFields(char *fields[], Student *s) {
+    memset(s, 0, sizeof(*s));
+    
+    if(!parseIntField(fields[0], &s->roll_no) || s->roll_no <= 0) {
+        return "roll number must be a positive integer";
+    }
+    if(fields[1][0] == '\0') return "name cannot be empty";
+    if(strlen(fields[1]) >= sizeof(s->name) || strlen(fields[2]) >= sizeof(s->department) ||
+       strlen(fields[3]) >= sizeof(s->course)) {
+        return "name, department or course too long";
+    }
+    if(!parseIntField(fields[4], &s->year_joined) || !isValidYear(s->year_joined)) {
+        return "year must be between 2000 and 2025";
+    }
+    if(!parseFloatField(fields[5], &s->gpa) || !isValidGPA(s->gpa)) {
+        return "GPA must be between 0.0 and 4.0";
+    }
+    strcpy(s->name, fields[1]);
+    strcpy(s->department, fields[2]);
+    strcpy(s->course, fields[3]);
+    return NULL;
+}
+
+static void serveGet(Table *t, Conn *c, char *fields[], int n) {
+    int roll_no;
+    long slot;
+    
+    if(n != 1 || !parseIntField(fields[0], &roll_no)) {
+        connWrite(c, "ERR usage: GET <roll>\n");
+        return;
+    }
+    slot = roll_no > 0 ? tableFind(t, roll_no) : -1;
+    if(slot < 0) {
+        connWrite(c, "ERR not found\n");
+        return;
+    }
+    
+    const Student *s = &t->records[slot];
+    connWrite(c, "OK %d\t%s\t%s\t%s\t%d\t%.2f\n",
+              s->roll_no, s->name, s->department, s->course, s->year_joined, s->gpa);
+}
+
+// Answer a mutation with "OK" or the reason it failed
+static void serveResult(Conn *c, int rc) {
+    if(rc == STUDENT_DB_OK) {
+        connWrite(c, "OK\n");
+    } else {
+        connWrite(c, "ERR %s\n", studentDbError(rc));
+    }
+}
+
+static void serveAdd(Table *t, Conn *c, char *fields[], int n) {
+    Student s;
+    const char *err;
+    
+    if(n != 6) {
+        connWrite(c, "ERR usage: ADD <roll> <name> <department> <course> <year> <gpa>\n");
+        return;
+    }
+    err = parseStudentFields(fields, &s);
+    if(err != NULL) {
+        connWrite(c, "ERR %s\n", err);
+        return;
+    }
+    serveResult(c, tableAdd(t, &s));
+}
+
+static void serveUpdate(Table *t, Conn *c, char *fields[], int n) {
+    Student s;
+    const char *err;
+    
+    if(n != 6) {
+        connWrite(c, "ERR usage: PUT <roll> <name> <department> <course> <year> <gpa>\n");
+        return;
+    }
+    err = parseStudentFields(fields, &s);
+    if(err != NULL) {
+        connWrite(c, "ERR %s\n", err);
+        return;
+    }
+    serveResult(c, tableUpdate(t, &s));
+}
+
+static void serveDelete(Table *t, Conn *c, char *fields[], int n) {
+    int roll_no;
+    
+    if(n != 1 || !parseIntField(fields[0], &roll_no)) {
+        connWrite(c, "ERR usage: DEL <roll>\n");
+        return;
+    }
+    serveResult(c, tableDelete(t, roll_no));
+}
+
+static void serveStats(Table *t, Conn *c) {
+    GpaAggregate agg;
+    
+    memset(&agg, 0, sizeof(agg));
+    agg.argmin = agg.argmax = -1;
+    aggregateGpa(t->gpa, t->roll, t->count, 0, &agg);
+    if(agg.count == 0) {
+        connWrite(c, "OK count=0\n");
+        return;
+    }
+    
+    connWrite(c, "OK count=%ld\taverage=%.2f\thighest=%.2f\ttop=%d\tlowest=%.2f\tweak=%d"
+              "\texcellent=%ld\tgood=%ld\taverage_band=%ld\tpoor=%ld\n",
+              agg.count, agg.sum / agg.count, agg.max, t->roll[agg.argmax],
+              agg.min, t->roll[agg.argmin], agg.atLeast35, agg.atLeast30 - agg.atLeast35,
+              agg.atLeast20 - agg.atLeast30, agg.count - agg.atLeast20);
+}
+
+static void serveExport(Table *t, Conn *c, char *fields[], int n) {
+    long rows;
+    
+    if(n != 1 || fields[0][0] == '\0') {
+        connWrite(c, "ERR usage: EXPORT <path>\n");
+        return;
+    }
+    rows = exportArrayToCsv(fields[0], t->records, t->count, NULL);
+    if(rows < 0) {
+        connWrite(c, "ERR cannot write %s\n", fields[0]);
+        return;
+    }
+    connWrite(c, "OK %ld\n", rows);
+}
+
+static volatile sig_atomic_t serverStopping = 0;
+static int serverWriting = 0;   // the round's transaction is open
+
+// Open the round's transaction and, now holding the writer lock, catch up
+// with what other processes committed since the round began. If the table
+// cannot be reloaded the transaction is closed again, and the server stops.
+static int serveBegin(Table *t) {
+    DbStamp now;
+    
+    walBegin();
+    getDbStamp(&now);
+    if(!sameStamp(&now, &t->stamp) && loadTable(t) != 0) {
+        fprintf(stderr, "⚠ Error: Cannot reload %s!\n", DB_FILE);
+        walCommit();
+        serverStopping = 1;
+        return -1;
+    }
+    serverWriting = 1;
+    return 0;
+}
+
+// Execute one request line. A round takes the writer lock only at its
+// first write, so rounds of reads never hold up other writers.
+static void serveRequest(Table *t, Conn *c, char *line) {
+    char *fields[SERVER_MAX_FIELDS + 1];
+    char *args = line + strcspn(line, " \t");
+    long start = metricsStart();
+    int n;
+    
+    if(*args != '\0') *args++ = '\0';
+    n = splitFields(args, fields, SERVER_MAX_FIELDS);
+    
+    if(!serverWriting && (strcasecmp(line, "ADD") == 0 || strcasecmp(line, "PUT") == 0 ||
+                          strcasecmp(line, "DEL") == 0) && serveBegin(t) != 0) {
+        connWrite(c, "ERR cannot reload the database\n");
+        metricsEnd(OP_REQUEST, start);
+        return;
+    }
+    // From the round's first write on, answers may show what its commit decides
+    if(serverWriting) c->wrote = 1;
+    
+    if(strcasecmp(line, "GET") == 0) {
+        serveGet(t, c, fields, n);
+    } else if(strcasecmp(line, "ADD") == 0) {
+        serveAdd(t, c, fields, n);
+    } else if(strcasecmp(line, "PUT") == 0) {
+        serveUpdate(t, c, fields, n);
+    } else if(strcasecmp(line, "DEL") == 0) {
+        serveDelete(t, c, fields, n);
+    } else if(strcasecmp(line, "STATS") == 0) {
+        serveStats(t, c);
+    } else if(strcasecmp(line, "EXPORT") == 0) {
+        serveExport(t, c, fields, n);
+    } else if(strcasecmp(line, "PING") == 0) {
+        connWrite(c, "OK\n");
+    } else {
+        connWrite(c, "ERR unknown command\n");
+    }
+    metricsEnd(OP_REQUEST, start);
+}
+
+// Read what the client sent and execute every complete line
+static void serveInput(Table *t, Conn *c) {
+    for(;;) {
+        ssize_t n;
+        char *line, *nl;
+        
+        // Stop reading from a client that is not reading its answers
+        if(c->outLen - c->outSent > SERVER_OUTPUT_MAX) return;
+        
+        n = read(c->fd, c->in + c->inLen, sizeof(c->in) - c->inLen);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK) c->dead = 1;
+            return;
+        }
+        if(n == 0) {
+            c->eof = 1;
+            return;
+        }
+        c->inLen += (size_t)n;
+        
+        line = c->in;
+        while((nl = memchr(line, '\n', c->inLen - (size_t)(line - c->in))) != NULL) {
+            *nl = '\0';
+            if(nl > line && nl[-1] == '\r') nl[-1] = '\0';
+            if(*line != '\0') serveRequest(t, c, line);
+            line = nl + 1;
+        }
+        c->inLen -= (size_t)(line - c->in);
+        memmove(c->in, line, c->inLen);
+        
+        if(c->inLen == sizeof(c->in)) {
+            connWrite(c, "ERR request too long\n");
+            c->eof = 1;
+            return;
+        }
+    }
+}
+
+// Send queued responses; returns 1 while some are still pending
+static int serveOutput(Conn *c) {
+    while(c->outSent < c->outLen) {
+        ssize_t n = write(c->fd, c->out + c->outSent, c->outLen - c->outSent);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK) c->dead = 1;
+            return !c->dead;
+        }
+        c->outSent += (size_t)n;
+    }
+    c->outLen = c->outSent = 0;
+    return 0;
+}
+
+static void stopServer(int sig) {
+    (void)sig;
+    serverStopping = 1;
+}
+
+static int listenOn(const char *path) {
+    struct sockaddr_un addr;
+    int fd;
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+    
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0) return -1;
+    unlink(path);
+    if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Serve requests from local clients until SIGINT or SIGTERM. All requests
+// that arrive together are handled in one transaction, so concurrent
+// writers share a single fdatasync before any of them is answered; a round
+// of reads alone opens none.
+int serveDatabase(const char *path) {
+    struct epoll_event ev, events[SERVER_MAX_EVENTS];
+    struct sigaction sa;
+    DbStamp now;
+    Table table;
+    long flushedAt = metricsStart();
+    int lfd, ep;
+    
+    // The table is held in memory as one array of slots
+    if(shardMap.count > 0) {
+        fprintf(stderr, "⚠ Server mode does not support a database split into shards.\n");
+        return 1;
+    }
+    
+    memset(&table, 0, sizeof(table));
+    if(loadTable(&table) != 0) {
+        fprintf(stderr, "⚠ Error: Cannot load %s!\n", DB_FILE);
+        freeTable(&table);
+        return 1;
+    }
+    
+    lfd = listenOn(path);
+    ep = epoll_create1(EPOLL_CLOEXEC);
+    if(lfd < 0 || ep < 0) {
+        fprintf(stderr, "⚠ Error: Cannot listen on %s: %s\n", path, strerror(errno));
+        if(lfd >= 0) close(lfd);
+        freeTable(&table);
+        return 1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev);
+    
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stopServer;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    
+    printf("✓ Serving %ld students on %s\n", table.count - table.freeCount, path);
+    fflush(stdout);
+    
+    while(!serverStopping) {
+        int n = epoll_wait(ep, events, SERVER_MAX_EVENTS, metricsOn ? METRICS_FLUSH_SECONDS * 1000 : -1);
+        int failed;
+        
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            break;
+        }
+        
+        // A long-running server shares its metrics as it goes
+        if(metricsOn && monotonicNs() - flushedAt >= METRICS_FLUSH_SECONDS * 1000000000L) {
+            metricsFlush();
+            flushedAt = monotonicNs();
+        }
+        if(n == 0) continue;
+        
+        // Pick up what other processes changed; the snapshot needs no lock
+        getDbStamp(&now);
+        if(!sameStamp(&now, &table.stamp) && loadTable(&table) != 0) {
+            fprintf(stderr, "⚠ Error: Cannot reload %s!\n", DB_FILE);
+            break;
+        }
+        
+        for(int i = 0; i < n; i++) {
+            Conn *c = events[i].data.ptr;
+            
+            if(c == NULL) {
+                int fd;
+                while((fd = accept(lfd, NULL, NULL)) >= 0) {
+                    Conn *nc = calloc(1, sizeof(Conn));
+                    if(nc == NULL || fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+                        free(nc);
+                        close(fd);
+                        continue;
+                    }
+                    nc->fd = fd;
+                    ev.events = EPOLLIN;
+                    ev.data.ptr = nc;
+                    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+                }
+                continue;
+            }
+            if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) serveInput(&table, c);
+        }
+        failed = serverWriting && walCommit() != 0;
+        
+        if(failed) {
+            // Nothing of this round reached the disk; forget it in memory too
+            fprintf(stderr, "⚠ Error: Failed to commit; reloading %s\n", DB_FILE);
+            if(loadTable(&table) != 0) serverStopping = 1;
+        } else if(serverWriting) {
+            table.stamp = wal.stamp;
+        }
+        serverWriting = 0;
+        
+        // Answer only now that the round's writes are durable
+        for(int i = 0; i < n; i++) {
+            Conn *c = events[i].data.ptr;
+            
+            if(c == NULL || c->fd < 0) continue;
+            if(failed && c->wrote) c->dead = 1;
+            c->wrote = 0;
+            
+            int pending = c->dead ? 0 : serveOutput(c);
+            if(c->dead || (c->eof && !pending)) {
+                epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+                close(c->fd);
+                c->fd = -1;
+                continue;
+            }
+            int backlogged = c->outLen - c->outSent > SERVER_OUTPUT_MAX;
+            ev.events = (c->eof || backlogged ? 0 : EPOLLIN) | (pending ? EPOLLOUT : 0);
+            ev.data.ptr = c;
+            epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+        }
+        for(int i = 0; i < n; i++) {
+            Conn *c = events[i].data.ptr;
+            if(c == NULL || c->fd >= 0) continue;
+            
+            // A connection appears once per round, so it is freed once
+            free(c->out);
+            free(c);
+        }
+        
+        // Compact like deleteStudent() does, then reload the new layout
+        if(table.freeCount > 0 && (double)table.freeCount >= compactThreshold() * (double)table.count &&
+           compactDatabase(0) > 0 && loadTable(&table) != 0) {
+            serverStopping = 1;
+        }
+    }
+    
+    close(lfd);
+    close(ep);
+    unlink(path);
+    freeTable(&table);
+    printf("✓ Server stopped.\n");
+    return 0;
+}
+
+// Send requests to a running server and print the responses. With "-" as
+// the command, request lines are read from stdin and pipelined; the socket
+// is non-blocking so answers are drained while requests are still queued.
+int runClient(const char *path, int argc, char *argv[]) {
+    struct sockaddr_un addr;
+    char out[65536], in[65536];
+    size_t outLen = 0, outSent = 0;
+    int fd, status = 0, reading, shut = 0, lineStart = 1;
+    
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "⚠ Cannot connect to %s: %s\n", path, strerror(errno));
+        if(fd >= 0) close(fd);
+        return 1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    
+    reading = strcmp(argv[0], "-") == 0;
+    if(!reading) {
+        // One request from the arguments: VERB<tab>arg<tab>arg...
+        for(int i = 0; i < argc && outLen < SERVER_LINE_MAX; i++) {
+            outLen += (size_t)snprintf(out + outLen, SERVER_LINE_MAX - outLen, "%s%s",
+                                       i ? "\t" : "", argv[i]);
+        }
+        if(outLen > SERVER_LINE_MAX - 1) outLen = SERVER_LINE_MAX - 1;
+        out[outLen++] = '\n';
+    }
+    
+    for(;;) {
+        struct pollfd pfd[2];
+        int nfds = 1;
+        
+        // Finished sending: let the server see end of input
+        if(outSent == outLen && !reading && !shut) {
+            shutdown(fd, SHUT_WR);
+            shut = 1;
+        }
+        
+        pfd[0].fd = fd;
+        pfd[0].events = POLLIN | (outSent < outLen ? POLLOUT : 0);
+        if(reading && outSent == outLen) {
+            pfd[1].fd = STDIN_FILENO;
+            pfd[1].events = POLLIN;
+            nfds = 2;
+        }
+        if(poll(pfd, (nfds_t)nfds, -1) < 0) {
+            if(errno == EINTR) continue;
+            status = 1;
+            break;
+        }
+        
+        if(nfds == 2 && (pfd[1].revents & (POLLIN | POLLHUP))) {
+            ssize_t n = read(STDIN_FILENO, out, sizeof(out));
+            if(n <= 0) reading = 0;
+            outLen = n > 0 ? (size_t)n : 0;
+            outSent = 0;
+        }
+        
+        if(pfd[0].revents & POLLOUT) {
+            ssize_t n = write(fd, out + outSent, outLen - outSent);
+            if(n < 0 && errno != EAGAIN && errno != EINTR) {
+                status = 1;
+                break;
+            }
+            if(n > 0) outSent += (size_t)n;
+        }
+        
+        if(pfd[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(fd, in, sizeof(in));
+            if(n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+            if(n <= 0) break;
+            
+            // Exit status 1 if any response was an error
+            for(ssize_t i = 0; i < n; i++) {
+                if(lineStart && in[i] == 'E') status = 1;
+                lineStart = in[i] == '\n';
+            }
+            fwrite(in, 1, (size_t)n, stdout);
+        }
+    }
+    
+    close(fd);
+    return status;
+}
+
+// ─── Embedding API ──────────────────────────────────────────
+
+// See student_db.h. A handle is the in-memory table the server keeps,
+// driven one call at a time.
+struct StudentDb {
+    Table table;
+};
+
+static StudentDb *openHandle;       // the one handle open, if any
+
+// Every file global, in the directory a library user names
+static const char **const dataFiles[] = {
+    &DB_FILE, &TEMP_FILE, &CSV_FILE, &IDX_FILE, &COL_FILE, &STR_FILE, &SEC_FILE, &TRI_FILE,
+    &STATS_FILE, &WAL_FILE, &CHG_FILE, &SOCKET_FILE, &LOCK_FILE, &METRICS_FILE, &PROM_FILE, &SHARD_FILE
+};
+
+const char *studentDbError(int status) {
+    switch(status) {
+        case STUDENT_DB_OK: return "ok";
+        case STUDENT_DB_NOT_FOUND: return "not found";
+        case STUDENT_DB_EXISTS: return "duplicate roll number";
+        case STUDENT_DB_INVALID: return "invalid student details";
+        case STUDENT_DB_NO_MEMORY: return "out of memory";
+        case STUDENT_DB_IO_ERROR: return "failed to save";
+        case STUDENT_DB_UNSUPPORTED: return "database is split into shards or in the old format";
+        case STUDENT_DB_BUSY: return "another handle is open";
+    }
+    return "unknown error";
+}
+
+#define DATA_FILES ((int)(sizeof(dataFiles) / sizeof(dataFiles[0])))
+
+static const char *defaultFiles[DATA_FILES];    // what they name as built
+
+// Point the file globals at `dir` and read the shard map
+static int openDirectory(const char *dir) {
+    static char paths[DATA_FILES][DB_PATH_MAX];
+    
+    if(defaultFiles[0] == NULL) {
+        for(int i = 0; i < DATA_FILES; i++) defaultFiles[i] = *dataFiles[i];
+    }
+    if(dir == NULL) dir = "";
+    // Temporary names add a suffix to these in buffers of the same size
+    if(strlen(dir) > DB_PATH_MAX / 2) return STUDENT_DB_INVALID;
+    
+    if(*dir != '\0') {
+        for(int i = 0; i < DATA_FILES; i++) {
+            snprintf(paths[i], sizeof(paths[i]), "%s/%s", dir, defaultFiles[i]);
+            *dataFiles[i] = paths[i];
+        }
+    }
+    if(!metricsOn) metricsInit();
+    return loadShardMap() == 0 ? STUDENT_DB_OK : STUDENT_DB_IO_ERROR;
+}
+
+// Let go of the directory openDirectory() named, so that the next handle
+// may be opened on another: drop its lock file (and with it our locks),
+// log and dictionaries, and put the file globals back
+static void closeDirectory() {
+    if(wal.fd >= 0) close(wal.fd);
+    wal.fd = -1;
+    wal.txn = 0;
+    memset(&wal.stamp, 0, sizeof(wal.stamp));
+    if(lockFd >= 0) close(lockFd);
+    lockFd = -1;
+    
+    for(int k = 0; k < SHARD_MAX; k++) {
+        Dictionary *d = &dicts[k];
+        
+        if(d->text != NULL) {
+            for(long id = 0; id < DICT_MAX; id++) free(d->text[id]);
+        }
+        free(d->text);
+        free(d->hash);
+        d->text = NULL;
+        d->hash = NULL;
+        d->count = 0;
+        d->hashCap = 0;
+    }
+    dict = &dicts[0];
+    
+    for(int i = 0; i < DATA_FILES; i++) {
+        if(defaultFiles[i] != NULL) *dataFiles[i] = defaultFiles[i];
+    }
+    memset(&shardMap, 0, sizeof(shardMap));
+    shardBase[0] = NULL;
+    currentShard = 0;
+}
+
+StudentDb *studentDbOpen(const char *dir, int *status) {
+    StudentDb *db = NULL;
+    int rc = openHandle != NULL ? STUDENT_DB_BUSY : openDirectory(dir);
+    
+    // The table is held in memory as one array of slots, as in server mode
+    if(rc == STUDENT_DB_OK && (shardMap.count > 0 || legacyDatabase())) rc = STUDENT_DB_UNSUPPORTED;
+    if(rc == STUDENT_DB_OK && recoverShards() != 0) rc = STUDENT_DB_IO_ERROR;
+    if(rc == STUDENT_DB_OK && (db = calloc(1, sizeof(*db))) == NULL) rc = STUDENT_DB_NO_MEMORY;
+    if(rc == STUDENT_DB_OK && loadTable(&db->table) != 0) {
+        freeTable(&db->table);
+        free(db);
+        db = NULL;
+        rc = STUDENT_DB_IO_ERROR;
+    }
+    
+    if(status != NULL) *status = rc;
+    if(db != NULL) openHandle = db;
+    else if(rc != STUDENT_DB_BUSY) closeDirectory();
+    return db;
+}
+
+void studentDbClose(StudentDb *db) {
+    if(db == NULL || db != openHandle) return;
+    freeTable(&db->table);
+    free(db);
+    openHandle = NULL;
+    checkpointShards();
+    closeDirectory();
+}
+
+// Take the writer lock and catch up with what other processes committed
+static int handleBegin(StudentDb *db) {
+    DbStamp now;
+    
+    walBegin();
+    getDbStamp(&now);
+    if(!sameStamp(&now, &db->table.stamp) && loadTable(&db->table) != 0) return STUDENT_DB_IO_ERROR;
+    return STUDENT_DB_OK;
+}
+
+// Commit, then compact as deleteStudent() does. A failed commit left
+// nothing on disk, so the table forgets the write too.
+static int handleCommit(StudentDb *db, int rc) {
+    Table *t = &db->table;
+    
+    if(walCommit() != 0) {
+        loadTable(t);
+        return rc == STUDENT_DB_OK ? STUDENT_DB_IO_ERROR : rc;
+    }
+    t->stamp = wal.stamp;
+    if(t->freeCount > 0 && (double)t->freeCount >= compactThreshold() * (double)t->count &&
+       compactDatabase(0) > 0 && loadTable(t) != 0) {
+        return STUDENT_DB_IO_ERROR;
+    }
+    return rc;
+}
+
+// A copy of a caller's record that passes the rules addStudent() and
+// updateStudent() enforce, with nothing after the end of each string
+static int checkStudent(const Student *in, Student *s) {
+    if(in->roll_no <= 0 || in->name[0] == '\0' || memchr(in->name, '\0', sizeof(in->name)) == NULL ||
+       memchr(in->department, '\0', sizeof(in->department)) == NULL ||
+       memchr(in->course, '\0', sizeof(in->course)) == NULL ||
+       !isValidYear(in->year_joined) || !isValidGPA(in->gpa)) {
+        return STUDENT_DB_INVALID;
+    }
+    memset(s, 0, sizeof(*s));
+    s->roll_no = in->roll_no;
+    strcpy(s->name, in->name);
+    strcpy(s->department, in->department);
+    strcpy(s->course, in->course);
+    s->year_joined = in->year_joined;
+    s->gpa = in->gpa;
+    return STUDENT_DB_OK;
+}
+
+int studentDbGet(StudentDb *db, int roll_no, Student *out) {
+    long start = metricsStart();
+    long slot = roll_no > 0 && db->table.hash != NULL ? tableFind(&db->table, roll_no) : -1;
+    
+    if(slot >= 0 && out != NULL) *out = db->table.records[slot];
+    metricsEnd(OP_LOOKUP, start);
+    return slot >= 0 ? STUDENT_DB_OK : STUDENT_DB_NOT_FOUND;
+}
+
+int studentDbPut(StudentDb *db, const Student *s) {
+    long start = metricsStart();
+    Student checked;
+    int rc = checkStudent(s, &checked);
+    
+    if(rc != STUDENT_DB_OK) return rc;
+    rc = handleBegin(db);
+    if(rc == STUDENT_DB_OK) rc = tableAdd(&db->table, &checked);
+    rc = handleCommit(db, rc);
+    metricsEnd(OP_ADD, start);
+    return rc;
+}
+
+int studentDbUpdate(StudentDb *db, const Student *s) {
+    long start = metricsStart();
+    Student checked;
+    int rc = checkStudent(s, &checked);
+    
+    if(rc != STUDENT_DB_OK) return rc;
+    rc = handleBegin(db);
+    if(rc == STUDENT_DB_OK) rc = tableUpdate(&db->table, &checked);
+    rc = handleCommit(db, rc);
+    metricsEnd(OP_UPDATE, start);
+    return rc;
+}
+
+int studentDbDelete(StudentDb *db, int roll_no) {
+    long start = metricsStart();
+    int rc = handleBegin(db);
+    
+    if(rc == STUDENT_DB_OK) rc = tableDelete(&db->table, roll_no);
+    rc = handleCommit(db, rc);
+    metricsEnd(OP_DELETE, start);
+    return rc;
+}
+
+long studentDbScan(StudentDb *db, StudentVisitor visit, void *ctx) {
+    const Table *t = &db->table;
+    long visited = 0;
+    
+    for(long slot = 0; slot < t->count; slot++) {
+        if(!IS_LIVE(t->records[slot])) continue;
+        visited++;
+        if(visit(&t->records[slot], ctx)) break;
+    }
+    return visited;
+}
+
+int studentDbStats(StudentDb *db, StudentStats *out) {
+    const Table *t = &db->table;
+    long start = metricsStart();
+    GpaAggregate agg;
+    
+    memset(&agg, 0, sizeof(agg));
+    memset(out, 0, sizeof(*out));
+    agg.argmin = agg.argmax = -1;
+    aggregateGpa(t->gpa, t->roll, t->count, 0, &agg);
+    if(agg.count > 0) {
+        out->count = agg.count;
+        out->average = agg.sum / agg.count;
+        out->highest = agg.max;
+        out->lowest = agg.min;
+        out->highestRoll = t->roll[agg.argmax];
+        out->lowestRoll = t->roll[agg.argmin];
+        out->excellent = agg.atLeast35;
+        out->good = agg.atLeast30 - agg.atLeast35;
+        out->fair = agg.atLeast20 - agg.atLeast30;
+        out->poor = agg.count - agg.atLeast20;
+    }
+    metricsEnd(OP_STATISTICS, start);
+    return STUDENT_DB_OK;
+}
+
+int studentDbRefresh(StudentDb *db) {
+    DbStamp now;
+    
+    getDbStamp(&now);
+    if(!sameStamp(&now, &db->table.stamp) && loadTable(&db->table) != 0) return STUDENT_DB_IO_ERROR;
+    return STUDENT_DB_OK;
+}
+
+// ─── Benchmarks ─────────────────────────────────────────────
+
+#define BENCH_DEFAULT_OPS 1000
+#define BENCH_DEFAULT_SCANS 5
+#define BENCH_EXPORT_FILE "bench_export.csv"
+
+// Departments and courses in the order of their share under skew
+static const char *const benchDepartments[] = {
+    "CS", "EE", "ME", "CE", "Mathematics", "Physics", "Chemistry", "Biology",
+    "Economics", "Civil Engineering", "Aerospace", "Materials Science",
+    "Chemical Engineering", "Industrial Design", "Statistics", "Other"
+};
+
+static const char *const benchCourses[] = {
+    "B.Tech", "M.Tech", "B.Sc", "M.Sc", "PhD", "MBA", "B.Sc Honours",
+    "Data Structures", "Operating Systems", "Signals and Systems", "Thermodynamics",
+    "Fluid Mechanics", "Linear Algebra", "Quantum Mechanics", "Organic Chemistry",
+    "Genetics", "Microeconomics", "Structural Analysis", "Control Systems",
+    "Machine Learning", "Compilers", "Computer Networks", "Probability", "Databases"
+};
+
+static const char *const benchFirstNames[] = {
+    "Aarav", "Priya", "Rahul", "Ananya", "Vikram", "Sneha", "Arjun", "Kavya",
+    "Rohan", "Isha", "Aditya", "Meera", "Karthik", "Divya", "Siddharth", "Pooja",
+    "James", "Maria", "Chen", "Fatima", "Lucas", "Amelia", "Mohammed", "Sofia",
+    "Oliver", "Yuki", "Daniel", "Olga", "Kwame", "Elena", "Mateo", "Nadia"
+};
+
+static const char *const benchLastNames[] = {
+    "Sharma", "Patel", "Iyer", "Reddy", "Gupta", "Nair", "Singh", "Mukherjee",
+    "Krishnamurthy", "Venkataraman", "Banerjee", "Chatterjee", "Rao", "Das",
+    "Smith", "Garcia", "Wang", "Khan", "Silva", "Brown", "Hernandez", "Tanaka",
+    "Müller", "Ivanova", "Mensah", "Rossi", "Nguyen", "Kowalski", "O'Brien",
+    "Abdullah", "Fernandes", "Lee"
+};
+
+#define BENCH_COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+// splitmix64: small, and gives the same sequence on every platform
+static unsigned long benchRandom(unsigned long *state) {
+    unsigned long z = (*state += 0x9E3779B97F4A7C15UL);
+    
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1)
+static double benchUniform(unsigned long *state) {
+    return (double)(benchRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Cumulative Zipf weights 1/k^skew; a skew of 0 is uniform
+static void skewInit(double *cdf, int n, double skew) {
+    double total = 0;
+    
+    for(int k = 0; k < n; k++) {
+        total += 1.0 / pow(k + 1, skew);
+        cdf[k] = total;
+    }
+    for(int k = 0; k < n; k++) cdf[k] /= total;
+}
+
+static int skewPick(const double *cdf, int n, unsigned long *state) {
+    double u = benchUniform(state);
+    int lo = 0, hi = n - 1;
+    
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if(cdf[mid] > u) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+typedef struct {
+    unsigned long state;
+    double departments[BENCH_COUNT(benchDepartments)];
+    double courses[BENCH_COUNT(benchCourses)];
+} StudentGenerator;
+
+static void generatorInit(StudentGenerator *g, unsigned long seed, double deptSkew, double courseSkew) {
+    g->state = seed;
+    skewInit(g->departments, BENCH_COUNT(benchDepartments), deptSkew);
+    skewInit(g->courses, BENCH_COUNT(benchCourses), courseSkew);
+}
+
+// Fill in a plausible student. Names run from 7 to over 30 bytes, so both
+// inline and spilled names are exercised; GPAs cluster around 2.5.
+static void generateStudent(StudentGenerator *g, int roll_no, Student *s) {
+    const char *first = benchFirstNames[benchRandom(&g->state) % BENCH_COUNT(benchFirstNames)];
+    const char *last = benchLastNames[benchRandom(&g->state) % BENCH_COUNT(benchLastNames)];
+    double gpa = 0;
+    
+    memset(s, 0, sizeof(*s));
+    s->roll_no = roll_no;
+    if(benchRandom(&g->state) % 4 == 0) {
+        const char *middle = benchLastNames[benchRandom(&g->state) % BENCH_COUNT(benchLastNames)];
+        snprintf(s->name, sizeof(s->name), "%s %s %s", first, middle, last);
+    } else {
+        snprintf(s->name, sizeof(s->name), "%s %s", first, last);
+    }
+    strcpy(s->department, benchDepartments[skewPick(g->departments, BENCH_COUNT(benchDepartments), &g->state)]);
+    strcpy(s->course, benchCourses[skewPick(g->courses, BENCH_COUNT(benchCourses), &g->state)]);
+    s->year_joined = MIN_YEAR + (int)(benchRandom(&g->state) % (MAX_YEAR - MIN_YEAR + 1));
+    for(int i = 0; i < 4; i++) gpa += benchUniform(&g->state);
+    s->gpa = (float)(rint((1.0 + gpa * 0.75) * 100.0) / 100.0);
+}
+
+// Parse a name=value argument into a long or a double
+static int benchOption(const char *arg, const char *name, long *l, double *d) {
+    size_t len = strlen(name);
+    char *end;
+    
+    if(strncmp(arg, name, len) != 0 || arg[len] != '=' || arg[len + 1] == '\0') return 0;
+    if(l != NULL) *l = strtol(arg + len + 1, &end, 10);
+    else *d = strtod(arg + len + 1, &end);
+    return *end == '\0';
+}
+
+// Write a new DB_FILE of `count` generated students with roll numbers
+// 1..count. The same seed and skews always give the same file.
+int generateCommand(int argc, char *argv[]) {
+    StudentGenerator g;
+    PageStream out;
+    Student s;
+    long count = 0, seed = 1;
+    double deptSkew = 1.0, courseSkew = 0.5;
+    char *end = NULL;
+    
+    if(argc >= 1) count = strtol(argv[0], &end, 10);
+    if(argc < 1 || *end != '\0' || count < 1 || count > 2147483647L) {
+        fprintf(stderr, "⚠ Expected a record count, got %s\n", argc >= 1 ? argv[0] : "nothing");
+        return 2;
+    }
+    for(int i = 1; i < argc; i++) {
+        if(!benchOption(argv[i], "seed", &seed, NULL) &&
+           !benchOption(argv[i], "dept-skew", NULL, &deptSkew) &&
+           !benchOption(argv[i], "course-skew", NULL, &courseSkew)) {
+            fprintf(stderr, "⚠ Invalid option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if(deptSkew < 0 || courseSkew < 0) {
+        fprintf(stderr, "⚠ Skews cannot be negative!\n");
+        return 2;
+    }
+    
+    if(lockWriter() != 0) {
+        fprintf(stderr, "⚠ Error: Cannot lock %s!\n", LOCK_FILE);
+        return 1;
+    }
+    if(access(DB_FILE, F_OK) == 0) {
+        fprintf(stderr, "⚠ %s already exists; generate into an empty directory.\n", DB_FILE);
+        unlockWriter();
+        return 1;
+    }
+    
+    generatorInit(&g, (unsigned long)seed, deptSkew, courseSkew);
+    if(streamOpen(&out, TEMP_FILE, 1, DB_LAYOUT) == 0) {
+        for(long i = 0; i < count && !out.failed; i++) {
+            generateStudent(&g, (int)(i + 1), &s);
+            streamAdd(&out, &s);
+        }
+    }
+    if(streamClose(&out) != 0 || rename(TEMP_FILE, DB_FILE) != 0) {
+        fprintf(stderr, "⚠ Error: Failed to write %s!\n", DB_FILE);
+        remove(TEMP_FILE);
+        unlockWriter();
+        return 1;
+    }
+    syncDirectory(DB_FILE);
+    unlockWriter();
+    
+    printf("✓ Generated %ld students (seed %ld, department skew %.2f, course skew %.2f).\n",
+           count, seed, deptSkew, courseSkew);
+    return 0;
+}
+
+// State shared by the timed operations
+typedef struct {
+    int *rolls;         // live roll numbers when the run started
+    long count;
+    long capacity;
+    int maxRoll;
+    long *order;        // the added students, in the order they are deleted
+    Student *originals; // what benchUpdate() changed, as it was, oldest first
+    long updated;
+    unsigned long state;
+    StudentGenerator gen;
+} BenchState;
+
+typedef long (*BenchOp)(BenchState *b, long i);
+
+static int collectRoll(const Student *s, long offset, void *ctx) {
+    BenchState *b = ctx;
+    (void)offset;
+    
+    if(b->count == b->capacity) {
+        long newCap = b->capacity ? b->capacity * 2 : 4096;
+        int *rolls = realloc(b->rolls, (size_t)newCap * sizeof(int));
+        if(rolls == NULL) return 1;
+        b->rolls = rolls;
+        b->capacity = newCap;
+    }
+    b->rolls[b->count++] = s->roll_no;
+    if(s->roll_no > b->maxRoll) b->maxRoll = s->roll_no;
+    return 0;
+}
+
+static long benchSearch(BenchState *b, long i) {
+    Student s;
+    (void)i;
+    
+    return findStudent(b->rolls[benchRandom(&b->state) % (unsigned long)b->count], &s);
+}
+
+static long benchAdd(BenchState *b, long i) {
+    Student s;
+    
+    generateStudent(&b->gen, b->maxRoll + 1 + (int)i, &s);
+    return addStudentRecord(&s);
+}
+
+static long benchUpdate(BenchState *b, long i) {
+    Student s;
+    (void)i;
+    
+    if(findStudent(b->rolls[benchRandom(&b->state) % (unsigned long)b->count], &s) < 0) return -1;
+    b->originals[b->updated++] = s;
+    s.gpa = (float)(benchRandom(&b->state) % 401) / 100.0f;
+    return updateStudentRecord(&s);
+}
+
+// Put back the students benchUpdate() changed, newest change first so a
+// student changed twice ends up as it was before the run
+static int benchRestore(BenchState *b) {
+    for(long i = b->updated - 1; i >= 0; i--) {
+        if(updateStudentRecord(&b->originals[i]) < 0) {
+            fprintf(stderr, "⚠ Error: Could not restore student %d after the update run!\n", b->originals[i].roll_no);
+            return 1;
+        }
+    }
+    b->updated = 0;
+    return 0;
+}
+
+static long benchDelete(BenchState *b, long i) {
+    return deleteStudentRecord(b->maxRoll + 1 + (int)b->order[i]);
+}
+
+static long benchStatistics(BenchState *b, long i) {
+    StatsBlock stats;
+    (void)b;
+    (void)i;
+    
+    return databaseStats(&stats);
+}
+
+static long benchExport(BenchState *b, long i) {
+    (void)b;
+    (void)i;
+    
+    return exportCsvFile(BENCH_EXPORT_FILE);
+}
+
+// Nearest-rank percentile of sorted latencies, in microseconds
+static double benchPercentile(const long *ns, long n, int p) {
+    long rank = (n * p + 99) / 100;
+    
+    return ns[rank > 0 ? rank - 1 : 0] / 1000.0;
+}
+
+// Run an operation `n` times and print its line of the JSON report
+static int benchRun(BenchState *b, const char *name, BenchOp op, long n, int last) {
+    long *ns = malloc((size_t)n * sizeof(long));
+    long errors = 0, total = 0;
+    
+    if(ns == NULL) return -1;
+    for(long i = 0; i < n; i++) {
+        long start = monotonicNs();
+        
+        if(op(b, i) < 0) errors++;
+        ns[i] = monotonicNs() - start;
+        total += ns[i];
+    }
+    qsort(ns, (size_t)n, sizeof(long), compareSlots);
+    
+    printf("    {\"op\": \"%s\", \"iterations\": %ld, \"errors\": %ld, \"ops_per_sec\": %.1f, "
+           "\"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f}%s\n",
+           name, n, errors, total > 0 ? n * 1e9 / (double)total : 0.0,
+           benchPercentile(ns, n, 50), benchPercentile(ns, n, 99), ns[n - 1] / 1000.0,
+           last ? "" : ",");
+    free(ns);
+    return 0;
+}
+
+// Time every CRUD path on the database in the current directory and print
+// throughput and latency percentiles as JSON. Students added by the run are
+// deleted again and those it updated are put back, untimed, so repeated
+// runs see the same table.
+int benchCommand(int argc, char *argv[]) {
+    BenchState b;
+    struct stat st;
+    long ops = BENCH_DEFAULT_OPS, scans = BENCH_DEFAULT_SCANS, seed = 1, scanned, bytes = 0;
+    unsigned long warm = 0;
+    int failed = 0;
+    
+    for(int i = 0; i < argc; i++) {
+        if(!benchOption(argv[i], "ops", &ops, NULL) &&
+           !benchOption(argv[i], "scans", &scans, NULL) &&
+           !benchOption(argv[i], "seed", &seed, NULL)) {
+            fprintf(stderr, "⚠ Invalid option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if(ops < 1 || scans < 1) {
+        fprintf(stderr, "⚠ ops and scans must be positive!\n");
+        return 2;
+    }
+    
+    memset(&b, 0, sizeof(b));
+    b.order = malloc((size_t)ops * sizeof(long));
+    b.originals = malloc((size_t)ops * sizeof(Student));
+    scanned = b.order != NULL && b.originals != NULL ? scanShards(SCAN_LIVE, collectRoll, &b) : -1;
+    for(int k = 0; k < shardTotal(); k++) {
+        useShard(k);
+        if(stat(DB_FILE, &st) == 0) bytes += (long)st.st_size;
+    }
+    useShard(0);
+    if(scanned != b.count || b.count == 0 ||
+       b.maxRoll > 2147483647 - ops || bytes == 0) {
+        fprintf(stderr, "⚠ No students to benchmark; run ./student_mgmt generate <count> first.\n");
+        free(b.rolls);
+        free(b.order);
+        free(b.originals);
+        return 1;
+    }
+    
+    b.state = (unsigned long)seed;
+    generatorInit(&b.gen, (unsigned long)seed ^ 0x5DEECE66DUL, 1.0, 0.5);
+    for(long i = 0; i < ops; i++) {
+        long j = (long)(benchRandom(&b.state) % (unsigned long)(i + 1));
+        b.order[i] = b.order[j];
+        b.order[j] = i;
+    }
+    
+    // Lazily rebuilt sidecars are brought up to date before timing starts,
+    // in every shard
+    for(long i = 0; i < b.count && warm != (1UL << (shardTotal() - 1) << 1) - 1; i++) {
+        if(warm & (1UL << shardOf(b.rolls[i]))) continue;
+        warm |= 1UL << shardOf(b.rolls[i]);
+        findStudent(b.rolls[i], NULL);
+    }
+    benchStatistics(&b, 0);
+    
+    printf("{\n");
+    printf("  \"records\": %ld,\n", b.count);
+    printf("  \"db_bytes\": %ld,\n", bytes);
+    printf("  \"seed\": %ld,\n", seed);
+    printf("  \"results\": [\n");
+    failed |= benchRun(&b, "search", benchSearch, ops, 0);
+    failed |= benchRun(&b, "add", benchAdd, ops, 0);
+    failed |= benchRun(&b, "update", benchUpdate, ops, 0);
+    failed |= benchRestore(&b);
+    failed |= benchRun(&b, "delete", benchDelete, ops, 0);
+    failed |= benchRun(&b, "statistics", benchStatistics, scans, 0);
+    failed |= benchRun(&b, "export", benchExport, scans, 1);
+    printf("  ]\n");
+    printf("}\n");
+    
+    remove(BENCH_EXPORT_FILE);
+    free(b.rolls);
+    free(b.order);
+    free(b.originals);
+    return failed ? 1 : 0;
 }
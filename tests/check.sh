@@ -0,0 +1,143 @@
+#!/bin/sh
+# Crash-recovery and round-trip checks, run by `make check`:
+#   tests/check.sh ./student_mgmt [work-dir]
+#
+# Writers are killed with SIGKILL part-way through an import and through an
+# update spanning shards, at delays from before the commit to well after
+# it; the next process must recover each of them to all or nothing, and at
+# least one must have been replayed from the log. Export/import and
+# backup/restore must give back the table they started from.
+
+set -u
+
+BIN=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+WORK=${2:-check_data}
+KILL_DELAYS="0 0.02 0.05 0.1 0.15 0.2 0.25 0.3 0.4 0.5"
+failed=0
+crashed=0
+replayed=0
+
+fail() {
+    echo "FAIL: $*"
+    failed=$((failed + 1))
+}
+
+# Start a command in the background, wait `delay` seconds once `file` has
+# data in it, then kill it. Counts the kills that caught it still running.
+killDuring() {
+    file=$1 delay=$2
+    shift 2
+    "$@" >/dev/null 2>&1 &
+    pid=$!
+    i=0
+    while [ ! -s "$file" ] && [ $i -lt 2000 ] && kill -0 $pid 2>/dev/null; do
+        sleep 0.001
+        i=$((i + 1))
+    done
+    sleep "$delay"
+    if kill -9 $pid 2>/dev/null; then
+        crashed=$((crashed + 1))
+    fi
+    wait $pid 2>/dev/null
+}
+
+# The table as a sorted CSV, after whatever recovery opening it takes;
+# counts the recoveries that replayed a committed transaction
+table() {
+    out=$("$BIN" export "$1" 2>&1) || return 1
+    case $out in
+        *Recovered*) replayed=$((replayed + 1)) ;;
+    esac
+    sort -o "$1" "$1"
+}
+
+# Stored statistics and the sidecars must agree with the records
+consistent() {
+    "$BIN" verify-stats >/dev/null 2>&1
+}
+
+rm -rf "$WORK"
+mkdir -p "$WORK" || exit 1
+cd "$WORK" || exit 1
+WORK=$(pwd)
+
+# ─── A transaction killed part-way ──────────────────────────
+
+mkdir base && cd base
+"$BIN" generate 20000 seed=1 >/dev/null 2>&1 || fail "generate"
+table "$WORK/before.csv"
+awk 'BEGIN { print "Roll Number,Name,Department,Course,Year Joined,GPA";
+             for(i = 1; i <= 100000; i++) printf "%d,Imported Student %d,CS,B.Tech,2020,3.25\n", 1000000 + i, i }' \
+    > "$WORK/import.csv"
+cd "$WORK"
+cp -r base done && cd done
+"$BIN" import "$WORK/import.csv" >/dev/null 2>&1 || fail "import"
+table "$WORK/imported.csv"
+cd "$WORK"
+
+for d in $KILL_DELAYS; do
+    rm -rf run && cp -r base run && cd run
+    killDuring students.wal "$d" "$BIN" import "$WORK/import.csv"
+    table "$WORK/after.csv" || fail "import killed after ${d}s: table unreadable"
+    if ! cmp -s "$WORK/after.csv" "$WORK/before.csv" && ! cmp -s "$WORK/after.csv" "$WORK/imported.csv"; then
+        fail "import killed after ${d}s left $(($(wc -l < "$WORK/after.csv") - 1)) students, neither all nor none"
+    fi
+    consistent || fail "import killed after ${d}s: statistics do not match the records"
+    cd "$WORK"
+done
+
+# ─── An update spanning shards killed part-way ──────────────
+
+rm -rf sharded && cp -r base sharded && cd sharded
+"$BIN" shard 3 >/dev/null 2>&1 || fail "shard"
+awk -F, '$1 ~ /^[0-9]+$/ { print $1 ",gpa,1.23" }' "$WORK/before.csv" > "$WORK/changes.csv"
+cd "$WORK"
+rm -rf done && cp -r sharded done && cd done
+"$BIN" update "$WORK/changes.csv" >/dev/null 2>&1 || fail "sharded update"
+table "$WORK/updated.csv"
+cd "$WORK"
+
+for d in $KILL_DELAYS; do
+    rm -rf run && cp -r sharded run && cd run
+    killDuring shard0/students.wal "$d" "$BIN" update "$WORK/changes.csv"
+    table "$WORK/after.csv" || fail "update killed after ${d}s: table unreadable"
+    if ! cmp -s "$WORK/after.csv" "$WORK/before.csv" && ! cmp -s "$WORK/after.csv" "$WORK/updated.csv"; then
+        fail "update killed after ${d}s applied $(grep -c ',1.23$' "$WORK/after.csv") of 20000 changes"
+    fi
+    [ -e students.txn ] && fail "update killed after ${d}s: students.txn left after recovery"
+    consistent || fail "update killed after ${d}s: statistics do not match the records"
+    cd "$WORK"
+done
+
+[ $crashed -gt 0 ] || fail "no writer was still running when killed"
+[ $replayed -gt 0 ] || fail "no killed writer had committed, so replay went unchecked"
+
+# ─── Round trips ────────────────────────────────────────────
+
+cd base
+"$BIN" export "$WORK/export.csv" >/dev/null 2>&1 || fail "export"
+cd "$WORK"
+rm -rf run && mkdir run && cd run
+"$BIN" import "$WORK/export.csv" >/dev/null 2>&1 || fail "import of an export"
+table "$WORK/after.csv"
+cmp -s "$WORK/after.csv" "$WORK/before.csv" || fail "export then import changed the table"
+cd "$WORK"
+
+rm -rf run && cp -r base run && cd run
+"$BIN" backup "$WORK/backup" >/dev/null 2>&1 || fail "backup"
+"$BIN" restore "$WORK/backup" check >/dev/null 2>&1 || fail "restore check of a fresh backup"
+"$BIN" update "$WORK/changes.csv" >/dev/null 2>&1 || fail "update after backup"
+"$BIN" restore "$WORK/backup" >/dev/null 2>&1 || fail "restore"
+table "$WORK/after.csv"
+cmp -s "$WORK/after.csv" "$WORK/before.csv" || fail "restore did not bring back the backed-up table"
+consistent || fail "restore: statistics do not match the records"
+printf 'X' | dd of="$WORK/backup/students.dat" bs=1 seek=5000 conv=notrunc 2>/dev/null
+"$BIN" restore "$WORK/backup" check >/dev/null 2>&1 && fail "restore check passed a damaged backup"
+cd "$WORK"
+
+if [ $failed -gt 0 ]; then
+    echo "$failed check(s) failed; files are in $WORK"
+    exit 1
+fi
+echo "All checks passed ($crashed writers killed part-way, $replayed replayed from the log)."
+cd .. && rm -rf "$WORK"